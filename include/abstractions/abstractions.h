@@ -1,5 +1,8 @@
 #pragma once
 
+#include <abstractions/cmaes.h>
 #include <abstractions/engine.h>
 #include <abstractions/image.h>
+#include <abstractions/optimizer.h>
 #include <abstractions/pgpe.h>
+#include <abstractions/snes.h>
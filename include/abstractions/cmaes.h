@@ -0,0 +1,175 @@
+#pragma once
+
+#include <abstractions/math/random.h>
+#include <abstractions/optimizer.h>
+#include <abstractions/types.h>
+
+#include <optional>
+#include <vector>
+
+namespace abstractions {
+
+/// @brief Runtime settings for the SepCmaEsOptimizer
+struct SepCmaEsOptimizerSettings {
+    /// @brief The initial standard deviation, used when one isn't provided to
+    ///     SepCmaEsOptimizer::Initialize().
+    double init_stddev = 0.1;
+
+    /// @brief The seed used by the optimizer's internal RNG.  Will be generated
+    ///     from a random source if not provided.
+    std::optional<uint32_t> seed = {};
+
+    /// @brief Validate the optimizer settings.
+    /// @return If the settings are invalid, then it will return the reason why they are invalid.
+    Error Validate() const;
+};
+
+/// @brief Optimize a function using the separable Covariance Matrix
+///     Adaptation Evolution Strategy (sep-CMA-ES).
+///
+/// This is CMA-ES restricted to a diagonal covariance matrix, as described in
+/// "A Simple Modification in CMA-ES Achieving Linear Time and Space
+/// Complexity" (Ros and Hansen, 2008).  The diagonal restriction keeps the
+/// update linear in the number of parameters and means that, like PGPE, the
+/// search distribution is fully described by a mean and a per-parameter
+/// standard deviation.  The best half of the samples are recombined into the
+/// new mean while the evolution paths adapt both the overall step size and the
+/// individual standard deviations.  All of the learning rates are derived from
+/// the number of samples and parameters, so there is nothing to tune.
+///
+/// The global step size is folded into the per-parameter standard deviations,
+/// and the covariance evolution path is scaled to match, so the state can be
+/// stored in the same form as the other optimizers.  The two evolution paths
+/// are stored in the OptimizerState as the "stepSizePath" and
+/// "covariancePath" vectors.
+///
+/// Unlike the other optimizers, the samples are not mirrored.  Each sample is
+/// drawn independently, so any number of samples, greater than one, may be
+/// used.
+/// @tparam T scalar type
+template <typename T>
+class BasicSepCmaEsOptimizer : public IOptimizer<T> {
+public:
+    /// @brief Create a new optimizer with the given settings.
+    /// @param settings optimizer settings
+    /// @return The configured optimizer or an Error instance if the creation
+    ///     failed.
+    static Expected<BasicSepCmaEsOptimizer> New(const SepCmaEsOptimizerSettings &settings);
+
+    /// @brief Create an optimizer from another one.
+    /// @param other other optimizer
+    BasicSepCmaEsOptimizer(const BasicSepCmaEsOptimizer &other) = default;
+
+    [[nodiscard]]
+    OptimizerType Type() const override;
+
+    [[nodiscard]]
+    Expected<BasicRowVector<T>> GetEstimate() const override;
+
+    [[nodiscard]]
+    Expected<BasicRowVector<T>> GetSolutionStdDev() const override;
+
+    /// @brief Get the settings used for this optimizer.
+    [[nodiscard]]
+    const SepCmaEsOptimizerSettings &GetSettings() const;
+
+    [[nodiscard]]
+    Expected<OptimizerState> GetState() const override;
+
+    Error SetState(const OptimizerState &state) override;
+
+    void SetPrngSeed(DefaultRngType::result_type seed) override;
+
+    void Initialize(ConstBasicRowVectorRef<T> x_init,
+                    std::optional<double> init_stddev = {}) override;
+
+    /// @brief Insert new parameters into the optimizer's solution vector.
+    /// @param index position where the new parameters are inserted
+    /// @param values values of the new parameters
+    /// @param init_stddev initial standard deviation of the new parameters
+    /// @return an error if the optimizer isn't initialized or the index is
+    ///     outside of the solution vector
+    ///
+    /// The new parameters start with empty evolution paths and, unless
+    /// provided, the mean of the current standard deviations.
+    Error InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                           std::optional<double> init_stddev = {}) override;
+
+    uint32_t NewPopulation() override;
+
+    Error SampleBlock(BasicMatrixRef<T> samples, int first_param, int num_params,
+                      uint32_t population) const override;
+
+    /// @brief Start an update that is computed in parameter blocks.
+    /// @param samples A set of state vector samples.
+    /// @param costs A column vector with the fitness of each sample.
+    /// @return An error if the update could not be started.
+    ///
+    /// This ranks the samples and assigns the recombination weights, which is
+    /// the only part of the update that needs every sample.
+    Error BeginUpdate(ConstBasicMatrixRef<T> samples,
+                      ConstBasicColumnVectorRef<T> costs) override;
+
+    /// @brief Accumulate the weighted recombination for a block of parameters.
+    /// @param samples the same samples that were passed to BeginUpdate()
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @return An error if the block could not be accumulated.
+    Error AccumulateGradients(ConstBasicMatrixRef<T> samples, int first_param,
+                              int num_params) override;
+
+    /// @brief Finish an update once every parameter block has been accumulated.
+    /// @return An error if no update is in progress.
+    ///
+    /// The step size adaptation depends on the length of the whole evolution
+    /// path, so the paths and the standard deviations are updated here.
+    Error FinishUpdate() override;
+
+private:
+    /// @brief The strategy parameters that depend on the problem size.
+    struct Parameters {
+        double mu_eff;
+        double c_sigma;
+        double d_sigma;
+        double c_c;
+        double c_1;
+        double c_mu;
+        double chi_n;
+    };
+
+    BasicSepCmaEsOptimizer(const SepCmaEsOptimizerSettings &settings,
+                           DefaultRngType::result_type seed);
+
+    using IOptimizer<T>::CheckInitialized;
+    using IOptimizer<T>::ValidateCosts;
+    using IOptimizer<T>::ValidateSamples;
+    using IOptimizer<T>::ValidateBlock;
+    using IOptimizer<T>::DrawNoise;
+    using IOptimizer<T>::InsertValues;
+
+    bool _is_initialized;
+    SepCmaEsOptimizerSettings _settings;
+    DefaultRngType::result_type _seed;
+    uint32_t _population;
+
+    BasicRowVector<T> _current_state;
+    BasicRowVector<T> _current_standard_deviation;
+    BasicRowVector<T> _step_size_path;
+    BasicRowVector<T> _covariance_path;
+
+    // Workspace for the update so that it doesn't need to allocate.
+    Parameters _parameters;
+    std::vector<int> _ranking;
+    BasicColumnVector<T> _weights;
+    BasicRowVector<T> _mean_shift;
+    BasicRowVector<T> _weighted_variance;
+    bool _update_pending;
+};
+
+extern template class BasicSepCmaEsOptimizer<double>;
+extern template class BasicSepCmaEsOptimizer<float>;
+
+/// @brief The default, double precision, sep-CMA-ES optimizer.
+using SepCmaEsOptimizer = BasicSepCmaEsOptimizer<double>;
+
+}  // namespace abstractions
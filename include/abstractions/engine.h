@@ -2,14 +2,20 @@
 
 #include <abstractions/image.h>
 #include <abstractions/math/random.h>
+#include <abstractions/optimizer.h>
 #include <abstractions/pgpe.h>
+#include <abstractions/render/canvas.h>
 #include <abstractions/render/shapes.h>
 #include <abstractions/types.h>
 #include <fmt/base.h>
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <stop_token>
 #include <vector>
 
 namespace abstractions {
@@ -23,6 +29,57 @@ enum class ImageComparison {
     L2Norm
 };
 
+/// @brief How the engine picks the shapes perturbed by a block-coordinate
+///     iteration.
+enum class BlockSelection {
+    /// @brief Cycle through the shapes in order.
+    RoundRobin,
+
+    /// @brief Pick the shapes uniformly at random.
+    Random,
+
+    /// @brief Pick the shapes at random, favouring the ones that lie in regions
+    ///     with the highest error.
+    ErrorGuided
+};
+
+/// @brief The reason why the abstraction engine stopped optimizing.
+enum class StopReason {
+    /// @brief The engine ran for the configured number of iterations.
+    Completed,
+
+    /// @brief The engine ran out of time.
+    TimeLimit,
+
+    /// @brief The current solution reached the target cost.
+    TargetCost,
+
+    /// @brief An external caller requested the engine to stop.
+    Cancelled
+};
+
+/// @brief Lets an external caller start the colour refinement while the
+///     engine is running.
+///
+/// Copies share the same flag, so the caller keeps one copy and passes another
+/// to the engine through its configuration.  The flag can be raised from any
+/// thread.
+class ColourRefinementRequest {
+public:
+    /// @brief Create a request that hasn't been raised yet.
+    ColourRefinementRequest();
+
+    /// @brief Ask the engine to start the colour refinement.
+    void Request();
+
+    /// @brief Check if the colour refinement was requested.
+    /// @return true if Request() was called on any copy of the request
+    bool IsRequested() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> _requested;
+};
+
 /// @brief Engine configuration options.
 struct EngineConfig {
     /// @brief Total number of optimizer iterations.
@@ -30,11 +87,24 @@ struct EngineConfig {
 
     /// @brief The number of samples to draw when calculating the reward costs.
     ///
-    /// The PGPE optimizer generates a set of random samples around the current
+    /// The optimizer generates a set of random samples around the current
     /// "best" solution.  It then expects the user to tell it how "good" the
-    /// solutions are.
+    /// solutions are.  This is the largest population used when the adaptive
+    /// population is enabled.
     int num_samples = 256;
 
+    /// @brief The smallest number of samples used by the adaptive population.
+    ///
+    /// Setting this enables the adaptive population.  The engine starts with
+    /// this many samples and, after every iteration, estimates the
+    /// signal-to-noise ratio of the population's gradient from the mirrored
+    /// sample pairs.  The population doubles, up to num_samples, as noise in
+    /// the costs starts to dominate the gradient and halves again once the
+    /// gradient is clear.  Fewer images are rendered early on, when the cost
+    /// differences between samples are large, and more are used for the final
+    /// refinement.  It must be an even number that's at least four.
+    std::optional<int> min_samples = {};
+
     /// @brief The set of shapes to use for the image abstraction.
     ///
     /// The optimizer can support multiple shape types.  The default is just
@@ -54,6 +124,15 @@ struct EngineConfig {
     /// This value must be greater than 0 and less than or equal to 1.0.
     double alpha_scale = 1.0;
 
+    /// @brief How the shape coordinates are mapped onto the image.
+    ///
+    /// The default rescales each coordinate by its range across all of the
+    /// shapes, so moving one shape can move every other one.  The independent
+    /// mappings place every shape on its own, so a shape only ever changes the
+    /// pixels that it covers.  That lets block-coordinate iterations start
+    /// from the cached layers regardless of how far the shapes move.
+    render::CoordinateMapping coordinate_mapping = render::CoordinateMapping::Rescaled;
+
     /// @brief The number of shapes, per shape type, to draw.
     ///
     /// This, along with the shapes option, controls how "abstract" the final
@@ -67,10 +146,48 @@ struct EngineConfig {
     /// The metric affects how fine details in the image are treated.
     ImageComparison comparison_metric = ImageComparison::L2Norm;
 
+    /// @brief The optimization algorithm used to search for the solution.
+    ///
+    /// The PgpeOptimizerSettings passed to Engine::Create() only apply to the
+    /// PGPE optimizer.  The other optimizers derive their learning rates from
+    /// the problem size and use their default settings.
+    OptimizerType optimizer = OptimizerType::Pgpe;
+
+    /// @brief Run the optimizer with single precision (`float`) values.
+    ///
+    /// This halves the memory used by the samples and the optimizer state and
+    /// doubles the SIMD width of the optimizer update.  Shapes are still
+    /// rendered, and the results reported, with double precision.  The
+    /// optimization will not be bit-identical to a double precision one with
+    /// the same seed.
+    bool single_precision = false;
+
+    /// @brief The render quality used for the sample renders.
+    ///
+    /// The sample costs mostly depend on how much of each colour ends up in
+    /// each part of the image, which doesn't need anti-aliased edges at the
+    /// fitting resolution.  Aliased sample renders are cheaper.  This applies
+    /// to every render used by the optimization itself, including the
+    /// estimate render used for exact callback costs, while the final render,
+    /// and the reported cost, are always anti-aliased.
+    render::RenderQuality sample_quality = render::RenderQuality::Antialiased;
+
+    /// @brief Render and compare the samples in square tiles of this size.
+    ///
+    /// Each sample's shapes are binned into the tiles that they overlap, and
+    /// then every tile of every sample is rendered and compared with the
+    /// reference as a separate job.  That keeps the thread pool busy even with
+    /// few samples, and each tile only draws the shapes that touch it, which
+    /// pays off with thousands of shapes.  Tiled renders don't use occlusion
+    /// culling or the cached layers of block-coordinate iterations.  Tiles
+    /// aren't used by default.
+    std::optional<int> render_tile_size = {};
+
     /// @brief The number of worker threads used during the optimization.
     ///
     /// The default is to let the internal thread pool pick the number of
-    /// workers.
+    /// workers.  If there are fewer samples to render than workers then each
+    /// render is split across the idle workers' share of threads.
     std::optional<int> num_workers = {};
 
     /// @brief Set the base seed for the PRNGs used by the optimizer.
@@ -78,10 +195,147 @@ struct EngineConfig {
     ///     seed, each PRNG obtains its seed from this one.  Both seed *and*
     ///     num_samples must be the same for a result to be repeatable.
     ///
+    /// All of the random streams are keyed by (seed, iteration, sample,
+    /// stream) with a counter-based generator, so the results do not depend on
+    /// the number of workers or the order that jobs are scheduled in.
+    ///
     /// A randomly generated seed will be used if one isn't specified.
     /// Otherwise the seed can be provided for some degree of repeatabilty.
     std::optional<DefaultRngType::result_type> seed = {};
 
+    /// @brief The maximum amount of (wall clock) time the engine may run for.
+    ///
+    /// The time limit is checked between each stage of the optimization
+    /// pipeline.  The engine will stop and return the best estimate it has
+    /// seen once the limit is exceeded.  Setting a limit requires the engine
+    /// to render the current solution at full resolution after every
+    /// iteration, like the target_cost.  There is no limit if this isn't set.
+    std::optional<std::chrono::milliseconds> time_limit = {};
+
+    /// @brief Stop once the current solution's cost falls below this value.
+    ///
+    /// The cost is measured the same way as the returned cost, at full
+    /// resolution on a black background.  Setting a target cost requires the
+    /// engine to render the current solution after every iteration, which adds
+    /// a small amount of overhead.  The best estimate seen is returned, which
+    /// may be from an earlier iteration than the one that reached the target.
+    std::optional<double> target_cost = {};
+
+    /// @brief Allows an external caller to stop the engine.
+    ///
+    /// Requesting a stop through the associated `std::stop_source` will cause
+    /// the engine to finish at the next stage boundary.  Any in-flight work is
+    /// allowed to finish first.  The best estimate seen is returned, so the
+    /// current solution is rendered after every iteration when a stop is
+    /// possible, like the time_limit.
+    std::stop_token stop_token = {};
+
+    /// @brief The number of levels in the multi-resolution reference pyramid.
+    ///
+    /// Each level is half the size of the one before it.  The optimization
+    /// starts on the coarsest level, where renders are much cheaper, and
+    /// gradually moves up to the full resolution reference image.  The default
+    /// of '1' disables the multi-resolution schedule.
+    int pyramid_levels = 1;
+
+    /// @brief The maximum number of iterations spent on each of the coarser
+    ///     pyramid levels.
+    ///
+    /// The default is to spend half of the total iterations on the coarser
+    /// levels, split evenly between them.
+    std::optional<int> pyramid_level_iterations = {};
+
+    /// @brief Move to the next pyramid level early if the best sample cost
+    ///     hasn't improved for this many iterations.
+    std::optional<int> pyramid_stall_iterations = {};
+
+    /// @brief The number of shapes, per shape type, the engine starts with.
+    ///
+    /// Setting this enables the progressive shape curriculum.  The engine
+    /// starts with a small solution, which is much cheaper to sample, render
+    /// and update, and periodically adds new shapes until it reaches
+    /// num_drawn_shapes.  New shapes are placed where the current solution has
+    /// the highest error.
+    std::optional<int> initial_drawn_shapes = {};
+
+    /// @brief The number of iterations between adding new shapes.
+    int shape_growth_interval = 100;
+
+    /// @brief The number of shapes, per shape type, added at each growth step.
+    int shape_growth_count = 5;
+
+    /// @brief The number of shapes, per shape type, perturbed in each
+    ///     iteration.
+    ///
+    /// Setting this enables block-coordinate optimization, which is only
+    /// supported by the PGPE optimizer.  Every iteration picks a block of
+    /// shapes, using block_selection, and only samples and updates their
+    /// parameters.  The other shapes stay at the current estimate, so the
+    /// cost of sampling and updating depends on the block size rather than on
+    /// the size of the whole solution.  The samples are rendered starting
+    /// from the estimate's cached layers below the first shape in the block.
+    /// Every shape is perturbed if the block is at least as large as the
+    /// solution.
+    std::optional<int> block_shapes = {};
+
+    /// @brief How the block of shapes is picked for each iteration.
+    ///
+    /// Error-guided selection renders the current estimate at the start of
+    /// every iteration to find the regions with the highest error.
+    BlockSelection block_selection = BlockSelection::RoundRobin;
+
+    /// @brief The number of iterations, at the end of the run, that only
+    ///     refine the shape colours.
+    ///
+    /// This is only supported by the PGPE optimizer, without sample reuse.
+    /// Once the phase starts, the geometry is frozen and the coverage mask of
+    /// every shape is rasterized once.  Every sample is then composited from
+    /// the masks rather than rendered, which is much cheaper since only the
+    /// colour and alpha values are optimized.  No shapes are added during the
+    /// phase and the samples are composited over the background of the first
+    /// renderer.
+    std::optional<int> colour_refinement_iterations = {};
+
+    /// @brief Allows an external caller to start the colour refinement early.
+    ///
+    /// Raising the request starts the colour-only refinement at the next
+    /// iteration, even if colour_refinement_iterations isn't set.  The phase
+    /// then lasts until the end of the run.  The same restrictions as
+    /// colour_refinement_iterations apply.
+    std::optional<ColourRefinementRequest> colour_refinement_request = {};
+
+    /// @brief Periodically write the engine state to this file.
+    ///
+    /// The checkpoint is written in the background so the optimization isn't
+    /// blocked by any disk I/O.  A final checkpoint is always written when the
+    /// optimization stops, even if it stopped early.
+    std::optional<std::filesystem::path> checkpoint_file = {};
+
+    /// @brief The number of iterations between checkpoints.
+    int checkpoint_interval = 500;
+
+    /// @brief The number of iterations between callback invocations.
+    ///
+    /// The callback always runs on the final iteration.  This is ignored if
+    /// callback_period is set.
+    int callback_interval = 1;
+
+    /// @brief The minimum amount of time between callback invocations.
+    ///
+    /// When set, the callback runs whenever this much time has passed since
+    /// the last invocation, regardless of the iteration count.
+    std::optional<std::chrono::milliseconds> callback_period = {};
+
+    /// @brief Render the current solution to get its exact cost before
+    ///     invoking the callback.
+    ///
+    /// This requires an extra render at each callback.  When disabled, the
+    /// callback is given the best sample cost from the current iteration, which
+    /// is a close approximation but costs nothing to compute.  The solution is
+    /// still rendered every iteration if the engine can stop early, i.e. if a
+    /// target_cost, time_limit or stop_token is set.
+    bool callback_exact_cost = true;
+
     /// @brief Validate the Engine configuration.
     /// @return an error if the configuration was invalid
     Error Validate() const;
@@ -131,11 +385,36 @@ struct TimingReport {
         /// The samples are stored as a `<iterations> x <samples>` array.
         std::vector<Duration> render_and_compare;
 
-        /// @brief The time spent, per iteration, on running the PGPE optimizer.
+        /// @brief The time spent, per iteration, on running the optimizer.
         std::vector<Duration> optimize;
 
         /// @brief The time spent, per iteration, on invoking the user callback.
         std::vector<Duration> callback;
+
+        /// @brief The number of samples rendered during each iteration.
+        ///
+        /// This is only less than NumSamples() when the adaptive population or
+        /// sample reuse is enabled.  The unused render_and_compare entries are
+        /// left at zero.
+        std::vector<int> num_samples;
+
+        /// @brief The shapes culled by the renderer during each iteration,
+        ///     summed over every rendered sample.
+        ///
+        /// This shows how much of the raster work is skipped because some of
+        /// the shapes can't change any pixels.
+        std::vector<render::CullStatistics> culling;
+
+        /// @brief The reference pyramid level used during each iteration.
+        ///
+        /// This is always '0' unless the coarse-to-fine schedule is enabled.
+        std::vector<int> pyramid_level;
+
+        /// @brief The width of the reference image used during each iteration.
+        std::vector<int> reference_width;
+
+        /// @brief The height of the reference image used during each iteration.
+        std::vector<int> reference_height;
     };
 
     /// @brief The total time the abstraction generation took.
@@ -158,9 +437,22 @@ struct TimingReport {
     }
 
     /// @brief Number of samples during the render-and-compare step.
+    ///
+    /// This is zero if there aren't any iterations.
     int NumSamples() const {
-        return iterations.render_and_compare.size() / NumIterations();
+        return NumIterations() > 0 ? iterations.render_and_compare.size() / NumIterations() : 0;
     }
+
+    /// @brief Total number of samples rendered across all iterations.
+    int TotalSamples() const;
+
+    /// @brief Shrink the report so it only covers the first few iterations.
+    /// @param num_iter number of iterations to keep
+    ///
+    /// This is used when the optimization stops early and the report should
+    /// only contain the iterations that actually completed.  The report is
+    /// never grown, and it's emptied if `num_iter` is zero or less.
+    void Truncate(int num_iter);
 };
 
 /// @brief The results of an optimization from the abstractions Engine.
@@ -174,12 +466,18 @@ struct OptimizationResult {
     /// @brief The number of iterations the optimization ran for.
     int iterations;
 
+    /// @brief Why the optimization stopped.
+    StopReason stop_reason = StopReason::Completed;
+
     /// @brief Aspect ratio (width over height) of the source image.
     double aspect_ratio;
 
     /// @brief Alpha scaling factor used during rendering.
     double alpha_scaling;
 
+    /// @brief How the shape coordinates are mapped onto the image.
+    render::CoordinateMapping coordinate_mapping = render::CoordinateMapping::Rescaled;
+
     /// @brief The shapes used in the reconstruction.
     Options<render::AbstractionShape> shapes;
 
@@ -200,18 +498,87 @@ struct OptimizationResult {
     static Expected<OptimizationResult> Load(const std::filesystem::path &file);
 };
 
+/// @brief A snapshot of the full abstractions Engine state.
+///
+/// A checkpoint contains everything needed to continue an optimization exactly
+/// as if it had never been interrupted, including the state of all of the
+/// PRNGs.  It is always taken at the start of an iteration.
+struct EngineCheckpoint {
+    /// @brief The next iteration the engine will run.
+    int iteration;
+
+    /// @brief The base seed that all of the engine's PRNGs are keyed by.
+    DefaultRngType::result_type seed;
+
+    /// @brief The shapes used in the reconstruction.
+    Options<render::AbstractionShape> shapes;
+
+    /// @brief How the shape coordinates are mapped onto the image.
+    ///
+    /// The saved parameters only make sense with the mapping they were
+    /// optimized with.
+    render::CoordinateMapping coordinate_mapping = render::CoordinateMapping::Rescaled;
+
+    /// @brief The number of samples generated at each iteration.
+    int num_samples;
+
+    /// @brief The number of shapes, per shape type, in the current solution.
+    int num_active_shapes;
+
+    /// @brief The number of samples in the adaptive population.
+    int num_active_samples;
+
+    /// @brief The smoothed gradient signal-to-noise ratio, relative to that of
+    ///     a noiseless objective, used by the adaptive population.  It's unset
+    ///     until the first measurement.
+    std::optional<double> population_snr;
+
+    /// @brief The internal optimizer state.
+    OptimizerState optimizer;
+
+    /// @brief The active level in the reference image pyramid.
+    int pyramid_level;
+
+    /// @brief The iteration the active pyramid level started on.
+    int level_start;
+
+    /// @brief The number of iterations without progress on the active level.
+    int level_stall_count;
+
+    /// @brief The best cost seen on the active level.
+    double level_best_cost;
+
+    /// @brief If the engine is in the colour-only refinement phase.
+    bool refining_colours = false;
+
+    /// @brief Save the checkpoint to a file.
+    /// @param file file name
+    /// @return an Error if the checkpoint could not be saved
+    ///
+    /// The checkpoint is first written to a temporary file and then moved into
+    /// place so that an existing checkpoint is never left half-written.
+    Error Save(const std::filesystem::path &file) const;
+
+    /// @brief Load a checkpoint from a file.
+    /// @param file file name
+    /// @return the EngineCheckpoint or an error if it could not be loaded
+    static Expected<EngineCheckpoint> Load(const std::filesystem::path &file);
+};
+
 /// @brief Given an image, generate an abstract representation using simple
 ///     shapes.
 ///
-/// The Engine uses the PgpeOptimizer to find the "optimal" combination of
-/// shapes to represent an image.  The end result will always be slightly
-/// different because PGPE is a stochastic optimization algorithm; it uses
-/// random sample to move towards a local optima.
+/// The Engine uses a black box optimizer, PGPE by default, to find the
+/// "optimal" combination of shapes to represent an image.  The end result will
+/// always be slightly different because the optimizers are all stochastic
+/// algorithms; they use random samples to move towards a local optima.  See
+/// EngineConfig::optimizer for the available optimizers.
 class Engine {
 public:
     /// @brief Create a new abstractions engine.
     /// @param config engine configuration
-    /// @param optim_settings optional optimizer configuration
+    /// @param optim_settings optional PGPE optimizer configuration; only
+    ///     validated and used when the engine is configured to use PGPE
     /// @return the initialized engine or an error if the configuraiton failed
     static Expected<Engine> Create(
         const EngineConfig &config,
@@ -221,16 +588,42 @@ public:
     /// @param reference reference image
     /// @return the results of the optimization, or an error if the optimization
     ///     failed
+    ///
+    /// The optimization runs for EngineConfig::iterations unless one of the
+    /// time, cost or cancellation limits are hit first.  The result will
+    /// always contain the best estimate found so far.
     [[nodiscard]]
     Expected<OptimizationResult> GenerateAbstraction(const Image &reference) const;
 
+    /// @brief Resume an optimization from a checkpoint.
+    /// @param reference reference image
+    /// @param checkpoint the saved engine state
+    /// @return the results of the optimization, or an error if the optimization
+    ///     failed
+    ///
+    /// The engine must be configured the same way as the one that produced
+    /// the checkpoint.  The result is identical to what would have been
+    /// produced had the original optimization never been interrupted.  An
+    /// optimization can't be resumed if PgpeOptimizerSettings::min_refresh_rate
+    /// is set, since the reused samples aren't saved in the checkpoint.
+    [[nodiscard]]
+    Expected<OptimizationResult> ResumeAbstraction(const Image &reference,
+                                                   const EngineCheckpoint &checkpoint) const;
+
     /// @brief Set the callback that runs after an optimization step.
+    ///
+    /// The callback runs on the engine's thread, so it should return quickly.
+    /// How often it runs is controlled by EngineConfig::callback_interval and
+    /// EngineConfig::callback_period.
     /// @param cb a callback function that takes the current iteration, total
     ///     number of iterations, solution cost, and the current solution
     void SetCallback(const std::function<void(int, double, ConstRowVectorRef)> &cb);
 
 private:
     Engine(const EngineConfig &config, const PgpeOptimizerSettings &settings);
+    template <typename T>
+    Expected<OptimizationResult> Run(const Image &reference,
+                                     const EngineCheckpoint *checkpoint) const;
     EngineConfig _config;
     PgpeOptimizerSettings _optim_settings;
     std::function<void(int, double, ConstRowVectorRef)> _callback;
@@ -243,11 +636,16 @@ private:
 /// @param solution solution vector
 /// @param alpha_scale alpha scaling
 /// @param background_colour (optional) background colour
+/// @param num_threads (optional) number of rendering threads; the default
+///     renders on the calling thread
+/// @param mapping (optional) how the shape coordinates are mapped onto the
+///     image
 /// @return rendered image abstraction
 [[nodiscard]] Expected<Image> RenderImageAbstraction(
     const int width, const int height, const Options<render::AbstractionShape> shapes,
     ConstRowVectorRef solution, const double alpha_scale = 1.0,
-    const Pixel background_colour = Pixel(0, 0, 0, 255));
+    const Pixel background_colour = Pixel(0, 0, 0, 255), const int num_threads = 0,
+    const render::CoordinateMapping mapping = render::CoordinateMapping::Rescaled);
 
 }  // namespace abstractions
 
@@ -257,3 +655,17 @@ struct fmt::formatter<abstractions::ImageComparison> : fmt::formatter<string_vie
     fmt::format_context::iterator format(abstractions::ImageComparison metric,
                                          fmt::format_context &ctx) const;
 };
+
+/// @brief Custom formatter for the BlockSelection type.
+template <>
+struct fmt::formatter<abstractions::BlockSelection> : fmt::formatter<string_view> {
+    fmt::format_context::iterator format(abstractions::BlockSelection selection,
+                                         fmt::format_context &ctx) const;
+};
+
+/// @brief Custom formatter for the StopReason type.
+template <>
+struct fmt::formatter<abstractions::StopReason> : fmt::formatter<string_view> {
+    fmt::format_context::iterator format(abstractions::StopReason reason,
+                                         fmt::format_context &ctx) const;
+};
@@ -264,4 +264,23 @@ Expected<double> CompareImagesAbsDiff(const Expected<Image> &first, const Expect
 Expected<double> CompareImagesSquaredDiff(const Expected<Image> &first,
                                           const Expected<Image> &second);
 
+/// @brief Compare an image with a region of a larger image using an L1-norm.
+/// @param first the larger image
+/// @param second image compared with the region
+/// @param x horizontal position of the region within `first`
+/// @param y vertical position of the region within `first`
+/// @return the pixel-wise L1-norm over the region, or an error if the region
+///     isn't inside of `first`
+Expected<double> CompareImageRegionAbsDiff(const Image &first, const Image &second, int x, int y);
+
+/// @brief Compare an image with a region of a larger image using an L2-norm.
+/// @param first the larger image
+/// @param second image compared with the region
+/// @param x horizontal position of the region within `first`
+/// @param y vertical position of the region within `first`
+/// @return the pixel-wise L2-norm over the region, or an error if the region
+///     isn't inside of `first`
+Expected<double> CompareImageRegionSquaredDiff(const Image &first, const Image &second, int x,
+                                               int y);
+
 }  // namespace abstractions
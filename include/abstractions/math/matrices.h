@@ -4,6 +4,7 @@
 #include <abstractions/math/types.h>
 
 #include <random>
+#include <span>
 #include <type_traits>
 
 namespace abstractions {
@@ -47,8 +48,9 @@ template <typename G, typename D>
 Matrix RandomMatrix(int rows, int cols, Distribution<G, D> &distribution) {
     static_assert(std::is_same<Matrix::Scalar, typename D::result_type>::value,
                   "Matrix type and distribution type must match.");
-    auto sampler = [&]() { return distribution.Sample(); };
-    return Matrix::NullaryExpr(rows, cols, sampler);
+    Matrix matrix(rows, cols);
+    distribution.Fill(std::span(matrix.data(), matrix.size()));
+    return matrix;
 }
 
 /// @brief Initialize a matrix with random values, in-place.
@@ -62,10 +64,15 @@ template <typename G, typename D>
 void RandomMatrix(MatrixRef matrix, Distribution<G, D> &distribution) {
     static_assert(std::is_same<Matrix::Scalar, typename D::result_type>::value,
                   "Matrix type and distribution type must match.");
-    const int rows = matrix.rows();
-    const int cols = matrix.cols();
-    auto sampler = [&]() { return distribution.Sample(); };
-    matrix = Matrix::NullaryExpr(rows, cols, sampler);
+    // The matrix may be a block of some larger matrix, in which case only the
+    // columns are contiguous.
+    if (matrix.outerStride() == matrix.rows()) {
+        distribution.Fill(std::span(matrix.data(), matrix.size()));
+    } else {
+        for (int i = 0; i < matrix.cols(); i++) {
+            distribution.Fill(std::span(matrix.col(i).data(), matrix.rows()));
+        }
+    }
 }
 
 }  // namespace abstractions
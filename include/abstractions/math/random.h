@@ -1,16 +1,434 @@
 #pragma once
 
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <limits>
 #include <mutex>
+#include <numbers>
 #include <optional>
+#include <ostream>
 #include <random>
+#include <span>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <type_traits>
 
 namespace abstractions {
 
+/// @brief The xoshiro256++ pseudo-random number generator.
+///
+/// See https://prng.di.unimi.it/ for details.  It is several times faster than
+/// the standard library engines, produces a full 64 bits per call and has none
+/// of the statistical weaknesses of the "minimal standard" LCGs.  It satisfies
+/// the *UniformRandomBitGenerator* named requirement and provides the subset
+/// of *RandomNumberEngine* that the library uses.
+class Xoshiro256pp {
+public:
+    /// @brief The generator's result type.
+    typedef uint64_t result_type;
+
+    /// @brief The seed used by a default-constructed generator.
+    static constexpr result_type default_seed = 1;
+
+    /// @brief Create a new generator with the given seed.
+    /// @param value initial seed
+    explicit Xoshiro256pp(result_type value = default_seed) {
+        seed(value);
+    }
+
+    /// @brief Reset the generator's state from a seed.
+    /// @param value the new seed
+    ///
+    /// The 256-bit state is expanded from the 64-bit seed with SplitMix64, as
+    /// recommended by the generator's authors.
+    void seed(result_type value) {
+        for (auto &word : _state) {
+            value += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = value;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    /// @brief The smallest value that the generator will return.
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    /// @brief The largest value that the generator will return.
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    /// @brief Generate a pseudo-random number.
+    result_type operator()() {
+        const uint64_t result = Rotate(_state[0] + _state[3], 23) + _state[0];
+        const uint64_t t = _state[1] << 17;
+
+        _state[2] ^= _state[0];
+        _state[3] ^= _state[1];
+        _state[1] ^= _state[2];
+        _state[0] ^= _state[3];
+        _state[2] ^= t;
+        _state[3] = Rotate(_state[3], 45);
+
+        return result;
+    }
+
+    /// @brief Advance the generator by some number of steps.
+    /// @param num number of values to skip
+    void discard(unsigned long long num) {
+        for (unsigned long long i = 0; i < num; i++) {
+            (*this)();
+        }
+    }
+
+    friend bool operator==(const Xoshiro256pp &a, const Xoshiro256pp &b) {
+        return a._state == b._state;
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const Xoshiro256pp &generator) {
+        return stream << generator._state[0] << ' ' << generator._state[1] << ' '
+                      << generator._state[2] << ' ' << generator._state[3];
+    }
+
+    friend std::istream &operator>>(std::istream &stream, Xoshiro256pp &generator) {
+        return stream >> generator._state[0] >> generator._state[1] >> generator._state[2] >>
+               generator._state[3];
+    }
+
+private:
+    static constexpr uint64_t Rotate(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    std::array<uint64_t, 4> _state;
+};
+
+/// @brief The Philox4x32-10 counter-based random number generator.
+///
+/// See Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (2011).
+/// Rather than stepping an internal state, every output is a keyed bijection
+/// of a 128-bit counter.  The key is the 64-bit seed and the counter is made
+/// up of an (iteration, sample, stream) triple plus the position within that
+/// stream.  Any value can therefore be computed directly, which makes
+/// skipping ahead O(1) and means that the output never depends on the order
+/// that the streams are consumed in.
+class Philox4x32 {
+public:
+    /// @brief The generator's result type.
+    typedef uint64_t result_type;
+
+    /// @brief A 128-bit counter block.
+    typedef std::array<uint32_t, 4> Counter;
+
+    /// @brief A 64-bit key.
+    typedef std::array<uint32_t, 2> Key;
+
+    /// @brief Create a new generator.
+    /// @param seed the generator key
+    /// @param iteration iteration the stream belongs to
+    /// @param sample sample the stream belongs to
+    /// @param stream stream index, used to separate independent uses
+    explicit Philox4x32(uint64_t seed = 0, uint32_t iteration = 0, uint32_t sample = 0,
+                        uint32_t stream = 0) :
+        _key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+        _counter{0, stream, sample, iteration},
+        _position{0} {}
+
+    /// @brief Apply the Philox4x32-10 bijection to a single counter block.
+    /// @param counter the counter block
+    /// @param key the key
+    /// @return four pseudo-random words
+    static constexpr Counter Generate(Counter counter, Key key) {
+        for (int round = 0; round < 10; round++) {
+            const uint64_t p0 = static_cast<uint64_t>(kMultiplier0) * counter[0];
+            const uint64_t p1 = static_cast<uint64_t>(kMultiplier1) * counter[2];
+            counter = {
+                static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0],
+                static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1],
+                static_cast<uint32_t>(p0),
+            };
+            key[0] += kWeyl0;
+            key[1] += kWeyl1;
+        }
+        return counter;
+    }
+
+    /// @brief Reset the generator to the start of stream zero with a new key.
+    /// @param value the new key
+    void seed(result_type value) {
+        *this = Philox4x32(value);
+    }
+
+    /// @brief The smallest value that the generator will return.
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    /// @brief The largest value that the generator will return.
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    /// @brief Generate a pseudo-random number.
+    result_type operator()() {
+        // Each counter block produces two 64-bit values.
+        const uint64_t block = _position / 2;
+        if (block != _cached_block) {
+            _counter[0] = static_cast<uint32_t>(block);
+            _output = Generate(_counter, _key);
+            _cached_block = block;
+        }
+
+        const int offset = 2 * static_cast<int>(_position % 2);
+        _position++;
+        return (static_cast<uint64_t>(_output[offset + 1]) << 32) | _output[offset];
+    }
+
+    /// @brief Advance the generator by some number of steps.
+    /// @param num number of values to skip
+    ///
+    /// This is a constant-time operation.
+    void discard(unsigned long long num) {
+        _position += num;
+    }
+
+    /// @brief Move the generator to an absolute position in its stream.
+    /// @param position the number of values from the start of the stream
+    void Seek(uint64_t position) {
+        _position = position;
+    }
+
+    /// @brief The generator's current position in its stream.
+    uint64_t Position() const {
+        return _position;
+    }
+
+    friend bool operator==(const Philox4x32 &a, const Philox4x32 &b) {
+        return a._key == b._key && a._counter[1] == b._counter[1] &&
+               a._counter[2] == b._counter[2] && a._counter[3] == b._counter[3] &&
+               a._position == b._position;
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const Philox4x32 &generator) {
+        return stream << generator._key[0] << ' ' << generator._key[1] << ' '
+                      << generator._counter[1] << ' ' << generator._counter[2] << ' '
+                      << generator._counter[3] << ' ' << generator._position;
+    }
+
+    friend std::istream &operator>>(std::istream &stream, Philox4x32 &generator) {
+        stream >> generator._key[0] >> generator._key[1] >> generator._counter[1] >>
+            generator._counter[2] >> generator._counter[3] >> generator._position;
+        generator._cached_block = kNoBlock;
+        return stream;
+    }
+
+private:
+    static constexpr uint32_t kMultiplier0 = 0xD2511F53;
+    static constexpr uint32_t kMultiplier1 = 0xCD9E8D57;
+    static constexpr uint32_t kWeyl0 = 0x9E3779B9;
+    static constexpr uint32_t kWeyl1 = 0xBB67AE85;
+    static constexpr uint64_t kNoBlock = std::numeric_limits<uint64_t>::max();
+
+    Key _key;
+    Counter _counter;
+    uint64_t _position;
+
+    uint64_t _cached_block = kNoBlock;
+    Counter _output = {};
+};
+
 /// @brief The default random number generator type.
-using DefaultRngType = std::minstd_rand0;
+using DefaultRngType = Xoshiro256pp;
+
+/// @brief Convert a random integer into a double on [0, 1).
+/// @tparam G the generator type
+/// @param generator the generator to draw from
+/// @return a uniformly distributed value on [0, 1)
+///
+/// Generators that produce a full 64 bits use the top 53 bits directly, which
+/// is much faster than std::generate_canonical().
+template <typename G>
+double DrawUnitInterval(G &generator) {
+    if constexpr (G::min() == 0 && G::max() == std::numeric_limits<uint64_t>::max()) {
+        return static_cast<double>(generator() >> 11) * 0x1.0p-53;
+    } else {
+        return std::generate_canonical<double, std::numeric_limits<double>::digits>(generator);
+    }
+}
+
+/// @brief A uniform distribution on [0, 1) that supports batch generation.
+///
+/// This meets enough of the *RandomNumberDistribution* requirements to be used
+/// with Distribution.
+class StandardUniform {
+public:
+    /// @brief The distribution's result type.
+    typedef double result_type;
+
+    /// @brief Draw a single value.
+    template <typename G>
+    double operator()(G &generator) {
+        return DrawUnitInterval(generator);
+    }
+
+    /// @brief Fill a buffer with values.
+    template <typename G>
+    void Fill(G &generator, std::span<double> values) {
+        for (auto &value : values) {
+            value = DrawUnitInterval(generator);
+        }
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const StandardUniform &) {
+        return stream;
+    }
+
+    friend std::istream &operator>>(std::istream &stream, StandardUniform &) {
+        return stream;
+    }
+};
+
+/// @brief Draw 64 random bits from a generator.
+/// @tparam G the generator type
+/// @param generator the generator to draw from
+/// @return a uniformly distributed 64-bit value
+template <typename G>
+uint64_t DrawBits(G &generator) {
+    if constexpr (G::min() == 0 && G::max() == std::numeric_limits<uint64_t>::max()) {
+        return generator();
+    } else {
+        return std::uniform_int_distribution<uint64_t>()(generator);
+    }
+}
+
+/// @brief A normal distribution that uses the Ziggurat method.
+///
+/// See Marsaglia and Tsang, "The Ziggurat Method for Generating Random
+/// Variables" (2000).  This version uses 256 layers and a single 64-bit draw
+/// for each value: the low 8 bits pick the layer and the top 52 bits give the
+/// position within it.  About 99% of values are accepted on the first draw
+/// without evaluating any transcendental functions, which makes it several
+/// times faster than `std::normal_distribution`.
+class ZigguratNormal {
+public:
+    /// @brief The distribution's result type.
+    typedef double result_type;
+
+    /// @brief Create a new distribution.
+    /// @param mean distribution mean
+    /// @param sigma distribution standard deviation
+    ZigguratNormal(double mean = 0, double sigma = 1) :
+        _mean{mean},
+        _sigma{sigma} {}
+
+    /// @brief Draw a single value.
+    template <typename G>
+    double operator()(G &generator) {
+        return _mean + _sigma * DrawStandard(generator, GetTables());
+    }
+
+    /// @brief Fill a buffer with values.
+    ///
+    /// The values are always generated with double precision, so a `float`
+    /// buffer receives the same values as a `double` one, just rounded.
+    template <typename G, typename V>
+    void Fill(G &generator, std::span<V> values) {
+        const Tables &tables = GetTables();
+        for (auto &value : values) {
+            value = static_cast<V>(_mean + _sigma * DrawStandard(generator, tables));
+        }
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const ZigguratNormal &dist) {
+        const auto precision = stream.precision(std::numeric_limits<double>::max_digits10);
+        stream << dist._mean << ' ' << dist._sigma;
+        stream.precision(precision);
+        return stream;
+    }
+
+    friend std::istream &operator>>(std::istream &stream, ZigguratNormal &dist) {
+        return stream >> dist._mean >> dist._sigma;
+    }
+
+private:
+    static constexpr int kNumLayers = 256;
+
+    /// @brief The start of the distribution's tail.
+    static constexpr double kTailStart = 3.654152885361008796;
+
+    /// @brief The area of each layer.
+    static constexpr double kLayerArea = 0.00492867323399;
+
+    /// @brief The layer boundaries (x) and the PDF at each boundary (f).
+    struct Tables {
+        std::array<double, kNumLayers + 1> x;
+        std::array<double, kNumLayers + 1> f;
+    };
+
+    static const Tables &GetTables() {
+        static const Tables tables = [] {
+            Tables t;
+            t.x[0] = kLayerArea / std::exp(-0.5 * kTailStart * kTailStart);
+            t.x[1] = kTailStart;
+            for (int i = 2; i < kNumLayers; i++) {
+                const double previous = t.x[i - 1];
+                t.x[i] = std::sqrt(-2 * std::log(kLayerArea / previous +
+                                                 std::exp(-0.5 * previous * previous)));
+            }
+            t.x[kNumLayers] = 0;
+
+            for (int i = 0; i <= kNumLayers; i++) {
+                t.f[i] = std::exp(-0.5 * t.x[i] * t.x[i]);
+            }
+            return t;
+        }();
+        return tables;
+    }
+
+    template <typename G>
+    static double DrawStandard(G &generator, const Tables &tables) {
+        while (true) {
+            const uint64_t bits = DrawBits(generator);
+            const int layer = bits & 0xff;
+            const double u = 2 * (static_cast<double>(bits >> 12) * 0x1.0p-52) - 1;
+            const double x = u * tables.x[layer];
+
+            // Fast path; the point is inside the layer's rectangle.
+            if (std::abs(x) < tables.x[layer + 1]) {
+                return x;
+            }
+
+            // The bottom layer includes the tail, which needs to be sampled
+            // separately.
+            if (layer == 0) {
+                double tail_x, tail_y;
+                do {
+                    tail_x = -std::log(1 - DrawUnitInterval(generator)) / kTailStart;
+                    tail_y = -std::log(1 - DrawUnitInterval(generator));
+                } while (2 * tail_y < tail_x * tail_x);
+                return u < 0 ? -(kTailStart + tail_x) : kTailStart + tail_x;
+            }
+
+            // Otherwise the point is in the wedge outside of the rectangle and
+            // needs to be checked against the actual PDF.
+            const double f = tables.f[layer + 1] +
+                             (tables.f[layer] - tables.f[layer + 1]) * DrawUnitInterval(generator);
+            if (f < std::exp(-0.5 * x * x)) {
+                return x;
+            }
+        }
+    }
+
+    double _mean;
+    double _sigma;
+};
 
 /// @brief A lightweight adapter to a random number engine to make it easier to
 ///     keep track of what seed it used.  This complies with the
@@ -52,11 +470,44 @@ public:
         return _generator();
     }
 
+    /// @brief Write the generator's current position to a stream.
+    /// @param stream output stream
+    ///
+    /// Unlike the seed, this captures how far along the generator is in its
+    /// sequence.  It can be restored with LoadState().
+    void SaveState(std::ostream &stream) const {
+        stream << _generator;
+    }
+
+    /// @brief Restore the generator's position from a stream.
+    /// @param stream input stream
+    void LoadState(std::istream &stream) {
+        stream >> _generator;
+    }
+
 private:
     G _generator;
     G::result_type _seed;
 };
 
+/// @brief Derive a seed from a (seed, iteration, sample, stream) key.
+/// @tparam G the PRNG engine the seed is for
+/// @param seed base seed
+/// @param iteration iteration the seed is for
+/// @param sample sample the seed is for
+/// @param stream stream index, used to separate independent uses
+/// @return a seed that is unique to the key
+///
+/// The seed is the first value of the matching Philox4x32 stream.  This allows
+/// sequential engines to be seeded from the same keys as the counter-based one
+/// without depending on the order that the seeds are requested in.
+template <typename G = DefaultRngType>
+G::result_type CounterSeed(uint64_t seed, uint32_t iteration, uint32_t sample,
+                           uint32_t stream) {
+    Philox4x32 generator(seed, iteration, sample, stream);
+    return static_cast<typename G::result_type>(generator() % G::max());
+}
+
 /// @brief A thread-safe PRNG generator.
 /// @tparam G the PRNG engine to use; defaults to the Mersenne Twister
 ///
@@ -146,11 +597,50 @@ public:
         return _distribution(_generator);
     }
 
+    /// @brief Fill a buffer with samples from the given distribution.
+    /// @param values buffer to fill
+    ///
+    /// Distributions with their own batch `Fill()` method, like
+    /// ZigguratNormal, use it.  Otherwise the values are drawn one at a time.
+    void Fill(std::span<typename D::result_type> values) {
+        if constexpr (requires { _distribution.Fill(_generator, values); }) {
+            _distribution.Fill(_generator, values);
+        } else {
+            for (auto &value : values) {
+                value = _distribution(_generator);
+            }
+        }
+    }
+
     /// @brief Seed used by the internal PRNG.
     G::result_type Seed() const {
         return _generator.seed();
     }
 
+    /// @brief Draw a raw value from the internal PRNG, for seeding others.
+    G::result_type DrawSeed() {
+        return _generator();
+    }
+
+    /// @brief Get the current state of the PRNG and statistical distribution.
+    /// @return a string representation of the distribution's state
+    std::string GetState() const {
+        std::ostringstream stream;
+        _generator.SaveState(stream);
+        stream << ' ' << _distribution;
+        return stream.str();
+    }
+
+    /// @brief Restore the state of the PRNG and statistical distribution.
+    /// @param state a state previously returned by GetState()
+    /// @return `true` if the state was restored
+    bool SetState(const std::string &state) {
+        std::istringstream stream(state);
+        _generator.LoadState(stream);
+        stream >> _distribution;
+        return !stream.fail();
+    }
+
 private:
     Prng<G> _generator;
     D _distribution;
@@ -159,27 +649,25 @@ private:
 /// @brief Generate a sequence of normally distributed random numbers.
 /// @tparam G an object that meets the *RandomNumberEngine* named requirement
 template <typename G = DefaultRngType>
-class NormalDistribution : public Distribution<G, std::normal_distribution<double>> {
+class NormalDistribution : public Distribution<G, ZigguratNormal> {
 public:
     /// @brief Create a new normal distribution instance.
     /// @param generator a PRNG instance
     /// @param mean the distribution mean
     /// @param sigma the distribution standard deviation
     NormalDistribution(Prng<G> generator, double mean, double sigma) :
-        Distribution<G, std::normal_distribution<double>>(generator,
-                                                          std::normal_distribution(mean, sigma)) {}
+        Distribution<G, ZigguratNormal>(generator, ZigguratNormal(mean, sigma)) {}
 };
 
 /// @brief Generate a sequence of uniformally distributed random numbers on [0,1).
 /// @tparam G an object that meets the *RandomNumberEngine* named requirement
 template <typename G = DefaultRngType>
-class UniformDistribution : public Distribution<G, std::uniform_real_distribution<double>> {
+class UniformDistribution : public Distribution<G, StandardUniform> {
 public:
     /// @brief Create a new uniform distribution instance.
     /// @param generator a PRNG instance
     UniformDistribution(Prng<G> generator) :
-        Distribution<G, std::uniform_real_distribution<double>>(
-            generator, std::uniform_real_distribution(0.0, 1.0)) {}
+        Distribution<G, StandardUniform>(generator, StandardUniform()) {}
 };
 
 }  // namespace abstractions
@@ -5,44 +5,80 @@
 #include <Eigen/Core>
 
 namespace abstractions {
+/// @brief Basic definition of an `MxN` matrix with a configurable scalar type.
+template <typename T>
+using BasicMatrix = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+
+/// @brief Basic definition of a column vector with a configurable scalar type.
+template <typename T>
+using BasicColumnVector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+
+/// @brief Basic definition of a row vector with a configurable scalar type.
+template <typename T>
+using BasicRowVector = Eigen::Matrix<T, 1, Eigen::Dynamic>;
+
+/// @brief An Eigen-friendly way to pass a BasicMatrix by reference.
+template <typename T>
+using BasicMatrixRef = Eigen::Ref<BasicMatrix<T>>;
+
+/// @brief An Eigen-friendly way to pass a BasicColumnVector by reference.
+template <typename T>
+using BasicColumnVectorRef = Eigen::Ref<BasicColumnVector<T>>;
+
+/// @brief An Eigen-friendly way to pass a BasicRowVector by reference.
+template <typename T>
+using BasicRowVectorRef = Eigen::Ref<BasicRowVector<T>>;
+
+/// @brief An Eigen-friendly constant reference to a BasicMatrix.
+template <typename T>
+using ConstBasicMatrixRef = const Eigen::Ref<const BasicMatrix<T>> &;
+
+/// @brief An Eigen-friendly constant reference to a BasicColumnVector.
+template <typename T>
+using ConstBasicColumnVectorRef = const Eigen::Ref<const BasicColumnVector<T>> &;
+
+/// @brief An Eigen-friendly constant reference to a BasicRowVector.
+template <typename T>
+using ConstBasicRowVectorRef = const Eigen::Ref<const BasicRowVector<T>> &;
+
 /// @brief Basic definition of an `MxN` matrix.
-using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>;
+using Matrix = BasicMatrix<double>;
 
 /// @brief Basic definition of a column vector, or a `Nx1` matrix.
-using ColumnVector = Eigen::Matrix<double, Eigen::Dynamic, 1>;
+using ColumnVector = BasicColumnVector<double>;
 
 /// @brief Basic defintion of a row vector, or a `1xN` matrix.
-using RowVector = Eigen::Matrix<double, 1, Eigen::Dynamic>;
+using RowVector = BasicRowVector<double>;
 
 /// @brief An Eigen-friend way to pass a Matrix by reference.
 ///
 /// Use this instead of `Matrix &`.
-using MatrixRef = Eigen::Ref<Matrix>;
+using MatrixRef = BasicMatrixRef<double>;
 
 /// @brief An Eigen-friendly way to pass a ColumnVector by reference.
 ///
 /// Use this instead of `ColumnVector &`.
-using ColumnVectorRef = Eigen::Ref<ColumnVector>;
+using ColumnVectorRef = BasicColumnVectorRef<double>;
 
 /// @brief An Eigen-friendly way to pass a RowVector by reference.
 ///
 /// Use this instead of `RowVector &`.
-using RowVectorRef = Eigen::Ref<RowVector>;
+using RowVectorRef = BasicRowVectorRef<double>;
 
 /// @brief An Eigen-friendly constant reference to a Matrix.
 ///
 /// Use this instead of `const Matrix &`.
-using ConstMatrixRef = const Eigen::Ref<const Matrix>&;
+using ConstMatrixRef = ConstBasicMatrixRef<double>;
 
 /// @brief An Eigen-friend constant reference to a ColumnVector.
 ///
 /// Use this instead of `const ColumnVector &`
-using ConstColumnVectorRef = const Eigen::Ref<const ColumnVector>&;
+using ConstColumnVectorRef = ConstBasicColumnVectorRef<double>;
 
 /// @brief An Eigen-friend constant reference to a RowVector.
 ///
 /// Use this instead of `const RowVector &`.
-using ConstRowVectorRef = const Eigen::Ref<const RowVector>&;
+using ConstRowVectorRef = ConstBasicRowVectorRef<double>;
 
 }  // namespace abstractions
 
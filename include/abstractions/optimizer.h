@@ -0,0 +1,335 @@
+#pragma once
+
+#include <abstractions/math/random.h>
+#include <abstractions/math/types.h>
+#include <abstractions/types.h>
+#include <fmt/base.h>
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace abstractions {
+
+/// @brief The optimization algorithms available to the abstractions engine.
+enum class OptimizerType {
+    /// @brief Policy Gradients with Parameter-based Exploration, using ClipUp.
+    ///
+    /// See BasicPgpeOptimizer.
+    Pgpe,
+
+    /// @brief Separable Natural Evolution Strategies.
+    ///
+    /// See BasicSnesOptimizer.
+    Snes,
+
+    /// @brief Separable (diagonal) Covariance Matrix Adaptation Evolution
+    ///     Strategy.
+    ///
+    /// See BasicSepCmaEsOptimizer.
+    SepCmaEs
+};
+
+/// @brief The complete internal state of an optimizer.
+///
+/// This is everything needed to restore an optimizer so that it continues
+/// exactly where it left off.  All of the supported optimizers search with a
+/// diagonal Gaussian distribution, so its mean and standard deviation are
+/// common to all of them.  Anything else is optimizer-specific.
+struct OptimizerState {
+    /// @brief The type of optimizer the state came from.
+    OptimizerType type;
+
+    /// @brief The current solution estimate.
+    RowVector state;
+
+    /// @brief The current per-parameter standard deviation.
+    RowVector standard_deviation;
+
+    /// @brief Any other per-parameter vectors used by the optimizer, such as
+    ///     the PGPE velocity, keyed by name.
+    std::map<std::string, RowVector> vectors;
+
+    /// @brief The key for the optimizer's sampling PRNG.
+    DefaultRngType::result_type seed;
+
+    /// @brief The number of populations that have been sampled.
+    uint32_t population;
+};
+
+/// @brief Common interface for the black box optimizers used by the Engine.
+///
+/// Every optimizer follows the same "sample, evaluate, update" loop:
+///
+/// ```cpp
+/// optimizer->Initialize(solution);
+///
+/// while (!converged) {
+///     optimizer->Sample(samples);
+///     ColumnVector costs = EstimateCosts(samples);
+///     optimizer->RankLinearize(costs);
+///     optimizer->Update(samples, costs);
+/// }
+/// ```
+///
+/// The costs passed into an update are *fitness* values, so larger is better.
+/// Both the sampling and the update steps can be split into blocks of
+/// parameters (columns) so that they can be computed in parallel.  The results
+/// never depend on how the parameters are split.
+/// @tparam T scalar type; either `double` or `float`
+template <typename T>
+class IOptimizer {
+public:
+    /// @brief The scalar type used for the solution and the samples.
+    typedef T Scalar;
+
+    /// @brief The Philox4x32 stream that the samples are drawn from.
+    static constexpr uint32_t kPrngStream = 0;
+
+    /// @brief The Philox4x32 stream used to decide which samples are reused
+    ///     by MixPopulation().  The streams in between belong to the Engine.
+    static constexpr uint32_t kMixingPrngStream = kPrngStream + 3;
+
+    virtual ~IOptimizer() = default;
+
+    /// @brief Linearizes the costs so they are equally distributed on [-0.5, 0.5].
+    /// @param[in,out] costs per-sample costs
+    /// @note The costs are modified in-place.
+    ///
+    /// This only preserves the ranking of the costs, so it can be used with any
+    /// of the optimizers.
+    static void RankLinearize(BasicColumnVectorRef<T> costs);
+
+    /// @brief The optimization algorithm implemented by the optimizer.
+    [[nodiscard]]
+    virtual OptimizerType Type() const = 0;
+
+    /// @brief Get the current estimate of the best parameter vector from the optimizer.
+    /// @return A row vector with the current estimate.
+    [[nodiscard]]
+    virtual Expected<BasicRowVector<T>> GetEstimate() const = 0;
+
+    /// @brief Get the current estimate of the solutions standard deviation.
+    /// @return A row vector storing the per-parameter standard deviations.
+    [[nodiscard]]
+    virtual Expected<BasicRowVector<T>> GetSolutionStdDev() const = 0;
+
+    /// @brief Get a copy of the optimizer's complete internal state.
+    /// @return the optimizer state or an error if it isn't initialized
+    [[nodiscard]]
+    virtual Expected<OptimizerState> GetState() const = 0;
+
+    /// @brief Restore the optimizer's internal state.
+    /// @param state a state previously returned by GetState()
+    /// @return an error if the state is invalid or came from a different type
+    ///     of optimizer
+    ///
+    /// An optimizer restored from a saved state will produce the same sequence
+    /// of samples and updates as the optimizer that the state came from.
+    virtual Error SetState(const OptimizerState &state) = 0;
+
+    /// @brief Replace the internal PRNG with a new one with the provided seed.
+    /// @param seed new PRNG seed
+    ///
+    /// The samples are drawn from the IOptimizer::kPrngStream stream of the
+    /// seed's Philox4x32 generator, so other components may share the seed as
+    /// long as they use other streams.
+    virtual void SetPrngSeed(DefaultRngType::result_type seed) = 0;
+
+    /// @brief Initialize the optimizer to some starting state `x_init`.
+    /// @param x_init The initial state (parameters) vector.
+    /// @param init_stddev The initial solution standard deviation.  Each
+    ///     optimizer picks its own default if this isn't provided.
+    ///
+    /// Calling this has the effect of resetting the optimizer.
+    virtual void Initialize(ConstBasicRowVectorRef<T> x_init,
+                            std::optional<double> init_stddev = {}) = 0;
+
+    /// @brief Insert new parameters into the optimizer's solution vector.
+    /// @param index position where the new parameters are inserted
+    /// @param values values of the new parameters
+    /// @param init_stddev initial standard deviation of the new parameters
+    /// @return an error if the optimizer isn't initialized or the index is
+    ///     outside of the solution vector
+    ///
+    /// This grows the optimizer's internal state without resetting it.  Any
+    /// sample matrices will need to be resized to match the new number of
+    /// parameters.
+    virtual Error InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                                   std::optional<double> init_stddev = {}) = 0;
+
+    /// @brief Sample parameters from the current optimizer state.
+    /// @param samples A reference to the matrix that will store the drawn
+    ///     samples.
+    /// @return An error if the samples could not be drawn.
+    ///
+    /// The optimizer stores parameters as row vectors, so the number of drawn
+    /// samples will be equal to the number of rows in the provided matrix.
+    /// This is equivalent to starting a new population and then sampling every
+    /// parameter in a single block.
+    Error Sample(BasicMatrixRef<T> samples);
+
+    /// @brief Start a new population of samples.
+    /// @return the population index
+    virtual uint32_t NewPopulation() = 0;
+
+    /// @brief Sample a block of parameters (columns) for a population.
+    /// @param samples A reference to the matrix that will store the drawn
+    ///     samples.
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @param population the index from NewPopulation()
+    /// @return An error if the samples could not be drawn.
+    ///
+    /// Different blocks may be sampled concurrently.
+    virtual Error SampleBlock(BasicMatrixRef<T> samples, int first_param, int num_params,
+                              uint32_t population) const = 0;
+
+    /// @brief Restrict the sampling and updates to a subset of the parameters.
+    /// @param params the indices of the active parameters, in increasing
+    ///     order, or an empty vector to make every parameter active again
+    /// @return an error if the optimizer doesn't support block-coordinate
+    ///     updates or the indices are invalid
+    ///
+    /// Only the active parameters are perturbed by SampleBlock() and changed
+    /// by the updates.  The inactive columns of the sample matrix are left
+    /// untouched, so the caller is responsible for filling them with the
+    /// current estimate.  The restriction lasts until it's replaced or the
+    /// solution vector is reset or resized.  The default implementation only
+    /// supports making every parameter active.
+    virtual Error SetActiveParameters(const std::vector<int> &params);
+
+    /// @brief Reuse samples from the previous population in a new one.
+    /// @param samples a new population, freshly sampled from the current
+    ///     distribution; any reused samples are copied into it
+    /// @param costs the new population's fitness; filled in for any reused
+    ///     samples
+    /// @param previous_samples the previous population, which may be empty
+    /// @param previous_costs the previous population's fitness, before it was
+    ///     rank-linearized
+    /// @param population the index from NewPopulation() for the new samples
+    /// @param[out] fresh_samples the rows of `samples` that still need to be
+    ///     evaluated
+    /// @return an error if the populations could not be mixed
+    ///
+    /// Evaluating a sample is usually much more expensive than updating the
+    /// optimizer, and a previous sample is often still likely under the
+    /// current distribution.  Optimizers that support it use importance mixing
+    /// so that the mixed population still follows the current distribution.
+    /// The default implementation doesn't reuse anything, so every sample is
+    /// fresh.
+    virtual Error MixPopulation(BasicMatrixRef<T> samples, BasicColumnVectorRef<T> costs,
+                                ConstBasicMatrixRef<T> previous_samples,
+                                ConstBasicColumnVectorRef<T> previous_costs, uint32_t population,
+                                std::vector<int> &fresh_samples);
+
+    /// @brief Update the optimizer's internal state based on the reported sample costs.
+    /// @param samples A set of state vector samples.
+    /// @param costs A column vector, where each element is the fitness of that
+    ///     particular solution.
+    /// @return An error if the update failed.
+    ///
+    /// Calling this is equivalent to calling BeginUpdate(), then
+    /// AccumulateGradients() for every parameter and finally FinishUpdate().
+    Error Update(ConstBasicMatrixRef<T> samples, ConstBasicColumnVectorRef<T> costs);
+
+    /// @brief Start an update that is computed in parameter blocks.
+    /// @param samples A set of state vector samples.
+    /// @param costs A column vector with the fitness of each sample.
+    /// @return An error if the update could not be started.
+    virtual Error BeginUpdate(ConstBasicMatrixRef<T> samples,
+                              ConstBasicColumnVectorRef<T> costs) = 0;
+
+    /// @brief Accumulate the updates for a block of parameters (columns).
+    /// @param samples the same samples that were passed to BeginUpdate()
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @return An error if the block could not be accumulated.
+    ///
+    /// Different, non-overlapping blocks may be accumulated concurrently.
+    virtual Error AccumulateGradients(ConstBasicMatrixRef<T> samples, int first_param,
+                                      int num_params) = 0;
+
+    /// @brief Finish an update once every parameter block has been accumulated.
+    /// @return An error if no update is in progress.
+    virtual Error FinishUpdate() = 0;
+
+protected:
+    /// @brief Check that an optimizer has been initialized.
+    /// @param is_initialized if the optimizer has been initialized
+    /// @return an error if it hasn't been
+    static Error CheckInitialized(bool is_initialized);
+
+    /// @brief Check that the number of costs matches the number of samples.
+    /// @param num_samples number of samples
+    /// @param costs per-sample costs
+    /// @return an error if they don't match
+    static Error ValidateCosts(int num_samples, ConstBasicColumnVectorRef<T> costs);
+
+    /// @brief Check that a sample matrix can be used by the optimizer.
+    /// @param samples sample matrix
+    /// @param num_params number of parameters in the solution vector
+    /// @return an error if there are fewer than two samples or the number of
+    ///     columns doesn't match the solution vector
+    static Error ValidateSamples(ConstBasicMatrixRef<T> samples, int num_params);
+
+    /// @brief Check that a sample matrix can hold mirrored samples.
+    /// @param samples sample matrix
+    /// @param num_params number of parameters in the solution vector
+    /// @return an error if the number of samples isn't even or the number of
+    ///     columns doesn't match the solution vector
+    static Error ValidateMirroredSamples(ConstBasicMatrixRef<T> samples, int num_params);
+
+    /// @brief Check that a block of parameters is inside the sample matrix.
+    /// @param samples sample matrix
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @return an error if the block is outside of the sampled parameters
+    static Error ValidateBlock(ConstBasicMatrixRef<T> samples, int first_param, int num_params);
+
+    /// @brief Fill the top of a parameter's column with noise on N(0, 1).
+    /// @param samples sample matrix
+    /// @param param the parameter (column) being sampled
+    /// @param num_rows number of rows to fill, starting from the top
+    /// @param seed optimizer seed
+    /// @param population the index from NewPopulation()
+    ///
+    /// Every parameter draws from its own counter-based stream, keyed by the
+    /// population and the parameter index, so the noise doesn't depend on
+    /// which parameters are sampled together.
+    static void DrawNoise(BasicMatrixRef<T> samples, int param, int num_rows,
+                          DefaultRngType::result_type seed, uint32_t population);
+
+    /// @brief Draw mirrored samples for a single parameter.
+    /// @param samples sample matrix
+    /// @param param the parameter (column) being sampled
+    /// @param mean the parameter's current estimate
+    /// @param stddev the parameter's current standard deviation
+    /// @param seed optimizer seed
+    /// @param population the index from NewPopulation()
+    ///
+    /// The top half of the column is drawn with DrawNoise() and the bottom
+    /// half mirrors it around the mean.
+    static void DrawMirroredSamples(BasicMatrixRef<T> samples, int param, T mean, T stddev,
+                                    DefaultRngType::result_type seed, uint32_t population);
+
+    /// @brief Insert values into one of the optimizer's per-parameter vectors.
+    /// @param vector the vector being grown
+    /// @param index position where the values are inserted
+    /// @param values the inserted values
+    static void InsertValues(BasicRowVector<T> &vector, int index,
+                             ConstBasicRowVectorRef<T> values);
+};
+
+extern template class IOptimizer<double>;
+extern template class IOptimizer<float>;
+
+}  // namespace abstractions
+
+/// @brief Custom formatter for the OptimizerType type.
+template <>
+struct fmt::formatter<abstractions::OptimizerType> : fmt::formatter<string_view> {
+    fmt::format_context::iterator format(abstractions::OptimizerType type,
+                                         fmt::format_context &ctx) const;
+};
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <abstractions/math/random.h>
+#include <abstractions/optimizer.h>
 #include <abstractions/types.h>
 
 #include <expected>
 #include <limits>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace abstractions {
 
@@ -38,6 +40,13 @@ struct PgpeOptimizerSettings {
     ///     from a random source if not provided.
     std::optional<uint32_t> seed = {};
 
+    /// @brief The minimal fraction of each population that is freshly sampled
+    ///     when samples are reused with importance mixing.
+    ///
+    /// Setting this enables PgpeOptimizer::MixPopulation().  It must be on
+    /// (0, 1]; a value of 1 never reuses a sample.
+    std::optional<double> min_refresh_rate = {};
+
     /// @brief Validate the optimizer settings.
     /// @return If the settings are invalid, then it will return the reason why they are invalid.
     Error Validate() const;
@@ -73,27 +82,37 @@ struct PgpeOptimizerSettings {
 ///     optimizer.Update(samples, costs);
 /// }
 /// ```
-class PgpeOptimizer {
+///
+/// The samples are mirrored, so the number of samples must be even.  The
+/// velocity is stored in the OptimizerState as the "velocity" vector.
+///
+/// The scalar type, `T`, is used for the solution, the samples and all of the
+/// optimizer's internal state.  It is either `double` (the default, see
+/// PgpeOptimizer) or `float`, which halves the memory needed for the samples
+/// and doubles the SIMD width of the update.  The OptimizerState is always
+/// stored with double precision.
+/// @tparam T scalar type
+template <typename T>
+class BasicPgpeOptimizer : public IOptimizer<T> {
 public:
     /// @brief Create a new optimizer with the given settings.
     /// @param settings optimizer settings
     /// @return The configured optimizer or an Error instance if the creation
     ///     failed.
-    static Expected<PgpeOptimizer> New(const PgpeOptimizerSettings &settings);
+    static Expected<BasicPgpeOptimizer> New(const PgpeOptimizerSettings &settings);
 
     /// @brief Create an optimizer from another one.
     /// @param other other optimizer
-    PgpeOptimizer(const PgpeOptimizer &other) = default;
+    BasicPgpeOptimizer(const BasicPgpeOptimizer &other) = default;
 
-    /// @brief Get the current estimate of the best parameter vector from the optimizer.
-    /// @return A row vector with the current estimate.
     [[nodiscard]]
-    Expected<RowVector> GetEstimate() const;
+    OptimizerType Type() const override;
 
-    /// @brief Get the current estimate of the solutions standard deviation.
-    /// @return A row vector storing the per-parameter standard deviations.
     [[nodiscard]]
-    Expected<RowVector> GetSolutionStdDev() const;
+    Expected<BasicRowVector<T>> GetEstimate() const override;
+
+    [[nodiscard]]
+    Expected<BasicRowVector<T>> GetSolutionStdDev() const override;
 
     /// @brief Get the currently estimated optimizer velocity.
     /// @return A row vector with the current solution velocity.
@@ -102,19 +121,27 @@ public:
     /// but with a magnitude defined by the PgpeOptimizerSettings::max_speed
     /// option.
     [[nodiscard]]
-    Expected<RowVector> GetSolutionVelocity() const;
+    Expected<BasicRowVector<T>> GetSolutionVelocity() const;
 
     /// @brief Get the settings used for this optimizer.
     [[nodiscard]]
     const PgpeOptimizerSettings &GetSettings() const;
 
+    [[nodiscard]]
+    Expected<OptimizerState> GetState() const override;
+
+    Error SetState(const OptimizerState &state) override;
+
     /// @brief Replace the internl PRNG with a new with the provided seed.
     /// @param seed new PRNG seed
     ///
     /// This is mainly for when the optimizer is being used as part of a larger
     /// system.  This allows the internal PRNG to be configured with a new seed
     /// post-initialization.  This has the effect of also resetting the PRNG.
-    void SetPrngSeed(DefaultRngType::result_type seed);
+    /// The samples are drawn from the IOptimizer::kPrngStream stream of the
+    /// seed's Philox4x32 generator, so other components may share the seed as
+    /// long as they use other streams.
+    void SetPrngSeed(DefaultRngType::result_type seed) override;
 
     /// @brief Initialize the optimizer to some starting state `x_init`.
     /// @param x_init The initial state (parameters) vector.
@@ -127,7 +154,8 @@ public:
     /// The initial standard deviation will be automatically calculated from the
     /// dimensionality of the input vector.  This can be overridden by providing
     /// a value to init_stddev.
-    void Initialize(ConstRowVectorRef x_init, std::optional<double> init_stddev = {});
+    void Initialize(ConstBasicRowVectorRef<T> x_init,
+                    std::optional<double> init_stddev = {}) override;
 
     /// @brief Initialize the optimizer.
     /// @param num_dim The dimensionality of the solution space.
@@ -141,49 +169,174 @@ public:
     /// deviation will be set to init_stddev.
     void Initialize(int num_dim, double init_stddev = 0.1);
 
-    /// @brief Linearizes the costs so they are equally distributed on [-0.5, 0.5].
-    /// @param[in,out] costs per-sample costs
-    /// @note The costs are modified in-place.
-    void RankLinearize(ColumnVectorRef costs) const;
+    /// @brief Insert new parameters into the optimizer's solution vector.
+    /// @param index position where the new parameters are inserted
+    /// @param values values of the new parameters
+    /// @param init_stddev initial standard deviation of the new parameters
+    /// @return an error if the optimizer isn't initialized or the index is
+    ///     outside of the solution vector
+    ///
+    /// This grows the optimizer's internal state without resetting it.  The
+    /// existing parameters keep their current estimate, standard deviation and
+    /// velocity.  The new parameters start with zero velocity and, unless
+    /// provided, the mean of the current standard deviations.
+    ///
+    /// Any sample matrices will need to be resized to match the new number of
+    /// parameters.
+    Error InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                           std::optional<double> init_stddev = {}) override;
+
+    /// @brief Start a new population of samples.
+    /// @return the population index
+    ///
+    /// This, along with PgpeOptimizer::SampleBlock(), allows a population to
+    /// be generated in parallel.  Calling Sample() is equivalent to starting
+    /// a new population and then sampling every parameter in a single block.
+    uint32_t NewPopulation() override;
 
-    /// @brief Sample parameters from the current optimizer state.
+    /// @brief Sample a block of parameters (columns) for a population.
     /// @param samples A reference to the matrix that will store the drawn
     ///     samples.
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @param population the index from NewPopulation()
     /// @return An error if the samples could not be drawn.
     ///
-    /// The optimizer stores parameters as row vectors, so the number of drawn
-    /// samples will be equal to the number of rows in the provided matrix.  The
-    /// number of columns must match the length of the vector that was passed
-    /// into PgpeOptimizer::Initialize().
-    Error Sample(MatrixRef samples);
-
-    /// @brief Update the optimizer's internal state based on the reported sample costs.
-    /// @param samples A set of state vector samples.  This has the same format
-    ///     as the input to PgpeOptimizer::Samples().
-    /// @param costs A column vector, where each element is the relative cost of
-    ///     that particular solution.
-    /// @return An error if the update failed.
-    ///
-    /// The optimizer knows nothing about the problem its being asked to solve.
-    /// Rather, it has a strategy for exploring a solution space and finding the
-    /// most optimal one.  The caller is responsible for calculating the
-    /// correctness of each solution.
-    Error Update(ConstMatrixRef samples, ConstColumnVectorRef costs);
+    /// Every parameter has its own counter-based PRNG stream, keyed by the
+    /// seed, the population index and the parameter index.  The samples are
+    /// the same no matter how the parameters are split into blocks, different
+    /// blocks may be sampled concurrently, and any earlier population can be
+    /// regenerated without replaying the ones before it.
+    Error SampleBlock(BasicMatrixRef<T> samples, int first_param, int num_params,
+                      uint32_t population) const override;
+
+    /// @brief Restrict the sampling and updates to a block of parameters.
+    /// @param params the indices of the active parameters, in increasing
+    ///     order, or an empty vector to make every parameter active again
+    /// @return an error if the indices are out of order or outside of the
+    ///     solution vector
+    ///
+    /// This enables block-coordinate PGPE.  SampleBlock() and
+    /// AccumulateGradients() skip the inactive parameters and the update only
+    /// changes the active parameters' state, velocity and standard deviation,
+    /// so their cost depends on the size of the block rather than the whole
+    /// solution.  ClipUp is applied to the block's gradient and velocity on
+    /// their own.  The inactive velocities are kept as-is until their
+    /// parameters are active again.  Nothing is reused by MixPopulation()
+    /// while a block is active.
+    Error SetActiveParameters(const std::vector<int> &params) override;
+
+    /// @brief Get the parameters that are currently being optimized.
+    /// @return the active parameter indices; empty if every parameter is active
+    [[nodiscard]]
+    const std::vector<int> &GetActiveParameters() const;
+
+    /// @brief Reuse sample pairs from the previous population with importance
+    ///     mixing.
+    /// @param samples a new population, freshly sampled from the current
+    ///     distribution; any reused pairs are copied into it
+    /// @param costs the new population's fitness; filled in for any reused
+    ///     pairs
+    /// @param previous_samples the previous population, which may be empty
+    /// @param previous_costs the previous population's fitness
+    /// @param population the index from NewPopulation() for the new samples
+    /// @param[out] fresh_samples the rows of `samples` that still need to be
+    ///     evaluated
+    /// @return an error if the populations could not be mixed
+    ///
+    /// This follows "Efficient Natural Evolution Strategies" (Sun et al.,
+    /// 2009), applied to mirrored pairs rather than individual samples.  Each
+    /// previous pair is kept with probability `min(1, (1 - a) p'(z) / p(z))`,
+    /// where `p` and `p'` are the previous and current distributions and `a`
+    /// is PgpeOptimizerSettings::min_refresh_rate.  The new pairs are then
+    /// accepted with probability `max(a, 1 - p(z) / p'(z))` until the
+    /// population is full.  Only the accepted new pairs need to be evaluated.
+    ///
+    /// Nothing is reused unless `min_refresh_rate` is set and the optimizer
+    /// has been updated since it was initialized.  A reused pair is no longer
+    /// mirrored around the current solution, so the next update uses the
+    /// per-sample form of the PGPE gradients.
+    Error MixPopulation(BasicMatrixRef<T> samples, BasicColumnVectorRef<T> costs,
+                        ConstBasicMatrixRef<T> previous_samples,
+                        ConstBasicColumnVectorRef<T> previous_costs, uint32_t population,
+                        std::vector<int> &fresh_samples) override;
+
+    /// @brief Start an update that is computed in parameter blocks.
+    /// @param samples A set of state vector samples.
+    /// @param costs A column vector with the relative cost of each sample.
+    /// @return An error if the update could not be started.
+    ///
+    /// This, along with AccumulateGradients() and FinishUpdate(), allows the
+    /// update to be computed in parallel.  The gradient for each parameter
+    /// only depends on that parameter's samples and the shared costs.
+    ///
+    /// The update reuses an internal workspace, so it will only allocate
+    /// memory the first time it's called or when the problem size changes.
+    Error BeginUpdate(ConstBasicMatrixRef<T> samples,
+                      ConstBasicColumnVectorRef<T> costs) override;
+
+    /// @brief Accumulate the gradients for a block of parameters (columns).
+    /// @param samples the same samples that were passed to BeginUpdate()
+    /// @param first_param the first parameter in the block
+    /// @param num_params the number of parameters in the block
+    /// @return An error if the gradients could not be accumulated.
+    ///
+    /// Different, non-overlapping blocks may be accumulated concurrently.
+    Error AccumulateGradients(ConstBasicMatrixRef<T> samples, int first_param,
+                              int num_params) override;
+
+    /// @brief Finish an update once every parameter block has been accumulated.
+    /// @return An error if no update is in progress.
+    ///
+    /// This applies ClipUp, which is the only step that needs the gradients of
+    /// every parameter since it normalizes the gradient and velocity vectors.
+    Error FinishUpdate() override;
 
 private:
-    PgpeOptimizer(const PgpeOptimizerSettings &settings, const uint32_t seed);
+    BasicPgpeOptimizer(const PgpeOptimizerSettings &settings, DefaultRngType::result_type seed);
 
-    Error CheckInitialized() const;
-    Error ValidateCosts(int num_samples, ConstColumnVectorRef costs) const;
-    Error ValidateSamples(ConstMatrixRef samples) const;
+    using IOptimizer<T>::CheckInitialized;
+    using IOptimizer<T>::ValidateCosts;
+    using IOptimizer<T>::ValidateMirroredSamples;
+    using IOptimizer<T>::ValidateBlock;
+    using IOptimizer<T>::DrawMirroredSamples;
+    using IOptimizer<T>::InsertValues;
 
     bool _is_initialized;
     PgpeOptimizerSettings _settings;
-    NormalDistribution<> _dist;
+    DefaultRngType::result_type _seed;
+    uint32_t _population;
+
+    BasicRowVector<T> _current_state;
+    BasicRowVector<T> _current_standard_deviation;
+    BasicRowVector<T> _current_velocity;
 
-    RowVector _current_state;
-    RowVector _current_standard_deviation;
-    RowVector _current_velocity;
+    // The distribution that the previous population was drawn from.  Only
+    // tracked when importance mixing is enabled.
+    BasicRowVector<T> _previous_state;
+    BasicRowVector<T> _previous_standard_deviation;
+    bool _has_previous_distribution;
+    bool _mixed_population;
+
+    // The active block of parameters; empty when every parameter is active.
+    std::vector<int> _active_params;
+
+    // Workspace for Update() so that it doesn't need to allocate.
+    BasicColumnVector<T> _delta_cost;
+    BasicColumnVector<T> _stddev_weights;
+    BasicColumnVector<T> _sample_weights;
+    BasicRowVector<T> _grad_solution;
+    BasicRowVector<T> _grad_stddev;
+    BasicRowVector<T> _active_gradient;
+    BasicRowVector<T> _active_velocity;
+    BasicRowVector<T> _active_stddev;
+    bool _update_pending;
 };
 
+extern template class BasicPgpeOptimizer<double>;
+extern template class BasicPgpeOptimizer<float>;
+
+/// @brief The default, double precision, PGPE optimizer.
+using PgpeOptimizer = BasicPgpeOptimizer<double>;
+
 }  // namespace abstractions
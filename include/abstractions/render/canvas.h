@@ -2,10 +2,16 @@
 
 #include <abstractions/image.h>
 #include <abstractions/math/random.h>
+#include <abstractions/render/shapes.h>
 #include <abstractions/types.h>
 #include <blend2d.h>
+#include <fmt/base.h>
 
+#include <array>
 #include <filesystem>
+#include <memory>
+#include <variant>
+#include <vector>
 
 namespace abstractions::render {
 
@@ -15,6 +21,137 @@ enum class CompositeMode {
     SrcOver,
 };
 
+/// @brief The rasterizers that a canvas can draw shapes with.
+enum class RenderBackend {
+    /// @brief Blend2D's general-purpose rendering pipeline.
+    Blend2D,
+
+    /// @brief The built-in scanline rasterizer.
+    /// @see Rasterizer
+    Scanline,
+};
+
+/// @brief How the edges of the shapes are rasterized.
+enum class RenderQuality {
+    /// @brief Edge pixels are blended according to how much of the pixel
+    ///     each shape covers.
+    Antialiased,
+
+    /// @brief A pixel is either inside or outside of a shape, based on where
+    ///     its centre is.
+    ///
+    /// Blend2D always anti-aliases, so this always draws the shapes with the
+    /// scanline rasterizer.
+    Aliased,
+};
+
+/// @brief How a canvas maps the shape coordinates onto the frame.
+///
+/// Every mapping sends `[0, 1]` to the frame, with some room for the shapes
+/// to extend past the edges.  Only the radii of the circles aren't mapped.
+enum class CoordinateMapping {
+    /// @brief Rescale each coordinate by its minimum and maximum across all
+    ///     shapes of the same type.
+    ///
+    /// The shapes always span the whole frame, but changing one shape's
+    /// extremes moves every other shape of that type.
+    Rescaled,
+
+    /// @brief Clamp each coordinate onto `[0, 1]`.
+    ///
+    /// Every shape is mapped independently.  A coordinate outside of the
+    /// range no longer changes the render.
+    Clamped,
+
+    /// @brief Pass each coordinate through a logistic function.
+    ///
+    /// Every shape is mapped independently and the mapping is smooth, so
+    /// coordinates never stop changing the render, just less so towards the
+    /// edges.
+    Sigmoid,
+};
+
+/// @brief Map shape coordinates onto the frame.
+/// @param coords shape coordinates, one shape per row
+/// @param mapping coordinate mapping
+/// @return the mapped coordinates, where `[0, 1]` spans the frame
+///
+/// The frame is padded by 10% on each side, so the mapped coordinates are on
+/// `[-0.1, 1.1]`.
+Matrix MapCoordinates(ConstMatrixRef coords, CoordinateMapping mapping);
+
+/// @brief Find the coordinate that maps onto a point in the frame.
+/// @param value mapped coordinate, where `[0, 1]` spans the frame
+/// @param mapping coordinate mapping
+/// @return a coordinate that maps onto `value`, or the nearest one if `value`
+///     can't be reached
+///
+/// The rescaled mapping depends on every other shape, so this assumes that the
+/// coordinates span `[0, 1]`.
+double UnmapCoordinate(double value, CoordinateMapping mapping);
+
+/// @brief The number of shapes that a canvas skipped because they couldn't
+///     change any pixels.
+struct CullStatistics {
+    /// @brief Number of shapes passed to the draw calls.
+    int submitted = 0;
+
+    /// @brief Shapes that are too transparent to change a pixel.
+    int transparent = 0;
+
+    /// @brief Shapes without any area, e.g., collinear triangles.
+    int degenerate = 0;
+
+    /// @brief Shapes that are entirely outside of the frame.
+    int offscreen = 0;
+
+    /// @brief Shapes hidden under opaque shapes that are drawn after them.
+    int occluded = 0;
+
+    /// @brief Total number of culled shapes.
+    int Culled() const {
+        return transparent + degenerate + offscreen + occluded;
+    }
+
+    /// @brief Add another set of statistics onto this one.
+    CullStatistics &operator+=(const CullStatistics &other);
+};
+
+/// @brief A shape that has been mapped onto a drawing surface.
+struct SurfaceShape {
+    /// @brief The shape's geometry, in pixel coordinates.
+    std::variant<BLCircle, BLRect, BLTriangle> geometry;
+
+    /// @brief The shape's colour, after the alpha scaling and clamping.
+    BLRgba colour;
+
+    /// @brief The shape's bounding box, in pixel coordinates.
+    BLBox bounds;
+
+    /// @brief Index of the shape in the collection passed to MapShapes(),
+    ///     counting through the circles, rectangles and then triangles.
+    int index = 0;
+};
+
+/// @brief Map a set of shapes onto a surface without drawing them.
+/// @param collection shapes being mapped; any of its collections may be empty
+/// @param width surface width
+/// @param height surface height
+/// @param alpha_scale alpha channel scaling
+/// @param mapping coordinate mapping
+/// @param shapes the mapped shapes, in the order they're drawn in
+/// @param statistics statistics updated with the culled shapes
+///
+/// This applies the same mapping as the Canvas draw calls, so drawing the
+/// mapped shapes with Canvas::DrawSurfaceShapes() gives the same result.  The
+/// shapes that can't change any pixels are culled, assuming that they're
+/// composited with CompositeMode::SrcOver.
+void MapShapes(const PackedShapeCollection &collection, int width, int height,
+               double alpha_scale, CoordinateMapping mapping, std::vector<SurfaceShape> &shapes,
+               CullStatistics &statistics);
+
+class Rasterizer;
+
 /// @brief A drawing surface for geometric shapes.
 ///
 /// The canvas uses a scaled, anisotropic coordinate system such that the
@@ -28,7 +165,7 @@ enum class CompositeMode {
 /// Image image;
 /// {
 ///     Canvas canvas{image};
-///     canvas.DrawFiledCircles(params);
+///     canvas.DrawFilledShapes(circles);
 /// }
 /// image.Save("image.jpg");
 /// ```
@@ -48,7 +185,13 @@ public:
     /// @brief Create a new Canvas from an iamge.
     /// @param image image the canvas draws to
     /// @param prng PRNG used for all random draw operations
-    Canvas(Image &image, Prng<DefaultRngType> prng);
+    /// @param num_threads number of threads Blend2D renders with; the default,
+    ///     `0`, renders synchronously on the calling thread
+    ///
+    /// With one or more threads, Blend2D queues the draw operations and
+    /// renders them on its own worker threads.  The output is the same either
+    /// way.
+    Canvas(Image &image, Prng<DefaultRngType> prng, int num_threads = 0);
 
     /// @brief Clean up the rendering canvas when it is destroyed.
     ///
@@ -66,32 +209,96 @@ public:
     /// @param alpha alpha value
     void Clear(const double red, const double green, const double blue, const double alpha = 1.0);
 
-    /// @brief Draw a set of filled circles.
-    /// @param params circles and their colours represented as an `Nx7` matrix
-    /// @return an Error if the inupt dimensions are incorrect
+    /// @brief Draw a contiguous range of filled circles.
+    /// @param circles circles and their colours
+    /// @param first index of the first circle that's drawn
+    /// @param last index one past the last circle that's drawn
+    /// @return an Error if the range is incorrect
     ///
-    /// Each circle is represented as a `(x,y,s,r,g,b.a)` tuple, packed into a
-    /// `Nx7` matrix.  The 's' dimension is a "signed radius", so it may be
-    /// positive or negative.  The renderer will take the absolute value of 's'
-    /// before doing any rendering.
-    Error DrawFilledCircles(ConstMatrixRef params);
+    /// Each circle is represented as a `(x,y,s,r,g,b.a)` tuple.  The 's'
+    /// dimension is a "signed radius", so it may be positive or negative.  The
+    /// renderer will take the absolute value of 's' before doing any
+    /// rendering.
+    ///
+    /// The coordinates are still rescaled using every circle in the
+    /// collection so drawing it in several ranges gives the same result as
+    /// drawing it all at once.
+    Error DrawFilledShapes(const CircleCollection &circles, int first, int last);
 
-    /// @brief Draw a set of filled rectangles.
-    /// @param params rectangles and their colours represeted as an `Nx8` matrix
-    /// @return an Error if the inupt dimensions are incorrect
+    /// @brief Draw a contiguous range of filled rectangles.
+    /// @param rectangles rectangles and their colours
+    /// @param first index of the first rectangle that's drawn
+    /// @param last index one past the last rectangle that's drawn
+    /// @return an Error if the range is incorrect
     ///
-    /// Each rectangle is represented as a `(x1,y1,x2,y2,r,g,b,a)` tuple packed
-    /// into a `Nx8` matrix.  `(x1,y1)` and `(x2,y2)` are the two corners of the
-    /// rectangle.  The width is `|x1 - x2|` and the height is `|y1 - y2|`.
-    Error DrawFilledRectangles(ConstMatrixRef params);
+    /// Each rectangle is represented as a `(x1,y1,x2,y2,r,g,b,a)` tuple.
+    /// `(x1,y1)` and `(x2,y2)` are the two corners of the rectangle.  The
+    /// width is `|x1 - x2|` and the height is `|y1 - y2|`.
+    Error DrawFilledShapes(const RectangleCollection &rectangles, int first, int last);
 
-    /// @brief Draw a set of filled triangles.
-    /// @param params triangles and their colours presented as an `Nx10` matrix
-    /// @return an Error if the inupt dimensions are incorrect
+    /// @brief Draw a contiguous range of filled triangles.
+    /// @param triangles triangles and their colours
+    /// @param first index of the first triangle that's drawn
+    /// @param last index one past the last triangle that's drawn
+    /// @return an Error if the range is incorrect
     ///
-    /// Each triangle is represented as a `(x1,y1,x2,y2,x3,y3,r,g,b,a)` tuple,
-    /// packed into a `Nx10` matrix.
-    Error DrawFilledTriangles(ConstMatrixRef params);
+    /// Each triangle is represented as a `(x1,y1,x2,y2,x3,y3,r,g,b,a)` tuple.
+    Error DrawFilledShapes(const TriangleCollection &triangles, int first, int last);
+
+    /// @brief Draw every shape in a collection.
+    /// @param shapes shapes and their colours
+    /// @return an Error if the shapes couldn't be drawn
+    template <int D>
+    Error DrawFilledShapes(const ShapeCollection<D> &shapes) {
+        return DrawFilledShapes(shapes, 0, shapes.NumShapes());
+    }
+
+    /// @brief Draw some of the shapes that were mapped onto a larger surface.
+    /// @param shapes shapes mapped by MapShapes()
+    /// @param indices indices of the shapes that are drawn, in draw order
+    /// @param x horizontal position of the canvas on the larger surface
+    /// @param y vertical position of the canvas on the larger surface
+    ///
+    /// This is used to draw one tile of a surface at a time, so the canvas is
+    /// usually smaller than the surface the shapes were mapped onto.
+    void DrawSurfaceShapes(const std::vector<SurfaceShape> &shapes,
+                           const std::vector<int> &indices, int x, int y);
+
+    /// @brief Find the shapes that are hidden under opaque shapes drawn after
+    ///     them.
+    /// @param shapes shapes that will be drawn; any of its collections may be
+    ///     empty
+    ///
+    /// The shapes are assumed to be drawn as the circles, then the rectangles
+    /// and then the triangles.  The surface is split into square tiles and
+    /// the shapes are visited back to front.  A tile is marked as covered
+    /// once it's entirely inside of an opaque shape, and a shape is hidden if
+    /// every tile that its bounding box touches is already covered.  This is
+    /// conservative, so a hidden shape never affects the final image.
+    ///
+    /// The subsequent draw calls skip the hidden shapes, so they must be
+    /// passed the same parameters.  Call ClearOccludedShapes() to draw every
+    /// shape again.
+    void FindOccludedShapes(const PackedShapeCollection &shapes);
+
+    /// @brief Stop skipping the shapes found by FindOccludedShapes().
+    void ClearOccludedShapes();
+
+    /// @brief Get the number of shapes culled by the draw calls so far.
+    ///
+    /// A shape is culled when it can't change any pixels: it has no area, is
+    /// entirely outside of the frame, is occluded or, when compositing with
+    /// CompositeMode::SrcOver, its alpha is too small to change an 8-bit
+    /// colour channel.  Culled shapes are never submitted to the rasterizer.
+    const CullStatistics &Statistics() const {
+        return _statistics;
+    }
+
+    /// @brief Wait for every pending draw operation to finish.
+    ///
+    /// The draw operations may be deferred, so the canvas has to be flushed
+    /// before the image is read while the canvas still exists.
+    void Flush();
 
     /// @brief Fill the canvas with uniformly random values.
     /// @note The random numbers are generated from the PRNG that's passed into
@@ -102,11 +309,30 @@ public:
     /// @param scale A scaling factor between 0 and 1
     void SetAlphaScale(const double scale);
 
+    /// @brief Set how the shape coordinates are mapped onto the frame.
+    /// @param mapping coordinate mapping
+    ///
+    /// The canvas rescales the coordinates by default.
+    void SetCoordinateMapping(const CoordinateMapping mapping);
+
     /// @brief Set the canvas' compositing mode.
     /// @param mode compositing mode
     /// @return an Error if the compositing mode is unsupported
     Error SetCompositeMode(const CompositeMode mode);
 
+    /// @brief Set the rasterizer used to draw the shapes.
+    /// @param backend rasterizer backend
+    ///
+    /// The canvas uses Blend2D by default.  The other operations, like
+    /// clearing the canvas, always use Blend2D.
+    void SetBackend(const RenderBackend backend);
+
+    /// @brief Set how the edges of the shapes are rasterized.
+    /// @param quality render quality
+    ///
+    /// The canvas anti-aliases by default.
+    void SetQuality(const RenderQuality quality);
+
     Canvas(const Canvas &) = delete;
     Canvas(Canvas &&) = delete;
     void operator=(const Canvas &) = delete;
@@ -116,6 +342,29 @@ private:
     BLContext _context;
     Prng<DefaultRngType> _prng;
     double _alpha_scale;
+    CoordinateMapping _mapping;
+    CompositeMode _composite_mode;
+    RenderBackend _backend;
+    RenderQuality _quality;
+    std::unique_ptr<Rasterizer> _rasterizer;
+    CullStatistics _statistics;
+    std::array<std::vector<bool>, kNumShapeTypes> _occluded;
+
+    void UpdateRasterizer();
+
+    template <typename Traits>
+    Error DrawFilled(const typename Traits::Collection &shapes, int first, int last);
+
+    void Fill(const BLCircle &circle, const BLRgba &colour);
+    void Fill(const BLRect &rect, const BLRgba &colour);
+    void Fill(const BLTriangle &triangle, const BLRgba &colour);
 };
 
 }  // namespace abstractions::render
+
+/// @brief Custom formatter for the CoordinateMapping type.
+template <>
+struct fmt::formatter<abstractions::render::CoordinateMapping> : fmt::formatter<fmt::string_view> {
+    fmt::format_context::iterator format(abstractions::render::CoordinateMapping mapping,
+                                         fmt::format_context &ctx) const;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <abstractions/errors.h>
+#include <abstractions/image.h>
+#include <abstractions/render/canvas.h>
+#include <abstractions/render/shapes.h>
+#include <abstractions/types.h>
+#include <blend2d.h>
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace abstractions::render {
+
+/// @brief An image stored as one contiguous array per colour channel.
+///
+/// Pixel `(x, y)` is stored in row `y * width + x` and the columns are the
+/// red, green and blue channels, each on `[0, 1]`.
+using ColourPlanes = Eigen::Array<float, Eigen::Dynamic, 3, Eigen::ColMajor>;
+
+/// @brief Convert an image into its colour planes.
+/// @param image image being converted; the alpha channel is ignored
+/// @return the image's colour planes
+ColourPlanes ToColourPlanes(const Image &image);
+
+/// @brief The coverage masks of a set of shapes whose geometry is fixed.
+///
+/// A shape's geometry decides how much of each pixel it covers while its
+/// colour and alpha only decide what's blended into those pixels.  Once the
+/// geometry stops changing, each shape can be rasterized once, as a mask over
+/// its bounding box, and any set of colours can then be composited straight
+/// from the masks.  Compositing is a multiply-add per pixel and channel over
+/// contiguous arrays, which is much cheaper than rasterizing the shapes again.
+///
+/// The masks are never modified once they're created, so any number of
+/// threads can composite from the same masks.
+class CoverageMasks {
+public:
+    /// @brief Rasterize the coverage masks of a set of shapes.
+    /// @param shapes shapes being rasterized; any of its collections may be
+    ///     empty
+    /// @param background the image the shapes are composited onto
+    /// @param alpha_scale alpha channel scaling
+    /// @param mapping coordinate mapping
+    /// @param backend rasterizer backend used to draw the masks
+    /// @param quality render quality used to draw the masks
+    /// @return the coverage masks or an Error if the inputs are incorrect
+    ///
+    /// The shapes' colours are ignored.  Shapes that can't cover any pixels,
+    /// regardless of their colour, don't get a mask.
+    static Expected<CoverageMasks> Create(const PackedShapeCollection &shapes,
+                                          const Image &background, double alpha_scale,
+                                          CoordinateMapping mapping, RenderBackend backend,
+                                          RenderQuality quality);
+
+    /// @brief Surface width, in pixels.
+    int Width() const {
+        return _width;
+    }
+
+    /// @brief Surface height, in pixels.
+    int Height() const {
+        return _height;
+    }
+
+    /// @brief Number of shapes the masks were created from.
+    int NumShapes() const {
+        return _num_shapes;
+    }
+
+    /// @brief Number of shapes that have a mask.
+    int NumMasks() const {
+        return static_cast<int>(_masks.size());
+    }
+
+    /// @brief Composite a set of shape colours onto the background.
+    /// @param shapes shapes with the same geometry as the ones the masks were
+    ///     created from; only their colours are used
+    /// @param target planes the composite is written into; it's filled with
+    ///     the background if it isn't the size of the surface
+    /// @return an Error if the shapes don't match the masks
+    ///
+    /// The result is the same as a render of `shapes`, up to the rounding of
+    /// the 8-bit channels in the render.
+    ///
+    /// Only the pixels under the masks are reset to the background, so a
+    /// `target` that's already the size of the surface must hold either the
+    /// background or an earlier composite from the same masks.  Reusing one
+    /// target for every composite means that nothing outside of the masks is
+    /// ever copied.
+    Error Composite(const PackedShapeCollection &shapes, ColourPlanes &target) const;
+
+private:
+    /// @brief The coverage of a single shape over its bounding box.
+    struct Mask {
+        /// @brief Index of the shape, counting through every collection.
+        int shape;
+
+        /// @brief The part of the surface covered by the mask.
+        BLRectI rect;
+
+        /// @brief Fraction of each pixel covered by the shape, in row-major
+        ///     order.
+        Eigen::ArrayXf coverage;
+    };
+
+    /// @brief A run of contiguous pixels, in the colour planes' storage order.
+    struct Span {
+        int start;
+        int length;
+    };
+
+    CoverageMasks(int width, int height, double alpha_scale, int num_shapes);
+
+    int _width;
+    int _height;
+    double _alpha_scale;
+    int _num_shapes;
+    ColourPlanes _background;
+    std::vector<Mask> _masks;
+
+    /// @brief The pixels covered by at least one mask, as sorted,
+    ///     non-overlapping spans.
+    std::vector<Span> _covered;
+};
+
+}  // namespace abstractions::render
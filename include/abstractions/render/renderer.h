@@ -2,8 +2,12 @@
 
 #include <abstractions/image.h>
 #include <abstractions/math/random.h>
+#include <abstractions/render/canvas.h>
+#include <abstractions/render/coverage.h>
 #include <abstractions/render/shapes.h>
+#include <abstractions/render/tiles.h>
 
+#include <memory>
 #include <optional>
 
 namespace abstractions::render {
@@ -13,8 +17,16 @@ namespace abstractions::render {
 /// The renderers maintains an internal rendering surface and can be reused.
 /// Each call to Renderer::Render() will clear out the surface before rendering
 /// the provided shapes.
+///
+/// The renderer can also cache the intermediate composites, or layers, of a
+/// base collection.  Collections that only differ from the base from some
+/// shape onward can then be rendered starting from one of those layers rather
+/// than from an empty surface.
 class Renderer {
 public:
+    /// @brief The default number of shapes between the cached layers.
+    static constexpr int kDefaultLayerInterval = 16;
+
     /// @brief Create a new renderer with the given canvas size.
     /// @param width canvas width
     /// @param height canvas height
@@ -32,6 +44,14 @@ public:
     /// @param alpha_scale alpha scaling value
     void SetAlphaScale(double alpha_scale);
 
+    /// @brief Set how the shape coordinates are mapped onto the surface.
+    /// @param mapping coordinate mapping
+    ///
+    /// With one of the independent mappings, a collection that only differs
+    /// from the cached base from some shape onward can always start from the
+    /// cached layers.
+    void SetCoordinateMapping(CoordinateMapping mapping);
+
     /// @brief Set the background fill colour.  This is ignored when the random
     ///     background fill is enabled.
     /// @param red red value
@@ -45,23 +65,150 @@ public:
     /// @param pixel background colour
     void SetBackground(const Pixel &pixel);
 
+    /// @brief Set the rasterizer used to draw the shapes.
+    /// @param backend rasterizer backend
+    ///
+    /// The built-in scanline rasterizer is specialized for the abstraction
+    /// shapes.  Its output is close to Blend2D's, but not identical.
+    void SetBackend(RenderBackend backend);
+
+    /// @brief Set how the edges of the shapes are rasterized.
+    /// @param quality render quality
+    ///
+    /// Renders are anti-aliased by default.  Aliased renders are cheaper,
+    /// which is useful when many renders are only compared against a
+    /// reference.
+    void SetQuality(RenderQuality quality);
+
+    /// @brief Set the number of threads used for each render.
+    /// @param num_threads number of rendering threads; `0` renders on the
+    ///     calling thread
+    ///
+    /// This splits a single render across several threads, which helps with
+    /// large images or when there are fewer renders than cores.  Only the
+    /// Blend2D backend is multi-threaded.
+    void SetThreadCount(int num_threads);
+
+    /// @brief Enable or disable occlusion culling.
+    /// @param enabled whether or not the hidden shapes are skipped
+    ///
+    /// With occlusion culling, shapes that are completely hidden under later,
+    /// opaque shapes aren't drawn.  The test is conservative, so the output
+    /// doesn't change.  It's disabled by default since it only pays off once
+    /// many of the shapes are opaque.  The cached layers never skip any
+    /// shapes since they store the intermediate composites.
+    /// @see Canvas::FindOccludedShapes()
+    void SetOcclusionCulling(bool enabled);
+
     /// @brief Draw the packed collection.
     /// @param shapes set of shapes for the renderer to draw
     /// @return the rendering result
     void Render(const PackedShapeCollection &shapes);
 
+    /// @brief Draw a packed collection that only differs from the cached base
+    ///     collection from some shape onward.
+    /// @param shapes set of shapes for the renderer to draw
+    /// @param first_changed index of the first shape that differs from the
+    ///     base, counting through the circles, rectangles and then triangles
+    ///
+    /// The shapes before `first_changed` are assumed to be the same as in the
+    /// base; this isn't checked.  The render starts from the deepest cached
+    /// layer that doesn't include `first_changed` and only draws the shapes
+    /// above it.  With CoordinateMapping::Rescaled, the canvas rescales the
+    /// coordinates using every shape in a collection so the layers are only
+    /// used when the coordinates span the same range as they do in the base.
+    /// Otherwise, or if no layers are cached, this is the same as calling
+    /// Render(shapes).
+    void Render(const PackedShapeCollection &shapes, int first_changed);
+
+    /// @brief Map a packed collection onto the drawing surface and bin the
+    ///     shapes into tiles.
+    /// @param shapes set of shapes
+    /// @param tile_size tile edge length, in pixels
+    /// @return the binned shapes, which can be passed to RenderTile()
+    Expected<TiledShapes> BinShapes(const PackedShapeCollection &shapes,
+                                    int tile_size = TiledShapes::kDefaultTileSize) const;
+
+    /// @brief Render a single tile of a binned collection.
+    /// @param tiles shapes binned by BinShapes()
+    /// @param tile tile index
+    /// @param target image the tile is rendered into; it must be the same size
+    ///     as the tile
+    /// @return an Error if the tiles or the target don't match the renderer
+    ///
+    /// The tile is the same as the corresponding part of Render(), up to
+    /// rounding in the anti-aliasing of the shapes that cross tile edges.  It
+    /// doesn't touch the drawing surface, or any other renderer state, so any
+    /// number of tiles can be rendered concurrently.  Occlusion culling and
+    /// the cached layers aren't used for tiles.
+    Error RenderTile(const TiledShapes &tiles, int tile, Image &target) const;
+
+    /// @brief Rasterize the coverage masks of a collection whose geometry
+    ///     won't change anymore.
+    /// @param base the collection; its colours are ignored
+    /// @return the coverage masks, composited onto this renderer's background
+    ///
+    /// Any collection with the same geometry as `base` can then be composited
+    /// with CoverageMasks::Composite() instead of being rendered.
+    Expected<CoverageMasks> CacheCoverage(const PackedShapeCollection &base) const;
+
+    /// @brief Render a base collection and cache its intermediate composites.
+    /// @param base the base collection
+    /// @param interval number of shapes between each cached layer
+    /// @return an Error if the layers could not be cached
+    ///
+    /// Shapes are composited in a fixed order, so a collection that only
+    /// differs from the base from some shape onward is identical to the base
+    /// up until that shape.  A copy of the drawing surface is kept for every
+    /// `interval` shapes, starting with the background.  The drawing surface
+    /// contains the rendered base afterwards.
+    Error CacheLayers(const PackedShapeCollection &base, int interval = kDefaultLayerInterval);
+
+    /// @brief Use the layers cached by another renderer.
+    /// @param other renderer that cached the layers
+    ///
+    /// The layers are never modified once they're cached so any number of
+    /// renderers, e.g., one per worker, can share them without copying.  The
+    /// shared layers include the background of the renderer that cached them.
+    void ShareLayers(const Renderer &other);
+
+    /// @brief Discard the cached layers, if there are any.
+    void ClearLayers();
+
+    /// @brief Get the culling statistics of the most recent render.
+    ///
+    /// Only the shapes that were actually drawn are counted, so a render that
+    /// starts from a cached layer only counts the shapes above that layer.
+    const CullStatistics &Statistics() const {
+        return _statistics;
+    }
+
     /// @brief Read-only access to the internal drawing surface
     const Image &DrawingSurface() const {
         return _drawing_surface;
     }
 
 private:
+    struct Layers;
+    struct RandomBackground;
+
     Renderer(Image &image, std::optional<Prng<>> seed);
+    void DrawBackground(Canvas &canvas) const;
+    const Image &RandomBackgroundImage() const;
+
     Prng<> _prng;
     bool _random_background;
+    std::shared_ptr<RandomBackground> _background;
     Pixel _background_colour;
     Image _drawing_surface;
     double _alpha_scale;
+    CoordinateMapping _mapping;
+    RenderBackend _backend;
+    RenderQuality _quality;
+    int _num_threads;
+    bool _occlusion_culling;
+    std::shared_ptr<const Layers> _layers;
+    CullStatistics _statistics;
 };
 
 }  // namespace abstractions::render
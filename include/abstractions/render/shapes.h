@@ -1,14 +1,25 @@
 #pragma once
 
 #include <abstractions/errors.h>
+#include <abstractions/math/matrices.h>
 #include <abstractions/math/random.h>
 #include <abstractions/types.h>
 #include <fmt/base.h>
 
+#include <Eigen/Core>
+#include <array>
+#include <string_view>
+#include <tuple>
+
 namespace abstractions::render {
 
 /// @brief A collection of shape parameter vectors.
 /// @tparam D number of dimensions needed to describe a shape
+///
+/// The parameters are stored in a column-major matrix with a fixed number of
+/// columns, so each parameter, e.g., every shape's `x` coordinate or red
+/// channel, is a contiguous array.  Operations that transform one parameter
+/// across all of the shapes are then simple, vectorizable loops.
 template <int D>
 struct ShapeCollection {
     static_assert(D > 0, "Shape dimensions must be greater than zero.");
@@ -19,6 +30,9 @@ struct ShapeCollection {
     /// @brief Total number of dimensions in a shape vector, including colour.
     static constexpr int TotalDimensions = D + 4;
 
+    /// @brief Storage for the shape parameters; one row per shape.
+    using ParamsMatrix = Eigen::Matrix<double, Eigen::Dynamic, TotalDimensions, Eigen::ColMajor>;
+
     /// @brief Create an empty ShapeCollection.
     ShapeCollection() :
         ShapeCollection(0) {}
@@ -27,12 +41,12 @@ struct ShapeCollection {
     /// @param num_shapes number of shapes in the collection
     ShapeCollection(int num_shapes) {
         abstractions_assert(num_shapes >= 0);
-        Params = Matrix::Zero(num_shapes, TotalDimensions);
+        Params = ParamsMatrix::Zero(num_shapes, TotalDimensions);
     }
 
     /// @brief A `NxD` matrix with the `N` shape vectors, each `D` dimensions in
     ///      length.
-    Matrix Params;
+    ParamsMatrix Params;
 
     /// @brief Determine if the collection is empty.
     bool Empty() const {
@@ -46,12 +60,12 @@ struct ShapeCollection {
 
     /// @brief Only get the submatrix containing the shape parameters.
     auto ShapeParameters() {
-        return Params.leftCols<D>();
+        return Params.template leftCols<D>();
     }
 
     /// @brief Only get the submatrix containing the shape colours.
     auto ColourValues() {
-        return Params.rightCols<4>();
+        return Params.template rightCols<4>();
     }
 
     /// @brief Get the number of shapes in the collection.
@@ -71,6 +85,135 @@ using RectangleCollection = ShapeCollection<4>;
 ///     format.
 using TriangleCollection = ShapeCollection<6>;
 
+/// @brief Available shapes for the image abstraction.
+enum class AbstractionShape { Circles, Rectangles, Triangles };
+
+ABSTRACTIONS_OPTIONS_ENUM(AbstractionShape)
+
+/// @brief Compile-time description of an abstraction shape.
+/// @tparam S shape being described
+///
+/// Every shape has a specialization that names its parameter storage and how
+/// many of those parameters are coordinates.  Code that handles every shape
+/// type should go through ForEachShapeType() rather than listing the shapes,
+/// so that adding a new shape only requires a new specialization.
+template <AbstractionShape S>
+struct ShapeTraits;
+
+template <>
+struct ShapeTraits<AbstractionShape::Circles> {
+    /// @brief The shape being described.
+    static constexpr AbstractionShape Shape = AbstractionShape::Circles;
+
+    /// @brief Name used when serializing the shape.
+    static constexpr std::string_view Name = "circles";
+
+    /// @brief Human-readable name for the shape.
+    static constexpr std::string_view Label = "Circles";
+
+    /// @brief Number of shape parameters that are canvas coordinates.
+    ///
+    /// The circle's radius is relative to the canvas size, so only the centre
+    /// is mapped onto the canvas.
+    static constexpr int CoordinateDimensions = 2;
+
+    /// @brief Storage for a set of circles.
+    using Collection = CircleCollection;
+
+    /// @brief Get the circle inscribed in a square.
+    /// @param x horizontal position of the square's centre
+    /// @param y vertical position of the square's centre
+    /// @param half half of the square's edge length
+    /// @return the circle's `(x,y,r)` parameters
+    static constexpr std::array<double, 3> InscribedInSquare(double x, double y, double half) {
+        return {x, y, half};
+    }
+};
+
+template <>
+struct ShapeTraits<AbstractionShape::Rectangles> {
+    /// @brief The shape being described.
+    static constexpr AbstractionShape Shape = AbstractionShape::Rectangles;
+
+    /// @brief Name used when serializing the shape.
+    static constexpr std::string_view Name = "rectangles";
+
+    /// @brief Human-readable name for the shape.
+    static constexpr std::string_view Label = "Rectangles";
+
+    /// @brief Number of shape parameters that are canvas coordinates.
+    static constexpr int CoordinateDimensions = 4;
+
+    /// @brief Storage for a set of rectangles.
+    using Collection = RectangleCollection;
+
+    /// @brief Get the rectangle that covers a square.
+    /// @param x horizontal position of the square's centre
+    /// @param y vertical position of the square's centre
+    /// @param half half of the square's edge length
+    /// @return the rectangle's `(x1,y1,x2,y2)` parameters
+    static constexpr std::array<double, 4> InscribedInSquare(double x, double y, double half) {
+        return {x - half, y - half, x + half, y + half};
+    }
+};
+
+template <>
+struct ShapeTraits<AbstractionShape::Triangles> {
+    /// @brief The shape being described.
+    static constexpr AbstractionShape Shape = AbstractionShape::Triangles;
+
+    /// @brief Name used when serializing the shape.
+    static constexpr std::string_view Name = "triangles";
+
+    /// @brief Human-readable name for the shape.
+    static constexpr std::string_view Label = "Triangles";
+
+    /// @brief Number of shape parameters that are canvas coordinates.
+    static constexpr int CoordinateDimensions = 6;
+
+    /// @brief Storage for a set of triangles.
+    using Collection = TriangleCollection;
+
+    /// @brief Get the triangle inscribed in a square.
+    /// @param x horizontal position of the square's centre
+    /// @param y vertical position of the square's centre
+    /// @param half half of the square's edge length
+    /// @return the triangle's `(x1,y1,x2,y2,x3,y3)` parameters, with the apex
+    ///     at the top of the square
+    static constexpr std::array<double, 6> InscribedInSquare(double x, double y, double half) {
+        return {x, y - half, x - half, y + half, x + half, y + half};
+    }
+};
+
+/// @brief Call a function once for every shape type.
+/// @param fn callable that accepts a ShapeTraits instance
+///
+/// The shapes are visited in the order that they're packed and drawn in,
+/// i.e., circles, rectangles and then triangles.
+template <typename F>
+constexpr void ForEachShapeType(F &&fn) {
+    fn(ShapeTraits<AbstractionShape::Circles>{});
+    fn(ShapeTraits<AbstractionShape::Rectangles>{});
+    fn(ShapeTraits<AbstractionShape::Triangles>{});
+}
+
+/// @brief Call a function once for every shape type, in the reverse of the
+///     order that they're drawn in.
+/// @param fn callable that accepts a ShapeTraits instance
+template <typename F>
+constexpr void ForEachShapeTypeReversed(F &&fn) {
+    fn(ShapeTraits<AbstractionShape::Triangles>{});
+    fn(ShapeTraits<AbstractionShape::Rectangles>{});
+    fn(ShapeTraits<AbstractionShape::Circles>{});
+}
+
+/// @brief The number of available shape types.
+constexpr int kNumShapeTypes = [] {
+    int num_types = 0;
+    ForEachShapeType([&](auto) { num_types++; });
+    return num_types;
+}();
+
 /// @brief Generate shape parameter matrices.
 ///
 /// The convention for the shape parameter matrices are for each shape to be
@@ -105,6 +248,28 @@ public:
     /// @return shape parameters matrix
     RectangleCollection RandomRectangles(const int num);
 
+    /// @brief Generate a set of random shapes with random colours.
+    /// @tparam S shape type
+    /// @param num number of shapes
+    /// @return shape parameters matrix
+    ///
+    /// The sizes that aren't canvas coordinates, i.e., the circle radii, are
+    /// reduced since it's very easy for a single shape to cover the entire
+    /// image, e.g., a circle with a radius of '1' is twice the image's size.
+    template <AbstractionShape S>
+    typename ShapeTraits<S>::Collection RandomShapes(const int num) {
+        using Traits = ShapeTraits<S>;
+        using Collection = typename Traits::Collection;
+        constexpr int kNumSizes = Collection::ShapeDimensions - Traits::CoordinateDimensions;
+
+        Collection collection(num);
+        RandomMatrix(collection.Params, _dist);
+        if constexpr (kNumSizes > 0) {
+            collection.Params.template middleCols<kNumSizes>(Traits::CoordinateDimensions) *= 0.25;
+        }
+        return collection;
+    }
+
     /// @brief The aspect ratio the generator is configured for.
     double AspectRatio() const {
         return _aspect_ratio;
@@ -115,11 +280,6 @@ private:
     UniformDistribution<> _dist;
 };
 
-/// @brief Available shapes for the image abstraction.
-enum class AbstractionShape { Circles, Rectangles, Triangles };
-
-ABSTRACTIONS_OPTIONS_ENUM(AbstractionShape)
-
 /// @brief Provides access to the individual shape collections when multiple
 ///     collections are inside a single parameter vector.
 /// @see AbstractionShape
@@ -172,32 +332,64 @@ public:
     /// @return a row vector with the packed parameters
     RowVector AsPackedVector() const;
 
+    /// @brief Get the collection for a particular shape type.
+    /// @tparam S shape type
+    template <AbstractionShape S>
+    typename ShapeTraits<S>::Collection &Collection() {
+        return std::get<typename ShapeTraits<S>::Collection>(_collections);
+    }
+
+    /// @brief Get the collection for a particular shape type.
+    /// @tparam S shape type
+    template <AbstractionShape S>
+    const typename ShapeTraits<S>::Collection &Collection() const {
+        return std::get<typename ShapeTraits<S>::Collection>(_collections);
+    }
+
+    /// @brief Call a function for every collection, in packing order.
+    /// @param fn callable with a `(ShapeTraits<S>, Collection &)` signature
+    ///
+    /// Collections for shapes that aren't stored are empty but are still
+    /// visited.
+    template <typename F>
+    void ForEachCollection(F &&fn) {
+        ForEachShapeType([&]<typename Traits>(Traits traits) {
+            fn(traits, Collection<Traits::Shape>());
+        });
+    }
+
+    /// @copydoc ForEachCollection(F &&)
+    template <typename F>
+    void ForEachCollection(F &&fn) const {
+        ForEachShapeType([&]<typename Traits>(Traits traits) {
+            fn(traits, Collection<Traits::Shape>());
+        });
+    }
+
     CircleCollection &Circles() {
-        return _circles;
+        return Collection<AbstractionShape::Circles>();
     }
     const CircleCollection &Circles() const {
-        return _circles;
+        return Collection<AbstractionShape::Circles>();
     }
 
     RectangleCollection &Rectangles() {
-        return _rectangles;
+        return Collection<AbstractionShape::Rectangles>();
     }
     const RectangleCollection &Rectangles() const {
-        return _rectangles;
+        return Collection<AbstractionShape::Rectangles>();
     }
 
     TriangleCollection &Triangles() {
-        return _triangles;
+        return Collection<AbstractionShape::Triangles>();
     }
     const TriangleCollection &Triangles() const {
-        return _triangles;
+        return Collection<AbstractionShape::Triangles>();
     }
 
 private:
     int _collection_size;
-    CircleCollection _circles;
-    RectangleCollection _rectangles;
-    TriangleCollection _triangles;
+    std::tuple<CircleCollection, RectangleCollection, TriangleCollection> _collections;
 };
 
 }  // namespace abstractions::render
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <abstractions/render/canvas.h>
+#include <abstractions/types.h>
+#include <blend2d.h>
+
+#include <vector>
+
+namespace abstractions::render {
+
+/// @brief A set of shapes, mapped onto a surface and binned into square
+///     tiles.
+///
+/// Each bin lists the shapes whose bounding boxes, grown by a pixel for the
+/// anti-aliasing, overlap the tile, in the same order that they're drawn in.
+/// A tile only depends on the shapes in its bin, so the tiles can be rendered
+/// independently of each other, e.g., on separate threads.  Tiles are small
+/// enough to stay in the cache while all of their shapes are drawn, which is
+/// what makes this worthwhile for collections with thousands of shapes.
+class TiledShapes {
+public:
+    /// @brief The default tile edge length, in pixels.
+    static constexpr int kDefaultTileSize = 64;
+
+    /// @brief Map a set of shapes onto a surface and bin them into tiles.
+    /// @param shapes shapes being binned; any of its collections may be empty
+    /// @param width surface width
+    /// @param height surface height
+    /// @param alpha_scale alpha channel scaling
+    /// @param mapping coordinate mapping
+    /// @param tile_size tile edge length, in pixels
+    /// @return the binned shapes or an Error if the inputs are incorrect
+    static Expected<TiledShapes> Create(const PackedShapeCollection &shapes, int width,
+                                        int height, double alpha_scale,
+                                        CoordinateMapping mapping,
+                                        int tile_size = kDefaultTileSize);
+
+    /// @brief Surface width, in pixels.
+    int Width() const {
+        return _width;
+    }
+
+    /// @brief Surface height, in pixels.
+    int Height() const {
+        return _height;
+    }
+
+    /// @brief Total number of tiles.
+    int NumTiles() const {
+        return _tiles_x * _tiles_y;
+    }
+
+    /// @brief Get the part of the surface covered by a tile.
+    /// @param tile tile index, in row-major order
+    /// @return the tile's rectangle; the tiles along the right and bottom
+    ///     edges are clipped to the surface
+    BLRectI Tile(int tile) const;
+
+    /// @brief Get the shapes that overlap a tile.
+    /// @param tile tile index, in row-major order
+    /// @return indices into Shapes(), in draw order
+    const std::vector<int> &Bin(int tile) const {
+        return _bins.at(tile);
+    }
+
+    /// @brief The mapped shapes, in draw order.
+    const std::vector<SurfaceShape> &Shapes() const {
+        return _shapes;
+    }
+
+    /// @brief The shapes culled while mapping them onto the surface.
+    const CullStatistics &Statistics() const {
+        return _statistics;
+    }
+
+private:
+    TiledShapes(int width, int height, int tile_size);
+
+    int _width;
+    int _height;
+    int _tile_size;
+    int _tiles_x;
+    int _tiles_y;
+    std::vector<SurfaceShape> _shapes;
+    std::vector<std::vector<int>> _bins;
+    CullStatistics _statistics;
+};
+
+}  // namespace abstractions::render
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <abstractions/math/random.h>
+#include <abstractions/optimizer.h>
+#include <abstractions/types.h>
+
+#include <optional>
+#include <vector>
+
+namespace abstractions {
+
+/// @brief Runtime settings for the SnesOptimizer
+struct SnesOptimizerSettings {
+    /// @brief The initial standard deviation, used when one isn't provided to
+    ///     SnesOptimizer::Initialize().
+    double init_stddev = 0.1;
+
+    /// @brief Learning rate used when updating the solution estimate.
+    double mean_learning_rate = 1.0;
+
+    /// @brief Learning rate used when updating the standard deviation.
+    ///
+    /// The default is the standard SNES learning rate of
+    /// `(3 + ln(n)) / (5 * sqrt(n))`, where `n` is the number of parameters.
+    std::optional<double> stddev_learning_rate = {};
+
+    /// @brief The seed used by the optimizer's internal RNG.  Will be generated
+    ///     from a random source if not provided.
+    std::optional<uint32_t> seed = {};
+
+    /// @brief Validate the optimizer settings.
+    /// @return If the settings are invalid, then it will return the reason why they are invalid.
+    Error Validate() const;
+};
+
+/// @brief Optimize a function using Separable Natural Evolution Strategies
+///     (SNES).
+///
+/// SNES searches with a diagonal Gaussian distribution, like PGPE, but follows
+/// the *natural* gradient of the expected fitness.  The samples are ranked and
+/// given fixed utility values, and the standard deviations are updated
+/// multiplicatively.  This makes it invariant to the scale of the costs and
+/// means that it has no step size to tune.  See "High Dimensions and Heavy
+/// Tails for Natural Evolution Strategies" (Schaul, Glasmachers and
+/// Schmidhuber, 2011) for the details.
+///
+/// The samples are mirrored, so the number of samples must be even.  Every
+/// parameter is updated independently, so the update is trivially parallel.
+/// @tparam T scalar type
+template <typename T>
+class BasicSnesOptimizer : public IOptimizer<T> {
+public:
+    /// @brief Create a new optimizer with the given settings.
+    /// @param settings optimizer settings
+    /// @return The configured optimizer or an Error instance if the creation
+    ///     failed.
+    static Expected<BasicSnesOptimizer> New(const SnesOptimizerSettings &settings);
+
+    /// @brief Create an optimizer from another one.
+    /// @param other other optimizer
+    BasicSnesOptimizer(const BasicSnesOptimizer &other) = default;
+
+    [[nodiscard]]
+    OptimizerType Type() const override;
+
+    [[nodiscard]]
+    Expected<BasicRowVector<T>> GetEstimate() const override;
+
+    [[nodiscard]]
+    Expected<BasicRowVector<T>> GetSolutionStdDev() const override;
+
+    /// @brief Get the settings used for this optimizer.
+    [[nodiscard]]
+    const SnesOptimizerSettings &GetSettings() const;
+
+    [[nodiscard]]
+    Expected<OptimizerState> GetState() const override;
+
+    Error SetState(const OptimizerState &state) override;
+
+    void SetPrngSeed(DefaultRngType::result_type seed) override;
+
+    void Initialize(ConstBasicRowVectorRef<T> x_init,
+                    std::optional<double> init_stddev = {}) override;
+
+    /// @brief Insert new parameters into the optimizer's solution vector.
+    /// @param index position where the new parameters are inserted
+    /// @param values values of the new parameters
+    /// @param init_stddev initial standard deviation of the new parameters
+    /// @return an error if the optimizer isn't initialized or the index is
+    ///     outside of the solution vector
+    ///
+    /// The new parameters start with, unless provided, the mean of the current
+    /// standard deviations.
+    Error InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                           std::optional<double> init_stddev = {}) override;
+
+    uint32_t NewPopulation() override;
+
+    Error SampleBlock(BasicMatrixRef<T> samples, int first_param, int num_params,
+                      uint32_t population) const override;
+
+    /// @brief Start an update that is computed in parameter blocks.
+    /// @param samples A set of state vector samples.
+    /// @param costs A column vector with the fitness of each sample.
+    /// @return An error if the update could not be started.
+    ///
+    /// This ranks the samples and assigns each one its utility, which is the
+    /// only part of the update that needs every sample.
+    Error BeginUpdate(ConstBasicMatrixRef<T> samples,
+                      ConstBasicColumnVectorRef<T> costs) override;
+
+    Error AccumulateGradients(ConstBasicMatrixRef<T> samples, int first_param,
+                              int num_params) override;
+
+    Error FinishUpdate() override;
+
+private:
+    BasicSnesOptimizer(const SnesOptimizerSettings &settings, DefaultRngType::result_type seed);
+
+    using IOptimizer<T>::CheckInitialized;
+    using IOptimizer<T>::ValidateCosts;
+    using IOptimizer<T>::ValidateMirroredSamples;
+    using IOptimizer<T>::ValidateBlock;
+    using IOptimizer<T>::DrawMirroredSamples;
+    using IOptimizer<T>::InsertValues;
+
+    bool _is_initialized;
+    SnesOptimizerSettings _settings;
+    DefaultRngType::result_type _seed;
+    uint32_t _population;
+
+    BasicRowVector<T> _current_state;
+    BasicRowVector<T> _current_standard_deviation;
+
+    // Workspace for the update so that it doesn't need to allocate.
+    std::vector<int> _ranking;
+    BasicColumnVector<T> _utilities;
+    BasicColumnVector<T> _delta_utility;
+    BasicColumnVector<T> _sum_utility;
+    BasicRowVector<T> _grad_solution;
+    BasicRowVector<T> _grad_stddev;
+    bool _update_pending;
+};
+
+extern template class BasicSnesOptimizer<double>;
+extern template class BasicSnesOptimizer<float>;
+
+/// @brief The default, double precision, SNES optimizer.
+using SnesOptimizer = BasicSnesOptimizer<double>;
+
+}  // namespace abstractions
@@ -0,0 +1,347 @@
+#include "abstractions/cmaes.h"
+
+#include <abstractions/errors.h>
+#include <abstractions/math/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace abstractions {
+
+Error SepCmaEsOptimizerSettings::Validate() const {
+    if (init_stddev <= 0) {
+        return "Initial standard deviation must be greater than zero.";
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Expected<BasicSepCmaEsOptimizer<T>> BasicSepCmaEsOptimizer<T>::New(
+    const SepCmaEsOptimizerSettings &settings) {
+    auto err = settings.Validate();
+    if (err) {
+        return std::unexpected(err);
+    }
+
+    uint64_t seed = 0;
+    if (settings.seed) {
+        seed = *settings.seed;
+    } else {
+        seed = PrngGenerator<>::DrawRandomSeed();
+    }
+
+    return BasicSepCmaEsOptimizer(settings, seed);
+}
+
+template <typename T>
+BasicSepCmaEsOptimizer<T>::BasicSepCmaEsOptimizer(const SepCmaEsOptimizerSettings &settings,
+                                                  DefaultRngType::result_type seed) :
+    _is_initialized{false},
+    _settings{settings},
+    _seed{seed},
+    _population{0},
+    _parameters{},
+    _update_pending{false} {}
+
+template <typename T>
+OptimizerType BasicSepCmaEsOptimizer<T>::Type() const {
+    return OptimizerType::SepCmaEs;
+}
+
+template <typename T>
+Expected<BasicRowVector<T>> BasicSepCmaEsOptimizer<T>::GetEstimate() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<BasicRowVector<T>>(err);
+    }
+
+    return _current_state;
+}
+
+template <typename T>
+Expected<BasicRowVector<T>> BasicSepCmaEsOptimizer<T>::GetSolutionStdDev() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<BasicRowVector<T>>(err);
+    }
+
+    return _current_standard_deviation;
+}
+
+template <typename T>
+const SepCmaEsOptimizerSettings &BasicSepCmaEsOptimizer<T>::GetSettings() const {
+    return _settings;
+}
+
+template <typename T>
+Expected<OptimizerState> BasicSepCmaEsOptimizer<T>::GetState() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<OptimizerState>(err);
+    }
+
+    return OptimizerState{
+        .type = OptimizerType::SepCmaEs,
+        .state = _current_state.template cast<double>(),
+        .standard_deviation = _current_standard_deviation.template cast<double>(),
+        .vectors =
+            {
+                {"stepSizePath", _step_size_path.template cast<double>()},
+                {"covariancePath", _covariance_path.template cast<double>()},
+            },
+        .seed = _seed,
+        .population = _population,
+    };
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::SetState(const OptimizerState &state) {
+    if (state.type != OptimizerType::SepCmaEs) {
+        return fmt::format("Cannot restore a {} optimizer state into a sep-CMA-ES optimizer.",
+                           state.type);
+    }
+
+    auto step_size_path = state.vectors.find("stepSizePath");
+    auto covariance_path = state.vectors.find("covariancePath");
+    if (step_size_path == state.vectors.end() || covariance_path == state.vectors.end()) {
+        return "The optimizer state is missing the sep-CMA-ES evolution paths.";
+    }
+
+    const int num_dim = state.state.cols();
+    if (state.standard_deviation.cols() != num_dim || step_size_path->second.cols() != num_dim ||
+        covariance_path->second.cols() != num_dim) {
+        return fmt::format(
+            "Optimizer state vectors must be the same length (state: {}, stddev: {}, step size "
+            "path: {}, covariance path: {}).",
+            num_dim, state.standard_deviation.cols(), step_size_path->second.cols(),
+            covariance_path->second.cols());
+    }
+
+    _current_state = state.state.cast<T>();
+    _current_standard_deviation = state.standard_deviation.cast<T>();
+    _step_size_path = step_size_path->second.cast<T>();
+    _covariance_path = covariance_path->second.cast<T>();
+    _seed = state.seed;
+    _population = state.population;
+    _is_initialized = true;
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+void BasicSepCmaEsOptimizer<T>::SetPrngSeed(DefaultRngType::result_type seed) {
+    _seed = seed;
+    _population = 0;
+}
+
+template <typename T>
+void BasicSepCmaEsOptimizer<T>::Initialize(ConstBasicRowVectorRef<T> x_init,
+                                           std::optional<double> init_stddev) {
+    const int num_dim = x_init.cols();
+    const T stddev = init_stddev.value_or(_settings.init_stddev);
+
+    _current_state = x_init;
+    _current_standard_deviation = BasicRowVector<T>::Constant(num_dim, stddev);
+    _step_size_path = BasicRowVector<T>::Zero(num_dim);
+    _covariance_path = BasicRowVector<T>::Zero(num_dim);
+    _is_initialized = true;
+    _update_pending = false;
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                                                  std::optional<double> init_stddev) {
+    if (auto err = CheckInitialized(_is_initialized)) {
+        return err;
+    }
+
+    const int num_dim = _current_state.cols();
+    const int num_new = values.cols();
+
+    if (index < 0 || index > num_dim) {
+        return fmt::format("Insertion index {} is outside of the solution vector (length {}).",
+                           index, num_dim);
+    }
+
+    const T stddev = init_stddev.value_or(
+        num_dim > 0 ? _current_standard_deviation.mean() : T(_settings.init_stddev));
+    InsertValues(_current_state, index, values);
+    InsertValues(_current_standard_deviation, index, BasicRowVector<T>::Constant(num_new, stddev));
+    InsertValues(_step_size_path, index, BasicRowVector<T>::Zero(num_new));
+    InsertValues(_covariance_path, index, BasicRowVector<T>::Zero(num_new));
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+uint32_t BasicSepCmaEsOptimizer<T>::NewPopulation() {
+    return _population++;
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::SampleBlock(BasicMatrixRef<T> samples, int first_param,
+                                             int num_params, uint32_t population) const {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateSamples(samples, _current_state.cols()),
+                                 ValidateBlock(samples, first_param, num_params)});
+    if (err) {
+        return err;
+    }
+
+    // Every parameter draws its whole column from its own noise stream.  The
+    // covariance is diagonal, so "x = m + sigma * sqrt(C) * z" is just a
+    // per-parameter scale and offset.
+    for (int i = first_param; i < first_param + num_params; i++) {
+        DrawNoise(samples, i, samples.rows(), _seed, population);
+
+        auto column = samples.col(i);
+        column.array() = _current_state(i) + _current_standard_deviation(i) * column.array();
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::BeginUpdate(ConstBasicMatrixRef<T> samples,
+                                             ConstBasicColumnVectorRef<T> costs) {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateSamples(samples, _current_state.cols()),
+                                 ValidateCosts(samples.rows(), costs)});
+
+    if (err) {
+        return err;
+    }
+
+    const int num_samples = samples.rows();
+    const int num_parents = num_samples / 2;
+    const int num_params = samples.cols();
+
+    _ranking.resize(num_samples);
+    _weights.resize(num_samples);
+    _mean_shift.resize(num_params);
+    _weighted_variance.resize(num_params);
+
+    // Rank the samples, best (largest fitness) first.  Only the best half are
+    // recombined, with log-linearly decreasing weights that sum to one.
+    std::iota(std::begin(_ranking), std::end(_ranking), 0);
+    std::stable_sort(std::begin(_ranking), std::end(_ranking),
+                     [&costs](const int &a, const int &b) { return costs(a) > costs(b); });
+
+    _weights.setZero();
+    double total_weight = 0;
+    for (int i = 0; i < num_parents; i++) {
+        const double weight = std::log(num_parents + 0.5) - std::log(i + 1.0);
+        _weights(_ranking[i]) = weight;
+        total_weight += weight;
+    }
+    _weights /= T(total_weight);
+
+    // The default strategy parameters from "The CMA Evolution Strategy: A
+    // Tutorial" (Hansen, 2016).  The covariance learning rates are scaled up
+    // by "(n + 2) / 3" since there are only 'n' covariance values to learn.
+    const double n = num_params;
+    const double mu_eff = 1 / _weights.template cast<double>().squaredNorm();
+    const double c_sigma = (mu_eff + 2) / (n + mu_eff + 5);
+    const double c_1 = 2 / ((n + 1.3) * (n + 1.3) + mu_eff);
+    const double c_mu = 2 * (mu_eff - 2 + 1 / mu_eff) / ((n + 2) * (n + 2) + mu_eff);
+    const double sep_scale = (n + 2) / 3;
+
+    _parameters = Parameters{
+        .mu_eff = mu_eff,
+        .c_sigma = c_sigma,
+        .d_sigma = 1 + 2 * std::max(0.0, std::sqrt((mu_eff - 1) / (n + 1)) - 1) + c_sigma,
+        .c_c = (4 + mu_eff / n) / (n + 4 + 2 * mu_eff / n),
+        .c_1 = std::min(1.0, sep_scale * c_1),
+        .c_mu = std::min(1 - std::min(1.0, sep_scale * c_1), sep_scale * c_mu),
+        .chi_n = std::sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n)),
+    };
+
+    _update_pending = true;
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::AccumulateGradients(ConstBasicMatrixRef<T> samples,
+                                                     int first_param, int num_params) {
+    if (!_update_pending) {
+        return "Cannot accumulate gradients; no update is in progress.";
+    }
+
+    if (first_param < 0 || num_params < 0 || first_param + num_params > _mean_shift.cols()) {
+        return fmt::format("Parameter block [{}, {}) is outside of the {} updated parameters.",
+                           first_param, first_param + num_params, _mean_shift.cols());
+    }
+
+    // The weights sum to one, so the recombined mean is the current mean plus
+    // the weighted sum of each sample's offset.  The same offsets give the
+    // rank-mu covariance update.
+    for (int i = first_param; i < first_param + num_params; i++) {
+        const auto offsets = samples.col(i).array() - _current_state(i);
+        _mean_shift(i) = (_weights.array() * offsets).sum();
+        _weighted_variance(i) = (_weights.array() * offsets.square()).sum();
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSepCmaEsOptimizer<T>::FinishUpdate() {
+    if (!_update_pending) {
+        return "Cannot finish the update; no update is in progress.";
+    }
+    _update_pending = false;
+
+    const auto &p = _parameters;
+    const int num_params = _current_state.cols();
+    const int generation = std::max<uint32_t>(_population, 1);
+
+    // Update the step size path.  With a diagonal covariance, "C^(-1/2) / sigma"
+    // is an element-wise division by the standard deviations.
+    _step_size_path = T(1 - p.c_sigma) * _step_size_path +
+                      T(std::sqrt(p.c_sigma * (2 - p.c_sigma) * p.mu_eff)) *
+                          _mean_shift.cwiseQuotient(_current_standard_deviation);
+
+    // Stall the covariance path if the step size path is too long, which
+    // prevents the covariance from growing too quickly when the step size is
+    // increasing.
+    const double path_norm = _step_size_path.template cast<double>().norm();
+    const double path_scale = std::sqrt(1 - std::pow(1 - p.c_sigma, 2 * generation));
+    const double h_sigma =
+        path_norm / path_scale < (1.4 + 2 / (num_params + 1.0)) * p.chi_n ? 1.0 : 0.0;
+
+    // The covariance path is kept in units of the parameters (i.e. multiplied
+    // by the global step size), so it can be combined directly with the
+    // variances.
+    _covariance_path = T(1 - p.c_c) * _covariance_path +
+                       T(h_sigma * std::sqrt(p.c_c * (2 - p.c_c) * p.mu_eff)) * _mean_shift;
+
+    // Update the variances and then apply the step size change to both the
+    // standard deviations and the covariance path.  The change is capped to
+    // avoid any instabilities early on.
+    const double decay = 1 - p.c_1 - p.c_mu + (1 - h_sigma) * p.c_1 * p.c_c * (2 - p.c_c);
+    const T step_change =
+        std::exp(std::min(1.0, (p.c_sigma / p.d_sigma) * (path_norm / p.chi_n - 1)));
+
+    _current_standard_deviation =
+        (step_change * (T(decay) * _current_standard_deviation.cwiseAbs2() +
+                        T(p.c_1) * _covariance_path.cwiseAbs2() + T(p.c_mu) * _weighted_variance)
+                           .cwiseSqrt())
+            .cwiseMax(T(1e-9));
+    _covariance_path *= step_change;
+    _current_state += _mean_shift;
+
+    return errors::no_error;
+}
+
+template class BasicSepCmaEsOptimizer<double>;
+template class BasicSepCmaEsOptimizer<float>;
+
+}  // namespace abstractions
@@ -1,11 +1,22 @@
 #include "abstractions/engine.h"
 
+#include <abstractions/cmaes.h>
+#include <abstractions/math/matrices.h>
 #include <abstractions/profile.h>
 #include <abstractions/render/renderer.h>
+#include <abstractions/snes.h>
 #include <abstractions/threads/threadpool.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <utility>
 #include <vector>
 
 #include "json.h"
@@ -14,6 +25,543 @@ namespace abstractions {
 
 namespace {
 
+/// @brief The smallest allowable side length for a level in the reference
+///     image pyramid.
+constexpr int kMinPyramidSize = 16;
+
+/// @brief The relative improvement in cost needed for the engine to consider
+///     that progress is still being made at a particular pyramid level.
+constexpr double kPyramidStallTolerance = 1e-3;
+
+/// @brief The exponential smoothing applied to the per-iteration
+///     signal-to-noise estimates, which are very noisy for small populations.
+constexpr double kPopulationSnrSmoothing = 0.9;
+
+/// @brief The smallest relative signal-to-noise ratio used when picking the
+///     adaptive population's size, which keeps the target population finite.
+constexpr double kPopulationMinSnr = 1e-3;
+
+/// @brief How far the adaptive population's target must be from the current
+///     population before it doubles or halves.  Anything less than two leaves
+///     a band where the population doesn't change, which stops it from
+///     oscillating between two sizes.
+constexpr double kPopulationChangeRatio = 1.5;
+
+/// @brief The counter-based PRNG stream used for the initial shapes.  The
+///     optimizer's samples use IOptimizer::kPrngStream and the sample reuse
+///     uses IOptimizer::kMixingPrngStream.
+constexpr uint32_t kShapeStream = IOptimizer<double>::kPrngStream + 1;
+
+/// @brief The counter-based PRNG stream used for the renderer seeds.
+constexpr uint32_t kRendererStream = IOptimizer<double>::kPrngStream + 2;
+
+/// @brief The counter-based PRNG stream used to pick the shapes in a block.
+constexpr uint32_t kBlockStream = IOptimizer<double>::kMixingPrngStream + 1;
+
+/// @brief The smallest weight, relative to the mean score, that error-guided
+///     block selection gives to a shape.
+constexpr double kBlockMinWeight = 0.1;
+
+/// @brief Build a multi-resolution pyramid from a reference image.
+/// @param reference full resolution reference image
+/// @param num_levels maximum number of pyramid levels
+/// @return the pyramid levels, with the first one being the full resolution
+///     image, or an error if the image could not be scaled
+///
+/// Each level is half the size of the one before it.  The pyramid may end up
+/// with fewer levels than requested if the image becomes too small.
+Expected<std::vector<Image>> BuildReferencePyramid(const Image &reference, int num_levels) {
+    std::vector<Image> pyramid{reference};
+    for (int i = 1; i < num_levels; i++) {
+        const Image &previous = pyramid.back();
+        if (std::min(previous.Width(), previous.Height()) / 2 < kMinPyramidSize) {
+            break;
+        }
+
+        Image level = previous;
+        if (auto err = level.ScaleToFit(std::max(previous.Width(), previous.Height()) / 2)) {
+            return errors::report<std::vector<Image>>(err);
+        }
+        pyramid.push_back(level);
+    }
+    return pyramid;
+}
+
+/// @brief Get the seeds for a set of per-sample renderers.
+/// @param seed the engine's base seed
+/// @param level the pyramid level the renderers are for
+/// @param num_renderers number of renderers
+/// @return the renderer seeds
+///
+/// Each seed is keyed by the pyramid level and the sample index, so the
+/// renderers for any level can be recreated without knowing the history of
+/// the optimization.
+std::vector<DefaultRngType::result_type> RendererSeeds(DefaultRngType::result_type seed, int level,
+                                                       int num_renderers) {
+    std::vector<DefaultRngType::result_type> seeds;
+    for (int i = 0; i < num_renderers; i++) {
+        seeds.push_back(CounterSeed(seed, level, i, kRendererStream));
+    }
+    return seeds;
+}
+
+/// @brief Get the number of threads each render should use.
+/// @param num_workers number of available worker threads
+/// @param num_renders number of renders that run at the same time
+/// @return the number of threads for each render, or `0` if each render
+///     should run on the worker that it was submitted to
+///
+/// The renders normally run one per worker.  When there are fewer renders
+/// than workers, the idle workers' share is given to Blend2D so that each
+/// render is split across several threads instead.
+int RenderThreadCount(int num_workers, int num_renders) {
+    if (num_renders <= 0 || num_renders >= num_workers) {
+        return 0;
+    }
+
+    const int num_threads = num_workers / num_renders;
+    return num_threads > 1 ? num_threads : 0;
+}
+
+/// @brief Create the set of per-sample renderers for a reference image.
+/// @param reference image the renderers are compared against
+/// @param seeds the seeds for each renderer's PRNG
+/// @param alpha_scale alpha scaling applied to each renderer
+/// @param mapping coordinate mapping used by each renderer
+/// @param quality render quality used by each renderer
+/// @return the renderers or an error if they could not be created
+///
+/// The renderers use a random background to avoid biasing blank areas.  They
+/// also skip the shapes hidden under opaque shapes, which are common once the
+/// optimization has run for a while.
+Expected<std::vector<render::Renderer>> CreateRenderers(
+    const Image &reference, const std::vector<DefaultRngType::result_type> &seeds,
+    double alpha_scale, render::CoordinateMapping mapping, render::RenderQuality quality) {
+    std::vector<render::Renderer> renderers;
+    for (const auto seed : seeds) {
+        auto renderer =
+            render::Renderer::Create(reference.Width(), reference.Height(), Prng<>(seed));
+
+        if (!renderer.has_value()) {
+            return errors::report<std::vector<render::Renderer>>(renderer.error());
+        }
+        renderer->SetAlphaScale(alpha_scale);
+        renderer->SetCoordinateMapping(mapping);
+        renderer->UseRandomBackgroundFill(true);
+        renderer->SetQuality(quality);
+        renderer->SetOcclusionCulling(true);
+        renderers.push_back(*renderer);
+    }
+    return renderers;
+}
+
+/// @brief The number of cells, along each side of the image, used when looking
+///     for regions with a high residual error.
+constexpr int kResidualGridSize = 8;
+
+/// @brief The initial alpha value given to shapes added by the shape curriculum.
+constexpr double kGrownShapeAlpha = 0.75;
+
+/// @brief A region in the reference image that is poorly represented by the
+///     current solution.
+struct ResidualRegion {
+    /// @brief Normalized x-coordinate of the region's centre.
+    double x;
+
+    /// @brief Normalized y-coordinate of the region's centre.
+    double y;
+
+    /// @brief Normalized size of the region.
+    double size;
+
+    /// @brief Mean colour of the reference image within the region.
+    double red, green, blue;
+
+    /// @brief The region's total squared error.
+    double error;
+};
+
+/// @brief Find the regions where a rendered image differs the most from the
+///     reference image.
+/// @param reference reference image
+/// @param rendered rendered solution; must be the same size as the reference
+/// @param num_regions number of regions to return
+/// @return the regions, sorted from highest to lowest error
+///
+/// The image is split into a coarse grid and each cell is scored by its total
+/// squared error.  Regions are reused, starting with the worst one, if more
+/// regions are requested than there are cells.
+std::vector<ResidualRegion> FindResidualRegions(const Image &reference, const Image &rendered,
+                                                int num_regions) {
+    const int width = reference.Width();
+    const int height = reference.Height();
+
+    std::vector<ResidualRegion> cells;
+    for (int cy = 0; cy < kResidualGridSize; cy++) {
+        for (int cx = 0; cx < kResidualGridSize; cx++) {
+            cells.push_back(ResidualRegion{
+                .x = (cx + 0.5) / kResidualGridSize,
+                .y = (cy + 0.5) / kResidualGridSize,
+                .size = 1.0 / kResidualGridSize,
+                .red = 0,
+                .green = 0,
+                .blue = 0,
+                .error = 0,
+            });
+        }
+    }
+
+    std::vector<int> counts(cells.size(), 0);
+    PixelData ref_pixels = reference.Pixels();
+    PixelData tgt_pixels = rendered.Pixels();
+
+    for (int y = 0; y < height; y++) {
+        const int cy = std::min(kResidualGridSize - 1, y * kResidualGridSize / height);
+        auto row_ref = ref_pixels.Row(y);
+        auto row_tgt = tgt_pixels.Row(y);
+
+        for (int x = 0; x < width; x++) {
+            const int cx = std::min(kResidualGridSize - 1, x * kResidualGridSize / width);
+            const int index = cy * kResidualGridSize + cx;
+
+            Pixel ref(row_ref[x]);
+            Pixel tgt(row_tgt[x]);
+
+            const double dr = (ref.Red() - tgt.Red()) / 255.0;
+            const double dg = (ref.Green() - tgt.Green()) / 255.0;
+            const double db = (ref.Blue() - tgt.Blue()) / 255.0;
+
+            auto &cell = cells[index];
+            cell.error += dr * dr + dg * dg + db * db;
+            cell.red += ref.Red() / 255.0;
+            cell.green += ref.Green() / 255.0;
+            cell.blue += ref.Blue() / 255.0;
+            counts[index]++;
+        }
+    }
+
+    for (int i = 0; i < static_cast<int>(cells.size()); i++) {
+        const int count = std::max(1, counts[i]);
+        cells[i].red /= count;
+        cells[i].green /= count;
+        cells[i].blue /= count;
+    }
+
+    std::stable_sort(std::begin(cells), std::end(cells),
+                     [](const auto &a, const auto &b) { return a.error > b.error; });
+
+    std::vector<ResidualRegion> regions;
+    for (int i = 0; i < num_regions; i++) {
+        regions.push_back(cells[i % cells.size()]);
+    }
+
+    return regions;
+}
+
+/// @brief Create the parameters for new shapes that cover a set of regions.
+/// @tparam Traits ShapeTraits of the shapes being created
+/// @param existing the existing shapes of that type
+/// @param regions regions the new shapes should cover
+/// @param mapping how the shape coordinates are mapped onto the image
+/// @return the new shapes' packed parameters
+///
+/// The rescaled mapping uses the minimum and maximum values of each
+/// coordinate.  The new shapes are placed within the range of the existing
+/// ones so that the rescaling maps them onto the requested region without
+/// moving any of the existing shapes.  The other mappings are just inverted.
+template <typename Traits>
+RowVector CreateShapesForRegions(const typename Traits::Collection &existing,
+                                 const std::vector<ResidualRegion> &regions,
+                                 render::CoordinateMapping mapping) {
+    using Collection = typename Traits::Collection;
+
+    const RowVector min_values = existing.Params.colwise().minCoeff();
+    const RowVector max_values = existing.Params.colwise().maxCoeff();
+
+    // Inverse of the canvas' '1.2 * x - 0.1' remapping.
+    auto to_parameter = [&](int col, double value) {
+        if (mapping != render::CoordinateMapping::Rescaled) {
+            return render::UnmapCoordinate(value, mapping);
+        }
+
+        const double range = max_values(col) - min_values(col);
+        const double normalized = (value + 0.1) / 1.2;
+        return min_values(col) + normalized * (range > 0 ? range : 1.0);
+    };
+
+    Collection created(static_cast<int>(regions.size()));
+    for (int i = 0; i < created.NumShapes(); i++) {
+        const auto &region = regions[i];
+        const auto shape = Traits::InscribedInSquare(region.x, region.y, region.size / 2);
+
+        // Only the coordinates are mapped onto the frame; any sizes are used
+        // as-is.
+        for (int j = 0; j < Collection::ShapeDimensions; j++) {
+            created.Params(i, j) = j < Traits::CoordinateDimensions ? to_parameter(j, shape[j])
+                                                                     : shape[j];
+        }
+
+        created.ColourValues().row(i) << region.red, region.green, region.blue,
+            kGrownShapeAlpha;
+    }
+
+    return created.AsVector().transpose();
+}
+
+/// @brief Add new shapes to the optimizer's solution.
+/// @param shapes shapes used in the solution
+/// @param optimizer optimizer being grown
+/// @param regions regions where the new shapes are placed; one new shape is
+///     added to each shape type for every region
+/// @param mapping how the shape coordinates are mapped onto the image
+/// @return an error if the optimizer could not be grown
+///
+/// The packed vector stores each shape type in its own block, so the new
+/// shapes are appended to the end of each block.  This is done in reverse
+/// order so that the earlier blocks' offsets remain valid.
+template <typename T>
+Error GrowSolution(Options<render::AbstractionShape> shapes, IOptimizer<T> &optimizer,
+                   const std::vector<ResidualRegion> &regions, render::CoordinateMapping mapping) {
+    auto estimate = optimizer.GetEstimate();
+    if (!estimate.has_value()) {
+        return estimate.error();
+    }
+
+    render::PackedShapeCollection current(shapes, estimate->template cast<double>());
+    std::vector<std::pair<int, RowVector>> insertions;
+    int block_end = 0;
+    current.ForEachCollection([&]<typename Traits>(Traits, const auto &collection) {
+        block_end += collection.Params.size();
+        if (shapes & Traits::Shape) {
+            auto params = CreateShapesForRegions<Traits>(collection, regions, mapping);
+            insertions.emplace_back(block_end, std::move(params));
+        }
+    });
+
+    for (auto it = insertions.rbegin(); it != insertions.rend(); ++it) {
+        if (auto err = optimizer.InsertParameters(it->first, it->second.cast<T>())) {
+            return err;
+        }
+    }
+
+    return errors::no_error;
+}
+
+/// @brief Render a solution and find the regions where it differs the most
+///     from the reference image.
+/// @param reference reference image
+/// @param shapes shapes stored in the solution
+/// @param solution packed solution vector
+/// @param alpha_scale alpha scaling applied to the shapes
+/// @param mapping how the shape coordinates are mapped onto the image
+/// @param num_regions number of regions to return
+/// @return the regions, sorted from highest to lowest error, or an error if
+///     the solution could not be rendered
+Expected<std::vector<ResidualRegion>> FindSolutionResiduals(
+    const Image &reference, Options<render::AbstractionShape> shapes, ConstRowVectorRef solution,
+    double alpha_scale, render::CoordinateMapping mapping, int num_regions) {
+    auto renderer = render::Renderer::Create(reference.Width(), reference.Height());
+    if (!renderer.has_value()) {
+        return errors::report<std::vector<ResidualRegion>>(renderer.error());
+    }
+    renderer->SetAlphaScale(alpha_scale);
+    renderer->SetCoordinateMapping(mapping);
+    renderer->SetBackground(0, 0, 0);
+    renderer->Render(render::PackedShapeCollection(shapes, solution));
+
+    return FindResidualRegions(reference, renderer->DrawingSurface(), num_regions);
+}
+
+/// @brief Score every shape by the residual error at its centre.
+/// @param shapes shapes stored in the solution
+/// @param solution packed solution vector
+/// @param residuals the residual error of every cell in the residual grid
+/// @param mapping how the shape coordinates are mapped onto the image
+/// @return the score of each shape index, summed over the shape types
+///
+/// The shape coordinates are mapped onto the image the same way the Canvas
+/// does, so a shape's centre is the mean of its mapped vertices (or its
+/// centre, for circles).
+std::vector<double> ScoreShapes(Options<render::AbstractionShape> shapes,
+                                ConstRowVectorRef solution,
+                                const std::vector<ResidualRegion> &residuals,
+                                render::CoordinateMapping mapping) {
+    std::vector<double> grid(kResidualGridSize * kResidualGridSize, 0);
+    auto to_cell = [](double value) {
+        const int cell = std::isfinite(value) ? static_cast<int>(value * kResidualGridSize) : 0;
+        return std::clamp(cell, 0, kResidualGridSize - 1);
+    };
+    for (const auto &region : residuals) {
+        grid[to_cell(region.y) * kResidualGridSize + to_cell(region.x)] = region.error;
+    }
+
+    render::PackedShapeCollection packed(shapes, solution);
+    std::vector<double> scores(packed.CollectionSize(), 0);
+    auto score = [&](ConstMatrixRef params, int num_coords) {
+        if (params.rows() == 0) {
+            return;
+        }
+
+        const Matrix coords = render::MapCoordinates(params.leftCols(num_coords), mapping);
+        for (int k = 0; k < coords.rows(); k++) {
+            double x = 0;
+            double y = 0;
+            for (int c = 0; c < num_coords; c += 2) {
+                x += coords(k, c);
+                y += coords(k, c + 1);
+            }
+            x /= num_coords / 2;
+            y /= num_coords / 2;
+            scores[k] += grid[to_cell(y) * kResidualGridSize + to_cell(x)];
+        }
+    };
+
+    packed.ForEachCollection([&]<typename Traits>(Traits, const auto &collection) {
+        score(collection.Params, Traits::CoordinateDimensions);
+    });
+    return scores;
+}
+
+/// @brief Pick the shapes perturbed during a block-coordinate iteration.
+/// @param selection how the shapes are picked
+/// @param iteration current iteration
+/// @param num_shapes number of shapes, per shape type, in the solution
+/// @param block_size number of shapes, per shape type, to pick
+/// @param seed the engine's base seed
+/// @param scores per-shape scores used by error-guided selection
+/// @return the picked shape indices, in increasing order
+///
+/// The random selections draw from their own counter-based stream, keyed by
+/// the iteration, so the same block is picked regardless of how the
+/// optimization got there.
+std::vector<int> SelectShapeBlock(BlockSelection selection, int iteration, int num_shapes,
+                                  int block_size, DefaultRngType::result_type seed,
+                                  const std::vector<double> &scores) {
+    std::vector<int> block;
+    if (selection == BlockSelection::RoundRobin) {
+        const int start = static_cast<int>((static_cast<int64_t>(iteration) * block_size) %
+                                           num_shapes);
+        for (int k = 0; k < block_size; k++) {
+            block.push_back((start + k) % num_shapes);
+        }
+        std::sort(block.begin(), block.end());
+        return block;
+    }
+
+    // Both random selections sample without replacement by giving every shape
+    // a random key and keeping the largest ones.  The error-guided keys are
+    // 'log(u) / w', which picks shapes in proportion to their weight 'w'
+    // (Efraimidis and Spirakis, 2006).  Every shape keeps a small weight so
+    // that none of them are starved.
+    Philox4x32 generator(seed, iteration, 0, kBlockStream);
+    StandardUniform uniform;
+
+    double mean_score = 0;
+    if (selection == BlockSelection::ErrorGuided) {
+        mean_score = std::accumulate(scores.begin(), scores.end(), 0.0) / num_shapes;
+    }
+
+    std::vector<std::pair<double, int>> keys;
+    for (int k = 0; k < num_shapes; k++) {
+        const double u = uniform(generator);
+        double key = u;
+        if (selection == BlockSelection::ErrorGuided) {
+            const double weight = scores[k] + kBlockMinWeight * mean_score +
+                                  std::numeric_limits<double>::min();
+            key = std::log(u) / weight;
+        }
+        keys.emplace_back(key, k);
+    }
+
+    std::partial_sort(keys.begin(), keys.begin() + block_size, keys.end(),
+                      [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (int k = 0; k < block_size; k++) {
+        block.push_back(keys[k].second);
+    }
+    std::sort(block.begin(), block.end());
+    return block;
+}
+
+/// @brief Get the packed parameter indices of a block of shapes.
+/// @param shapes shapes stored in the solution
+/// @param num_shapes number of shapes, per shape type, in the solution
+/// @param block shape indices, in increasing order
+/// @return the parameter indices, in increasing order
+///
+/// Each shape type is stored as a contiguous collection, one shape after
+/// another, so every shape in the block covers a contiguous range of
+/// parameters within each collection.
+std::vector<int> ShapeBlockParameters(Options<render::AbstractionShape> shapes, int num_shapes,
+                                      const std::vector<int> &block) {
+    std::vector<int> params;
+    int offset = 0;
+    render::ForEachShapeType([&]<typename Traits>(Traits) {
+        constexpr int num_dims = Traits::Collection::TotalDimensions;
+        if (!(shapes & Traits::Shape)) {
+            return;
+        }
+
+        for (int k : block) {
+            for (int d = 0; d < num_dims; d++) {
+                params.push_back(offset + k * num_dims + d);
+            }
+        }
+        offset += num_shapes * num_dims;
+    });
+    return params;
+}
+
+/// @brief Get the packed parameter indices of every shape's colour.
+/// @param shapes shapes stored in the solution
+/// @param num_shapes number of shapes, per shape type, in the solution
+/// @return the parameter indices, in increasing order
+std::vector<int> ColourParameters(Options<render::AbstractionShape> shapes, int num_shapes) {
+    std::vector<int> params;
+    int offset = 0;
+    render::ForEachShapeType([&]<typename Traits>(Traits) {
+        constexpr int num_dims = Traits::Collection::TotalDimensions;
+        if (!(shapes & Traits::Shape)) {
+            return;
+        }
+
+        for (int k = 0; k < num_shapes; k++) {
+            for (int d = num_dims - 4; d < num_dims; d++) {
+                params.push_back(offset + k * num_dims + d);
+            }
+        }
+        offset += num_shapes * num_dims;
+    });
+    return params;
+}
+
+/// @brief Find the parameters handled by one of the parallel sampling or
+///     update jobs.
+/// @param index job index
+/// @param num_blocks number of jobs
+/// @param num_params number of parameters in the solution
+/// @param active the active parameters, or empty if every parameter is active
+/// @return the first parameter in the block and the number of parameters
+///
+/// The active parameters are split evenly between the jobs.  A job's block
+/// spans from its first to its last active parameter, so the blocks never
+/// overlap.
+std::pair<int, int> ParameterBlock(int index, int num_blocks, int num_params,
+                                   const std::vector<int> &active) {
+    if (active.empty()) {
+        const int first = index * num_params / num_blocks;
+        const int last = (index + 1) * num_params / num_blocks;
+        return {first, last - first};
+    }
+
+    const int num_active = active.size();
+    const int begin = index * num_active / num_blocks;
+    const int end = (index + 1) * num_active / num_blocks;
+    if (begin == end) {
+        return {0, 0};
+    }
+    return {active[begin], active[end - 1] + 1 - active[begin]};
+}
+
 /// @brief Compute the comparison costs.
 /// @param metric comparison metric
 /// @param ref reference image
@@ -30,70 +578,325 @@ Expected<double> ComputeCost(ImageComparison metric, const Image &ref, const Ima
     return errors::report<double>("Unknown comparison metric.");
 }
 
-/// @brief Contains the optimizer along with everything it needs to perform
-///     the "sample" and "optimize" operations.
+/// @brief Compute the comparison cost of a single tile.
+/// @param metric comparison metric
+/// @param ref reference image
+/// @param tile rendered tile
+/// @param x horizontal position of the tile within the reference
+/// @param y vertical position of the tile within the reference
+/// @return the tile's share of the full image's cost, or an error if
+///     something went wrong
+///
+/// Both metrics are the mean over every pixel, so the tile costs of an image
+/// add up to its full cost.
+Expected<double> ComputeTileCost(ImageComparison metric, const Image &ref, const Image &tile,
+                                 int x, int y) {
+    const double area = static_cast<double>(tile.Width()) * tile.Height();
+    const double weight = area / (static_cast<double>(ref.Width()) * ref.Height());
+    auto weighted = [weight](Expected<double> cost) -> Expected<double> {
+        if (!cost.has_value()) {
+            return cost;
+        }
+        return weight * *cost;
+    };
+
+    switch (metric) {
+        case ImageComparison::L1Norm:
+            return weighted(CompareImageRegionAbsDiff(ref, tile, x, y));
+        case ImageComparison::L2Norm:
+            return weighted(CompareImageRegionSquaredDiff(ref, tile, x, y));
+    }
+
+    return errors::report<double>("Unknown comparison metric.");
+}
+
+/// @brief Compute the comparison cost of a composite.
+/// @param metric comparison metric
+/// @param ref reference image, as colour planes
+/// @param composite composite being compared to the reference
+/// @return the cost, or an error if something went wrong
+///
+/// The cost is the same as the one ComputeCost() would give for the
+/// equivalent images, minus the rounding to 8-bit channels.
+Expected<double> ComputeCompositeCost(ImageComparison metric, const render::ColourPlanes &ref,
+                                      const render::ColourPlanes &composite) {
+    if (ref.rows() != composite.rows() || ref.rows() == 0) {
+        return errors::report<double>(
+            fmt::format("Cannot compare a composite with {} pixels to a reference with {}.",
+                        composite.rows(), ref.rows()));
+    }
+
+    const auto diff = (ref - composite).template cast<double>();
+    switch (metric) {
+        case ImageComparison::L1Norm:
+            return diff.abs().sum() / ref.rows();
+        case ImageComparison::L2Norm:
+            return diff.square().sum() / ref.rows();
+    }
+
+    return errors::report<double>("Unknown comparison metric.");
+}
+
+/// @brief Estimate the signal-to-noise ratio of the gradient implied by a
+///     population of samples.
+/// @param samples population of samples; row `k` is paired with row `k + n/2`
+/// @param fitness the fitness of each sample
+/// @param gradient workspace for the mean gradient
+/// @return the ratio between the squared gradient norm and the variance of
+///     its estimate
+///
+/// Each pair of samples gives a finite-difference estimate of the gradient,
+/// `(f_k - f_k') (x_k - x_k')`, which is exact for the mirrored samples and
+/// still unbiased for independent ones.  The ratio compares the squared norm
+/// of the mean estimate, corrected for its own noise, with the variance of
+/// that mean, so it grows linearly with the number of samples.
+///
+/// Even a noiseless, linear objective only has a ratio of about
+/// `n_pairs / (n_params + 1)` since each pair only probes one random
+/// direction.  Anything below that is caused by noise in the costs.
+template <typename T>
+double GradientSnr(ConstBasicMatrixRef<T> samples, ConstBasicColumnVectorRef<T> fitness,
+                   BasicRowVector<T> &gradient) {
+    const int num_pairs = samples.rows() / 2;
+    if (num_pairs < 2) {
+        return 0;
+    }
+
+    const auto top = samples.topRows(num_pairs);
+    const auto bottom = samples.bottomRows(num_pairs);
+    const auto diff = fitness.head(num_pairs) - fitness.tail(num_pairs);
+
+    gradient.noalias() = diff.transpose() * top;
+    gradient.noalias() -= diff.transpose() * bottom;
+
+    const double mean_norm = gradient.template cast<double>().squaredNorm() /
+                             (static_cast<double>(num_pairs) * num_pairs);
+    const double second_moment =
+        (diff.array().square() * (top - bottom).rowwise().squaredNorm().array())
+            .template cast<double>()
+            .sum() /
+        num_pairs;
+
+    const double mean_variance = (second_moment - mean_norm) / (num_pairs - 1);
+    if (mean_variance <= 0) {
+        return mean_norm > 0 ? std::numeric_limits<double>::infinity() : 0;
+    }
+
+    return std::max(0.0, mean_norm - mean_variance) / mean_variance;
+}
+
+/// @brief Create one of the engine's optimizers.
+/// @param type the optimization algorithm
+/// @param pgpe_settings settings for the PGPE optimizer
+/// @param seed the optimizer's PRNG seed
+/// @return the new optimizer or an error if it could not be created
+template <typename T>
+Expected<std::unique_ptr<IOptimizer<T>>> CreateOptimizer(OptimizerType type,
+                                                         const PgpeOptimizerSettings &pgpe_settings,
+                                                         DefaultRngType::result_type seed) {
+    std::unique_ptr<IOptimizer<T>> optimizer;
+    Error err;
+
+    switch (type) {
+        case OptimizerType::Pgpe: {
+            auto pgpe = BasicPgpeOptimizer<T>::New(pgpe_settings);
+            if (pgpe.has_value()) {
+                optimizer = std::make_unique<BasicPgpeOptimizer<T>>(*pgpe);
+            } else {
+                err = pgpe.error();
+            }
+            break;
+        }
+        case OptimizerType::Snes: {
+            auto snes = BasicSnesOptimizer<T>::New(SnesOptimizerSettings());
+            if (snes.has_value()) {
+                optimizer = std::make_unique<BasicSnesOptimizer<T>>(*snes);
+            } else {
+                err = snes.error();
+            }
+            break;
+        }
+        case OptimizerType::SepCmaEs: {
+            auto cmaes = BasicSepCmaEsOptimizer<T>::New(SepCmaEsOptimizerSettings());
+            if (cmaes.has_value()) {
+                optimizer = std::make_unique<BasicSepCmaEsOptimizer<T>>(*cmaes);
+            } else {
+                err = cmaes.error();
+            }
+            break;
+        }
+    }
+
+    if (err) {
+        return errors::report<std::unique_ptr<IOptimizer<T>>>(err);
+    }
+
+    if (!optimizer) {
+        return errors::report<std::unique_ptr<IOptimizer<T>>>("Unknown optimizer type.");
+    }
+
+    optimizer->SetPrngSeed(seed);
+    return optimizer;
+}
+
+/// @brief Contains the optimizer along with everything it needs to update
+///     one block of its parameters.
+template <typename T>
 struct OptimizerPayload {
-    std::reference_wrapper<PgpeOptimizer> optimizer;
-    MatrixRef samples;
-    ColumnVectorRef costs;
+    std::reference_wrapper<IOptimizer<T>> optimizer;
+    std::reference_wrapper<BasicMatrix<T>> samples;
+    std::reference_wrapper<const std::vector<int>> active_params;
+    int num_samples;
+    int num_blocks;
+};
+
+/// @brief Contains everything needed to generate one block of a population of
+///     samples.
+template <typename T>
+struct SamplePayload {
+    std::reference_wrapper<const IOptimizer<T>> optimizer;
+    std::reference_wrapper<BasicMatrix<T>> samples;
+    std::reference_wrapper<const std::vector<int>> active_params;
+    int num_samples;
+    uint32_t population;
+    int num_blocks;
 };
 
 /// @brief Contains everything needed to render a single image and compute the
 ///     matching cost.
+template <typename T>
 struct RenderPayload {
     std::reference_wrapper<const Image> reference;
     std::vector<render::Renderer> renderers;
-    MatrixRef samples;
-    ColumnVectorRef costs;
+    std::reference_wrapper<BasicMatrix<T>> samples;
+    std::reference_wrapper<BasicColumnVector<T>> costs;
+    std::reference_wrapper<std::vector<render::CullStatistics>> culling;
     const Options<render::AbstractionShape> shapes;
     const ImageComparison comparison_metric;
+
+    // The shapes, per shape type, perturbed during the current iteration.  It's
+    // empty when every shape is perturbed.  All of the other shapes are the
+    // same in every sample.
+    std::reference_wrapper<const std::vector<int>> active_shapes;
+};
+
+/// @brief Contains everything needed to render the samples in tiles and
+///     compute the per-tile costs.
+template <typename T>
+struct TilePayload {
+    std::reference_wrapper<const Image> reference;
+    std::reference_wrapper<const std::vector<render::Renderer>> renderers;
+    std::reference_wrapper<BasicMatrix<T>> samples;
+    std::reference_wrapper<std::vector<std::optional<render::TiledShapes>>> tiles;
+    std::reference_wrapper<Matrix> tile_costs;
+    const Options<render::AbstractionShape> shapes;
+    const ImageComparison comparison_metric;
+    const int tile_size;
+
+    // The number of tiles in each sample, which is the same for every sample
+    // rendered at a pyramid level.
+    int num_tiles;
+};
+
+/// @brief Contains everything needed to composite the samples from the cached
+///     coverage masks and compute the matching costs.
+template <typename T>
+struct CompositePayload {
+    std::reference_wrapper<const render::ColourPlanes> reference;
+    std::reference_wrapper<const render::CoverageMasks> masks;
+    std::reference_wrapper<BasicMatrix<T>> samples;
+    std::reference_wrapper<BasicColumnVector<T>> costs;
+    std::reference_wrapper<std::vector<render::CullStatistics>> culling;
+    const Options<render::AbstractionShape> shapes;
+    const ImageComparison comparison_metric;
+
+    // One composite per worker.  Each one is reused for every sample that its
+    // worker composites, so the background is only copied into it once.
+    std::reference_wrapper<std::vector<render::ColourPlanes>> composites;
+};
+
+/// @brief Contains everything needed to write a checkpoint file.
+struct CheckpointPayload {
+    EngineCheckpoint checkpoint;
+    std::filesystem::path file;
+};
+
+/// @brief Write an engine checkpoint to disk.
+struct WriteCheckpoint : public threads::IJobFunction {
+    Error operator()(threads::JobContext &ctx) const override {
+        auto payload = ctx.Data<CheckpointPayload>();
+        if (!payload.has_value()) {
+            return payload.error();
+        }
+
+        return payload->checkpoint.Save(payload->file);
+    }
 };
 
-/// @brief Generate the set of samples needed for estimating sample costs.
+/// @brief Generate one block of the samples needed for estimating sample
+///     costs.  The block is selected by the job index.
+template <typename T>
 struct GenerateSolutionSamples : public threads::IJobFunction {
     Error operator()(threads::JobContext &ctx) const override {
-        auto payload = ctx.Data<OptimizerPayload>();
+        auto payload = ctx.Data<SamplePayload<T>>();
         if (!payload.has_value()) {
             return payload.error();
         }
 
-        auto &optim = payload->optimizer.get();
-        return optim.Sample(payload->samples);
+        auto &samples = payload->samples.get();
+        const auto [first, num_params] = ParameterBlock(ctx.Index(), payload->num_blocks,
+                                                        samples.cols(), payload->active_params);
+
+        return payload->optimizer.get().SampleBlock(samples.topRows(payload->num_samples), first,
+                                                    num_params, payload->population);
     }
 };
 
-/// @brief Run the PGPE optimizer to update the internal solution.
-struct RunOptimizer : public threads::IJobFunction {
+/// @brief Accumulate the optimizer update for one block of parameters.  The
+///     block is selected by the job index.
+template <typename T>
+struct AccumulateGradientBlock : public threads::IJobFunction {
     Error operator()(threads::JobContext &ctx) const override {
-        auto payload = ctx.Data<OptimizerPayload>();
+        auto payload = ctx.Data<OptimizerPayload<T>>();
         if (!payload.has_value()) {
             return payload.error();
         }
 
-        auto &optim = payload->optimizer.get();
-        optim.RankLinearize(payload->costs);
+        const auto &samples = payload->samples.get();
+        const auto [first, num_params] = ParameterBlock(ctx.Index(), payload->num_blocks,
+                                                        samples.cols(), payload->active_params);
 
-        return optim.Update(payload->samples, payload->costs);
+        return payload->optimizer.get().AccumulateGradients(samples.topRows(payload->num_samples),
+                                                            first, num_params);
     }
 };
 
-/// @brief Render the set of images from the PGPE optimizer samples and compute
-///     the per-sample costs.
+/// @brief Render the set of images from the optimizer samples and compute the
+///     per-sample costs.
+///
+/// The renderer works with double precision, so single precision samples are
+/// widened before they're rendered.
+template <typename T>
 struct RenderAndCompare : public threads::IJobFunction {
     Error operator()(threads::JobContext &ctx) const override {
-        auto payload = ctx.Data<RenderPayload>();
+        auto payload = ctx.Data<RenderPayload<T>>();
         if (!payload.has_value()) {
             return payload.error();
         }
 
-        render::PackedShapeCollection sampled_shapes(payload->shapes,
-                                                     payload->samples.row(ctx.Index()));
+        render::PackedShapeCollection sampled_shapes(
+            payload->shapes, payload->samples.get().row(ctx.Index()).template cast<double>());
 
-        // Render the test image, using a random background to avoid biasing
-        // blank areas.
+        // Render the test image.  Only the shapes in the block can differ
+        // from the estimate so the render can start from its cached layers.
         auto &renderer = payload->renderers.at(ctx.Index());
-        renderer.UseRandomBackgroundFill(true);
-        renderer.Render(sampled_shapes);
+        const auto &active_shapes = payload->active_shapes.get();
+        if (active_shapes.empty()) {
+            renderer.Render(sampled_shapes);
+        } else {
+            renderer.Render(sampled_shapes, active_shapes.front());
+        }
+        payload->culling.get().at(ctx.Index()) = renderer.Statistics();
 
         // Compute the matching cost of the rendered image with the reference.
         auto cost =
@@ -103,10 +906,108 @@ struct RenderAndCompare : public threads::IJobFunction {
             return cost.error();
         }
 
-        // NOTE: Storing the *negative* costs because PGPE finds a maximum, not
-        // a minimum.
-        payload->costs(ctx.Index()) = -(*cost);
+        // NOTE: Storing the *negative* costs because the optimizers find a
+        // maximum, not a minimum.
+        payload->costs.get()(ctx.Index()) = -(*cost);
+
+        return errors::no_error;
+    }
+};
+
+/// @brief Composite a single sample from the coverage masks and compute its
+///     cost.  The sample is selected by the job index.
+///
+/// Only the colours differ between the samples, so nothing is rasterized.
+template <typename T>
+struct CompositeAndCompare : public threads::IJobFunction {
+    Error operator()(threads::JobContext &ctx) const override {
+        auto payload = ctx.Data<CompositePayload<T>>();
+        if (!payload.has_value()) {
+            return payload.error();
+        }
+
+        render::PackedShapeCollection sampled_shapes(
+            payload->shapes, payload->samples.get().row(ctx.Index()).template cast<double>());
+
+        auto &composite = payload->composites.get().at(ctx.Worker());
+        if (auto err = payload->masks.get().Composite(sampled_shapes, composite)) {
+            return err;
+        }
+        payload->culling.get().at(ctx.Index()) = render::CullStatistics{};
+
+        auto cost =
+            ComputeCompositeCost(payload->comparison_metric, payload->reference, composite);
+        if (!cost.has_value()) {
+            return cost.error();
+        }
+
+        // NOTE: Storing the *negative* costs because the optimizers find a
+        // maximum, not a minimum.
+        payload->costs.get()(ctx.Index()) = -(*cost);
+        return errors::no_error;
+    }
+};
+
+/// @brief Bin the shapes of a single sample into tiles.  The sample is
+///     selected by the job index.
+template <typename T>
+struct BinSampleShapes : public threads::IJobFunction {
+    Error operator()(threads::JobContext &ctx) const override {
+        auto payload = ctx.Data<TilePayload<T>>();
+        if (!payload.has_value()) {
+            return payload.error();
+        }
+
+        render::PackedShapeCollection sampled_shapes(
+            payload->shapes, payload->samples.get().row(ctx.Index()).template cast<double>());
+
+        const auto &renderer = payload->renderers.get().at(ctx.Index());
+        auto tiles = renderer.BinShapes(sampled_shapes, payload->tile_size);
+        if (!tiles.has_value()) {
+            return tiles.error();
+        }
+
+        payload->tiles.get().at(ctx.Index()) = std::move(*tiles);
+        return errors::no_error;
+    }
+};
+
+/// @brief Render a single tile of a sample and compute its share of the
+///     sample's cost.  The job index is `sample * num_tiles + tile`.
+template <typename T>
+struct RenderAndCompareTile : public threads::IJobFunction {
+    Error operator()(threads::JobContext &ctx) const override {
+        auto payload = ctx.Data<TilePayload<T>>();
+        if (!payload.has_value()) {
+            return payload.error();
+        }
+
+        const int sample = ctx.Index() / payload->num_tiles;
+        const int tile = ctx.Index() % payload->num_tiles;
 
+        const auto &tiles = payload->tiles.get().at(sample);
+        if (!tiles.has_value()) {
+            return Error(fmt::format("The shapes of sample {} haven't been binned.", sample));
+        }
+
+        const BLRectI rect = tiles->Tile(tile);
+        auto image = Image::New(rect.w, rect.h, true);
+        if (!image.has_value()) {
+            return image.error();
+        }
+
+        const auto &renderer = payload->renderers.get().at(sample);
+        if (auto err = renderer.RenderTile(*tiles, tile, *image)) {
+            return err;
+        }
+
+        auto cost =
+            ComputeTileCost(payload->comparison_metric, payload->reference, *image, rect.x, rect.y);
+        if (!cost.has_value()) {
+            return cost.error();
+        }
+
+        payload->tile_costs.get()(sample, tile) = *cost;
         return errors::no_error;
     }
 };
@@ -118,6 +1019,40 @@ TimingReport::TimingReport(int num_iter, int num_samples) {
     iterations.optimize = std::vector<TimingReport::Duration>(num_iter);
     iterations.callback = std::vector<TimingReport::Duration>(num_iter);
     iterations.render_and_compare = std::vector<TimingReport::Duration>(num_iter * num_samples);
+    iterations.num_samples = std::vector<int>(num_iter, 0);
+    iterations.culling = std::vector<render::CullStatistics>(num_iter);
+    iterations.pyramid_level = std::vector<int>(num_iter, 0);
+    iterations.reference_width = std::vector<int>(num_iter, 0);
+    iterations.reference_height = std::vector<int>(num_iter, 0);
+}
+
+int TimingReport::TotalSamples() const {
+    return std::accumulate(iterations.num_samples.begin(), iterations.num_samples.end(), 0);
+}
+
+void TimingReport::Truncate(int num_iter) {
+    const int num_samples = NumSamples();
+    num_iter = std::clamp(num_iter, 0, NumIterations());
+    iterations.sample.resize(num_iter);
+    iterations.optimize.resize(num_iter);
+    iterations.callback.resize(num_iter);
+    iterations.render_and_compare.resize(num_iter * num_samples);
+    iterations.num_samples.resize(num_iter);
+    iterations.culling.resize(num_iter);
+    iterations.pyramid_level.resize(num_iter);
+    iterations.reference_width.resize(num_iter);
+    iterations.reference_height.resize(num_iter);
+}
+
+ColourRefinementRequest::ColourRefinementRequest() :
+    _requested{std::make_shared<std::atomic<bool>>(false)} {}
+
+void ColourRefinementRequest::Request() {
+    _requested->store(true);
+}
+
+bool ColourRefinementRequest::IsRequested() const {
+    return _requested->load();
 }
 
 Error EngineConfig::Validate() const {
@@ -129,14 +1064,77 @@ Error EngineConfig::Validate() const {
         return "The number of samples must be greater than zero and an even number.";
     }
 
+    if (min_samples &&
+        (*min_samples < 4 || *min_samples % 2 != 0 || *min_samples > num_samples)) {
+        return "The minimum number of samples must be an even number between four and the "
+               "number of samples.";
+    }
+
     if (num_drawn_shapes < 1) {
         return "The number of drawn shapes must be greater than zero.";
     }
 
+    if (render_tile_size && *render_tile_size < 1) {
+        return "The render tile size must be greater than zero.";
+    }
+
     if (num_workers && num_workers < 1) {
         return "The number of thread workers must be greater than zero.";
     }
 
+    if (time_limit && time_limit->count() <= 0) {
+        return "The time limit must be greater than zero.";
+    }
+
+    if (target_cost && *target_cost < 0) {
+        return "The target cost cannot be negative.";
+    }
+
+    if (pyramid_levels < 1) {
+        return "The number of pyramid levels must be greater than zero.";
+    }
+
+    if (pyramid_level_iterations && *pyramid_level_iterations < 1) {
+        return "The number of iterations per pyramid level must be greater than zero.";
+    }
+
+    if (pyramid_stall_iterations && *pyramid_stall_iterations < 1) {
+        return "The pyramid stall iterations must be greater than zero.";
+    }
+
+    if (initial_drawn_shapes &&
+        (*initial_drawn_shapes < 1 || *initial_drawn_shapes > num_drawn_shapes)) {
+        return "The initial number of shapes must be between one and the number of drawn shapes.";
+    }
+
+    if (shape_growth_interval < 1) {
+        return "The shape growth interval must be greater than zero.";
+    }
+
+    if (shape_growth_count < 1) {
+        return "The number of shapes added at each growth step must be greater than zero.";
+    }
+
+    if (block_shapes && *block_shapes < 1) {
+        return "The number of shapes in a block must be greater than zero.";
+    }
+
+    if (colour_refinement_iterations && *colour_refinement_iterations < 1) {
+        return "The number of colour refinement iterations must be greater than zero.";
+    }
+
+    if (checkpoint_interval < 1) {
+        return "The checkpoint interval must be greater than zero.";
+    }
+
+    if (callback_interval < 1) {
+        return "The callback interval must be greater than zero.";
+    }
+
+    if (callback_period && callback_period->count() <= 0) {
+        return "The callback period must be greater than zero.";
+    }
+
     return errors::no_error;
 }
 
@@ -144,6 +1142,7 @@ Error OptimizationResult::Save(const std::filesystem::path &file) const {
     nlohmann::json json = {
         {"aspectRatio", aspect_ratio},
         {"alphaScaling", alpha_scaling},
+        {"coordinateMapping", coordinate_mapping},
         {"iterations", iterations},
         {"cost", cost},
         {"shapes", shapes},
@@ -151,39 +1150,170 @@ Error OptimizationResult::Save(const std::filesystem::path &file) const {
         {"solution", solution},
     };
 
-    std::ofstream output(file, std::ios::out);
-    output << std::setw(2) << json;
+    std::ofstream output(file, std::ios::out);
+    output << std::setw(2) << json;
+
+    return errors::no_error;
+}
+
+Expected<OptimizationResult> OptimizationResult::Load(const std::filesystem::path &file) {
+    std::ifstream input(file);
+    auto json = nlohmann::json::parse(input);
+
+    if (json["solution"].empty()) {
+        return errors::report<OptimizationResult>("Missing solution vector.");
+    }
+
+    if (json["shapes"].empty()) {
+        return errors::report<OptimizationResult>("Missing shape configuration.");
+    }
+
+    auto shapes = json["shapes"].get<Options<render::AbstractionShape>>();
+
+    if (shapes == false) {
+        return errors::report<OptimizationResult>("Failed to parse shape configuration.");
+    }
+
+    // Results saved before the coordinate mapping was configurable always used
+    // the rescaled mapping.
+    auto mapping = render::CoordinateMapping::Rescaled;
+    if (json.contains("coordinateMapping")) {
+        mapping = json["coordinateMapping"].get<render::CoordinateMapping>();
+    }
+
+    return OptimizationResult{
+        .solution = json["solution"],
+        .cost = json["cost"].get<double>(),
+        .iterations = json["iterations"].get<int>(),
+        .aspect_ratio = json["aspectRatio"].get<double>(),
+        .alpha_scaling = json["alphaScaling"].get<double>(),
+        .coordinate_mapping = mapping,
+        .shapes = shapes,
+        .seed = json["seed"].get<uint32_t>(),
+        .timing = TimingReport(0, 0),
+    };
+}
+
+Error EngineCheckpoint::Save(const std::filesystem::path &file) const {
+    // JSON has no representation for infinity, so an unset "best cost" is
+    // stored as a null.
+    nlohmann::json best_cost = nullptr;
+    if (std::isfinite(level_best_cost)) {
+        best_cost = level_best_cost;
+    }
+
+    nlohmann::json json = {
+        {"iteration", iteration},
+        {"seed", seed},
+        {"shapes", shapes},
+        {"coordinateMapping", coordinate_mapping},
+        {"numSamples", num_samples},
+        {"activeShapes", num_active_shapes},
+        {"population",
+         {
+             {"activeSamples", num_active_samples},
+             {"snr", population_snr ? nlohmann::json(*population_snr) : nlohmann::json()},
+         }},
+        {"optimizer",
+         {
+             {"type", optimizer.type},
+             {"state", optimizer.state},
+             {"stddev", optimizer.standard_deviation},
+             {"vectors", optimizer.vectors},
+             {"seed", optimizer.seed},
+             {"population", optimizer.population},
+         }},
+        {"pyramid",
+         {
+             {"level", pyramid_level},
+             {"levelStart", level_start},
+             {"stallCount", level_stall_count},
+             {"bestCost", best_cost},
+         }},
+        {"refiningColours", refining_colours},
+    };
+
+    // Write to a temporary file first and then move it into place.  The rename
+    // is atomic so there will never be a partially written checkpoint.
+    auto temp_file = file;
+    temp_file += ".tmp";
+
+    {
+        std::ofstream output(temp_file, std::ios::out | std::ios::trunc);
+        output << json;
+        output.flush();
+
+        if (!output.good()) {
+            return fmt::format("Failed to write checkpoint to '{}'.", temp_file.string());
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(temp_file, file, err);
+    if (err) {
+        return fmt::format("Failed to move checkpoint to '{}' ({}).", file.string(), err.message());
+    }
 
     return errors::no_error;
 }
 
-Expected<OptimizationResult> OptimizationResult::Load(const std::filesystem::path &file) {
+Expected<EngineCheckpoint> EngineCheckpoint::Load(const std::filesystem::path &file) {
+    if (!std::filesystem::exists(file)) {
+        return errors::report<EngineCheckpoint>(
+            fmt::format("Checkpoint '{}' does not exist.", file.string()));
+    }
+
     std::ifstream input(file);
     auto json = nlohmann::json::parse(input);
 
-    if (json["solution"].empty()) {
-        return errors::report<OptimizationResult>("Missing solution vector.");
-    }
-
-    if (json["shapes"].empty()) {
-        return errors::report<OptimizationResult>("Missing shape configuration.");
+    if (!json.contains("optimizer") || !json.contains("pyramid") ||
+        !json.contains("population")) {
+        return errors::report<EngineCheckpoint>("Checkpoint is missing the engine state.");
     }
 
     auto shapes = json["shapes"].get<Options<render::AbstractionShape>>();
-
     if (shapes == false) {
-        return errors::report<OptimizationResult>("Failed to parse shape configuration.");
+        return errors::report<EngineCheckpoint>("Failed to parse shape configuration.");
     }
 
-    return OptimizationResult{
-        .solution = json["solution"],
-        .cost = json["cost"].get<double>(),
-        .iterations = json["iterations"].get<int>(),
-        .aspect_ratio = json["aspectRatio"].get<double>(),
-        .alpha_scaling = json["alphaScaling"].get<double>(),
+    // Checkpoints saved before the coordinate mapping was configurable always
+    // used the rescaled mapping.
+    auto mapping = render::CoordinateMapping::Rescaled;
+    if (json.contains("coordinateMapping")) {
+        mapping = json["coordinateMapping"].get<render::CoordinateMapping>();
+    }
+
+    const auto &optimizer = json["optimizer"];
+    const auto &pyramid = json["pyramid"];
+    const auto &population = json["population"];
+
+    return EngineCheckpoint{
+        .iteration = json["iteration"].get<int>(),
+        .seed = json["seed"].get<DefaultRngType::result_type>(),
         .shapes = shapes,
-        .seed = json["seed"].get<uint32_t>(),
-        .timing = TimingReport(0, 0),
+        .coordinate_mapping = mapping,
+        .num_samples = json["numSamples"].get<int>(),
+        .num_active_shapes = json["activeShapes"].get<int>(),
+        .num_active_samples = population["activeSamples"].get<int>(),
+        .population_snr = population["snr"].is_null()
+                              ? std::nullopt
+                              : std::optional<double>(population["snr"].get<double>()),
+        .optimizer =
+            OptimizerState{
+                .type = optimizer["type"].get<OptimizerType>(),
+                .state = optimizer["state"].get<RowVector>(),
+                .standard_deviation = optimizer["stddev"].get<RowVector>(),
+                .vectors = optimizer["vectors"].get<std::map<std::string, RowVector>>(),
+                .seed = optimizer["seed"].get<DefaultRngType::result_type>(),
+                .population = optimizer["population"].get<uint32_t>(),
+            },
+        .pyramid_level = pyramid["level"].get<int>(),
+        .level_start = pyramid["levelStart"].get<int>(),
+        .level_stall_count = pyramid["stallCount"].get<int>(),
+        .level_best_cost = pyramid["bestCost"].is_null()
+                               ? std::numeric_limits<double>::infinity()
+                               : pyramid["bestCost"].get<double>(),
+        .refining_colours = json.value("refiningColours", false),
     };
 }
 
@@ -193,8 +1323,34 @@ Expected<Engine> Engine::Create(const EngineConfig &config,
         return errors::report<Engine>(err);
     }
 
-    if (auto err = optim_settings.Validate()) {
-        return errors::report<Engine>(err);
+    if (config.optimizer == OptimizerType::Pgpe) {
+        if (auto err = optim_settings.Validate()) {
+            return errors::report<Engine>(err);
+        }
+    }
+
+    if (config.block_shapes) {
+        if (config.optimizer != OptimizerType::Pgpe) {
+            return errors::report<Engine>(fmt::format(
+                "Block-coordinate optimization isn't supported by the {} optimizer.",
+                config.optimizer));
+        }
+
+        if (optim_settings.min_refresh_rate) {
+            return errors::report<Engine>(
+                "Block-coordinate optimization can't be combined with sample reuse.");
+        }
+    }
+
+    if (config.colour_refinement_iterations || config.colour_refinement_request) {
+        if (config.optimizer != OptimizerType::Pgpe) {
+            return errors::report<Engine>(fmt::format(
+                "Colour refinement isn't supported by the {} optimizer.", config.optimizer));
+        }
+
+        if (optim_settings.min_refresh_rate) {
+            return errors::report<Engine>("Colour refinement can't be combined with sample reuse.");
+        }
     }
 
     return Engine(config, optim_settings);
@@ -205,6 +1361,67 @@ Engine::Engine(const EngineConfig &config, const PgpeOptimizerSettings &optim) :
     _optim_settings{optim} {}
 
 Expected<OptimizationResult> Engine::GenerateAbstraction(const Image &reference) const {
+    if (_config.single_precision) {
+        return Run<float>(reference, nullptr);
+    }
+    return Run<double>(reference, nullptr);
+}
+
+Expected<OptimizationResult> Engine::ResumeAbstraction(const Image &reference,
+                                                       const EngineCheckpoint &checkpoint) const {
+    if (checkpoint.shapes != _config.shapes) {
+        return errors::report<OptimizationResult>(
+            "The checkpoint's shapes don't match the engine configuration.");
+    }
+
+    if (checkpoint.coordinate_mapping != _config.coordinate_mapping) {
+        return errors::report<OptimizationResult>(fmt::format(
+            "The checkpoint used the {} coordinate mapping but the engine is configured to use "
+            "{}.",
+            checkpoint.coordinate_mapping, _config.coordinate_mapping));
+    }
+
+    if (checkpoint.num_samples != _config.num_samples) {
+        return errors::report<OptimizationResult>(fmt::format(
+            "The checkpoint used {} samples but the engine is configured to use {}.",
+            checkpoint.num_samples, _config.num_samples));
+    }
+
+    if (checkpoint.num_active_shapes > _config.num_drawn_shapes) {
+        return errors::report<OptimizationResult>(
+            "The checkpoint has more shapes than the engine is configured to draw.");
+    }
+
+    if (checkpoint.num_active_samples < _config.min_samples.value_or(_config.num_samples) ||
+        checkpoint.num_active_samples > _config.num_samples) {
+        return errors::report<OptimizationResult>(
+            "The checkpoint's population doesn't match the engine configuration.");
+    }
+
+    if (checkpoint.optimizer.type != _config.optimizer) {
+        return errors::report<OptimizationResult>(
+            fmt::format("The checkpoint used the {} optimizer but the engine is configured to "
+                        "use {}.",
+                        checkpoint.optimizer.type, _config.optimizer));
+    }
+
+    // The previous population and distribution used for importance mixing
+    // aren't part of the checkpoint, so the resumed run couldn't reuse the
+    // same samples as the original.
+    if (_config.optimizer == OptimizerType::Pgpe && _optim_settings.min_refresh_rate) {
+        return errors::report<OptimizationResult>(
+            "Cannot resume from a checkpoint when samples are reused (min_refresh_rate is set).");
+    }
+
+    if (_config.single_precision) {
+        return Run<float>(reference, &checkpoint);
+    }
+    return Run<double>(reference, &checkpoint);
+}
+
+template <typename T>
+Expected<OptimizationResult> Engine::Run(const Image &reference,
+                                         const EngineCheckpoint *checkpoint) const {
     const int width = reference.Width();
     const int height = reference.Height();
 
@@ -221,101 +1438,625 @@ Expected<OptimizationResult> Engine::GenerateAbstraction(const Image &reference)
     };
     threads::ThreadPool thread_pool(multithreading_config);
 
-    // Create the generator for all PRNGs that will be used during the
+    // Pick the base seed for all PRNGs that will be used during the
     // optimization.  This wil use either a pre-configured seed or a randomly
-    // chosen one.
-    PrngGenerator<> prng_generator(_config.seed);
-
-    // First, create the optimizer.  Use a generated PRNG to get the seed.
-    auto pgpe_prng = prng_generator.CreatePrng();
-    auto optimizer = PgpeOptimizer::New(_optim_settings);
-    if (!optimizer.has_value()) {
-        return errors::report<OptimizationResult>(optimizer.error());
+    // chosen one.  A resumed optimization always uses the checkpoint's seed.
+    // Every random stream is keyed off of this seed, rather than being handed
+    // out in order, so nothing depends on how the work is scheduled.
+    const DefaultRngType::result_type seed =
+        checkpoint ? checkpoint->seed
+                   : _config.seed.value_or(PrngGenerator<>::DrawRandomSeed());
+
+    // First, create the optimizer.  It shares the base seed but draws from its
+    // own stream.
+    auto created_optimizer = CreateOptimizer<T>(_config.optimizer, _optim_settings, seed);
+    if (!created_optimizer.has_value()) {
+        return errors::report<OptimizationResult>(created_optimizer.error());
     }
-    optimizer->SetPrngSeed(pgpe_prng.seed());
+    auto optimizer = std::move(*created_optimizer);
 
     // Do the initial abstract shape generation to prime the optimizer with an
     // initial solution.
-    Matrix samples;
-    ColumnVector costs;
+    BasicMatrix<T> samples;
+    BasicColumnVector<T> costs;
+
+    // The renderer's culling statistics for each sample.
+    std::vector<render::CullStatistics> culling(_config.num_samples);
+
+    // The binned shapes and per-tile costs of each sample when the samples are
+    // rendered in tiles.
+    std::vector<std::optional<render::TiledShapes>> sample_tiles(_config.num_samples);
+    Matrix tile_costs;
+
+    // The optimization starts on the coarsest level of the reference pyramid
+    // and works its way up to the full resolution image.  There's only a
+    // single level if the multi-resolution schedule is disabled.
+    std::vector<Image> pyramid;
+    int level = 0;
+
+    // The solution may start with fewer shapes than requested if the shape
+    // curriculum is enabled.  More are added as the optimization progresses.
+    int num_active_shapes = _config.initial_drawn_shapes.value_or(_config.num_drawn_shapes);
+    int shape_dimensions = 0;
+
+    // The adaptive population starts with the fewest samples and is adjusted
+    // after every iteration.  The sample and cost buffers are always sized for
+    // the largest population and only the leading rows are used.
+    int num_active_samples = checkpoint
+                                 ? checkpoint->num_active_samples
+                                 : _config.min_samples.value_or(_config.num_samples);
+    std::optional<double> population_snr = checkpoint ? checkpoint->population_snr : std::nullopt;
+    BasicRowVector<T> snr_gradient;
+
+    // PGPE can reuse samples from the previous population with importance
+    // mixing.  The previous population and its raw costs are kept in a second
+    // pair of buffers that's swapped with the current one after every update.
+    // The history isn't part of the checkpoint, so these runs can't be
+    // resumed.
+    const bool reuse_samples =
+        _config.optimizer == OptimizerType::Pgpe && _optim_settings.min_refresh_rate.has_value();
+    BasicMatrix<T> previous_samples;
+    BasicColumnVector<T> previous_costs;
+    int num_previous_samples = 0;
+    std::vector<int> fresh_samples;
+
+    // Block-coordinate optimization only perturbs a block of shapes in each
+    // iteration.  The inactive columns of the samples hold the current
+    // estimate, which doesn't change between iterations, so only the previous
+    // block's columns need to be reset.  Everything is reset if any of the
+    // sampled rows are stale.
+    std::vector<int> active_shapes;
+    std::vector<int> active_params;
+    std::vector<int> previous_active_params;
+    int num_synced_samples = 0;
+    // The colour refinement phase freezes the geometry and composites every
+    // sample from the coverage masks of the estimate's shapes.  The masks are
+    // recreated whenever the reference changes.  Engine::Create only allows
+    // it with PGPE and without sample reuse.
+    bool refining_colours = checkpoint ? checkpoint->refining_colours : false;
+    std::optional<render::CoverageMasks> coverage;
+    render::ColourPlanes reference_planes;
+    std::vector<render::ColourPlanes> composites;
+
+    auto num_perturbed_params = [&]() -> int {
+        return active_params.empty() ? static_cast<int>(samples.cols())
+                                     : static_cast<int>(active_params.size());
+    };
 
     OperationTiming init_timing;
     {
         Profile profiler{init_timing};
-        render::ShapeGenerator shape_generator(width, height, prng_generator.CreatePrng());
 
-        render::CircleCollection circles;
-        render::RectangleCollection rectangles;
-        render::TriangleCollection triangles;
+        auto reference_pyramid = BuildReferencePyramid(reference, _config.pyramid_levels);
+        if (!reference_pyramid.has_value()) {
+            return errors::report<OptimizationResult>(reference_pyramid.error());
+        }
+        pyramid = std::move(*reference_pyramid);
+        level = pyramid.size() - 1;
+    }
+
+    // A resumed optimization restores everything from the checkpoint rather
+    // than generating a new initial solution.
+    if (checkpoint) {
+        Profile profiler{init_timing};
 
-        if (_config.shapes & render::AbstractionShape::Circles) {
-            circles = shape_generator.RandomCircles(_config.num_drawn_shapes);
+        if (checkpoint->pyramid_level >= static_cast<int>(pyramid.size())) {
+            return errors::report<OptimizationResult>(
+                "The checkpoint's pyramid level doesn't exist for this image.");
         }
 
-        if (_config.shapes & render::AbstractionShape::Rectangles) {
-            rectangles = shape_generator.RandomRectangles(_config.num_drawn_shapes);
+        if (auto err = optimizer->SetState(checkpoint->optimizer)) {
+            return errors::report<OptimizationResult>(err);
         }
 
-        if (_config.shapes & render::AbstractionShape::Triangles) {
-            triangles = shape_generator.RandomTriangles(_config.num_drawn_shapes);
+        level = checkpoint->pyramid_level;
+        num_active_shapes = checkpoint->num_active_shapes;
+        shape_dimensions = render::PackedShapeCollection(_config.shapes, 1).TotalDimensions();
+
+        if (checkpoint->optimizer.state.size() != shape_dimensions * num_active_shapes) {
+            return errors::report<OptimizationResult>(
+                "The checkpoint's solution doesn't match its shape configuration.");
         }
 
-        render::PackedShapeCollection init_shapes(circles, rectangles, triangles);
-        optimizer->Initialize(init_shapes.AsPackedVector());
+        samples = BasicMatrix<T>::Zero(_config.num_samples, shape_dimensions * num_active_shapes);
+        costs = BasicColumnVector<T>::Zero(_config.num_samples);
+    } else {
+        Profile profiler{init_timing};
+        render::ShapeGenerator shape_generator(width, height,
+                                               Prng<>(CounterSeed(seed, 0, 0, kShapeStream)));
+
+        render::PackedShapeCollection init_shapes(_config.shapes, num_active_shapes);
+        init_shapes.ForEachCollection([&]<typename Traits>(Traits, auto &collection) {
+            if (_config.shapes & Traits::Shape) {
+                collection = shape_generator.RandomShapes<Traits::Shape>(num_active_shapes);
+            }
+        });
+        optimizer->Initialize(init_shapes.AsPackedVector().cast<T>());
 
-        samples = Matrix::Zero(_config.num_samples,
-                               init_shapes.TotalDimensions() * _config.num_drawn_shapes);
-        costs = ColumnVector::Zero(_config.num_samples);
+        shape_dimensions = init_shapes.TotalDimensions();
+        samples = BasicMatrix<T>::Zero(_config.num_samples, shape_dimensions * num_active_shapes);
+        costs = BasicColumnVector<T>::Zero(_config.num_samples);
     }
     timing_report.stages.initialization = init_timing.GetTiming().total;
 
+    if (reuse_samples) {
+        previous_samples = BasicMatrix<T>::Zero(samples.rows(), samples.cols());
+        previous_costs = BasicColumnVector<T>::Zero(costs.rows());
+    }
+
     // Setup the thread payloads.
-    OptimizerPayload optim_payload{
-        .optimizer = *optimizer,
+    auto renderers =
+        CreateRenderers(pyramid[level], RendererSeeds(seed, level, _config.num_samples),
+                        _config.alpha_scale, _config.coordinate_mapping, _config.sample_quality);
+    if (!renderers.has_value()) {
+        return errors::report<OptimizationResult>(renderers.error());
+    }
+
+    RenderPayload<T> render_payload{
+        .reference = pyramid[level],
+        .renderers = std::move(*renderers),
         .samples = samples,
         .costs = costs,
+        .culling = culling,
+        .shapes = _config.shapes,
+        .comparison_metric = _config.comparison_metric,
+        .active_shapes = active_shapes,
     };
 
-    RenderPayload render_payload{
-        .reference = reference,
-        .renderers = std::vector<render::Renderer>(),
+    TilePayload<T> tile_payload{
+        .reference = pyramid[level],
+        .renderers = render_payload.renderers,
         .samples = samples,
-        .costs = costs,
+        .tiles = sample_tiles,
+        .tile_costs = tile_costs,
         .shapes = _config.shapes,
         .comparison_metric = _config.comparison_metric,
+        .tile_size = _config.render_tile_size.value_or(render::TiledShapes::kDefaultTileSize),
+        .num_tiles = 0,
     };
 
-    for (int i = 0; i < _config.num_samples; i++) {
-        auto renderer = render::Renderer::Create(width, height, prng_generator.CreatePrng());
+    // The coarser pyramid levels are, by default, given half of the total
+    // iterations.  The engine may also move to the next level early if the
+    // optimization stops making progress.
+    const int num_coarse_levels = pyramid.size() - 1;
+    const int level_iterations =
+        num_coarse_levels == 0
+            ? 0
+            : _config.pyramid_level_iterations.value_or(
+                  std::max(1, _config.iterations / (2 * num_coarse_levels)));
+
+    int level_start = checkpoint ? checkpoint->level_start : 0;
+    int level_stall_count = checkpoint ? checkpoint->level_stall_count : 0;
+    double level_best_cost =
+        checkpoint ? checkpoint->level_best_cost : std::numeric_limits<double>::infinity();
+
+    // Checkpoints are written by a separate, single worker so that the disk
+    // I/O never blocks the optimization loop.  An iteration that's interrupted
+    // part way through must be re-run when resuming, so a snapshot of the
+    // engine state is taken at the start of every iteration if the engine can
+    // be interrupted.  Otherwise it's only taken when a checkpoint is written.
+    const bool can_interrupt = _config.time_limit || _config.stop_token.stop_possible();
+    std::optional<threads::ThreadPool> checkpoint_writer;
+    std::optional<threads::Job::Future> pending_checkpoint;
+    std::optional<EngineCheckpoint> snapshot;
+
+    if (_config.checkpoint_file) {
+        checkpoint_writer.emplace(threads::ThreadPoolConfig{.num_workers = 1});
+    }
 
-        if (!renderer.has_value()) {
-            return errors::report<OptimizationResult>(renderer.error());
+    auto take_snapshot = [&](int next_iteration) -> Expected<EngineCheckpoint> {
+        auto optimizer_state = optimizer->GetState();
+        if (!optimizer_state.has_value()) {
+            return errors::report<EngineCheckpoint>(optimizer_state.error());
         }
-        renderer->SetAlphaScale(_config.alpha_scale);
-        render_payload.renderers.push_back(*renderer);
-    }
+
+        return EngineCheckpoint{
+            .iteration = next_iteration,
+            .seed = seed,
+            .shapes = _config.shapes,
+            .coordinate_mapping = _config.coordinate_mapping,
+            .num_samples = _config.num_samples,
+            .num_active_shapes = num_active_shapes,
+            .num_active_samples = num_active_samples,
+            .population_snr = population_snr,
+            .optimizer = *optimizer_state,
+            .pyramid_level = level,
+            .level_start = level_start,
+            .level_stall_count = level_stall_count,
+            .level_best_cost = level_best_cost,
+            .refining_colours = refining_colours,
+        };
+    };
+
+    auto write_checkpoint = [&](const EngineCheckpoint &state) -> Error {
+        // Only one checkpoint is ever in flight.  Any error from the previous
+        // one is reported here.
+        if (pending_checkpoint) {
+            auto status = pending_checkpoint->get();
+            pending_checkpoint.reset();
+            if (status.error) {
+                return status.error;
+            }
+        }
+
+        CheckpointPayload payload{
+            .checkpoint = state,
+            .file = *_config.checkpoint_file,
+        };
+        pending_checkpoint = checkpoint_writer->SubmitWithPayload<WriteCheckpoint>(0, payload);
+        return errors::no_error;
+    };
 
     // Create the timers used for the various stages of the optimization pipeline.
     OperationTiming sample_timing, render_and_compare_timing, optimize_timing, callback_timing;
 
+    // The engine will stop early if it runs out of time, reaches the target
+    // cost, or is asked to stop by the caller.  This is only checked between
+    // stages so that there is never any in-flight work when the loop exits.
+    auto check_limits = [&]() -> std::optional<StopReason> {
+        if (_config.stop_token.stop_requested()) {
+            return StopReason::Cancelled;
+        }
+
+        if (_config.time_limit && e2e_timer.GetElapsedTime() >= *_config.time_limit) {
+            return StopReason::TimeLimit;
+        }
+
+        return {};
+    };
+
     // Now run the "sample->render->optimize" loop, keeping track of how the
     // solution is performing.
 
-    int iterations = 0;
-    std::vector<threads::Job::Future> futures(_config.num_samples);
-    for (int i = 0; i < _config.iterations; i++) {
-        // Run the sampling step
+    const int first_iteration = checkpoint ? checkpoint->iteration : 0;
+
+    int iterations = first_iteration;
+    double best_sample_cost = 0;
+
+    // The estimates are measured the same way as the returned solution: a
+    // full resolution, anti-aliased render on a black background.  The sample
+    // renderers work on a pyramid level and may use another background and
+    // quality, so their costs can't be compared with the final cost.
+    auto final_renderer = render::Renderer::Create(width, height);
+    if (!final_renderer.has_value()) {
+        return errors::report<OptimizationResult>(final_renderer.error());
+    }
+    final_renderer->SetAlphaScale(_config.alpha_scale);
+    final_renderer->SetCoordinateMapping(_config.coordinate_mapping);
+    final_renderer->SetBackground(0, 0, 0);
+    final_renderer->SetThreadCount(RenderThreadCount(thread_pool.Workers(), 1));
+
+    auto compute_final_cost = [&](const RowVector &solution) -> Expected<double> {
+        final_renderer->Render(render::PackedShapeCollection(_config.shapes, solution));
+        return ComputeCost(_config.comparison_metric, reference, final_renderer->DrawingSurface());
+    };
+
+    // The best estimate seen so far, which is what's returned when the engine
+    // stops early.  It's only tracked when the engine can stop early.
+    std::optional<BasicRowVector<T>> best_estimate;
+    double best_estimate_cost = std::numeric_limits<double>::infinity();
+    Timer callback_timer;
+    int last_callback = -1;
+    StopReason stop_reason = StopReason::Completed;
+    std::vector<threads::Job::Future> futures(std::max(_config.num_samples, thread_pool.Workers()));
+
+    // Renders the fresh samples in tiles.  The shapes are binned first, one
+    // job per sample, and then every tile of every sample gets its own job.
+    // Each sample is charged for the time spent on its own jobs.
+    std::vector<threads::Job::Future> tile_futures;
+    auto render_tiles = [&](int iteration) -> Error {
+        const int num_fresh = fresh_samples.size();
+        if (num_fresh == 0) {
+            return errors::no_error;
+        }
+
+        auto &render_times = timing_report.iterations.render_and_compare;
+        const int first_time = iteration * _config.num_samples;
+        for (int j = 0; j < num_fresh; j++) {
+            futures.at(j) =
+                thread_pool.SubmitWithPayload<BinSampleShapes<T>>(fresh_samples[j], tile_payload);
+        }
+
+        for (int j = 0; j < num_fresh; j++) {
+            auto result = futures[j].get();
+            if (result.error) {
+                return result.error;
+            }
+            render_times[first_time + j] = result.time;
+        }
+
+        const int num_tiles = sample_tiles[fresh_samples.front()]->NumTiles();
+        if (tile_costs.rows() != _config.num_samples || tile_costs.cols() != num_tiles) {
+            tile_costs = Matrix::Zero(_config.num_samples, num_tiles);
+        }
+        tile_payload.num_tiles = num_tiles;
+
+        tile_futures.clear();
+        for (int j = 0; j < num_fresh; j++) {
+            for (int t = 0; t < num_tiles; t++) {
+                tile_futures.push_back(thread_pool.SubmitWithPayload<RenderAndCompareTile<T>>(
+                    fresh_samples[j] * num_tiles + t, tile_payload));
+            }
+        }
+
+        Error err;
+        for (int k = 0; k < static_cast<int>(tile_futures.size()); k++) {
+            auto result = tile_futures[k].get();
+            if (result.error && !err) {
+                err = result.error;
+            }
+            render_times[first_time + k / num_tiles] += result.time;
+        }
+
+        if (err) {
+            return err;
+        }
+
+        // NOTE: Storing the *negative* costs because the optimizers find a
+        // maximum, not a minimum.
+        for (int j = 0; j < num_fresh; j++) {
+            const int sample = fresh_samples[j];
+            costs(sample) = -tile_costs.row(sample).sum();
+            culling[sample] = sample_tiles[sample]->Statistics();
+        }
+
+        return errors::no_error;
+    };
+    for (int i = first_iteration; i < _config.iterations; i++) {
+        const bool checkpoint_iteration =
+            i > first_iteration && i % _config.checkpoint_interval == 0;
+        if (checkpoint_writer && (checkpoint_iteration || can_interrupt)) {
+            auto state = take_snapshot(i);
+            if (!state.has_value()) {
+                return errors::report<OptimizationResult>(state.error());
+            }
+            snapshot = std::move(*state);
+
+            if (checkpoint_iteration) {
+                if (auto err = write_checkpoint(*snapshot)) {
+                    return errors::report<OptimizationResult>(err);
+                }
+            }
+        }
+
+        if (auto reason = check_limits()) {
+            stop_reason = *reason;
+            break;
+        }
+
+        // Move to the next pyramid level if the current one has used up its
+        // iterations or has stalled.  The optimizer state carries over as-is
+        // since the shape coordinates are resolution independent.
+        if (level > 0) {
+            const bool schedule_done = i - level_start >= level_iterations;
+            const bool stalled = _config.pyramid_stall_iterations &&
+                                 level_stall_count >= *_config.pyramid_stall_iterations;
+
+            if (schedule_done || stalled) {
+                level--;
+
+                auto level_renderers =
+                    CreateRenderers(pyramid[level], RendererSeeds(seed, level, _config.num_samples),
+                                    _config.alpha_scale, _config.coordinate_mapping,
+                                    _config.sample_quality);
+                if (!level_renderers.has_value()) {
+                    return errors::report<OptimizationResult>(level_renderers.error());
+                }
+
+                render_payload.reference = pyramid[level];
+                render_payload.renderers = std::move(*level_renderers);
+                tile_payload.reference = pyramid[level];
+
+                level_start = i;
+                level_stall_count = 0;
+                level_best_cost = std::numeric_limits<double>::infinity();
+
+                // The previous costs were measured against another reference.
+                num_previous_samples = 0;
+                coverage.reset();
+            }
+        }
+
+        timing_report.iterations.pyramid_level[i] = level;
+        timing_report.iterations.reference_width[i] = pyramid[level].Width();
+        timing_report.iterations.reference_height[i] = pyramid[level].Height();
+
+        // Grow the solution if the shape curriculum is enabled.  The current
+        // estimate is rendered so that the new shapes can be placed where the
+        // error is the highest.
+        if (!refining_colours && num_active_shapes < _config.num_drawn_shapes && i > 0 &&
+            i % _config.shape_growth_interval == 0) {
+            Profile profiler{optimize_timing};
+
+            auto estimate = optimizer->GetEstimate();
+            if (!estimate.has_value()) {
+                return errors::report<OptimizationResult>(estimate.error());
+            }
+
+            const int num_new = std::min(_config.shape_growth_count,
+                                         _config.num_drawn_shapes - num_active_shapes);
+            auto regions = FindSolutionResiduals(
+                render_payload.reference, _config.shapes, estimate->template cast<double>(),
+                _config.alpha_scale, _config.coordinate_mapping, num_new);
+            if (!regions.has_value()) {
+                return errors::report<OptimizationResult>(regions.error());
+            }
+
+            if (auto err = GrowSolution(_config.shapes, *optimizer, *regions,
+                                        _config.coordinate_mapping)) {
+                return errors::report<OptimizationResult>(err);
+            }
+
+            num_active_shapes += num_new;
+            samples =
+                BasicMatrix<T>::Zero(_config.num_samples, shape_dimensions * num_active_shapes);
+
+            if (reuse_samples) {
+                previous_samples = BasicMatrix<T>::Zero(samples.rows(), samples.cols());
+                num_previous_samples = 0;
+            }
+            num_synced_samples = 0;
+
+            // The earlier estimates have fewer shapes than the grown solution.
+            best_estimate.reset();
+            best_estimate_cost = std::numeric_limits<double>::infinity();
+        }
+
+        // Switch to the colour refinement once it's scheduled or requested.
+        // The phase lasts until the end of the run.
+        if (!refining_colours) {
+            const bool scheduled = _config.colour_refinement_iterations &&
+                                   i >= _config.iterations - *_config.colour_refinement_iterations;
+            const bool requested = _config.colour_refinement_request &&
+                                   _config.colour_refinement_request->IsRequested();
+            refining_colours = scheduled || requested;
+        }
+
+        // Rasterize the coverage masks of the estimate and only perturb the
+        // colour parameters from now on.  The geometry columns of every
+        // sample are left at the estimate, which no longer changes.
+        if (refining_colours && !coverage) {
+            Profile profiler{optimize_timing};
+
+            const BasicRowVector<T> estimate = *optimizer->GetEstimate();
+            render::PackedShapeCollection base(_config.shapes, estimate.template cast<double>());
+            auto masks = render_payload.renderers.front().CacheCoverage(base);
+            if (!masks.has_value()) {
+                return errors::report<OptimizationResult>(masks.error());
+            }
+            coverage = std::move(*masks);
+            reference_planes = render::ToColourPlanes(pyramid[level]);
+            composites.assign(thread_pool.Workers(), render::ColourPlanes());
+
+            active_shapes.clear();
+            active_params = ColourParameters(_config.shapes, num_active_shapes);
+            if (auto err = optimizer->SetActiveParameters(active_params)) {
+                return errors::report<OptimizationResult>(err);
+            }
+
+            for (auto &renderer : render_payload.renderers) {
+                renderer.ClearLayers();
+            }
+
+            samples.rowwise() = estimate;
+        }
+
+        // Run the sampling step.  The parameters are split into blocks so
+        // that every worker can help generate the samples.  The samples don't
+        // depend on how they're split so the results are the same regardless
+        // of the number of workers.
         {
             Profile profiler{sample_timing};
-            auto sample_job =
-                thread_pool.SubmitWithPayload<GenerateSolutionSamples>(0, optim_payload);
-            auto sample_result = sample_job.get();
+            Timer timer;
+
+            // Pick the block of shapes for this iteration and make sure every
+            // other shape is at the current estimate.
+            if (_config.block_shapes && !refining_colours) {
+                const BasicRowVector<T> estimate = *optimizer->GetEstimate();
+
+                std::vector<double> scores;
+                if (_config.block_selection == BlockSelection::ErrorGuided) {
+                    const RowVector solution = estimate.template cast<double>();
+                    auto residuals = FindSolutionResiduals(
+                        render_payload.reference, _config.shapes, solution, _config.alpha_scale,
+                        _config.coordinate_mapping, kResidualGridSize * kResidualGridSize);
+                    if (!residuals.has_value()) {
+                        return errors::report<OptimizationResult>(residuals.error());
+                    }
+                    scores = ScoreShapes(_config.shapes, solution, *residuals,
+                                         _config.coordinate_mapping);
+                }
+
+                std::swap(active_params, previous_active_params);
+                if (*_config.block_shapes < num_active_shapes) {
+                    active_shapes = SelectShapeBlock(_config.block_selection, i, num_active_shapes,
+                                                     *_config.block_shapes, seed, scores);
+                    active_params =
+                        ShapeBlockParameters(_config.shapes, num_active_shapes, active_shapes);
+                } else {
+                    active_shapes.clear();
+                    active_params.clear();
+                }
+
+                if (auto err = optimizer->SetActiveParameters(active_params)) {
+                    return errors::report<OptimizationResult>(err);
+                }
+
+                auto sampled_rows = samples.topRows(num_active_samples);
+                if (!active_params.empty()) {
+                    if (num_active_samples > num_synced_samples) {
+                        sampled_rows.rowwise() = estimate;
+                    } else {
+                        for (int param : previous_active_params) {
+                            sampled_rows.col(param).setConstant(estimate(param));
+                        }
+                    }
+                }
+                num_synced_samples = active_params.empty() ? 0 : num_active_samples;
+
+                // Every sample matches the estimate below the first shape in
+                // the block, so the estimate's layers are shared by all of the
+                // renderers.
+                auto &renderers = render_payload.renderers;
+                if (active_shapes.empty()) {
+                    for (auto &renderer : renderers) {
+                        renderer.ClearLayers();
+                    }
+                } else {
+                    render::PackedShapeCollection base(_config.shapes,
+                                                       estimate.template cast<double>());
+                    if (auto err = renderers.front().CacheLayers(base)) {
+                        return errors::report<OptimizationResult>(err);
+                    }
+
+                    for (auto &renderer : renderers) {
+                        renderer.ShareLayers(renderers.front());
+                    }
+                }
+            }
+
+            const uint32_t population = optimizer->NewPopulation();
+            SamplePayload<T> sample_payload{
+                .optimizer = *optimizer,
+                .samples = samples,
+                .active_params = active_params,
+                .num_samples = num_active_samples,
+                .population = population,
+                .num_blocks = std::min(thread_pool.Workers(), num_perturbed_params()),
+            };
+
+            for (int j = 0; j < sample_payload.num_blocks; j++) {
+                futures.at(j) =
+                    thread_pool.SubmitWithPayload<GenerateSolutionSamples<T>>(j, sample_payload);
+            }
+
+            for (int j = 0; j < sample_payload.num_blocks; j++) {
+                auto sample_result = futures[j].get();
+                if (sample_result.error) {
+                    return errors::report<OptimizationResult>(sample_result.error);
+                }
+            }
 
-            if (sample_result.error) {
-                return errors::report<OptimizationResult>(sample_result.error);
+            // Only the samples that weren't reused need to be rendered.
+            if (reuse_samples) {
+                auto err = optimizer->MixPopulation(
+                    samples.topRows(num_active_samples), costs.head(num_active_samples),
+                    previous_samples.topRows(num_previous_samples),
+                    previous_costs.head(num_previous_samples), population, fresh_samples);
+                if (err) {
+                    return errors::report<OptimizationResult>(err);
+                }
+            } else {
+                fresh_samples.resize(num_active_samples);
+                std::iota(fresh_samples.begin(), fresh_samples.end(), 0);
             }
 
-            timing_report.iterations.sample[i] = sample_result.time;
+            timing_report.iterations.sample[i] = timer.GetElapsedTime();
+        }
+
+        if (auto reason = check_limits()) {
+            stop_reason = *reason;
+            break;
         }
 
         // Render images from the generated samples and compute the costs.  The
@@ -323,83 +2064,305 @@ Expected<OptimizationResult> Engine::GenerateAbstraction(const Image &reference)
         // futures.  The 'get()' will block until the future is available.
         {
             Profile profiler{render_and_compare_timing};
-            for (int j = 0; j < _config.num_samples; j++) {
-                auto render_job =
-                    thread_pool.SubmitWithPayload<RenderAndCompare>(j, render_payload);
-                futures.at(j) = std::move(render_job);
+            const int num_fresh = fresh_samples.size();
+
+            const int render_threads = RenderThreadCount(thread_pool.Workers(), num_fresh);
+            for (auto &renderer : render_payload.renderers) {
+                renderer.SetThreadCount(render_threads);
             }
 
-            for (int j = 0; j < _config.num_samples; j++) {
-                auto result = futures[j].get();
+            if (coverage) {
+                CompositePayload<T> composite_payload{
+                    .reference = reference_planes,
+                    .masks = *coverage,
+                    .samples = samples,
+                    .costs = costs,
+                    .culling = culling,
+                    .shapes = _config.shapes,
+                    .comparison_metric = _config.comparison_metric,
+                    .composites = composites,
+                };
+
+                for (int j = 0; j < num_fresh; j++) {
+                    futures.at(j) = thread_pool.SubmitWithPayload<CompositeAndCompare<T>>(
+                        fresh_samples[j], composite_payload);
+                }
+
+                for (int j = 0; j < num_fresh; j++) {
+                    auto result = futures[j].get();
+                    if (result.error) {
+                        return errors::report<OptimizationResult>(result.error);
+                    }
+
+                    timing_report.iterations.render_and_compare[i * _config.num_samples + j] =
+                        result.time;
+                }
+            } else if (_config.render_tile_size) {
+                if (auto err = render_tiles(i)) {
+                    return errors::report<OptimizationResult>(err);
+                }
+            } else {
+                for (int j = 0; j < num_fresh; j++) {
+                    auto render_job = thread_pool.SubmitWithPayload<RenderAndCompare<T>>(
+                        fresh_samples[j], render_payload);
+                    futures.at(j) = std::move(render_job);
+                }
+
+                for (int j = 0; j < num_fresh; j++) {
+                    auto result = futures[j].get();
 
-                if (result.error) {
-                    return errors::report<OptimizationResult>(result.error);
+                    if (result.error) {
+                        return errors::report<OptimizationResult>(result.error);
+                    }
+
+                    timing_report.iterations.render_and_compare[i * _config.num_samples + j] =
+                        result.time;
                 }
+            }
+
+            for (int j = 0; j < num_fresh; j++) {
+                timing_report.iterations.culling[i] += culling[fresh_samples[j]];
+            }
+
+            timing_report.iterations.num_samples[i] = num_fresh;
+        }
 
-                timing_report.iterations.render_and_compare[i * _config.num_samples + j] =
-                    result.time;
+        auto active_samples = samples.topRows(num_active_samples);
+        auto active_costs = costs.head(num_active_samples);
+
+        // The optimizer update overwrites the costs so the best one needs to
+        // be kept for the callback.  The costs are negated so the best one is
+        // the largest.
+        best_sample_cost = active_costs.maxCoeff();
+
+        // Track whether or not the coarse levels are still making progress.
+        if (level > 0 && _config.pyramid_stall_iterations) {
+            const double iteration_cost = -best_sample_cost;
+            if (iteration_cost < (1 - kPyramidStallTolerance) * level_best_cost) {
+                level_best_cost = iteration_cost;
+                level_stall_count = 0;
+            } else {
+                level_stall_count++;
             }
         }
 
-        // Run the optimizer and update its state.
+        if (auto reason = check_limits()) {
+            stop_reason = *reason;
+            break;
+        }
+
+        // Run the optimizer and update its state.  The update is split into
+        // parameter blocks, like the samples, and only the final step, which
+        // couples all of the parameters, runs on this thread.
         {
             Profile profiler{optimize_timing};
-            auto update_job = thread_pool.SubmitWithPayload<RunOptimizer>(0, optim_payload);
-            auto update_result = update_job.get();
+            Timer timer;
+
+            // The gradient's signal-to-noise ratio is measured on the raw
+            // costs, before they're rank-linearized.  It's kept relative to
+            // the ratio of a noiseless objective, so a value of one means the
+            // costs have no noise at all, and doesn't depend on the number of
+            // samples.
+            if (_config.min_samples) {
+                const double noiseless_snr =
+                    (num_active_samples / 2.0) / (num_perturbed_params() + 1.0);
+                const double snr = std::min(
+                    1.0, GradientSnr<T>(active_samples, active_costs, snr_gradient) /
+                             noiseless_snr);
+                population_snr =
+                    population_snr ? kPopulationSnrSmoothing * *population_snr +
+                                         (1 - kPopulationSnrSmoothing) * snr
+                                   : snr;
+            }
+
+            // The reused costs have to be comparable with the new ones so the
+            // raw costs are kept rather than the rank-linearized ones.
+            if (reuse_samples) {
+                previous_costs.head(num_active_samples) = active_costs;
+            }
+
+            optimizer->RankLinearize(active_costs);
+            if (auto err = optimizer->BeginUpdate(active_samples, active_costs)) {
+                return errors::report<OptimizationResult>(err);
+            }
+
+            OptimizerPayload<T> optim_payload{
+                .optimizer = *optimizer,
+                .samples = samples,
+                .active_params = active_params,
+                .num_samples = num_active_samples,
+                .num_blocks = std::min(thread_pool.Workers(), num_perturbed_params()),
+            };
+
+            for (int j = 0; j < optim_payload.num_blocks; j++) {
+                futures.at(j) =
+                    thread_pool.SubmitWithPayload<AccumulateGradientBlock<T>>(j, optim_payload);
+            }
+
+            for (int j = 0; j < optim_payload.num_blocks; j++) {
+                auto update_result = futures[j].get();
+                if (update_result.error) {
+                    return errors::report<OptimizationResult>(update_result.error);
+                }
+            }
+
+            if (auto err = optimizer->FinishUpdate()) {
+                return errors::report<OptimizationResult>(err);
+            }
+
+            // Swapping the buffers is constant time since only the pointers
+            // are exchanged.  The sample buffer is overwritten by the next
+            // population, so the callback is still free to use its first row.
+            if (reuse_samples) {
+                std::swap(samples, previous_samples);
+                num_previous_samples = num_active_samples;
+            }
 
-            if (update_result.error) {
-                return errors::report<OptimizationResult>(update_result.error);
+            // Pick the population for the next iteration.  The target is the
+            // population whose gradient is as reliable as the smallest one's
+            // would be without any noise.
+            if (_config.min_samples) {
+                const double target =
+                    *_config.min_samples / std::max(*population_snr, kPopulationMinSnr);
+                if (target > kPopulationChangeRatio * num_active_samples) {
+                    num_active_samples = std::min(_config.num_samples, 2 * num_active_samples);
+                } else if (kPopulationChangeRatio * target < num_active_samples) {
+                    num_active_samples =
+                        std::max(*_config.min_samples, num_active_samples / 4 * 2);
+                }
             }
 
-            timing_report.iterations.optimize[i] = update_result.time;
+            timing_report.iterations.optimize[i] = timer.GetElapsedTime();
         }
 
-        // Invoke any callbacks.  A render job is dispatched to get the current
-        // solution cost before calling the callback.
+        iterations++;
+
+        // Invoke any callbacks.  The callback is throttled so that it only
+        // runs periodically, plus once more on the final iteration.
+        bool invoke_callback = false;
         if (_callback) {
+            if (i == _config.iterations - 1) {
+                invoke_callback = true;
+            } else if (_config.callback_period) {
+                invoke_callback = callback_timer.GetElapsedTime() >= *_config.callback_period;
+            } else {
+                invoke_callback = i % _config.callback_interval == 0;
+            }
+        }
+
+        // The current solution is rendered to get its exact cost when the
+        // callback wants it.  The same cost is used to check against the
+        // target cost, and to track the best estimate, if the engine can stop
+        // early.
+        const bool can_stop_early =
+            _config.target_cost || _config.time_limit || _config.stop_token.stop_possible();
+        const bool render_estimate =
+            can_stop_early || (invoke_callback && _config.callback_exact_cost);
+
+        if (invoke_callback || render_estimate) {
             Profile profiler{callback_timing};
 
             // Need this timer because we need to estimate how long this
             // particular invocation took.
             Timer timer;
 
-            // Spawn a render job to compute the sample cost.
-            samples.row(0) = *optimizer->GetEstimate();
-            auto render_job = thread_pool.SubmitWithPayload<RenderAndCompare>(0, render_payload);
-            auto render_status = render_job.get();
-            if (render_status.error) {
-                return errors::report<OptimizationResult>(render_status.error);
+            // Render the estimate to compute its cost.  The costs passed to
+            // the callback are negated, like the sample costs.
+            auto estimate = optimizer->GetEstimate();
+            if (!estimate.has_value()) {
+                return errors::report<OptimizationResult>(estimate.error());
+            }
+
+            double estimate_cost = best_sample_cost;
+            if (render_estimate) {
+                auto cost = compute_final_cost(estimate->template cast<double>());
+                if (!cost.has_value()) {
+                    return errors::report<OptimizationResult>(cost.error());
+                }
+
+                estimate_cost = -*cost;
+                if (can_stop_early && *cost < best_estimate_cost) {
+                    best_estimate_cost = *cost;
+                    best_estimate = *estimate;
+                }
             }
 
             // *Now* invoke the callback.
-            _callback(i, costs(0), *optimizer->GetEstimate());
+            if (invoke_callback) {
+                _callback(i, estimate_cost, estimate->template cast<double>());
+                callback_timer = Timer();
+                last_callback = i;
+            }
 
             timing_report.iterations.callback[i] = timer.GetElapsedTime();
+
+            // The stored costs are negated, so flip the sign back before
+            // comparing against the target.
+            if (_config.target_cost && -estimate_cost <= *_config.target_cost) {
+                stop_reason = StopReason::TargetCost;
+                break;
+            }
         }
+    }
 
-        iterations++;
+    // Only report on the iterations that actually finished.
+    if (iterations < _config.iterations) {
+        timing_report.Truncate(iterations);
     }
 
-    // Wrap things up by rendering a final image to compute the comparison cost.
-    // (Will reuse one of the renderers for this since there's no reason to make
-    // a new one.)
-    auto solution = optimizer->GetEstimate();
-    if (!solution.has_value()) {
-        return errors::report<OptimizationResult>(solution.error());
+    // Write out the final checkpoint.  If the loop was interrupted part way
+    // through an iteration then the snapshot from the start of that iteration
+    // is used.  Otherwise the snapshot needs to reflect the final optimizer
+    // state.
+    if (checkpoint_writer) {
+        if (!snapshot || snapshot->iteration != iterations) {
+            auto state = take_snapshot(iterations);
+            if (!state.has_value()) {
+                return errors::report<OptimizationResult>(state.error());
+            }
+            snapshot = std::move(*state);
+        }
+
+        if (auto err = write_checkpoint(*snapshot)) {
+            return errors::report<OptimizationResult>(err);
+        }
+
+        auto status = pending_checkpoint->get();
+        if (status.error) {
+            return errors::report<OptimizationResult>(status.error);
+        }
     }
 
-    render::PackedShapeCollection image_abstraction(_config.shapes, *solution);
+    // Wrap things up by rendering a final image to compute the comparison cost.
+    // This is always done at the full resolution since the optimization may
+    // have stopped on one of the coarser pyramid levels.
+    auto estimate = optimizer->GetEstimate();
+    if (!estimate.has_value()) {
+        return errors::report<OptimizationResult>(estimate.error());
+    }
 
-    auto &renderer = render_payload.renderers.front();
-    renderer.SetAlphaScale(_config.alpha_scale);
-    renderer.SetBackground(0, 0, 0);
-    renderer.Render(image_abstraction);
+    // The optimizer isn't guaranteed to improve in every iteration, so an
+    // earlier estimate may be better than the current one when the engine
+    // stops early.
+    const bool use_best_estimate = best_estimate && stop_reason != StopReason::Completed;
+    const RowVector solution =
+        (use_best_estimate ? *best_estimate : *estimate).template cast<double>();
 
-    auto final_cost = ComputeCost(_config.comparison_metric, reference, renderer.DrawingSurface());
+    auto final_cost = compute_final_cost(solution);
     if (!final_cost.has_value()) {
         return errors::report<OptimizationResult>(final_cost.error());
     }
 
+    // The final iteration always gets a callback with the returned solution,
+    // even if the engine stopped before the throttled callback could run or
+    // returns an earlier estimate.  The cost is negated, like the others.
+    const bool returns_other_estimate = use_best_estimate && *best_estimate != *estimate;
+    if (_callback && iterations > first_iteration &&
+        (last_callback != iterations - 1 || returns_other_estimate)) {
+        Profile profiler{callback_timing};
+        _callback(iterations - 1, -*final_cost, solution);
+    }
+
     // Generate the final timing report by collecting all of the individual
     // timers and profilers.
     timing_report.total_time = e2e_timer.GetElapsedTime();
@@ -409,13 +2372,15 @@ Expected<OptimizationResult> Engine::GenerateAbstraction(const Image &reference)
     timing_report.stages.callback = callback_timing.GetTiming().total;
 
     OptimizationResult result{
-        .solution = *solution,
+        .solution = solution,
         .cost = *final_cost,
         .iterations = iterations,
+        .stop_reason = stop_reason,
         .aspect_ratio = static_cast<double>(reference.Width()) / reference.Height(),
         .alpha_scaling = _config.alpha_scale,
+        .coordinate_mapping = _config.coordinate_mapping,
         .shapes = _config.shapes,
-        .seed = prng_generator.BaseSeed(),
+        .seed = seed,
         .timing = timing_report,
     };
 
@@ -429,7 +2394,8 @@ void Engine::SetCallback(const std::function<void(int, double, ConstRowVectorRef
 Expected<Image> RenderImageAbstraction(const int width, const int height,
                                        const Options<render::AbstractionShape> shapes,
                                        ConstRowVectorRef solution, const double alpha_scale,
-                                       const Pixel background_colour) {
+                                       const Pixel background_colour, const int num_threads,
+                                       const render::CoordinateMapping mapping) {
     auto renderer = render::Renderer::Create(width, height);
     if (!renderer.has_value()) {
         errors::report<Image>(renderer.error());
@@ -438,7 +2404,9 @@ Expected<Image> RenderImageAbstraction(const int width, const int height,
     render::PackedShapeCollection packed_shapes(shapes, solution);
 
     renderer->SetAlphaScale(alpha_scale);
+    renderer->SetCoordinateMapping(mapping);
     renderer->SetBackground(background_colour);
+    renderer->SetThreadCount(num_threads);
     renderer->Render(packed_shapes);
     return renderer->DrawingSurface();
 }
@@ -461,3 +2429,40 @@ format_context::iterator formatter<ImageComparison>::format(ImageComparison metr
     }
     return formatter<string_view>::format(name, ctx);
 }
+
+format_context::iterator formatter<BlockSelection>::format(BlockSelection selection,
+                                                           format_context &ctx) const {
+    string_view name = "undefined";
+    switch (selection) {
+        case BlockSelection::RoundRobin:
+            name = "Round-Robin";
+            break;
+        case BlockSelection::Random:
+            name = "Random";
+            break;
+        case BlockSelection::ErrorGuided:
+            name = "Error-Guided";
+            break;
+    }
+    return formatter<string_view>::format(name, ctx);
+}
+
+format_context::iterator formatter<StopReason>::format(StopReason reason,
+                                                       format_context &ctx) const {
+    string_view name = "undefined";
+    switch (reason) {
+        case StopReason::Completed:
+            name = "Completed";
+            break;
+        case StopReason::TimeLimit:
+            name = "Time Limit";
+            break;
+        case StopReason::TargetCost:
+            name = "Target Cost";
+            break;
+        case StopReason::Cancelled:
+            name = "Cancelled";
+            break;
+    }
+    return formatter<string_view>::format(name, ctx);
+}
@@ -19,6 +19,36 @@ struct PixelDiff {
         blue{(detail::GetBlueValue(a) - detail::GetBlueValue(b)) / 255.0} {}
 };
 
+template <typename AccFn>
+Expected<double> RegionComparison(const Image &first, const Image &second, int x, int y,
+                                  AccFn fn) {
+    const int width = second.Width();
+    const int height = second.Height();
+
+    if (x < 0 || y < 0 || x + width > first.Width() || y + height > first.Height()) {
+        return errors::report<double>(
+            fmt::format("Cannot compare images; a {}x{} region at ({}, {}) is outside of the "
+                        "{}x{} image.",
+                        width, height, x, y, first.Width(), first.Height()));
+    }
+
+    PixelData ref = first.Pixels();
+    PixelData tgt = second.Pixels();
+
+    double sum = 0;
+    for (int j = 0; j < height; j++) {
+        auto row_ref = ref.Row(y + j) + x;
+        auto row_tgt = tgt.Row(j);
+
+        for (int i = 0; i < width; i++) {
+            PixelDiff diff(row_ref[i], row_tgt[i]);
+            sum += fn(diff);
+        }
+    }
+
+    return sum / (width * height);
+}
+
 template <typename AccFn>
 Expected<double> PixelwiseComparison(const Expected<Image> &first, const Expected<Image> &second,
                                      AccFn fn) {
@@ -34,24 +64,17 @@ Expected<double> PixelwiseComparison(const Expected<Image> &first, const Expecte
                         first->Width(), first->Height(), second->Width(), second->Height()));
     }
 
-    const int width = first->Width();
-    const int height = first->Height();
-
-    PixelData ref = first->Pixels();
-    PixelData tgt = second->Pixels();
-
-    double sum = 0;
-    for (int y = 0; y < height; y++) {
-        auto row_ref = ref.Row(y);
-        auto row_tgt = tgt.Row(y);
+    return RegionComparison(*first, *second, 0, 0, fn);
+}
 
-        for (int x = 0; x < width; x++) {
-            PixelDiff diff(row_ref[x], row_tgt[x]);
-            sum += fn(diff);
-        }
-    }
+/// @brief The absolute difference between two pixels.
+double AbsDiff(const PixelDiff &diff) {
+    return std::abs(diff.red) + std::abs(diff.green) + std::abs(diff.blue);
+}
 
-    return sum / (width * height);
+/// @brief The squared difference between two pixels.
+double SquaredDiff(const PixelDiff &diff) {
+    return diff.red * diff.red + diff.green * diff.green + diff.blue * diff.blue;
 }
 
 }  // namespace
@@ -187,16 +210,22 @@ Error Image::Save(const std::filesystem::path &path) const {
 }
 
 Expected<double> CompareImagesAbsDiff(const Expected<Image> &first, const Expected<Image> &second) {
-    return PixelwiseComparison(first, second, [](PixelDiff &diff) {
-        return std::abs(diff.red) + std::abs(diff.green) + std::abs(diff.blue);
-    });
+    return PixelwiseComparison(first, second, AbsDiff);
 }
 
 Expected<double> CompareImagesSquaredDiff(const Expected<Image> &first,
                                           const Expected<Image> &second) {
-    return PixelwiseComparison(first, second, [](PixelDiff &diff) {
-        return diff.red * diff.red + diff.green * diff.green + diff.blue * diff.blue;
-    });
+    return PixelwiseComparison(first, second, SquaredDiff);
+}
+
+Expected<double> CompareImageRegionAbsDiff(const Image &first, const Image &second, int x,
+                                           int y) {
+    return RegionComparison(first, second, x, y, AbsDiff);
+}
+
+Expected<double> CompareImageRegionSquaredDiff(const Image &first, const Image &second, int x,
+                                               int y) {
+    return RegionComparison(first, second, x, y, SquaredDiff);
 }
 
 }  // namespace abstractions
@@ -8,33 +8,78 @@ namespace abstractions {
 
 void to_json(nlohmann::json &json, const Options<render::AbstractionShape> shapes) {
     json = nlohmann::json::array();
+    render::ForEachShapeType([&]<typename Traits>(Traits) {
+        if (shapes & Traits::Shape) {
+            json.push_back(Traits::Name);
+        }
+    });
+}
 
-    if (shapes & render::AbstractionShape::Circles) {
-        json.push_back("circles");
+void from_json(const nlohmann::json &json, Options<render::AbstractionShape> &shapes) {
+    for (int i = 0; i < json.size(); i++) {
+        auto str = json.at(i).get<std::string>();
+        render::ForEachShapeType([&]<typename Traits>(Traits) {
+            if (str == Traits::Name) {
+                shapes.Set(Traits::Shape);
+            }
+        });
     }
+}
 
-    if (shapes & render::AbstractionShape::Rectangles) {
-        json.push_back("rectangles");
+void to_json(nlohmann::json &json, const OptimizerType type) {
+    switch (type) {
+        case OptimizerType::Pgpe:
+            json = "pgpe";
+            break;
+        case OptimizerType::Snes:
+            json = "snes";
+            break;
+        case OptimizerType::SepCmaEs:
+            json = "sep-cma-es";
+            break;
     }
+}
 
-    if (shapes & render::AbstractionShape::Triangles) {
-        json.push_back("triangles");
+void from_json(const nlohmann::json &json, OptimizerType &type) {
+    auto str = json.get<std::string>();
+    if (str == "pgpe") {
+        type = OptimizerType::Pgpe;
+    } else if (str == "snes") {
+        type = OptimizerType::Snes;
+    } else if (str == "sep-cma-es") {
+        type = OptimizerType::SepCmaEs;
     }
 }
 
-void from_json(const nlohmann::json &json, Options<render::AbstractionShape> &shapes) {
-    for (int i = 0; i < json.size(); i++) {
-        auto str = json.at(i).get<std::string>();
-        if (str == "circles") {
-            shapes.Set(render::AbstractionShape::Circles);
-        } else if (str == "rectangles") {
-            shapes.Set(render::AbstractionShape::Rectangles);
-        } else if (str == "triangles") {
-            shapes.Set(render::AbstractionShape::Triangles);
-        }
+namespace render {
+
+void to_json(nlohmann::json &json, const CoordinateMapping mapping) {
+    switch (mapping) {
+        case CoordinateMapping::Rescaled:
+            json = "rescaled";
+            break;
+        case CoordinateMapping::Clamped:
+            json = "clamped";
+            break;
+        case CoordinateMapping::Sigmoid:
+            json = "sigmoid";
+            break;
     }
 }
 
+void from_json(const nlohmann::json &json, CoordinateMapping &mapping) {
+    auto str = json.get<std::string>();
+    if (str == "rescaled") {
+        mapping = CoordinateMapping::Rescaled;
+    } else if (str == "clamped") {
+        mapping = CoordinateMapping::Clamped;
+    } else if (str == "sigmoid") {
+        mapping = CoordinateMapping::Sigmoid;
+    }
+}
+
+}  // namespace render
+
 }  // namespace abstractions
 
 namespace nlohmann {
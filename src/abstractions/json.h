@@ -1,6 +1,8 @@
 #pragma once
 
 #include <abstractions/math/types.h>
+#include <abstractions/optimizer.h>
+#include <abstractions/render/canvas.h>
 #include <abstractions/render/shapes.h>
 
 #include <nlohmann/json.hpp>
@@ -9,6 +11,16 @@ namespace abstractions {
 void to_json(nlohmann::json &json, const Options<render::AbstractionShape> shapes);
 void from_json(const nlohmann::json &json, Options<render::AbstractionShape> &shapes);
 
+void to_json(nlohmann::json &json, const OptimizerType type);
+void from_json(const nlohmann::json &json, OptimizerType &type);
+
+namespace render {
+
+void to_json(nlohmann::json &json, const CoordinateMapping mapping);
+void from_json(const nlohmann::json &json, CoordinateMapping &mapping);
+
+}  // namespace render
+
 }  // namespace abstractions
 
 namespace nlohmann {
@@ -0,0 +1,178 @@
+#include "abstractions/optimizer.h"
+
+#include <abstractions/errors.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace abstractions {
+
+template <typename T>
+void IOptimizer<T>::RankLinearize(BasicColumnVectorRef<T> costs) {
+    const int num_costs = costs.rows();
+    std::vector<int> indices(num_costs);
+
+    std::iota(std::begin(indices), std::end(indices), 0);
+    std::sort(std::begin(indices), std::end(indices),
+              [costs](const int &a, const int &b) -> bool { return costs(a) < costs(b); });
+
+    for (int i = 0; i < num_costs; i++) {
+        costs(indices[i]) = static_cast<double>(i) / (num_costs - 1) - 0.5;
+    }
+}
+
+template <typename T>
+Error IOptimizer<T>::Sample(BasicMatrixRef<T> samples) {
+    return SampleBlock(samples, 0, samples.cols(), NewPopulation());
+}
+
+template <typename T>
+Error IOptimizer<T>::SetActiveParameters(const std::vector<int> &params) {
+    if (!params.empty()) {
+        return fmt::format("The {} optimizer doesn't support block-coordinate updates.", Type());
+    }
+    return errors::no_error;
+}
+
+template <typename T>
+Error IOptimizer<T>::MixPopulation(BasicMatrixRef<T> samples, BasicColumnVectorRef<T>,
+                                  ConstBasicMatrixRef<T>, ConstBasicColumnVectorRef<T>, uint32_t,
+                                  std::vector<int> &fresh_samples) {
+    fresh_samples.resize(samples.rows());
+    std::iota(std::begin(fresh_samples), std::end(fresh_samples), 0);
+    return errors::no_error;
+}
+
+template <typename T>
+Error IOptimizer<T>::Update(ConstBasicMatrixRef<T> samples, ConstBasicColumnVectorRef<T> costs) {
+    if (auto err = BeginUpdate(samples, costs)) {
+        return err;
+    }
+
+    if (auto err = AccumulateGradients(samples, 0, samples.cols())) {
+        return err;
+    }
+
+    return FinishUpdate();
+}
+
+template <typename T>
+Error IOptimizer<T>::CheckInitialized(bool is_initialized) {
+    if (!is_initialized) {
+        return "Cannot perform operation; optimizer has not been initialized.";
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error IOptimizer<T>::ValidateCosts(int num_samples, ConstBasicColumnVectorRef<T> costs) {
+    if (costs.rows() != num_samples) {
+        return fmt::format("The number of costs ({}) doesn't match the number of samples ({}).",
+                           costs.rows(), num_samples);
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error IOptimizer<T>::ValidateSamples(ConstBasicMatrixRef<T> samples, int num_params) {
+    if (samples.rows() < 2) {
+        return fmt::format("Samples matrix has {} rows; it must have at least two.",
+                           samples.rows());
+    }
+
+    if (samples.cols() != num_params) {
+        return fmt::format(
+            "Number of columns in samples matrix ({}) does not match the size of the parameters "
+            "vector ({}).",
+            samples.cols(), num_params);
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error IOptimizer<T>::ValidateMirroredSamples(ConstBasicMatrixRef<T> samples, int num_params) {
+    if (samples.rows() == 0 || (samples.rows() % 2) != 0) {
+        return fmt::format("Samples matrix has {} rows; it must be greater than zero and even.",
+                           samples.rows());
+    }
+
+    return ValidateSamples(samples, num_params);
+}
+
+template <typename T>
+Error IOptimizer<T>::ValidateBlock(ConstBasicMatrixRef<T> samples, int first_param,
+                                   int num_params) {
+    if (first_param < 0 || num_params < 0 || first_param + num_params > samples.cols()) {
+        return fmt::format("Parameter block [{}, {}) is outside of the {} sampled parameters.",
+                           first_param, first_param + num_params, samples.cols());
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+void IOptimizer<T>::DrawNoise(BasicMatrixRef<T> samples, int param, int num_rows,
+                              DefaultRngType::result_type seed, uint32_t population) {
+    Philox4x32 generator(seed, population, param, kPrngStream);
+    ZigguratNormal dist;
+
+    // The matrices are column-major so each column is contiguous in memory.
+    auto column = samples.col(param).head(num_rows);
+    dist.Fill(generator, std::span(column.data(), num_rows));
+}
+
+template <typename T>
+void IOptimizer<T>::DrawMirroredSamples(BasicMatrixRef<T> samples, int param, T mean, T stddev,
+                                        DefaultRngType::result_type seed, uint32_t population) {
+    const int random_samples = samples.rows() / 2;
+    DrawNoise(samples, param, random_samples, seed, population);
+
+    auto top = samples.col(param).head(random_samples);
+    auto bottom = samples.col(param).tail(random_samples);
+    bottom.array() = mean - stddev * top.array();
+    top.array() = mean + stddev * top.array();
+}
+
+template <typename T>
+void IOptimizer<T>::InsertValues(BasicRowVector<T> &vector, int index,
+                                 ConstBasicRowVectorRef<T> values) {
+    const int num_tail = vector.cols() - index;
+
+    BasicRowVector<T> grown(vector.cols() + values.cols());
+    grown.head(index) = vector.head(index);
+    grown.segment(index, values.cols()) = values;
+    grown.tail(num_tail) = vector.tail(num_tail);
+    vector = std::move(grown);
+}
+
+template class IOptimizer<double>;
+template class IOptimizer<float>;
+
+}  // namespace abstractions
+
+using namespace abstractions;
+using namespace fmt;
+
+format_context::iterator formatter<OptimizerType>::format(OptimizerType type,
+                                                          format_context &ctx) const {
+    string_view name = "undefined";
+    switch (type) {
+        case OptimizerType::Pgpe:
+            name = "PGPE";
+            break;
+        case OptimizerType::Snes:
+            name = "SNES";
+            break;
+        case OptimizerType::SepCmaEs:
+            name = "sep-CMA-ES";
+            break;
+    }
+    return formatter<string_view>::format(name, ctx);
+}
@@ -5,9 +5,9 @@
 #include <abstractions/math/random.h>
 #include <fmt/format.h>
 
+#include <algorithm>
 #include <cmath>
 #include <expected>
-#include <numeric>
 #include <optional>
 #include <string>
 #include <vector>
@@ -16,12 +16,81 @@ namespace abstractions {
 
 namespace {
 
-RowVector ClipUp(ConstRowVectorRef velocity, ConstRowVectorRef &x_grad, const double v_max,
-                 const double momentum) {
-    const double alpha = v_max / 2.0;
-    RowVector velocity_next = momentum * velocity + alpha * (x_grad / x_grad.norm());
-    float velocity_norm = velocity_next.norm();
-    return velocity_norm > v_max ? v_max * velocity_next.normalized() : velocity_next;
+/// @brief Apply the ClipUp velocity update in place.
+/// @param velocity current velocity; replaced with the updated velocity
+/// @param x_grad solution gradient
+/// @param v_max maximum speed
+/// @param momentum velocity momentum
+template <typename T>
+void ClipUp(BasicRowVector<T> &velocity, ConstBasicRowVectorRef<T> x_grad, const T v_max,
+            const T momentum) {
+    const T alpha = v_max / 2;
+    velocity = momentum * velocity + alpha * (x_grad / x_grad.norm());
+    float velocity_norm = velocity.norm();
+    if (velocity_norm > v_max) {
+        velocity = v_max * (velocity / velocity.norm());
+    }
+}
+
+/// @brief Apply the PGPE standard deviation update in place.
+/// @param stddev current standard deviation; replaced with the updated one
+/// @param stddev_grad standard deviation gradient
+/// @param settings optimizer settings
+///
+/// The estimate is clamped so that it never goes to zero or gets too large.
+/// Every coefficient only depends on its own previous value so this can be
+/// done in place.
+template <typename T>
+void UpdateStdDev(BasicRowVector<T> &stddev, ConstBasicRowVectorRef<T> stddev_grad,
+                  const PgpeOptimizerSettings &settings) {
+    const T learning_rate = settings.stddev_learning_rate;
+    const T stddev_upper = 1 + settings.stddev_max_change;
+    const T stddev_lower = 1 - settings.stddev_max_change;
+    stddev = (stddev + learning_rate * stddev_grad)
+                 .cwiseMin(stddev_upper * stddev)
+                 .cwiseMax((stddev_lower * stddev).cwiseMax(T(1e-9)));
+}
+
+/// @brief Call a function for every active parameter within a block.
+/// @param active the active parameters, in increasing order; every parameter
+///     is active if it's empty
+/// @param first_param the first parameter in the block
+/// @param num_params the number of parameters in the block
+/// @param fn function called with each active parameter's index
+template <typename F>
+void ForEachActiveParameter(const std::vector<int> &active, int first_param, int num_params,
+                            F &&fn) {
+    const int last_param = first_param + num_params;
+    if (active.empty()) {
+        for (int i = first_param; i < last_param; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    auto it = std::lower_bound(active.begin(), active.end(), first_param);
+    for (; it != active.end() && *it < last_param; ++it) {
+        fn(*it);
+    }
+}
+
+/// @brief Compute the log-likelihood ratio of a sample under two diagonal
+///     Gaussian distributions.
+/// @param sample the sample
+/// @param mean mean of the numerator's distribution
+/// @param stddev standard deviation of the numerator's distribution
+/// @param other_mean mean of the denominator's distribution
+/// @param other_stddev standard deviation of the denominator's distribution
+/// @return `log(p(sample) / q(sample))`
+template <typename T>
+double LogDensityRatio(ConstBasicRowVectorRef<T> sample, ConstBasicRowVectorRef<T> mean,
+                       ConstBasicRowVectorRef<T> stddev, ConstBasicRowVectorRef<T> other_mean,
+                       ConstBasicRowVectorRef<T> other_stddev) {
+    const auto z = (sample - mean).array() / stddev.array();
+    const auto other_z = (sample - other_mean).array() / other_stddev.array();
+    return ((other_z.square() - z.square()) / T(2) + (other_stddev.array() / stddev.array()).log())
+        .template cast<double>()
+        .sum();
 }
 
 }  // anonymous namespace
@@ -45,11 +114,16 @@ Error PgpeOptimizerSettings::Validate() const {
     if (stddev_max_change < 0) {
         return "Standard deviation maximum change cannot be negative.";
     }
+    if (min_refresh_rate && (*min_refresh_rate <= 0 || *min_refresh_rate > 1)) {
+        return fmt::format("Minimum refresh rate must be on (0, 1], not {}.", *min_refresh_rate);
+    }
 
     return errors::no_error;
 }
 
-Expected<PgpeOptimizer> PgpeOptimizer::New(const PgpeOptimizerSettings &settings) {
+template <typename T>
+Expected<BasicPgpeOptimizer<T>> BasicPgpeOptimizer<T>::New(
+    const PgpeOptimizerSettings &settings) {
     auto err = settings.Validate();
     if (err) {
         return std::unexpected(err);
@@ -62,116 +136,342 @@ Expected<PgpeOptimizer> PgpeOptimizer::New(const PgpeOptimizerSettings &settings
         seed = PrngGenerator<>::DrawRandomSeed();
     }
 
-    return PgpeOptimizer(settings, seed);
+    return BasicPgpeOptimizer(settings, seed);
 }
 
-PgpeOptimizer::PgpeOptimizer(const PgpeOptimizerSettings &settings, const uint32_t seed) :
-    _is_initialized{true},
+template <typename T>
+BasicPgpeOptimizer<T>::BasicPgpeOptimizer(const PgpeOptimizerSettings &settings,
+                                          DefaultRngType::result_type seed) :
+    _is_initialized{false},
     _settings{settings},
-    _dist{Prng(seed), 0, 1} {}
+    _seed{seed},
+    _population{0},
+    _has_previous_distribution{false},
+    _mixed_population{false},
+    _update_pending{false} {}
+
+template <typename T>
+OptimizerType BasicPgpeOptimizer<T>::Type() const {
+    return OptimizerType::Pgpe;
+}
 
-Expected<RowVector> PgpeOptimizer::GetEstimate() const {
-    auto err = CheckInitialized();
+template <typename T>
+Expected<BasicRowVector<T>> BasicPgpeOptimizer<T>::GetEstimate() const {
+    auto err = CheckInitialized(_is_initialized);
     if (err) {
-        return errors::report<RowVector>(err);
+        return errors::report<BasicRowVector<T>>(err);
     }
 
     return _current_state;
 }
 
-Expected<RowVector> PgpeOptimizer::GetSolutionStdDev() const {
-    auto err = CheckInitialized();
+template <typename T>
+Expected<BasicRowVector<T>> BasicPgpeOptimizer<T>::GetSolutionStdDev() const {
+    auto err = CheckInitialized(_is_initialized);
     if (err) {
-        return errors::report<RowVector>(err);
+        return errors::report<BasicRowVector<T>>(err);
     }
 
     return _current_standard_deviation;
 }
 
-Expected<RowVector> PgpeOptimizer::GetSolutionVelocity() const {
-    auto err = CheckInitialized();
+template <typename T>
+Expected<BasicRowVector<T>> BasicPgpeOptimizer<T>::GetSolutionVelocity() const {
+    auto err = CheckInitialized(_is_initialized);
     if (err) {
-        return errors::report<RowVector>(err);
+        return errors::report<BasicRowVector<T>>(err);
     }
 
     return _current_velocity;
 }
 
-const PgpeOptimizerSettings &PgpeOptimizer::GetSettings() const {
+template <typename T>
+const PgpeOptimizerSettings &BasicPgpeOptimizer<T>::GetSettings() const {
     return _settings;
 }
 
-void PgpeOptimizer::SetPrngSeed(DefaultRngType::result_type seed) {
-    _dist = NormalDistribution(Prng(seed), 0, 1);
+template <typename T>
+Expected<OptimizerState> BasicPgpeOptimizer<T>::GetState() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<OptimizerState>(err);
+    }
+
+    return OptimizerState{
+        .type = OptimizerType::Pgpe,
+        .state = _current_state.template cast<double>(),
+        .standard_deviation = _current_standard_deviation.template cast<double>(),
+        .vectors = {{"velocity", _current_velocity.template cast<double>()}},
+        .seed = _seed,
+        .population = _population,
+    };
 }
 
-void PgpeOptimizer::Initialize(ConstRowVectorRef x_init, std::optional<double> init_stddev) {
+template <typename T>
+Error BasicPgpeOptimizer<T>::SetState(const OptimizerState &state) {
+    if (state.type != OptimizerType::Pgpe) {
+        return fmt::format("Cannot restore a {} optimizer state into a PGPE optimizer.",
+                           state.type);
+    }
+
+    auto velocity = state.vectors.find("velocity");
+    if (velocity == state.vectors.end()) {
+        return "The optimizer state is missing the PGPE velocity.";
+    }
+
+    const int num_dim = state.state.cols();
+    if (state.standard_deviation.cols() != num_dim || velocity->second.cols() != num_dim) {
+        return fmt::format(
+            "Optimizer state vectors must be the same length (state: {}, stddev: {}, velocity: "
+            "{}).",
+            num_dim, state.standard_deviation.cols(), velocity->second.cols());
+    }
+
+    _current_state = state.state.cast<T>();
+    _current_standard_deviation = state.standard_deviation.cast<T>();
+    _current_velocity = velocity->second.cast<T>();
+    _seed = state.seed;
+    _population = state.population;
+    _is_initialized = true;
+    _has_previous_distribution = false;
+    _active_params.clear();
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+void BasicPgpeOptimizer<T>::SetPrngSeed(DefaultRngType::result_type seed) {
+    _seed = seed;
+    _population = 0;
+}
+
+template <typename T>
+void BasicPgpeOptimizer<T>::Initialize(ConstBasicRowVectorRef<T> x_init,
+                                       std::optional<double> init_stddev) {
     const int num_dim = x_init.cols();
-    const double stddev_magnitude = _settings.init_search_radius * _settings.max_speed;
-    const double stddev_unit_norm = 1.0 / std::sqrt(num_dim);
+    const T stddev_magnitude = _settings.init_search_radius * _settings.max_speed;
+    const T stddev_unit_norm = 1.0 / std::sqrt(num_dim);
 
     _current_state = x_init;
-    _current_standard_deviation = RowVector::Ones(num_dim);
-    _current_velocity = RowVector::Zero(num_dim);
+    _current_standard_deviation = BasicRowVector<T>::Ones(num_dim);
+    _current_velocity = BasicRowVector<T>::Zero(num_dim);
     _is_initialized = true;
+    _has_previous_distribution = false;
+    _active_params.clear();
+    _update_pending = false;
 
     if (init_stddev) {
-        _current_standard_deviation *= init_stddev.value();
+        _current_standard_deviation *= static_cast<T>(init_stddev.value());
     } else {
         _current_standard_deviation *= stddev_magnitude * stddev_unit_norm;
     }
 }
 
-void PgpeOptimizer::Initialize(int num_dim, double init_stddev) {
-    _current_state = RowVector::Zero(num_dim);
-    _current_standard_deviation = RowVector::Ones(num_dim) * init_stddev;
-    _current_velocity = RowVector::Zero(num_dim);
+template <typename T>
+void BasicPgpeOptimizer<T>::Initialize(int num_dim, double init_stddev) {
+    _current_state = BasicRowVector<T>::Zero(num_dim);
+    _current_standard_deviation = BasicRowVector<T>::Constant(num_dim, init_stddev);
+    _current_velocity = BasicRowVector<T>::Zero(num_dim);
     _is_initialized = true;
+    _has_previous_distribution = false;
+    _active_params.clear();
+    _update_pending = false;
 }
 
-void PgpeOptimizer::RankLinearize(ColumnVectorRef costs) const {
-    const int num_costs = costs.rows();
-    std::vector<int> indices(num_costs);
+template <typename T>
+Error BasicPgpeOptimizer<T>::InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                                              std::optional<double> init_stddev) {
+    if (auto err = CheckInitialized(_is_initialized)) {
+        return err;
+    }
 
-    std::iota(std::begin(indices), std::end(indices), 0);
-    std::sort(std::begin(indices), std::end(indices),
-              [costs](const int &a, const int &b) -> bool { return costs(a) < costs(b); });
+    const int num_dim = _current_state.cols();
+    const int num_new = values.cols();
 
-    for (int i = 0; i < num_costs; i++) {
-        costs(indices[i]) = static_cast<double>(i) / (num_costs - 1) - 0.5;
+    if (index < 0 || index > num_dim) {
+        return fmt::format("Insertion index {} is outside of the solution vector (length {}).",
+                           index, num_dim);
     }
+
+    const T stddev =
+        init_stddev.value_or(num_dim > 0 ? _current_standard_deviation.mean() : T(0.1));
+    InsertValues(_current_state, index, values);
+    InsertValues(_current_standard_deviation, index, BasicRowVector<T>::Constant(num_new, stddev));
+    InsertValues(_current_velocity, index, BasicRowVector<T>::Zero(num_new));
+    _has_previous_distribution = false;
+    _active_params.clear();
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+uint32_t BasicPgpeOptimizer<T>::NewPopulation() {
+    _mixed_population = false;
+    return _population++;
 }
 
-Error PgpeOptimizer::Sample(MatrixRef samples) {
-    auto err = errors::find_any({CheckInitialized(), ValidateSamples(samples)});
+template <typename T>
+Error BasicPgpeOptimizer<T>::SampleBlock(BasicMatrixRef<T> samples, int first_param,
+                                         int num_params, uint32_t population) const {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateMirroredSamples(samples, _current_state.cols()),
+                                 ValidateBlock(samples, first_param, num_params)});
     if (err) {
         return err;
     }
 
-    const int num_samples = samples.rows();
-    const int num_params = samples.cols();
+    // Fill the top half of each column with normally distributed values on
+    // N(0, 1).  The bottom half is the negation of the top half to mirror the
+    // samples.  Each one is then scaled by the current standard deviation
+    // estimate and offset by the current state estimate.  Any inactive
+    // parameters are skipped entirely.
+    ForEachActiveParameter(_active_params, first_param, num_params, [&](int i) {
+        DrawMirroredSamples(samples, i, _current_state(i), _current_standard_deviation(i), _seed,
+                            population);
+    });
 
-    // Fill the samples array with normally distributed values on N(0, 1).  The
-    // bottom half is the negation of the top half to prepare to mirror the
-    // samples.
+    return errors::no_error;
+}
 
-    const int random_samples = num_samples / 2;
-    samples.topRows(random_samples) = RandomMatrix(random_samples, num_params, _dist);
-    samples.bottomRows(random_samples) = -samples.topRows(random_samples);
+template <typename T>
+Error BasicPgpeOptimizer<T>::SetActiveParameters(const std::vector<int> &params) {
+    if (auto err = CheckInitialized(_is_initialized)) {
+        return err;
+    }
 
-    // Scale the parameters (columns) by the current standard deviation
-    // estimate.
-    samples.array().rowwise() *= _current_standard_deviation.array();
+    const int num_dim = _current_state.cols();
+    for (int k = 0; k < static_cast<int>(params.size()); k++) {
+        if (params[k] < 0 || params[k] >= num_dim) {
+            return fmt::format("Active parameter {} is outside of the solution vector (length {}).",
+                               params[k], num_dim);
+        }
 
-    // Now add the current state estimate to get the final set of samples.
-    samples.rowwise() += _current_state;
+        if (k > 0 && params[k] <= params[k - 1]) {
+            return "The active parameters must be unique and in increasing order.";
+        }
+    }
 
+    _active_params = params;
+    _update_pending = false;
     return errors::no_error;
 }
 
-Error PgpeOptimizer::Update(ConstMatrixRef samples, ConstColumnVectorRef costs) {
-    auto err = errors::find_any(
-        {CheckInitialized(), ValidateSamples(samples), ValidateCosts(samples.rows(), costs)});
+template <typename T>
+const std::vector<int> &BasicPgpeOptimizer<T>::GetActiveParameters() const {
+    return _active_params;
+}
+
+template <typename T>
+Error BasicPgpeOptimizer<T>::MixPopulation(BasicMatrixRef<T> samples, BasicColumnVectorRef<T> costs,
+                                           ConstBasicMatrixRef<T> previous_samples,
+                                           ConstBasicColumnVectorRef<T> previous_costs,
+                                           uint32_t population, std::vector<int> &fresh_samples) {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateMirroredSamples(samples, _current_state.cols()),
+                                 ValidateCosts(samples.rows(), costs),
+                                 ValidateCosts(previous_samples.rows(), previous_costs)});
+    if (err) {
+        return err;
+    }
+
+    _mixed_population = false;
+    if (!_settings.min_refresh_rate || !_has_previous_distribution || !_active_params.empty() ||
+        previous_samples.rows() == 0) {
+        return IOptimizer<T>::MixPopulation(samples, costs, previous_samples, previous_costs,
+                                            population, fresh_samples);
+    }
+
+    if (previous_samples.cols() != samples.cols() || previous_samples.rows() % 2 != 0) {
+        return fmt::format(
+            "Previous samples matrix ({}x{}) must have an even number of rows and match the "
+            "number of parameters ({}).",
+            previous_samples.rows(), previous_samples.cols(), samples.cols());
+    }
+
+    // A mirrored pair is treated as a single sample whose log-likelihood ratio
+    // is the average of its two members.  The pairs of the previous population
+    // were mirrored around the previous mean, so the average keeps the ratio
+    // symmetric.
+    auto pair_ratio = [&](ConstBasicMatrixRef<T> pairs, int pair, auto &&ratio) {
+        const int num_pairs = pairs.rows() / 2;
+        return (ratio(pairs.row(pair)) + ratio(pairs.row(pair + num_pairs))) / 2;
+    };
+    auto current_over_previous = [&](ConstBasicRowVectorRef<T> sample) {
+        return LogDensityRatio<T>(sample, _current_state, _current_standard_deviation,
+                                  _previous_state, _previous_standard_deviation);
+    };
+
+    const double refresh_rate = *_settings.min_refresh_rate;
+    const int num_pairs = samples.rows() / 2;
+    const int num_previous = previous_samples.rows() / 2;
+
+    Philox4x32 generator(_seed, population, 0, IOptimizer<T>::kMixingPrngStream);
+    StandardUniform uniform;
+
+    // Step 1: keep the previous pairs that are still likely under the current
+    // distribution.
+    std::vector<int> reused;
+    for (int k = 0; k < num_previous && static_cast<int>(reused.size()) < num_pairs; k++) {
+        const double log_ratio = pair_ratio(previous_samples, k, current_over_previous);
+        if (uniform(generator) < (1 - refresh_rate) * std::exp(log_ratio)) {
+            reused.push_back(k);
+        }
+    }
+
+    // Step 2: accept new pairs from regions the previous distribution rarely
+    // covered.  The population is topped up with the rejected pairs, in order,
+    // if not enough were accepted.
+    const int num_fresh = num_pairs - static_cast<int>(reused.size());
+    std::vector<bool> is_fresh(num_pairs, false);
+    int num_accepted = 0;
+    for (int k = 0; k < num_pairs && num_accepted < num_fresh; k++) {
+        const double log_ratio = pair_ratio(samples, k, current_over_previous);
+        if (uniform(generator) < std::max(refresh_rate, 1 - std::exp(-log_ratio))) {
+            is_fresh[k] = true;
+            num_accepted++;
+        }
+    }
+    for (int k = 0; k < num_pairs && num_accepted < num_fresh; k++) {
+        if (!is_fresh[k]) {
+            is_fresh[k] = true;
+            num_accepted++;
+        }
+    }
+
+    // Step 3: the fresh pairs stay where they were sampled and the reused
+    // pairs, along with their costs, fill the remaining slots.
+    fresh_samples.clear();
+    auto next_reused = reused.begin();
+    for (int k = 0; k < num_pairs; k++) {
+        if (is_fresh[k]) {
+            fresh_samples.push_back(k);
+            continue;
+        }
+
+        const int previous = *next_reused++;
+        samples.row(k) = previous_samples.row(previous);
+        samples.row(k + num_pairs) = previous_samples.row(previous + num_previous);
+        costs(k) = previous_costs(previous);
+        costs(k + num_pairs) = previous_costs(previous + num_previous);
+    }
+
+    const int num_fresh_pairs = fresh_samples.size();
+    for (int k = 0; k < num_fresh_pairs; k++) {
+        fresh_samples.push_back(fresh_samples[k] + num_pairs);
+    }
+
+    _mixed_population = !reused.empty();
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicPgpeOptimizer<T>::BeginUpdate(ConstBasicMatrixRef<T> samples,
+                                         ConstBasicColumnVectorRef<T> costs) {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateMirroredSamples(samples, _current_state.cols()),
+                                 ValidateCosts(samples.rows(), costs)});
 
     if (err) {
         return err;
@@ -180,92 +480,136 @@ Error PgpeOptimizer::Update(ConstMatrixRef samples, ConstColumnVectorRef costs)
     // Now we can do the parameter updates.  This follows Algorithm 1 from the
     // ClipUp paper.  Step 2 (build the population) is accomplished in the
     // Sample() method.  The gradient computation is the remaining steps.
+    //
+    // All of the intermediate values are kept in a workspace that is reused
+    // between updates.  Resizing it is a no-op unless the problem size has
+    // changed, so a steady-state update never touches the heap.
 
     const int num_samples = samples.rows() / 2;
+    const int num_params = samples.cols();
 
-    // The "d+ - x_k" is common to both the solution and standard deviation
-    // gradients so it can be factored out and computed first.  This is equal
-    // to pertubation added to x_k since "d+ = x_k + sigma" and
-    // "d- = x_k - sigma".  The mean fitness can also be computed.
-
-    const Matrix perturbations = samples.topRows(num_samples).rowwise() - _current_state;
-    const double baseline_cost = costs.mean();
-
-    // Compute what's needed for getting the solution gradient
-    const ColumnVector delta_cost =
-        (costs.topRows(num_samples) - costs.bottomRows(num_samples)) / 2.0;
-
-    // Compute what's needed for getting the standard deviation gradient
-    const ColumnVector stddev_weights =
-        ((costs.topRows(num_samples) + costs.bottomRows(num_samples)) / 2.0).array() -
-        baseline_cost;
-    const Matrix stddev_directions =
-        (perturbations.array().pow(2).rowwise() - _current_standard_deviation.array().pow(2))
-            .rowwise() /
-        _current_standard_deviation.array();
-
-    // Finally, compute the gradients
-    const RowVector grad_solution =
-        (delta_cost.asDiagonal() * perturbations).colwise().sum() / num_samples;
-    const RowVector grad_stddev =
-        (stddev_weights.asDiagonal() * stddev_directions).colwise().sum() / num_samples;
-
-    // Use ClipUp to compute the updated velocity and state
-    const RowVector updated_velocity =
-        ClipUp(_current_velocity, grad_solution, _settings.max_speed, _settings.momentum);
-    const RowVector updated_state = _current_state + updated_velocity;
-
-    // Find the next standard deviation estimation, clamping the estimate so
-    // that it never goes to zero or gets too large.
-    const RowVector stddev_upper = (1 + _settings.stddev_max_change) * _current_standard_deviation;
-    const RowVector stddev_lower =
-        ((1 - _settings.stddev_max_change) * _current_standard_deviation).cwiseMax(1e-9);
-    const RowVector updated_stddev =
-        (_current_standard_deviation + _settings.stddev_learning_rate * grad_stddev)
-            .cwiseMin(stddev_upper)
-            .cwiseMax(stddev_lower);
-
-    _current_state = updated_state;
-    _current_standard_deviation = updated_stddev;
-    _current_velocity = updated_velocity;
+    _delta_cost.resize(num_samples);
+    _stddev_weights.resize(num_samples);
+    _sample_weights.resize(samples.rows());
+    _grad_solution.resize(num_params);
+    _grad_stddev.resize(num_params);
+
+    // The per-sample weights are shared by every parameter so they are
+    // computed once up front.  The baseline is the mean fitness.
+    const T baseline_cost = costs.mean();
+    if (_mixed_population) {
+        // Reused pairs aren't mirrored around the current solution, so every
+        // sample gets its own weight.
+        _sample_weights = costs.array() - baseline_cost;
+    } else {
+        _delta_cost = (costs.topRows(num_samples) - costs.bottomRows(num_samples)) / T(2);
+        _stddev_weights =
+            ((costs.topRows(num_samples) + costs.bottomRows(num_samples)) / T(2)).array() -
+            baseline_cost;
+    }
 
+    _update_pending = true;
     return errors::no_error;
 }
 
-Error PgpeOptimizer::CheckInitialized() const {
-    if (!_is_initialized) {
-        return "Cannot perform operation; pptimizer has not been initialized.";
+template <typename T>
+Error BasicPgpeOptimizer<T>::AccumulateGradients(ConstBasicMatrixRef<T> samples,
+                                                 int first_param, int num_params) {
+    if (!_update_pending) {
+        return "Cannot accumulate gradients; no update is in progress.";
     }
 
-    return errors::no_error;
-}
+    if (first_param < 0 || num_params < 0 || first_param + num_params > _grad_solution.cols()) {
+        return fmt::format("Parameter block [{}, {}) is outside of the {} updated parameters.",
+                           first_param, first_param + num_params, _grad_solution.cols());
+    }
 
-Error PgpeOptimizer::ValidateCosts(int num_samples, ConstColumnVectorRef costs) const {
-    if (costs.rows() != num_samples) {
-        return fmt::format("The number of costs ({}) doesn't match the number of samples ({}).",
-                           costs.rows(), num_samples);
+    // Both gradients need "d+ - x_k", which is the perturbation that was added
+    // to x_k since "d+ = x_k + sigma" and "d- = x_k - sigma".  The matrices are
+    // column-major, so both gradients for a parameter are accumulated in a
+    // single pass over its column without materializing the perturbations.
+    //
+    // After importance mixing the pairs are no longer symmetric, so the sums
+    // are taken over every sample instead.  For mirrored pairs, both forms
+    // produce the same gradients.
+    if (_mixed_population) {
+        const int num_samples = _sample_weights.rows();
+        ForEachActiveParameter(_active_params, first_param, num_params, [&](int i) {
+            const T state = _current_state(i);
+            const T stddev = _current_standard_deviation(i);
+            const auto perturbations = samples.col(i).array() - state;
+
+            _grad_solution(i) = (_sample_weights.array() * perturbations).sum() / num_samples;
+            _grad_stddev(i) =
+                (_sample_weights.array() * (perturbations.square() - stddev * stddev)).sum() /
+                (stddev * num_samples);
+        });
+
+        return errors::no_error;
     }
 
+    const int num_samples = _delta_cost.rows();
+    ForEachActiveParameter(_active_params, first_param, num_params, [&](int i) {
+        const T state = _current_state(i);
+        const T stddev = _current_standard_deviation(i);
+        const auto perturbations = samples.col(i).head(num_samples).array() - state;
+
+        _grad_solution(i) = (_delta_cost.array() * perturbations).sum() / num_samples;
+        _grad_stddev(i) =
+            (_stddev_weights.array() * (perturbations.square() - stddev * stddev)).sum() /
+            (stddev * num_samples);
+    });
+
     return errors::no_error;
 }
 
-Error PgpeOptimizer::ValidateSamples(ConstMatrixRef samples) const {
-    const int num_samples = samples.rows();
-    const int num_params = samples.cols();
-
-    if (num_samples == 0 || (num_samples % 2) != 0) {
-        return fmt::format("Samples matrix has {} rows; it must be greater than zero and even.",
-                           num_samples);
+template <typename T>
+Error BasicPgpeOptimizer<T>::FinishUpdate() {
+    if (!_update_pending) {
+        return "Cannot finish the update; no update is in progress.";
+    }
+    _update_pending = false;
+    _mixed_population = false;
+
+    // The next population is mixed with the one that was just used, so the
+    // distribution it was drawn from has to be kept.
+    _has_previous_distribution = _settings.min_refresh_rate && _active_params.empty();
+    if (_has_previous_distribution) {
+        _previous_state = _current_state;
+        _previous_standard_deviation = _current_standard_deviation;
     }
 
-    if (num_params != _current_state.cols()) {
-        return fmt::format(
-            "Number of columns in samples matrix ({}) does not match the size of the parameters "
-            "vector ({}).",
-            num_params, _current_state.cols());
+    // Use ClipUp to compute the updated velocity and state.  This is the only
+    // step that couples the parameters, through the gradient and velocity
+    // norms, so it has to wait for every block to be accumulated.
+    //
+    // Find the next standard deviation estimation, clamping the estimate so
+    // that it never goes to zero or gets too large.
+    if (_active_params.empty()) {
+        ClipUp<T>(_current_velocity, _grad_solution, _settings.max_speed, _settings.momentum);
+        _current_state += _current_velocity;
+        UpdateStdDev<T>(_current_standard_deviation, _grad_stddev, _settings);
+        return errors::no_error;
     }
 
+    // Only the active block is updated, so its values are gathered into a
+    // compact workspace.  The inactive parameters, including their velocity,
+    // stay exactly as they are.
+    _active_gradient = _grad_solution(_active_params);
+    _active_velocity = _current_velocity(_active_params);
+    ClipUp<T>(_active_velocity, _active_gradient, _settings.max_speed, _settings.momentum);
+    _current_velocity(_active_params) = _active_velocity;
+    _current_state(_active_params) += _active_velocity;
+
+    _active_gradient = _grad_stddev(_active_params);
+    _active_stddev = _current_standard_deviation(_active_params);
+    UpdateStdDev<T>(_active_stddev, _active_gradient, _settings);
+    _current_standard_deviation(_active_params) = _active_stddev;
+
     return errors::no_error;
 }
 
+template class BasicPgpeOptimizer<double>;
+template class BasicPgpeOptimizer<float>;
+
 }  // namespace abstractions
@@ -2,30 +2,490 @@
 
 #include <abstractions/errors.h>
 #include <abstractions/math/matrices.h>
+#include <abstractions/render/rasterizer.h>
 #include <fmt/format.h>
 
+#include <Eigen/Core>
 #include <algorithm>
+#include <cmath>
+#include <variant>
+#include <vector>
 
 namespace abstractions::render {
 
+namespace {
+
+/// @brief Get the Blend2D rendering context settings.
+/// @param num_threads number of rendering threads
+/// @return the context's creation settings
+BLContextCreateInfo ContextCreateInfo(int num_threads) {
+    abstractions_assert(num_threads >= 0);
+    BLContextCreateInfo info{};
+    info.threadCount = num_threads;
+    return info;
+}
+
+/// @brief The slope of the logistic function used by the sigmoid coordinate
+///     mapping.  With the frame padding, the mapping's slope at the centre of
+///     the frame is the same as an identity mapping's.
+constexpr double kSigmoidSlope = 4.0;
+
+/// @brief Map the shape coordinates onto the frame and clamp the colours.
+/// @tparam Traits ShapeTraits of the shapes being prepared
+/// @param shapes shape collection
+/// @param alpha_scale alpha channel scaling
+/// @param mapping coordinate mapping
+/// @return the prepared parameters
+///
+/// Force the shapes to be *mostly* inside of the frame but keep the colour
+/// values clamped on [0, 1] since anything outside that doesn't make any
+/// sense.  The alpha scaling is applied right before any clamping.
+template <typename Traits>
+typename Traits::Collection::ParamsMatrix PrepareParams(const typename Traits::Collection &shapes,
+                                                        double alpha_scale,
+                                                        CoordinateMapping mapping) {
+    constexpr int kNumCoords = Traits::CoordinateDimensions;
+    typename Traits::Collection::ParamsMatrix prepped = shapes.Params;
+    prepped.template leftCols<kNumCoords>() =
+        MapCoordinates(shapes.Params.template leftCols<kNumCoords>(), mapping);
+
+    prepped.template rightCols<1>() *= alpha_scale;
+    prepped.template rightCols<4>() = ClampValues(prepped.template rightCols<4>());
+    return prepped;
+}
+
+/// @brief Get the colour of a prepared shape.
+/// @param prepped prepared shape parameters
+/// @param i index of the shape
+template <typename M>
+BLRgba ShapeColour(const Eigen::MatrixBase<M> &prepped, int i) {
+    const auto colour = prepped.template rightCols<4>().row(i);
+    return BLRgba(colour(0), colour(1), colour(2), colour(3));
+}
+
+/// @brief Get the alpha channels of a range of prepared shapes.
+/// @param prepped prepared shape parameters
+/// @param first index of the first shape
+/// @param num_shapes number of shapes in the range
+template <typename M>
+Eigen::ArrayXd ShapeAlphas(const Eigen::MatrixBase<M> &prepped, int first, int num_shapes) {
+    return prepped.template rightCols<1>().middleRows(first, num_shapes).array();
+}
+
+/// @brief Move a circle by the given offset.
+BLCircle Translate(const BLCircle &circle, double dx, double dy) {
+    return BLCircle(circle.cx + dx, circle.cy + dy, circle.r);
+}
+
+/// @brief Move a rectangle by the given offset.
+BLRect Translate(const BLRect &rect, double dx, double dy) {
+    return BLRect(rect.x + dx, rect.y + dy, rect.w, rect.h);
+}
+
+/// @brief Move a triangle by the given offset.
+BLTriangle Translate(const BLTriangle &triangle, double dx, double dy) {
+    return BLTriangle(triangle.x0 + dx, triangle.y0 + dy, triangle.x1 + dx, triangle.y1 + dy,
+                      triangle.x2 + dx, triangle.y2 + dy);
+}
+
+/// @brief The edge length of the tiles used for occlusion culling, in pixels.
+constexpr int kOcclusionTileSize = 16;
+
+/// @brief Blend2D approximates circles with curves, so circles are shrunk by
+///     this fraction of their radius before they're allowed to cover a tile.
+constexpr double kCircleCoverageMargin = 1e-3;
+
+/// @brief A tile-level map of the parts of a surface that are covered by
+///     opaque shapes.
+///
+/// A tile is only marked as covered when it's entirely inside of a shape, so
+/// every pixel in the tile is overwritten with the shape's colour.  All of the
+/// shapes are convex, which means a tile is inside of a shape when its four
+/// corners are.
+class OcclusionMap {
+public:
+    OcclusionMap(int width, int height) :
+        _width{width},
+        _height{height},
+        _tiles_x{(width + kOcclusionTileSize - 1) / kOcclusionTileSize},
+        _tiles_y{(height + kOcclusionTileSize - 1) / kOcclusionTileSize},
+        _covered(_tiles_x * _tiles_y, false) {}
+
+    /// @brief Check if a bounding box only touches covered tiles.
+    bool IsHidden(double left, double top, double right, double bottom) const {
+        bool hidden = true;
+        const bool onscreen = ForEachTile(left, top, right, bottom, [&](int tx, int ty) {
+            hidden = hidden && _covered[ty * _tiles_x + tx];
+        });
+        return onscreen && hidden;
+    }
+
+    /// @brief Cover the tiles inside of an axis-aligned rectangle.
+    void CoverRect(double left, double top, double right, double bottom) {
+        Cover(left, top, right, bottom, [&](double x, double y) {
+            return x >= left && x <= right && y >= top && y <= bottom;
+        });
+    }
+
+    /// @brief Cover the tiles inside of a circle.
+    void CoverCircle(double cx, double cy, double radius) {
+        const double inner = radius * (1 - kCircleCoverageMargin);
+        Cover(cx - radius, cy - radius, cx + radius, cy + radius, [&](double x, double y) {
+            return (x - cx) * (x - cx) + (y - cy) * (y - cy) <= inner * inner;
+        });
+    }
+
+    /// @brief Cover the tiles inside of a triangle.
+    void CoverTriangle(const double (&xs)[3], const double (&ys)[3]) {
+        // A point is inside when it's on the same side of every edge as the
+        // triangle's interior.
+        const double area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (xs[2] - xs[0]) * (ys[1] - ys[0]);
+        if (!(std::abs(area) > 0)) {
+            return;
+        }
+
+        const double sign = area > 0 ? 1 : -1;
+        auto inside = [&](double x, double y) {
+            for (int i = 0; i < 3; i++) {
+                const int j = (i + 1) % 3;
+                const double edge = (xs[j] - xs[i]) * (y - ys[i]) - (ys[j] - ys[i]) * (x - xs[i]);
+                if (sign * edge < 0) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        Cover(*std::min_element(xs, xs + 3), *std::min_element(ys, ys + 3),
+              *std::max_element(xs, xs + 3), *std::max_element(ys, ys + 3), inside);
+    }
+
+private:
+    /// @brief Call a function for every tile that a bounding box touches.
+    /// @return `false` if the bounding box is empty or outside of the surface
+    template <typename F>
+    bool ForEachTile(double left, double top, double right, double bottom, F &&fn) const {
+        left = std::max(left, 0.0);
+        top = std::max(top, 0.0);
+        right = std::min<double>(right, _width);
+        bottom = std::min<double>(bottom, _height);
+        if (!(left < right && top < bottom)) {
+            return false;
+        }
+
+        const int tx0 = left / kOcclusionTileSize;
+        const int ty0 = top / kOcclusionTileSize;
+        const int tx1 = std::min<int>(std::ceil(right / kOcclusionTileSize), _tiles_x);
+        const int ty1 = std::min<int>(std::ceil(bottom / kOcclusionTileSize), _tiles_y);
+        for (int ty = ty0; ty < ty1; ty++) {
+            for (int tx = tx0; tx < tx1; tx++) {
+                fn(tx, ty);
+            }
+        }
+        return true;
+    }
+
+    /// @brief Cover every tile whose corners are all inside of a shape.
+    template <typename F>
+    void Cover(double left, double top, double right, double bottom, F &&inside) {
+        ForEachTile(left, top, right, bottom, [&](int tx, int ty) {
+            const double x0 = tx * kOcclusionTileSize;
+            const double y0 = ty * kOcclusionTileSize;
+            const double x1 = std::min((tx + 1) * kOcclusionTileSize, _width);
+            const double y1 = std::min((ty + 1) * kOcclusionTileSize, _height);
+            if (inside(x0, y0) && inside(x1, y0) && inside(x0, y1) && inside(x1, y1)) {
+                _covered[ty * _tiles_x + tx] = true;
+            }
+        });
+    }
+
+    int _width;
+    int _height;
+    int _tiles_x;
+    int _tiles_y;
+    std::vector<bool> _covered;
+};
+
+/// @brief Per-shape flags, e.g., whether or not a shape is drawn.
+using ShapeMask = Eigen::ArrayX<bool>;
+
+/// @brief The pixel coordinates of a range of prepared shapes.
+/// @tparam S shape type
+///
+/// Every shape type provides its bounding boxes, flags the shapes without any
+/// area, builds the Blend2D geometry for a single shape and covers the
+/// occlusion tiles inside of it.  Everything else that the canvas does with
+/// the shapes is the same for every type.
+template <AbstractionShape S>
+struct PixelGeometry;
+
+template <>
+struct PixelGeometry<AbstractionShape::Circles> {
+    /// @brief Scaling is isotropic, so vertical is [0,1] while horizontal is
+    ///     [0, aspect].  The radii aren't rescaled, so getting them to the
+    ///     full size image is just a matter of multiplying by the height.
+    PixelGeometry(const CircleCollection::ParamsMatrix &prepped, int first, int num_shapes,
+                  double x_scale, double y_scale) :
+        cx{x_scale * prepped.col(0).segment(first, num_shapes).array()},
+        cy{y_scale * prepped.col(1).segment(first, num_shapes).array()},
+        radius{y_scale * prepped.col(2).segment(first, num_shapes).array().abs()},
+        left{cx - radius},
+        right{cx + radius},
+        top{cy - radius},
+        bottom{cy + radius},
+        degenerate{!(radius > 0)} {}
+
+    BLCircle Geometry(int i) const {
+        return BLCircle(cx(i), cy(i), radius(i));
+    }
+
+    void Cover(OcclusionMap &occlusion, int i) const {
+        occlusion.CoverCircle(cx(i), cy(i), radius(i));
+    }
+
+    Eigen::ArrayXd cx, cy, radius;
+    Eigen::ArrayXd left, right, top, bottom;
+    ShapeMask degenerate;
+};
+
+template <>
+struct PixelGeometry<AbstractionShape::Rectangles> {
+    PixelGeometry(const RectangleCollection::ParamsMatrix &prepped, int first, int num_shapes,
+                  double x_scale, double y_scale) {
+        const auto corners = prepped.leftCols<4>().middleRows(first, num_shapes).array();
+        left = x_scale * corners.col(0).min(corners.col(2));
+        right = x_scale * corners.col(0).max(corners.col(2));
+        top = y_scale * corners.col(1).min(corners.col(3));
+        bottom = y_scale * corners.col(1).max(corners.col(3));
+        degenerate = !(right > left && bottom > top);
+    }
+
+    BLRect Geometry(int i) const {
+        return BLRect(left(i), top(i), right(i) - left(i), bottom(i) - top(i));
+    }
+
+    void Cover(OcclusionMap &occlusion, int i) const {
+        occlusion.CoverRect(left(i), top(i), right(i), bottom(i));
+    }
+
+    Eigen::ArrayXd left, right, top, bottom;
+    ShapeMask degenerate;
+};
+
+template <>
+struct PixelGeometry<AbstractionShape::Triangles> {
+    /// @brief A triangle has no area when its vertices are collinear.
+    PixelGeometry(const TriangleCollection::ParamsMatrix &prepped, int first, int num_shapes,
+                  double x_scale, double y_scale) {
+        const auto vertices = prepped.leftCols<6>().middleRows(first, num_shapes).array();
+        x0 = x_scale * vertices.col(0);
+        y0 = y_scale * vertices.col(1);
+        x1 = x_scale * vertices.col(2);
+        y1 = y_scale * vertices.col(3);
+        x2 = x_scale * vertices.col(4);
+        y2 = y_scale * vertices.col(5);
+        left = x0.min(x1).min(x2);
+        right = x0.max(x1).max(x2);
+        top = y0.min(y1).min(y2);
+        bottom = y0.max(y1).max(y2);
+        degenerate = !(((x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0)).abs() > 0);
+    }
+
+    BLTriangle Geometry(int i) const {
+        return BLTriangle(x0(i), y0(i), x1(i), y1(i), x2(i), y2(i));
+    }
+
+    void Cover(OcclusionMap &occlusion, int i) const {
+        const double xs[3] = {x0(i), x1(i), x2(i)};
+        const double ys[3] = {y0(i), y1(i), y2(i)};
+        occlusion.CoverTriangle(xs, ys);
+    }
+
+    Eigen::ArrayXd x0, y0, x1, y1, x2, y2;
+    Eigen::ArrayXd left, right, top, bottom;
+    ShapeMask degenerate;
+};
+
+/// @brief The smallest alpha that can change an 8-bit colour channel.
+///
+/// A shape composited with a smaller alpha changes every channel by less than
+/// half a level, so the blended value always rounds back to the original.
+constexpr double kMinVisibleAlpha = 0.5 / 255;
+
+/// @brief Find the shapes that can change at least one pixel.
+/// @param left left side of each shape's bounding box, in pixels
+/// @param right right side of each shape's bounding box, in pixels
+/// @param top top side of each shape's bounding box, in pixels
+/// @param bottom bottom side of each shape's bounding box, in pixels
+/// @param degenerate flags the shapes that have no area
+/// @param alpha the shape alphas, after scaling and clamping
+/// @param width surface width
+/// @param height surface height
+/// @param cull_transparent whether or not transparent shapes are culled
+/// @param statistics statistics updated with the culled shapes
+/// @return a mask that flags the shapes that need to be drawn
+///
+/// Each culled shape is only counted once, in the order the checks are listed
+/// in CullStatistics.
+ShapeMask CullShapes(const Eigen::ArrayXd &left, const Eigen::ArrayXd &right,
+                     const Eigen::ArrayXd &top, const Eigen::ArrayXd &bottom,
+                     const ShapeMask &degenerate, const Eigen::ArrayXd &alpha, int width,
+                     int height, bool cull_transparent, CullStatistics &statistics) {
+    const ShapeMask offscreen =
+        !degenerate && ((right <= 0) || (left >= width) || (bottom <= 0) || (top >= height));
+
+    ShapeMask transparent = ShapeMask::Constant(alpha.rows(), false);
+    if (cull_transparent) {
+        transparent = !degenerate && !offscreen && (alpha < kMinVisibleAlpha);
+    }
+
+    statistics.submitted += alpha.rows();
+    statistics.degenerate += degenerate.count();
+    statistics.offscreen += offscreen.count();
+    statistics.transparent += transparent.count();
+    return !(degenerate || offscreen || transparent);
+}
+
+/// @brief Skip the visible shapes that are occluded.
+/// @param visible flags the shapes that need to be drawn
+/// @param occluded flags the occluded shapes in the whole collection; it's
+///     ignored unless it has one flag per shape
+/// @param first index of the first shape in `visible`
+/// @param num_shapes number of shapes in the collection
+/// @param statistics statistics updated with the occluded shapes
+void SkipOccludedShapes(ShapeMask &visible, const std::vector<bool> &occluded, int first,
+                        int num_shapes, CullStatistics &statistics) {
+    if (static_cast<int>(occluded.size()) != num_shapes) {
+        return;
+    }
+
+    for (int i = 0; i < visible.rows(); i++) {
+        if (visible(i) && occluded[first + i]) {
+            visible(i) = false;
+            statistics.occluded++;
+        }
+    }
+}
+
+}  // namespace
+
+void MapShapes(const PackedShapeCollection &collection, int width, int height,
+               double alpha_scale, CoordinateMapping mapping, std::vector<SurfaceShape> &shapes,
+               CullStatistics &statistics) {
+    const double x_scale = width - 1;
+    const double y_scale = height - 1;
+
+    int num_shapes = 0;
+    collection.ForEachCollection([&](auto, const auto &params) {
+        num_shapes += params.NumShapes();
+    });
+
+    shapes.clear();
+    shapes.reserve(num_shapes);
+
+    int first_index = 0;
+    collection.ForEachCollection([&]<typename Traits>(Traits, const auto &params) {
+        const int num_params = params.NumShapes();
+        if (num_params == 0) {
+            return;
+        }
+
+        const auto prepped = PrepareParams<Traits>(params, alpha_scale, mapping);
+        const PixelGeometry<Traits::Shape> geometry(prepped, 0, num_params, x_scale, y_scale);
+        const ShapeMask visible =
+            CullShapes(geometry.left, geometry.right, geometry.top, geometry.bottom,
+                       geometry.degenerate, ShapeAlphas(prepped, 0, num_params), width, height,
+                       true, statistics);
+
+        for (int i = 0; i < num_params; i++) {
+            if (visible(i)) {
+                shapes.push_back(SurfaceShape{
+                    .geometry = geometry.Geometry(i),
+                    .colour = ShapeColour(prepped, i),
+                    .bounds = BLBox(geometry.left(i), geometry.top(i), geometry.right(i),
+                                    geometry.bottom(i)),
+                    .index = first_index + i,
+                });
+            }
+        }
+
+        first_index += num_params;
+    });
+}
+
+Matrix MapCoordinates(ConstMatrixRef coords, CoordinateMapping mapping) {
+    switch (mapping) {
+        case CoordinateMapping::Rescaled:
+            return 1.2 * RescaleValuesColumnWise(coords).array() - 0.1;
+        case CoordinateMapping::Clamped:
+            return 1.2 * coords.array().max(0).min(1) - 0.1;
+        case CoordinateMapping::Sigmoid:
+            return 1.2 / (1 + (-kSigmoidSlope * (coords.array() - 0.5)).exp()) - 0.1;
+    }
+
+    abstractions_assert(false);
+    return coords;
+}
+
+double UnmapCoordinate(double value, CoordinateMapping mapping) {
+    const double normalized = (value + 0.1) / 1.2;
+    switch (mapping) {
+        case CoordinateMapping::Rescaled:
+            return normalized;
+        case CoordinateMapping::Clamped:
+            return std::clamp(normalized, 0.0, 1.0);
+        case CoordinateMapping::Sigmoid: {
+            // The logistic function never quite reaches the edges of the
+            // padded frame.
+            constexpr double kEpsilon = 1e-6;
+            const double p = std::clamp(normalized, kEpsilon, 1 - kEpsilon);
+            return 0.5 + std::log(p / (1 - p)) / kSigmoidSlope;
+        }
+    }
+
+    abstractions_assert(false);
+    return value;
+}
+
+CullStatistics &CullStatistics::operator+=(const CullStatistics &other) {
+    submitted += other.submitted;
+    transparent += other.transparent;
+    degenerate += other.degenerate;
+    offscreen += other.offscreen;
+    occluded += other.occluded;
+    return *this;
+}
+
 Canvas::Canvas(Expected<Image> &image, std::optional<DefaultRngType::result_type> seed) :
     _prng{seed.value_or(PrngGenerator<DefaultRngType>::DrawRandomSeed())},
-    _alpha_scale{1.0} {
+    _alpha_scale{1.0},
+    _mapping{CoordinateMapping::Rescaled},
+    _composite_mode{CompositeMode::SrcOver},
+    _backend{RenderBackend::Blend2D},
+    _quality{RenderQuality::Antialiased} {
     abstractions_check(image);
     _context = BLContext(*image);
 }
 
 Canvas::Canvas(Expected<Image> &image, Prng<DefaultRngType> prng) :
     _prng{prng},
-    _alpha_scale{1.0} {
+    _alpha_scale{1.0},
+    _mapping{CoordinateMapping::Rescaled},
+    _composite_mode{CompositeMode::SrcOver},
+    _backend{RenderBackend::Blend2D},
+    _quality{RenderQuality::Antialiased} {
     abstractions_check(image);
     _context = BLContext(*image);
 }
 
-Canvas::Canvas(Image &image, Prng<DefaultRngType> prng) :
-    _context{BLContext(image)},
+Canvas::Canvas(Image &image, Prng<DefaultRngType> prng, int num_threads) :
+    _context{BLContext(image, ContextCreateInfo(num_threads))},
     _prng{prng},
-    _alpha_scale{1.0} {}
+    _alpha_scale{1.0},
+    _mapping{CoordinateMapping::Rescaled},
+    _composite_mode{CompositeMode::SrcOver},
+    _backend{RenderBackend::Blend2D},
+    _quality{RenderQuality::Antialiased} {}
 
 Canvas::~Canvas() {
     _context.end();
@@ -44,142 +504,151 @@ void Canvas::Clear(const double red, const double green, const double blue, cons
     _context.setCompOp(orig_mode);
 }
 
-Error Canvas::DrawFilledCircles(ConstMatrixRef params) {
-    const int num_circles = params.rows();
-    const int num_dimensions = params.cols();
-    if (num_dimensions != 7) {
-        return Error(
-            fmt::format("Expected a Nx7 array, got an {}x{}.", num_circles, num_dimensions));
-    }
-
-    // Scaling is isotropic, so vertical is [0,1] while horizontal is
-    // [0, aspect].  This means getting to the full size image is just a matter
-    // of multiplying by the height.
-
-    const double x_scale = _context.targetWidth() - 1;
-    const double y_scale = _context.targetHeight() - 1;
-    const double r_scale = y_scale;
-
-    // Force the shapes to be *mostly* inside of the frame but keep the colour
-    // values clamped on [0, 1] since anything outside that doesn't make any
-    // sense.  The circle radii also have to be constrained more than other
-    // shapes as they can easily grow to cover the entire image.
-
-    Matrix prepped = params;
-    prepped.leftCols(2) = 1.2 * RescaleValuesColumnWise(params.leftCols(2)).array() - 0.1;
-
-    prepped.rightCols(4) = params.rightCols(4);
-    prepped.rightCols(1) *= _alpha_scale;
-    prepped.rightCols(4) = ClampValues(prepped.rightCols(4));
-
-    for (int i = 0; i < num_circles; i++) {
-        const RowVector row = prepped.row(i);
-
-        const BLRgba colour(row[3], row[4], row[5], row[6]);
-        // clang-format off
-        const BLCircle circle(
-            x_scale * row[0],
-            y_scale * row[1],
-            r_scale * std::abs(row[2])
-        );
-        // clang-format on
-        _context.fillCircle(circle, colour);
-    }
+Error Canvas::DrawFilledShapes(const CircleCollection &circles, int first, int last) {
+    return DrawFilled<ShapeTraits<AbstractionShape::Circles>>(circles, first, last);
+}
 
-    return errors::no_error;
+Error Canvas::DrawFilledShapes(const RectangleCollection &rectangles, int first, int last) {
+    return DrawFilled<ShapeTraits<AbstractionShape::Rectangles>>(rectangles, first, last);
 }
 
-Error Canvas::DrawFilledTriangles(ConstMatrixRef params) {
-    const int num_triangles = params.rows();
-    const int num_dimensions = params.cols();
+Error Canvas::DrawFilledShapes(const TriangleCollection &triangles, int first, int last) {
+    return DrawFilled<ShapeTraits<AbstractionShape::Triangles>>(triangles, first, last);
+}
 
-    if (num_dimensions != 10) {
-        return Error(
-            fmt::format("Expected a Nx10 array, got an {}x{}.", num_triangles, num_dimensions));
+template <typename Traits>
+Error Canvas::DrawFilled(const typename Traits::Collection &shapes, int first, int last) {
+    const int num_shapes = shapes.NumShapes();
+    if (first < 0 || first > last || last > num_shapes) {
+        return Error(fmt::format("Cannot draw {} [{}, {}) out of {}.", Traits::Name, first, last,
+                                 num_shapes));
     }
 
-    // Scaling is isotropic, so vertical is [0,1] while horizontal is
-    // [0, aspect].  This means getting to the full size image is just a matter
-    // of multiplying by the height.
-
     const double x_scale = _context.targetWidth() - 1;
     const double y_scale = _context.targetHeight() - 1;
 
-    // Force the shapes to be *mostly* inside of the frame but keep the colour
-    // values clamped on [0, 1] since anything outside that doesn't make any
-    // sense.  Apply the alpha scaling right before any clamping.
-
-    Matrix prepped = params;
-    prepped.leftCols(6) = 1.2 * RescaleValuesColumnWise(params.leftCols(6)).array() - 0.1;
-
-    prepped.rightCols(4) = params.rightCols(4);
-    prepped.rightCols(1) *= _alpha_scale;
-    prepped.rightCols(4) = ClampValues(prepped.rightCols(4));
-
-    for (int i = 0; i < num_triangles; i++) {
-        const RowVector row = prepped.row(i);
+    const auto prepped = PrepareParams<Traits>(shapes, _alpha_scale, _mapping);
+
+    // Cull the shapes that can't change any pixels.
+    const int num_drawn = last - first;
+    const PixelGeometry<Traits::Shape> geometry(prepped, first, num_drawn, x_scale, y_scale);
+    ShapeMask visible =
+        CullShapes(geometry.left, geometry.right, geometry.top, geometry.bottom,
+                   geometry.degenerate, ShapeAlphas(prepped, first, num_drawn),
+                   _context.targetWidth(), _context.targetHeight(),
+                   _composite_mode == CompositeMode::SrcOver, _statistics);
+    SkipOccludedShapes(visible, _occluded[static_cast<int>(Traits::Shape)], first, num_shapes,
+                       _statistics);
+
+    // The rasterizer writes straight to the image so any pending Blend2D
+    // operations have to finish first.
+    if (_rasterizer) {
+        Flush();
+    }
 
-        const BLRgba colour(row[6], row[7], row[8], row[9]);
-        // clang-format off
-        const BLTriangle triangle(
-            x_scale * row[0], y_scale * row[1],
-            x_scale * row[2], y_scale * row[3],
-            x_scale * row[4], y_scale * row[5]
-        );
-        // clang-format on
-        _context.fillTriangle(triangle, colour);
+    for (int i = 0; i < num_drawn; i++) {
+        if (visible(i)) {
+            Fill(geometry.Geometry(i), ShapeColour(prepped, first + i));
+        }
     }
 
     return errors::no_error;
 }
 
-Error Canvas::DrawFilledRectangles(ConstMatrixRef params) {
-    const int num_rects = params.rows();
-    const int num_dimensions = params.cols();
-    if (num_dimensions != 8) {
-        return Error(fmt::format("Expected a Nx8 array, got an {}x{}.", num_rects, num_dimensions));
+void Canvas::DrawSurfaceShapes(const std::vector<SurfaceShape> &shapes,
+                               const std::vector<int> &indices, int x, int y) {
+    // The rasterizer writes straight to the image so any pending Blend2D
+    // operations have to finish first.
+    if (_rasterizer) {
+        Flush();
     }
 
-    // Scaling is isotropic, so vertical is [0,1] while horizontal is
-    // [0, aspect].  This means getting to the full size image is just a matter
-    // of multiplying by the height.
-
-    const double x_scale = _context.targetWidth() - 1;
-    const double y_scale = _context.targetHeight() - 1;
-
-    // Force the shapes to be *mostly* inside of the frame but keep the colour
-    // values clamped on [0, 1] since anything outside that doesn't make any
-    // sense.  Apply the alpha scaling right before any clamping.
-
-    Matrix prepped = params;
-    prepped.leftCols(4) = 1.2 * RescaleValuesColumnWise(params.leftCols(4)).array() - 0.1;
+    // The shapes are moved so that the canvas' top-left corner is at the
+    // origin.  The offset is a whole number of pixels so the shapes cover the
+    // same fraction of every pixel as they would on the larger surface.
+    for (const int index : indices) {
+        const auto &shape = shapes.at(index);
+        std::visit([&](const auto &geometry) { Fill(Translate(geometry, -x, -y), shape.colour); },
+                   shape.geometry);
+    }
+}
 
-    prepped.rightCols(4) = params.rightCols(4);
-    prepped.rightCols(1) *= _alpha_scale;
-    prepped.rightCols(4) = ClampValues(prepped.rightCols(4));
+void Canvas::Fill(const BLCircle &circle, const BLRgba &colour) {
+    if (_rasterizer) {
+        _rasterizer->FillCircle(circle, colour);
+    } else {
+        _context.fillCircle(circle, colour);
+    }
+}
 
-    for (int i = 0; i < num_rects; i++) {
-        const RowVector row = prepped.row(i);
+void Canvas::Fill(const BLRect &rect, const BLRgba &colour) {
+    if (_rasterizer) {
+        _rasterizer->FillRect(rect, colour);
+    } else {
+        _context.fillRect(rect, colour);
+    }
+}
 
-        const double x1 = x_scale * row[0];
-        const double y1 = y_scale * row[1];
-        const double x2 = x_scale * row[2];
-        const double y2 = y_scale * row[3];
+void Canvas::Fill(const BLTriangle &triangle, const BLRgba &colour) {
+    if (_rasterizer) {
+        _rasterizer->FillTriangle(triangle, colour);
+    } else {
+        _context.fillTriangle(triangle, colour);
+    }
+}
 
-        const double x = std::min(x1, x2);
-        const double y = std::min(y1, y2);
-        const double w = std::abs(x1 - x2);
-        const double h = std::abs(y1 - y2);
+void Canvas::FindOccludedShapes(const PackedShapeCollection &shapes) {
+    const int width = _context.targetWidth();
+    const int height = _context.targetHeight();
+    const double x_scale = width - 1;
+    const double y_scale = height - 1;
+
+    // Any shape drawn with source-copy replaces the pixels that it covers,
+    // regardless of its alpha.
+    auto is_opaque = [this](double alpha) {
+        return _composite_mode == CompositeMode::SrcCopy || alpha >= 1;
+    };
+
+    // The shapes are visited in the reverse of the order they're drawn in.
+    OcclusionMap occlusion(width, height);
+    ForEachShapeTypeReversed([&]<typename Traits>(Traits) {
+        const auto &collection = shapes.Collection<Traits::Shape>();
+        const int num_shapes = collection.NumShapes();
+
+        auto &occluded = _occluded[static_cast<int>(Traits::Shape)];
+        occluded.assign(num_shapes, false);
+        if (num_shapes == 0) {
+            return;
+        }
+
+        const auto prepped = PrepareParams<Traits>(collection, _alpha_scale, _mapping);
+        const PixelGeometry<Traits::Shape> geometry(prepped, 0, num_shapes, x_scale, y_scale);
+        for (int i = num_shapes - 1; i >= 0; i--) {
+            if (occlusion.IsHidden(geometry.left(i), geometry.top(i), geometry.right(i),
+                                   geometry.bottom(i))) {
+                occluded[i] = true;
+            } else if (is_opaque(prepped.template rightCols<1>()(i))) {
+                geometry.Cover(occlusion, i);
+            }
+        }
+    });
+}
 
-        const BLRgba colour(row[4], row[5], row[6], row[7]);
-        const BLRect rect(x, y, w, h);
-        _context.fillRect(rect, colour);
+void Canvas::ClearOccludedShapes() {
+    for (auto &occluded : _occluded) {
+        occluded.clear();
     }
+}
 
-    return errors::no_error;
+void Canvas::Flush() {
+    _context.flush(BL_CONTEXT_FLUSH_SYNC);
 }
 
 void Canvas::RandomFill() {
+    // The pixels are written directly so any queued draw operations have to
+    // finish first.
+    Flush();
+
     auto image = _context.targetImage();
     abstractions_assert(image != nullptr);
 
@@ -196,6 +665,10 @@ void Canvas::SetAlphaScale(const double alpha_scale) {
     _alpha_scale = alpha_scale;
 }
 
+void Canvas::SetCoordinateMapping(const CoordinateMapping mapping) {
+    _mapping = mapping;
+}
+
 Error Canvas::SetCompositeMode(const CompositeMode mode) {
     BLCompOp op;
     switch (mode) {
@@ -210,8 +683,65 @@ Error Canvas::SetCompositeMode(const CompositeMode mode) {
     }
 
     _context.setCompOp(op);
+    _composite_mode = mode;
+    if (_rasterizer) {
+        _rasterizer->SetCompositeMode(mode);
+    }
 
     return errors::no_error;
 }
 
+void Canvas::SetBackend(const RenderBackend backend) {
+    _backend = backend;
+    UpdateRasterizer();
+}
+
+void Canvas::SetQuality(const RenderQuality quality) {
+    _quality = quality;
+    UpdateRasterizer();
+}
+
+void Canvas::UpdateRasterizer() {
+    // Only the scanline rasterizer can draw aliased shapes.
+    if (_backend == RenderBackend::Blend2D && _quality == RenderQuality::Antialiased) {
+        _rasterizer.reset();
+        return;
+    }
+
+    if (_rasterizer) {
+        _rasterizer->SetQuality(_quality);
+        return;
+    }
+
+    auto image = _context.targetImage();
+    abstractions_assert(image != nullptr);
+
+    BLImageData image_data;
+    abstractions_assert(image->getData(&image_data) == BL_SUCCESS);
+
+    _rasterizer = std::make_unique<Rasterizer>(image_data);
+    _rasterizer->SetCompositeMode(_composite_mode);
+    _rasterizer->SetQuality(_quality);
+}
+
 }  // namespace abstractions::render
+
+using namespace fmt;
+using namespace abstractions::render;
+
+format_context::iterator formatter<CoordinateMapping>::format(CoordinateMapping mapping,
+                                                              format_context &ctx) const {
+    string_view name = "undefined";
+    switch (mapping) {
+        case CoordinateMapping::Rescaled:
+            name = "Rescaled";
+            break;
+        case CoordinateMapping::Clamped:
+            name = "Clamped";
+            break;
+        case CoordinateMapping::Sigmoid:
+            name = "Sigmoid";
+            break;
+    }
+    return formatter<string_view>::format(name, ctx);
+}
@@ -0,0 +1,209 @@
+#include "abstractions/render/coverage.h"
+
+#include <abstractions/math/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace abstractions::render {
+
+namespace {
+
+/// @brief Get a copy of a shape collection with every shape fully opaque.
+/// @param shapes shape collection
+/// @return the opaque shapes
+PackedShapeCollection MakeOpaque(const PackedShapeCollection &shapes) {
+    PackedShapeCollection opaque = shapes;
+    opaque.ForEachCollection([](auto, auto &collection) {
+        collection.Params.template rightCols<1>().setOnes();
+    });
+    return opaque;
+}
+
+/// @brief Get the part of the surface that a shape's bounding box touches.
+/// @param bounds shape bounds, in pixel coordinates
+/// @param width surface width
+/// @param height surface height
+/// @return the touched pixels; the rectangle is empty if there aren't any
+BLRectI TouchedPixels(const BLBox &bounds, int width, int height) {
+    if (!std::isfinite(bounds.x0 + bounds.y0 + bounds.x1 + bounds.y1)) {
+        return BLRectI(0, 0, 0, 0);
+    }
+
+    // The anti-aliasing can touch the pixels just outside of the box.
+    const int x0 = std::clamp<double>(std::floor(bounds.x0) - 1, 0, width);
+    const int y0 = std::clamp<double>(std::floor(bounds.y0) - 1, 0, height);
+    const int x1 = std::clamp<double>(std::ceil(bounds.x1) + 1, 0, width);
+    const int y1 = std::clamp<double>(std::ceil(bounds.y1) + 1, 0, height);
+    return BLRectI(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0));
+}
+
+}  // namespace
+
+ColourPlanes ToColourPlanes(const Image &image) {
+    const int width = image.Width();
+    const int height = image.Height();
+    ColourPlanes planes(width * height, 3);
+
+    auto pixels = image.Pixels();
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row = pixels.Row(y);
+        for (int x = 0; x < width; x++) {
+            planes(y * width + x, 0) = detail::GetRedValue(row[x]) / 255.0f;
+            planes(y * width + x, 1) = detail::GetGreenValue(row[x]) / 255.0f;
+            planes(y * width + x, 2) = detail::GetBlueValue(row[x]) / 255.0f;
+        }
+    }
+
+    return planes;
+}
+
+Expected<CoverageMasks> CoverageMasks::Create(const PackedShapeCollection &shapes,
+                                              const Image &background, double alpha_scale,
+                                              CoordinateMapping mapping, RenderBackend backend,
+                                              RenderQuality quality) {
+    const int width = background.Width();
+    const int height = background.Height();
+    if (width < 1 || height < 1) {
+        return errors::report<CoverageMasks>(
+            fmt::format("Cannot create coverage masks for a {}x{} surface.", width, height));
+    }
+
+    // The colours are ignored, so the shapes are made opaque to prevent any of
+    // them from being culled for being transparent.
+    std::vector<SurfaceShape> surface_shapes;
+    CullStatistics statistics;
+    MapShapes(MakeOpaque(shapes), width, height, 1.0, mapping, surface_shapes, statistics);
+
+    int num_shapes = 0;
+    shapes.ForEachCollection([&](auto, const auto &collection) {
+        num_shapes += collection.NumShapes();
+    });
+
+    CoverageMasks masks(width, height, alpha_scale, num_shapes);
+    masks._background = ToColourPlanes(background);
+    masks._masks.reserve(surface_shapes.size());
+
+    // Each mask is a white shape drawn onto an opaque black surface, so the
+    // red channel is the shape's coverage.
+    for (SurfaceShape shape : surface_shapes) {
+        const BLRectI rect = TouchedPixels(shape.bounds, width, height);
+        if (rect.w == 0 || rect.h == 0) {
+            continue;
+        }
+
+        auto image = Image::New(rect.w, rect.h, true);
+        if (!image.has_value()) {
+            return errors::report<CoverageMasks>(image.error());
+        }
+
+        shape.colour = BLRgba(1, 1, 1, 1);
+        {
+            Canvas canvas{*image, Prng<>(0)};
+            canvas.SetBackend(backend);
+            canvas.SetQuality(quality);
+            canvas.Clear(0, 0, 0, 1);
+            canvas.DrawSurfaceShapes({shape}, {0}, rect.x, rect.y);
+        }
+
+        Eigen::ArrayXf coverage(rect.w * rect.h);
+        auto pixels = image->Pixels();
+        for (int y = 0; y < rect.h; y++) {
+            const uint32_t *row = pixels.Row(y);
+            for (int x = 0; x < rect.w; x++) {
+                coverage(y * rect.w + x) = detail::GetRedValue(row[x]) / 255.0f;
+            }
+        }
+
+        masks._masks.push_back(
+            Mask{.shape = shape.index, .rect = rect, .coverage = std::move(coverage)});
+    }
+
+    // Merge the rows of every mask into the spans that a composite has to
+    // reset before the masks are blended again.
+    std::vector<Span> rows;
+    for (const Mask &mask : masks._masks) {
+        for (int y = 0; y < mask.rect.h; y++) {
+            rows.push_back(Span{(mask.rect.y + y) * width + mask.rect.x, mask.rect.w});
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(),
+              [](const Span &a, const Span &b) { return a.start < b.start; });
+    for (const Span &row : rows) {
+        if (!masks._covered.empty()) {
+            Span &last = masks._covered.back();
+            if (row.start <= last.start + last.length) {
+                last.length = std::max(last.length, row.start + row.length - last.start);
+                continue;
+            }
+        }
+        masks._covered.push_back(row);
+    }
+
+    return masks;
+}
+
+Error CoverageMasks::Composite(const PackedShapeCollection &shapes, ColourPlanes &target) const {
+    int num_shapes = 0;
+    shapes.ForEachCollection([&](auto, const auto &collection) {
+        num_shapes += collection.NumShapes();
+    });
+
+    if (num_shapes != _num_shapes) {
+        return Error(fmt::format("Expected {} shapes for the coverage masks, got {}.",
+                                 _num_shapes, num_shapes));
+    }
+
+    // Gather the colours in draw order so that they can be looked up by the
+    // shape index stored with each mask.
+    Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor> colours(num_shapes, 4);
+    int first = 0;
+    shapes.ForEachCollection([&](auto, const auto &collection) {
+        if (!collection.Empty()) {
+            colours.middleRows(first, collection.NumShapes()) =
+                collection.Params.template rightCols<4>();
+            first += collection.NumShapes();
+        }
+    });
+
+    if (target.rows() != _background.rows()) {
+        target = _background;
+    } else {
+        for (const Span &span : _covered) {
+            target.middleRows(span.start, span.length) =
+                _background.middleRows(span.start, span.length);
+        }
+    }
+
+    for (const Mask &mask : _masks) {
+        const auto colour = colours.row(mask.shape);
+        const float alpha = std::clamp(colour(3) * _alpha_scale, 0.0, 1.0);
+        if (!(alpha > 0)) {
+            continue;
+        }
+
+        // Compositing an opaque surface with SRC_OVER is a linear
+        // interpolation towards the shape's colour, weighted by its coverage.
+        for (int c = 0; c < 3; c++) {
+            const float value = std::clamp(colour(c), 0.0, 1.0);
+            for (int y = 0; y < mask.rect.h; y++) {
+                const int start = (mask.rect.y + y) * _width + mask.rect.x;
+                auto pixels = target.col(c).segment(start, mask.rect.w);
+                const auto coverage = mask.coverage.segment(y * mask.rect.w, mask.rect.w);
+                pixels += (alpha * coverage) * (value - pixels);
+            }
+        }
+    }
+
+    return errors::no_error;
+}
+
+CoverageMasks::CoverageMasks(int width, int height, double alpha_scale, int num_shapes) :
+    _width{width},
+    _height{height},
+    _alpha_scale{alpha_scale},
+    _num_shapes{num_shapes} {}
+
+}  // namespace abstractions::render
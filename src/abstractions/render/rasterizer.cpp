@@ -0,0 +1,402 @@
+#include "abstractions/render/rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <numbers>
+#include <utility>
+
+namespace abstractions::render {
+
+namespace {
+
+/// @brief Find the overlap between a pixel and an interval.
+/// @param pixel pixel index
+/// @param start start of the interval
+/// @param end end of the interval
+/// @return the length of `[pixel, pixel + 1]` that's inside of the interval
+float PixelOverlap(int pixel, double start, double end) {
+    return std::max(0.0, std::min(pixel + 1.0, end) - std::max<double>(pixel, start));
+}
+
+/// @brief Find the first pixel whose centre is at, or after, a position.
+/// @param position position along a row or column
+/// @param size number of pixels in the row or column
+/// @return the pixel index, clamped to `[0, size]`
+int FirstPixelCentre(double position, int size) {
+    return std::clamp(std::ceil(position - 0.5), 0.0, static_cast<double>(size));
+}
+
+/// @brief Blend a colour onto a pixel.
+/// @param pixel premultiplied ARGB pixel
+/// @param colour premultiplied colour channels, ordered as `(r,g,b,a)`
+/// @param src_scale scaling applied to the colour
+/// @param dst_scale scaling applied to the pixel
+/// @return the blended pixel
+inline uint32_t BlendPixel(uint32_t pixel, const float *colour, float src_scale,
+                           float dst_scale) {
+    auto channel = [&](float src, int shift) {
+        const float dst = static_cast<float>((pixel >> shift) & 0xff);
+        const float value = std::min(src * src_scale + dst * dst_scale + 0.5f, 255.0f);
+        return static_cast<uint32_t>(value) << shift;
+    };
+
+    return channel(colour[3], 24) | channel(colour[0], 16) | channel(colour[1], 8) |
+           channel(colour[2], 0);
+}
+
+}  // namespace
+
+Rasterizer::Rasterizer(const BLImageData &surface) :
+    _pixels{static_cast<uint8_t *>(surface.pixelData)},
+    _stride{surface.stride},
+    _width{surface.size.w},
+    _height{surface.size.h},
+    _mode{CompositeMode::SrcOver},
+    _quality{RenderQuality::Antialiased},
+    _box_width{0},
+    _box_height{0} {}
+
+void Rasterizer::SetCompositeMode(CompositeMode mode) {
+    _mode = mode;
+}
+
+void Rasterizer::SetQuality(RenderQuality quality) {
+    _quality = quality;
+}
+
+void Rasterizer::FillCircle(const BLCircle &circle, const BLRgba &colour) {
+    const double radius = std::abs(circle.r);
+    if (!std::isfinite(circle.cx) || !std::isfinite(circle.cy) || !std::isfinite(radius)) {
+        return;
+    }
+
+    if (_quality == RenderQuality::Aliased) {
+        FillAliasedCircle(BLCircle(circle.cx, circle.cy, radius), Premultiply(colour));
+        return;
+    }
+
+    const int x0 = std::max(0.0, std::floor(circle.cx - radius));
+    const int x1 = std::min<double>(_width, std::ceil(circle.cx + radius));
+    const int y0 = std::max(0.0, std::floor(circle.cy - radius));
+    const int y1 = std::min<double>(_height, std::ceil(circle.cy + radius));
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // The distance-based coverage overestimates the area of circles smaller
+    // than a pixel, so it's capped by the circle's actual area.
+    const float max_coverage = std::min(1.0, std::numbers::pi * radius * radius);
+    const Colour premultiplied = Premultiply(colour);
+
+    _coverage.resize(x1 - x0);
+    for (int y = y0; y < y1; y++) {
+        const double dy = y + 0.5 - circle.cy;
+        for (int x = x0; x < x1; x++) {
+            const double dx = x + 0.5 - circle.cx;
+            const double coverage = radius + 0.5 - std::sqrt(dx * dx + dy * dy);
+            _coverage[x - x0] = std::clamp<float>(coverage, 0, max_coverage);
+        }
+        BlendSpan(x0, y, x1 - x0, _coverage.data(), premultiplied);
+    }
+}
+
+void Rasterizer::FillRect(const BLRect &rect, const BLRgba &colour) {
+    if (!std::isfinite(rect.x) || !std::isfinite(rect.y) || !std::isfinite(rect.w) ||
+        !std::isfinite(rect.h)) {
+        return;
+    }
+
+    if (_quality == RenderQuality::Aliased) {
+        FillAliasedRect(rect, Premultiply(colour));
+        return;
+    }
+
+    const double left = rect.x;
+    const double right = rect.x + rect.w;
+    const double top = rect.y;
+    const double bottom = rect.y + rect.h;
+
+    const int x0 = std::max(0.0, std::floor(left));
+    const int x1 = std::min<double>(_width, std::ceil(right));
+    const int y0 = std::max(0.0, std::floor(top));
+    const int y1 = std::min<double>(_height, std::ceil(bottom));
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const Colour premultiplied = Premultiply(colour);
+    const int span = x1 - x0;
+
+    // The coverage is separable, so the horizontal coverage is shared by
+    // every row and only scaled on the partially covered rows.
+    _coverage.resize(span);
+    _accumulation.resize(span);
+    for (int x = x0; x < x1; x++) {
+        _coverage[x - x0] = PixelOverlap(x, left, right);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        const float row_coverage = PixelOverlap(y, top, bottom);
+        if (row_coverage == 1) {
+            BlendSpan(x0, y, span, _coverage.data(), premultiplied);
+            continue;
+        }
+
+        for (int i = 0; i < span; i++) {
+            _accumulation[i] = row_coverage * _coverage[i];
+        }
+        BlendSpan(x0, y, span, _accumulation.data(), premultiplied);
+    }
+}
+
+void Rasterizer::FillTriangle(const BLTriangle &triangle, const BLRgba &colour) {
+    const double xs[3] = {triangle.x0, triangle.x1, triangle.x2};
+    const double ys[3] = {triangle.y0, triangle.y1, triangle.y2};
+    for (int i = 0; i < 3; i++) {
+        if (!std::isfinite(xs[i]) || !std::isfinite(ys[i])) {
+            return;
+        }
+    }
+
+    if (_quality == RenderQuality::Aliased) {
+        FillAliasedTriangle(triangle, Premultiply(colour));
+        return;
+    }
+
+    const int x0 = std::max(0.0, std::floor(*std::min_element(xs, xs + 3)));
+    const int x1 = std::min<double>(_width, std::ceil(*std::max_element(xs, xs + 3)));
+    const int y0 = std::max(0.0, std::floor(*std::min_element(ys, ys + 3)));
+    const int y1 = std::min<double>(_height, std::ceil(*std::max_element(ys, ys + 3)));
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Each accumulation row has two extra entries since an edge on the right
+    // side of the box deposits its area just past the last pixel.
+    _box_width = x1 - x0;
+    _box_height = y1 - y0;
+    _accumulation.assign((_box_width + 2) * _box_height, 0.0f);
+
+    for (int i = 0; i < 3; i++) {
+        const int j = (i + 1) % 3;
+        AddEdge(xs[i] - x0, ys[i] - y0, xs[j] - x0, ys[j] - y0);
+    }
+
+    // Integrating the accumulated areas along a row gives the coverage.  The
+    // sign depends on the triangle's winding order.
+    const Colour premultiplied = Premultiply(colour);
+    _coverage.resize(_box_width);
+    for (int y = 0; y < _box_height; y++) {
+        const float *row = &_accumulation[y * (_box_width + 2)];
+        float accumulated = 0;
+        for (int x = 0; x < _box_width; x++) {
+            accumulated += row[x];
+            _coverage[x] = std::min(std::abs(accumulated), 1.0f);
+        }
+        BlendSpan(x0, y0 + y, _box_width, _coverage.data(), premultiplied);
+    }
+}
+
+Rasterizer::Colour Rasterizer::Premultiply(const BLRgba &colour) {
+    const float alpha = colour.a;
+    return Colour{
+        .red = 255.0f * alpha * static_cast<float>(colour.r),
+        .green = 255.0f * alpha * static_cast<float>(colour.g),
+        .blue = 255.0f * alpha * static_cast<float>(colour.b),
+        .alpha = 255.0f * alpha,
+    };
+}
+
+void Rasterizer::FillAliasedCircle(const BLCircle &circle, const Colour &colour) {
+    const double radius_squared = circle.r * circle.r;
+    const int y0 = FirstPixelCentre(circle.cy - circle.r, _height);
+    const int y1 = FirstPixelCentre(circle.cy + circle.r, _height);
+
+    for (int y = y0; y < y1; y++) {
+        const double dy = y + 0.5 - circle.cy;
+        const double half_width = std::sqrt(std::max(0.0, radius_squared - dy * dy));
+
+        const int x0 = FirstPixelCentre(circle.cx - half_width, _width);
+        const int x1 = FirstPixelCentre(circle.cx + half_width, _width);
+        if (x0 < x1) {
+            BlendSolidSpan(x0, y, x1 - x0, colour);
+        }
+    }
+}
+
+void Rasterizer::FillAliasedRect(const BLRect &rect, const Colour &colour) {
+    const int x0 = FirstPixelCentre(rect.x, _width);
+    const int x1 = FirstPixelCentre(rect.x + rect.w, _width);
+    const int y0 = FirstPixelCentre(rect.y, _height);
+    const int y1 = FirstPixelCentre(rect.y + rect.h, _height);
+    if (x0 >= x1) {
+        return;
+    }
+
+    for (int y = y0; y < y1; y++) {
+        BlendSolidSpan(x0, y, x1 - x0, colour);
+    }
+}
+
+void Rasterizer::FillAliasedTriangle(const BLTriangle &triangle, const Colour &colour) {
+    const double xs[3] = {triangle.x0, triangle.x1, triangle.x2};
+    const double ys[3] = {triangle.y0, triangle.y1, triangle.y2};
+
+    const int y0 = FirstPixelCentre(*std::min_element(ys, ys + 3), _height);
+    const int y1 = FirstPixelCentre(*std::max_element(ys, ys + 3), _height);
+
+    // Each row is filled between the points where the row's centre line
+    // crosses the triangle's edges.  The edges are half-open so that a vertex
+    // sitting exactly on the centre line isn't counted twice.
+    for (int y = y0; y < y1; y++) {
+        const double centre = y + 0.5;
+        double left = std::numeric_limits<double>::infinity();
+        double right = -std::numeric_limits<double>::infinity();
+
+        for (int i = 0; i < 3; i++) {
+            const int j = (i + 1) % 3;
+            const double top = std::min(ys[i], ys[j]);
+            const double bottom = std::max(ys[i], ys[j]);
+            if (centre < top || centre >= bottom) {
+                continue;
+            }
+
+            const double x = xs[i] + (centre - ys[i]) / (ys[j] - ys[i]) * (xs[j] - xs[i]);
+            left = std::min(left, x);
+            right = std::max(right, x);
+        }
+
+        if (left > right) {
+            continue;
+        }
+
+        const int x0 = FirstPixelCentre(left, _width);
+        const int x1 = FirstPixelCentre(right, _width);
+        if (x0 < x1) {
+            BlendSolidSpan(x0, y, x1 - x0, colour);
+        }
+    }
+}
+
+void Rasterizer::AddEdge(double x0, double y0, double x1, double y1) {
+    if (y0 == y1) {
+        return;
+    }
+
+    // Split the edge wherever it crosses the sides of the box.  Every part is
+    // then either inside of the box or entirely to one side of it, so it can
+    // be clamped onto the box without changing the coverage.
+    const double max_x = _box_width;
+    for (double side : {0.0, max_x}) {
+        if ((x0 - side) * (x1 - side) < 0) {
+            const double y_side = y0 + (side - x0) / (x1 - x0) * (y1 - y0);
+            AddEdge(x0, y0, side, y_side);
+            AddEdge(side, y_side, x1, y1);
+            return;
+        }
+    }
+
+    // The edges always go downwards, with the direction stored in the sign of
+    // the accumulated area.
+    double direction = 1;
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        direction = -1;
+    }
+
+    const double dxdy = (x1 - x0) / (y1 - y0);
+
+    // Start at the first row inside of the box.
+    double x = x0;
+    if (y0 < 0) {
+        x -= y0 * dxdy;
+    }
+
+    const int first_row = std::max(0.0, std::floor(y0));
+    const int last_row = std::min<double>(_box_height, std::ceil(y1));
+    for (int y = first_row; y < last_row; y++) {
+        float *row = &_accumulation[y * (_box_width + 2)];
+
+        const double dy = std::min(y + 1.0, y1) - std::max<double>(y, y0);
+        const double x_next = x + dxdy * dy;
+        const double area = direction * dy;
+
+        // Anything left of the box covers the first column while anything to
+        // the right doesn't cover any of them.  The clamping also guards
+        // against rounding errors at the sides.
+        double left = std::clamp(x, 0.0, max_x);
+        double right = std::clamp(x_next, 0.0, max_x);
+        if (left > right) {
+            std::swap(left, right);
+        }
+
+        const double left_floor = std::floor(left);
+        const int first = left_floor;
+        const int last = std::ceil(right);
+
+        if (last <= first + 1) {
+            // The edge stays within a single pixel on this row.
+            const double mid = 0.5 * (left + right) - left_floor;
+            row[first] += area * (1 - mid);
+            row[first + 1] += area * mid;
+        } else {
+            // The edge crosses several pixels, so its area is split between
+            // the partially covered pixels at either end and a constant
+            // amount for each pixel in between.
+            const double slope = 1.0 / (right - left);
+            const double left_frac = left - left_floor;
+            const double first_area = 0.5 * slope * (1 - left_frac) * (1 - left_frac);
+            const double right_frac = right - last + 1;
+            const double last_area = 0.5 * slope * right_frac * right_frac;
+
+            row[first] += area * first_area;
+            if (last == first + 2) {
+                row[first + 1] += area * (1 - first_area - last_area);
+            } else {
+                const double second_area = slope * (1.5 - left_frac);
+                row[first + 1] += area * (second_area - first_area);
+                for (int i = first + 2; i < last - 1; i++) {
+                    row[i] += area * slope;
+                }
+                const double penultimate_area = second_area + (last - first - 3) * slope;
+                row[last - 1] += area * (1 - penultimate_area - last_area);
+            }
+            row[last] += area * last_area;
+        }
+
+        x = x_next;
+    }
+}
+
+void Rasterizer::BlendSpan(int x, int y, int width, const float *coverage,
+                           const Colour &colour) {
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(_pixels + y * _stride) + x;
+    const float channels[4] = {colour.red, colour.green, colour.blue, colour.alpha};
+    const float alpha = colour.alpha / 255.0f;
+
+    // The loops don't branch on the coverage so that they can be vectorized.
+    if (_mode == CompositeMode::SrcOver) {
+        for (int i = 0; i < width; i++) {
+            pixels[i] = BlendPixel(pixels[i], channels, coverage[i], 1 - alpha * coverage[i]);
+        }
+    } else {
+        for (int i = 0; i < width; i++) {
+            pixels[i] = BlendPixel(pixels[i], channels, coverage[i], 1 - coverage[i]);
+        }
+    }
+}
+
+void Rasterizer::BlendSolidSpan(int x, int y, int width, const Colour &colour) {
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(_pixels + y * _stride) + x;
+    const float channels[4] = {colour.red, colour.green, colour.blue, colour.alpha};
+    const float dst_scale = _mode == CompositeMode::SrcOver ? 1 - colour.alpha / 255.0f : 0.0f;
+
+    for (int i = 0; i < width; i++) {
+        pixels[i] = BlendPixel(pixels[i], channels, 1.0f, dst_scale);
+    }
+}
+
+}  // namespace abstractions::render
@@ -1,10 +1,153 @@
 #include "abstractions/render/renderer.h"
 
+#include <abstractions/errors.h>
 #include <abstractions/math/random.h>
 #include <abstractions/render/canvas.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <vector>
 
 namespace abstractions::render {
 
+/// @brief The cached intermediate composites of a base collection.
+struct Renderer::Layers {
+    /// @brief Number of shapes between each composite.
+    int interval;
+
+    /// @brief Alpha scaling used to render the base.
+    double alpha_scale;
+
+    /// @brief Coordinate mapping used to render the base.
+    CoordinateMapping mapping;
+
+    /// @brief Rasterizer used to render the base.
+    RenderBackend backend;
+
+    /// @brief Render quality used to render the base.
+    RenderQuality quality;
+
+    /// @brief The base's rescaling bounds.
+    /// @see RescalingBounds()
+    std::vector<double> bounds;
+
+    /// @brief The `k`-th composite contains the background and the first
+    ///     `k * interval` shapes of the base.
+    std::vector<Image> composites;
+};
+
+/// @brief The random background fill, generated the first time that it's
+///     needed.
+///
+/// The copies of a renderer share the same background since they all have
+/// the same PRNG and surface size.
+struct Renderer::RandomBackground {
+    std::once_flag generated;
+    std::optional<Image> image;
+};
+
+namespace {
+
+/// @brief Call a function for every drawn shape collection, in the same order
+///     that the collections are drawn in.
+/// @param shapes packed shape collection
+/// @param fn callable with a `(ShapeTraits<S>, const Collection &)` signature
+template <typename F>
+void ForEachDrawnCollection(const PackedShapeCollection &shapes, F &&fn) {
+    shapes.ForEachCollection([&](auto traits, const auto &collection) {
+        if (!collection.Empty()) {
+            fn(traits, collection);
+        }
+    });
+}
+
+/// @brief Get the total number of drawn shapes.
+/// @param shapes packed shape collection
+/// @return number of shapes in every drawn collection
+int NumDrawnShapes(const PackedShapeCollection &shapes) {
+    int num_shapes = 0;
+    ForEachDrawnCollection(shapes, [&](auto, const auto &collection) {
+        num_shapes += collection.NumShapes();
+    });
+    return num_shapes;
+}
+
+/// @brief Get everything that the canvas uses to map the shape coordinates.
+/// @param shapes packed shape collection
+/// @param mapping coordinate mapping
+/// @return the size of each drawn collection followed, for the rescaled
+///     mapping, by the minimum and maximum of every rescaled coordinate
+///
+/// Two collections with the same bounds place a shape with the same
+/// parameters in exactly the same spot.
+std::vector<double> RescalingBounds(const PackedShapeCollection &shapes,
+                                    CoordinateMapping mapping) {
+    std::vector<double> bounds;
+    ForEachDrawnCollection(shapes, [&]<typename Traits>(Traits, const auto &collection) {
+        bounds.push_back(collection.NumShapes());
+        if (mapping != CoordinateMapping::Rescaled) {
+            return;
+        }
+
+        for (int j = 0; j < Traits::CoordinateDimensions; j++) {
+            bounds.push_back(collection.Params.col(j).minCoeff());
+            bounds.push_back(collection.Params.col(j).maxCoeff());
+        }
+    });
+    return bounds;
+}
+
+/// @brief Draw a range of shapes.
+/// @param canvas canvas being drawn to
+/// @param shapes packed shape collection
+/// @param first index of the first shape that's drawn
+/// @param last index one past the last shape that's drawn
+///
+/// The shapes are indexed in the order they're drawn, i.e., the circles
+/// followed by the rectangles and then the triangles.
+void DrawShapes(Canvas &canvas, const PackedShapeCollection &shapes, int first, int last) {
+    int offset = 0;
+    ForEachDrawnCollection(shapes, [&](auto, const auto &collection) {
+        const int num_shapes = collection.NumShapes();
+        const int begin = std::clamp(first - offset, 0, num_shapes);
+        const int end = std::clamp(last - offset, 0, num_shapes);
+        offset += num_shapes;
+
+        if (begin < end) {
+            canvas.DrawFilledShapes(collection, begin, end);
+        }
+    });
+}
+
+/// @brief Copy the pixels from one image into another image.
+/// @param source image being copied
+/// @param target image being copied into
+/// @param x horizontal position, within `source`, of the copied region
+/// @param y vertical position, within `source`, of the copied region
+///
+/// The copied region is the same size as `target` and must be inside of
+/// `source`.
+void CopyPixels(const Image &source, Image &target, int x = 0, int y = 0) {
+    abstractions_assert(x >= 0 && x + target.Width() <= source.Width());
+    abstractions_assert(y >= 0 && y + target.Height() <= source.Height());
+
+    BLImageData image_data;
+    BLImage &buffer = target;
+    abstractions_assert(buffer.makeMutable(&image_data) == BL_SUCCESS);
+
+    auto pixels = source.Pixels();
+    const size_t row_bytes = sizeof(uint32_t) * target.Width();
+    uint8_t *rows = static_cast<uint8_t *>(image_data.pixelData);
+    for (int j = 0; j < target.Height(); j++) {
+        std::memcpy(rows + j * image_data.stride, pixels.Row(y + j) + x, row_bytes);
+    }
+}
+
+}  // namespace
+
 Expected<Renderer> Renderer::Create(int width, int height, std::optional<Prng<>> prng) {
     auto image = Image::New(width, height, true);
     if (image.has_value()) {
@@ -18,16 +161,26 @@ Renderer::Renderer(Image &image, std::optional<Prng<>> prng) :
     _random_background{false},
     _background_colour{0xff, 0xff, 0xff},
     _drawing_surface{image},
-    _alpha_scale{1.0} {}
+    _alpha_scale{1.0},
+    _mapping{CoordinateMapping::Rescaled},
+    _backend{RenderBackend::Blend2D},
+    _quality{RenderQuality::Antialiased},
+    _num_threads{0},
+    _occlusion_culling{false} {}
 
 void Renderer::UseRandomBackgroundFill(bool use_random) {
     _random_background = use_random;
+    _background = use_random ? std::make_shared<RandomBackground>() : nullptr;
 }
 
 void Renderer::SetAlphaScale(double alpha_scale) {
     _alpha_scale = alpha_scale;
 }
 
+void Renderer::SetCoordinateMapping(CoordinateMapping mapping) {
+    _mapping = mapping;
+}
+
 void Renderer::SetBackground(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha) {
     _background_colour = Pixel(red, green, blue, alpha);
 }
@@ -36,10 +189,187 @@ void Renderer::SetBackground(const Pixel &background) {
     _background_colour = background;
 }
 
+void Renderer::SetBackend(RenderBackend backend) {
+    _backend = backend;
+}
+
+void Renderer::SetQuality(RenderQuality quality) {
+    _quality = quality;
+}
+
+void Renderer::SetThreadCount(int num_threads) {
+    abstractions_assert(num_threads >= 0);
+    _num_threads = num_threads;
+}
+
+void Renderer::SetOcclusionCulling(bool enabled) {
+    _occlusion_culling = enabled;
+}
+
 void Renderer::Render(const PackedShapeCollection &shapes) {
-    Canvas canvas{_drawing_surface, _prng};
+    Canvas canvas{_drawing_surface, _prng, _num_threads};
     canvas.SetAlphaScale(_alpha_scale);
+    canvas.SetCoordinateMapping(_mapping);
+    canvas.SetBackend(_backend);
+    canvas.SetQuality(_quality);
+    DrawBackground(canvas);
+    if (_occlusion_culling) {
+        canvas.FindOccludedShapes(shapes);
+    }
+    DrawShapes(canvas, shapes, 0, NumDrawnShapes(shapes));
+    _statistics = canvas.Statistics();
+}
+
+void Renderer::Render(const PackedShapeCollection &shapes, int first_changed) {
+    const bool use_layers = _layers && _layers->alpha_scale == _alpha_scale &&
+                            _layers->mapping == _mapping && _layers->backend == _backend &&
+                            _layers->quality == _quality &&
+                            _layers->composites.front().Width() == _drawing_surface.Width() &&
+                            _layers->composites.front().Height() == _drawing_surface.Height() &&
+                            _layers->bounds == RescalingBounds(shapes, _mapping);
+    if (!use_layers) {
+        Render(shapes);
+        return;
+    }
+
+    const int num_layers = _layers->composites.size();
+    const int layer = std::clamp(first_changed / _layers->interval, 0, num_layers - 1);
+    CopyPixels(_layers->composites[layer], _drawing_surface);
+
+    Canvas canvas{_drawing_surface, _prng, _num_threads};
+    canvas.SetAlphaScale(_alpha_scale);
+    canvas.SetCoordinateMapping(_mapping);
+    canvas.SetBackend(_backend);
+    canvas.SetQuality(_quality);
+    if (_occlusion_culling) {
+        canvas.FindOccludedShapes(shapes);
+    }
+    DrawShapes(canvas, shapes, layer * _layers->interval, NumDrawnShapes(shapes));
+    _statistics = canvas.Statistics();
+}
 
+Expected<TiledShapes> Renderer::BinShapes(const PackedShapeCollection &shapes,
+                                          int tile_size) const {
+    return TiledShapes::Create(shapes, _drawing_surface.Width(), _drawing_surface.Height(),
+                               _alpha_scale, _mapping, tile_size);
+}
+
+Error Renderer::RenderTile(const TiledShapes &tiles, int tile, Image &target) const {
+    if (tiles.Width() != _drawing_surface.Width() || tiles.Height() != _drawing_surface.Height()) {
+        return Error(fmt::format("Tiles binned for {}x{} don't match the {}x{} renderer.",
+                                 tiles.Width(), tiles.Height(), _drawing_surface.Width(),
+                                 _drawing_surface.Height()));
+    }
+
+    if (tile < 0 || tile >= tiles.NumTiles()) {
+        return Error(fmt::format("Tile {} is out of range; there are {} tiles.", tile,
+                                 tiles.NumTiles()));
+    }
+
+    const BLRectI rect = tiles.Tile(tile);
+    if (target.Width() != rect.w || target.Height() != rect.h) {
+        return Error(fmt::format("The {}x{} target doesn't match the {}x{} tile.", target.Width(),
+                                 target.Height(), rect.w, rect.h));
+    }
+
+    if (_random_background) {
+        CopyPixels(RandomBackgroundImage(), target, rect.x, rect.y);
+    }
+
+    Canvas canvas{target, _prng};
+    canvas.SetBackend(_backend);
+    canvas.SetQuality(_quality);
+    if (!_random_background) {
+        DrawBackground(canvas);
+    }
+    canvas.DrawSurfaceShapes(tiles.Shapes(), tiles.Bin(tile), rect.x, rect.y);
+    return errors::no_error;
+}
+
+Expected<CoverageMasks> Renderer::CacheCoverage(const PackedShapeCollection &base) const {
+    auto background = Image::New(_drawing_surface.Width(), _drawing_surface.Height(), true);
+    if (!background.has_value()) {
+        return errors::report<CoverageMasks>(background.error());
+    }
+
+    if (_random_background) {
+        CopyPixels(RandomBackgroundImage(), *background);
+    } else {
+        Canvas canvas{*background, _prng};
+        DrawBackground(canvas);
+    }
+
+    return CoverageMasks::Create(base, *background, _alpha_scale, _mapping, _backend, _quality);
+}
+
+Error Renderer::CacheLayers(const PackedShapeCollection &base, int interval) {
+    if (interval < 1) {
+        return Error(fmt::format("The layer interval must be at least one, not {}.", interval));
+    }
+
+    auto layers = std::make_shared<Layers>();
+    layers->interval = interval;
+    layers->alpha_scale = _alpha_scale;
+    layers->mapping = _mapping;
+    layers->backend = _backend;
+    layers->quality = _quality;
+    layers->bounds = RescalingBounds(base, _mapping);
+
+    Canvas canvas{_drawing_surface, _prng, _num_threads};
+    canvas.SetAlphaScale(_alpha_scale);
+    canvas.SetCoordinateMapping(_mapping);
+    canvas.SetBackend(_backend);
+    canvas.SetQuality(_quality);
+    DrawBackground(canvas);
+
+    // There's always at least one composite, even if it's just the background.
+    const int num_shapes = NumDrawnShapes(base);
+    int first = 0;
+    do {
+        auto composite = Image::New(_drawing_surface.Width(), _drawing_surface.Height(), true);
+        if (!composite.has_value()) {
+            return composite.error();
+        }
+
+        canvas.Flush();
+        CopyPixels(_drawing_surface, *composite);
+        layers->composites.push_back(*composite);
+
+        DrawShapes(canvas, base, first, first + interval);
+        first += interval;
+    } while (first < num_shapes);
+
+    _statistics = canvas.Statistics();
+    _layers = std::move(layers);
+    return errors::no_error;
+}
+
+void Renderer::ShareLayers(const Renderer &other) {
+    _layers = other._layers;
+}
+
+void Renderer::ClearLayers() {
+    _layers.reset();
+}
+
+const Image &Renderer::RandomBackgroundImage() const {
+    // Every canvas gets a copy of the PRNG, which always produces the same
+    // background, so it's only generated once.  Full renders draw the
+    // background directly and never need it.  The tiles of a sample can ask
+    // for it from several threads at once.
+    std::call_once(_background->generated, [this]() {
+        auto background = Image::New(_drawing_surface.Width(), _drawing_surface.Height(), true);
+        abstractions_assert(background.has_value());
+        {
+            Canvas canvas{*background, _prng};
+            canvas.RandomFill();
+        }
+        _background->image = std::move(*background);
+    });
+    return *_background->image;
+}
+
+void Renderer::DrawBackground(Canvas &canvas) const {
     if (_random_background) {
         canvas.RandomFill();
     } else {
@@ -49,19 +379,6 @@ void Renderer::Render(const PackedShapeCollection &shapes) {
         double a = static_cast<double>(_background_colour.Alpha()) / 255.0;
         canvas.Clear(r, g, b, a);
     }
-
-    auto selected_shapes = shapes.Shapes();
-    if (selected_shapes & AbstractionShape::Circles) {
-        canvas.DrawFilledCircles(shapes.Circles().Params);
-    }
-
-    if (selected_shapes & AbstractionShape::Rectangles) {
-        canvas.DrawFilledRectangles(shapes.Rectangles().Params);
-    }
-
-    if (selected_shapes & AbstractionShape::Triangles) {
-        canvas.DrawFilledTriangles(shapes.Triangles().Params);
-    }
 }
 
 }  // namespace abstractions::render
@@ -0,0 +1,72 @@
+#include "abstractions/render/tiles.h"
+
+#include <abstractions/errors.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace abstractions::render {
+
+Expected<TiledShapes> TiledShapes::Create(const PackedShapeCollection &shapes, int width,
+                                          int height, double alpha_scale,
+                                          CoordinateMapping mapping, int tile_size) {
+    if (width < 1 || height < 1) {
+        return errors::report<TiledShapes>(
+            fmt::format("Cannot tile a {}x{} surface.", width, height));
+    }
+
+    if (tile_size < 1) {
+        return errors::report<TiledShapes>(
+            fmt::format("The tile size must be at least one, not {}.", tile_size));
+    }
+
+    TiledShapes tiles(width, height, tile_size);
+    MapShapes(shapes, width, height, alpha_scale, mapping, tiles._shapes, tiles._statistics);
+
+    // A shape touches every pixel its bounding box overlaps, so it's added to
+    // the bin of every tile that contains one of those pixels.  The shapes are
+    // visited in draw order so every bin stays in draw order.
+    for (int i = 0; i < static_cast<int>(tiles._shapes.size()); i++) {
+        const BLBox &bounds = tiles._shapes[i].bounds;
+        if (!std::isfinite(bounds.x0 + bounds.y0 + bounds.x1 + bounds.y1)) {
+            continue;
+        }
+
+        // The anti-aliasing can touch the pixels just outside of the box.
+        const double x0 = std::floor(bounds.x0) - 1;
+        const double y0 = std::floor(bounds.y0) - 1;
+        const double x1 = std::ceil(bounds.x1) + 1;
+        const double y1 = std::ceil(bounds.y1) + 1;
+
+        const int tx0 = std::clamp<double>(std::floor(x0 / tile_size), 0, tiles._tiles_x);
+        const int ty0 = std::clamp<double>(std::floor(y0 / tile_size), 0, tiles._tiles_y);
+        const int tx1 = std::clamp<double>(std::ceil(x1 / tile_size), 0, tiles._tiles_x);
+        const int ty1 = std::clamp<double>(std::ceil(y1 / tile_size), 0, tiles._tiles_y);
+
+        for (int ty = ty0; ty < ty1; ty++) {
+            for (int tx = tx0; tx < tx1; tx++) {
+                tiles._bins[ty * tiles._tiles_x + tx].push_back(i);
+            }
+        }
+    }
+
+    return tiles;
+}
+
+TiledShapes::TiledShapes(int width, int height, int tile_size) :
+    _width{width},
+    _height{height},
+    _tile_size{tile_size},
+    _tiles_x{(width + tile_size - 1) / tile_size},
+    _tiles_y{(height + tile_size - 1) / tile_size},
+    _bins(_tiles_x * _tiles_y) {}
+
+BLRectI TiledShapes::Tile(int tile) const {
+    abstractions_assert(tile >= 0 && tile < NumTiles());
+    const int x = (tile % _tiles_x) * _tile_size;
+    const int y = (tile / _tiles_x) * _tile_size;
+    return BLRectI(x, y, std::min(_tile_size, _width - x), std::min(_tile_size, _height - y));
+}
+
+}  // namespace abstractions::render
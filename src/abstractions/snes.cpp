@@ -0,0 +1,292 @@
+#include "abstractions/snes.h"
+
+#include <abstractions/errors.h>
+#include <abstractions/math/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace abstractions {
+
+Error SnesOptimizerSettings::Validate() const {
+    if (init_stddev <= 0) {
+        return "Initial standard deviation must be greater than zero.";
+    }
+    if (mean_learning_rate <= 0) {
+        return "Mean learning rate must be greater than zero.";
+    }
+    if (stddev_learning_rate && *stddev_learning_rate <= 0) {
+        return "Standard deviation learning rate must be greater than zero.";
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Expected<BasicSnesOptimizer<T>> BasicSnesOptimizer<T>::New(
+    const SnesOptimizerSettings &settings) {
+    auto err = settings.Validate();
+    if (err) {
+        return std::unexpected(err);
+    }
+
+    uint64_t seed = 0;
+    if (settings.seed) {
+        seed = *settings.seed;
+    } else {
+        seed = PrngGenerator<>::DrawRandomSeed();
+    }
+
+    return BasicSnesOptimizer(settings, seed);
+}
+
+template <typename T>
+BasicSnesOptimizer<T>::BasicSnesOptimizer(const SnesOptimizerSettings &settings,
+                                          DefaultRngType::result_type seed) :
+    _is_initialized{false},
+    _settings{settings},
+    _seed{seed},
+    _population{0},
+    _update_pending{false} {}
+
+template <typename T>
+OptimizerType BasicSnesOptimizer<T>::Type() const {
+    return OptimizerType::Snes;
+}
+
+template <typename T>
+Expected<BasicRowVector<T>> BasicSnesOptimizer<T>::GetEstimate() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<BasicRowVector<T>>(err);
+    }
+
+    return _current_state;
+}
+
+template <typename T>
+Expected<BasicRowVector<T>> BasicSnesOptimizer<T>::GetSolutionStdDev() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<BasicRowVector<T>>(err);
+    }
+
+    return _current_standard_deviation;
+}
+
+template <typename T>
+const SnesOptimizerSettings &BasicSnesOptimizer<T>::GetSettings() const {
+    return _settings;
+}
+
+template <typename T>
+Expected<OptimizerState> BasicSnesOptimizer<T>::GetState() const {
+    auto err = CheckInitialized(_is_initialized);
+    if (err) {
+        return errors::report<OptimizerState>(err);
+    }
+
+    return OptimizerState{
+        .type = OptimizerType::Snes,
+        .state = _current_state.template cast<double>(),
+        .standard_deviation = _current_standard_deviation.template cast<double>(),
+        .vectors = {},
+        .seed = _seed,
+        .population = _population,
+    };
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::SetState(const OptimizerState &state) {
+    if (state.type != OptimizerType::Snes) {
+        return fmt::format("Cannot restore a {} optimizer state into a SNES optimizer.",
+                           state.type);
+    }
+
+    const int num_dim = state.state.cols();
+    if (state.standard_deviation.cols() != num_dim) {
+        return fmt::format(
+            "Optimizer state vectors must be the same length (state: {}, stddev: {}).", num_dim,
+            state.standard_deviation.cols());
+    }
+
+    _current_state = state.state.cast<T>();
+    _current_standard_deviation = state.standard_deviation.cast<T>();
+    _seed = state.seed;
+    _population = state.population;
+    _is_initialized = true;
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+void BasicSnesOptimizer<T>::SetPrngSeed(DefaultRngType::result_type seed) {
+    _seed = seed;
+    _population = 0;
+}
+
+template <typename T>
+void BasicSnesOptimizer<T>::Initialize(ConstBasicRowVectorRef<T> x_init,
+                                       std::optional<double> init_stddev) {
+    const int num_dim = x_init.cols();
+    const T stddev = init_stddev.value_or(_settings.init_stddev);
+
+    _current_state = x_init;
+    _current_standard_deviation = BasicRowVector<T>::Constant(num_dim, stddev);
+    _is_initialized = true;
+    _update_pending = false;
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::InsertParameters(int index, ConstBasicRowVectorRef<T> values,
+                                              std::optional<double> init_stddev) {
+    if (auto err = CheckInitialized(_is_initialized)) {
+        return err;
+    }
+
+    const int num_dim = _current_state.cols();
+    const int num_new = values.cols();
+
+    if (index < 0 || index > num_dim) {
+        return fmt::format("Insertion index {} is outside of the solution vector (length {}).",
+                           index, num_dim);
+    }
+
+    const T stddev = init_stddev.value_or(
+        num_dim > 0 ? _current_standard_deviation.mean() : T(_settings.init_stddev));
+    InsertValues(_current_state, index, values);
+    InsertValues(_current_standard_deviation, index, BasicRowVector<T>::Constant(num_new, stddev));
+    _update_pending = false;
+
+    return errors::no_error;
+}
+
+template <typename T>
+uint32_t BasicSnesOptimizer<T>::NewPopulation() {
+    return _population++;
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::SampleBlock(BasicMatrixRef<T> samples, int first_param,
+                                         int num_params, uint32_t population) const {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateMirroredSamples(samples, _current_state.cols()),
+                                 ValidateBlock(samples, first_param, num_params)});
+    if (err) {
+        return err;
+    }
+
+    // The samples are drawn exactly the same way as the PGPE optimizer's.
+    for (int i = first_param; i < first_param + num_params; i++) {
+        DrawMirroredSamples(samples, i, _current_state(i), _current_standard_deviation(i), _seed,
+                            population);
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::BeginUpdate(ConstBasicMatrixRef<T> samples,
+                                         ConstBasicColumnVectorRef<T> costs) {
+    auto err = errors::find_any({CheckInitialized(_is_initialized),
+                                 ValidateMirroredSamples(samples, _current_state.cols()),
+                                 ValidateCosts(samples.rows(), costs)});
+
+    if (err) {
+        return err;
+    }
+
+    const int num_samples = samples.rows();
+    const int num_pairs = num_samples / 2;
+    const int num_params = samples.cols();
+
+    _ranking.resize(num_samples);
+    _utilities.resize(num_samples);
+    _delta_utility.resize(num_pairs);
+    _sum_utility.resize(num_pairs);
+    _grad_solution.resize(num_params);
+    _grad_stddev.resize(num_params);
+
+    // Rank the samples, best (largest fitness) first, and give each one its
+    // utility.  The utilities only depend on the rank, and sum to zero, so the
+    // update is invariant to any monotonic transformation of the costs.
+    std::iota(std::begin(_ranking), std::end(_ranking), 0);
+    std::stable_sort(std::begin(_ranking), std::end(_ranking),
+                     [&costs](const int &a, const int &b) { return costs(a) > costs(b); });
+
+    const double log_half = std::log(num_samples / 2.0 + 1);
+    double total_utility = 0;
+    for (int i = 0; i < num_samples; i++) {
+        const double utility = std::max(0.0, log_half - std::log(i + 1.0));
+        _utilities(_ranking[i]) = utility;
+        total_utility += utility;
+    }
+    _utilities = _utilities.array() / T(total_utility) - T(1.0 / num_samples);
+
+    // The mirrored samples share the same noise, up to its sign, so each
+    // gradient only needs a single pass over the top half of the samples.
+    _delta_utility = _utilities.topRows(num_pairs) - _utilities.bottomRows(num_pairs);
+    _sum_utility = _utilities.topRows(num_pairs) + _utilities.bottomRows(num_pairs);
+
+    _update_pending = true;
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::AccumulateGradients(ConstBasicMatrixRef<T> samples,
+                                                 int first_param, int num_params) {
+    if (!_update_pending) {
+        return "Cannot accumulate gradients; no update is in progress.";
+    }
+
+    if (first_param < 0 || num_params < 0 || first_param + num_params > _grad_solution.cols()) {
+        return fmt::format("Parameter block [{}, {}) is outside of the {} updated parameters.",
+                           first_param, first_param + num_params, _grad_solution.cols());
+    }
+
+    // The natural gradients are taken with respect to the standardized noise,
+    // "s = (x - mu) / sigma", rather than the raw samples.
+    const int num_pairs = _delta_utility.rows();
+    for (int i = first_param; i < first_param + num_params; i++) {
+        const T state = _current_state(i);
+        const T inv_stddev = 1 / _current_standard_deviation(i);
+        const auto noise = (samples.col(i).head(num_pairs).array() - state) * inv_stddev;
+
+        _grad_solution(i) = (_delta_utility.array() * noise).sum();
+        _grad_stddev(i) = (_sum_utility.array() * (noise.square() - 1)).sum();
+    }
+
+    return errors::no_error;
+}
+
+template <typename T>
+Error BasicSnesOptimizer<T>::FinishUpdate() {
+    if (!_update_pending) {
+        return "Cannot finish the update; no update is in progress.";
+    }
+    _update_pending = false;
+
+    const int num_params = _current_state.cols();
+    const T mean_learning_rate = _settings.mean_learning_rate;
+    const T stddev_learning_rate = _settings.stddev_learning_rate.value_or(
+        (3 + std::log(num_params)) / (5 * std::sqrt(num_params)));
+
+    // Both updates use the standard deviation from before the update.
+    _current_state +=
+        mean_learning_rate * _current_standard_deviation.cwiseProduct(_grad_solution);
+    _current_standard_deviation.array() *= (stddev_learning_rate / 2 * _grad_stddev.array()).exp();
+    _current_standard_deviation = _current_standard_deviation.cwiseMax(T(1e-9));
+
+    return errors::no_error;
+}
+
+template class BasicSnesOptimizer<double>;
+template class BasicSnesOptimizer<float>;
+
+}  // namespace abstractions
@@ -3,14 +3,18 @@
 #include <abstractions/errors.h>
 #include <abstractions/terminal/chrono.h>
 #include <abstractions/terminal/table.h>
+#include <abstractions/threads/threadpool.h>
 #include <fmt/format.h>
 #include <fmt/std.h>
 
 #include <indicators/cursor_control.hpp>
 #include <indicators/cursor_movement.hpp>
 #include <indicators/progress_bar.hpp>
+#include <chrono>
+#include <future>
 #include <iostream>
 #include <map>
+#include <thread>
 
 #ifdef ABSTRACTIONS_ENABLE_GPERFTOOLS
 #include <gperftools/profiler.h>
@@ -26,6 +30,8 @@ constexpr const char *kPgpeOptions = "PGPE Optimizer";
 
 constexpr const double kDefaultMaxSolutionVelocity = 0.15;
 constexpr const int kDefaultImageSize = 512;
+constexpr const int kDefaultSnapshotInterval = 25;
+constexpr const int kDefaultProgressInterval = 100;
 
 static cli_helpers::EnumValidator<ImageComparison> ImageComparisonEnum("METRIC",
                                                                        {
@@ -33,6 +39,27 @@ static cli_helpers::EnumValidator<ImageComparison> ImageComparisonEnum("METRIC",
                                                                            ImageComparison::L2Norm,
                                                                        });
 
+static cli_helpers::EnumValidator<OptimizerType> OptimizerTypeEnum("OPTIMIZER",
+                                                                  {
+                                                                      OptimizerType::Pgpe,
+                                                                      OptimizerType::Snes,
+                                                                      OptimizerType::SepCmaEs,
+                                                                  });
+
+static cli_helpers::EnumValidator<BlockSelection> BlockSelectionEnum("SELECTION",
+                                                                    {
+                                                                        BlockSelection::RoundRobin,
+                                                                        BlockSelection::Random,
+                                                                        BlockSelection::ErrorGuided,
+                                                                    });
+
+static cli_helpers::EnumValidator<render::CoordinateMapping> CoordinateMappingEnum(
+    "MAPPING", {
+                   render::CoordinateMapping::Rescaled,
+                   render::CoordinateMapping::Clamped,
+                   render::CoordinateMapping::Sigmoid,
+               });
+
 static cli_helpers::EnumValidator<render::AbstractionShape> AbstractionShapeEnum(
     "SHAPE", {
                  render::AbstractionShape::Circles,
@@ -40,6 +67,36 @@ static cli_helpers::EnumValidator<render::AbstractionShape> AbstractionShapeEnum
                  render::AbstractionShape::Triangles,
              });
 
+/// @brief Everything needed to save an intermediate optimizer result.
+struct SnapshotPayload {
+    int width;
+    int height;
+    Options<render::AbstractionShape> shapes;
+    RowVector params;
+    double alpha_scale;
+    render::CoordinateMapping mapping;
+    std::filesystem::path path;
+};
+
+/// @brief Render an intermediate optimizer result and save it to disk.
+struct SaveSnapshot : public threads::IJobFunction {
+    Error operator()(threads::JobContext &ctx) const override {
+        auto payload = ctx.Data<SnapshotPayload>();
+        if (!payload.has_value()) {
+            return payload.error();
+        }
+
+        auto output = RenderImageAbstraction(payload->width, payload->height, payload->shapes,
+                                             payload->params, payload->alpha_scale,
+                                             Pixel(0, 0, 0, 255), 0, payload->mapping);
+        if (!output.has_value()) {
+            return output.error();
+        }
+
+        return output->Save(payload->path);
+    }
+};
+
 void ShowTimingReport(const terminal::Console &console, const TimingReport &report) {
     OperationTiming sampling, rendering, optimizing, callback;
 
@@ -49,8 +106,13 @@ void ShowTimingReport(const terminal::Console &console, const TimingReport &repo
         callback.AddSample(report.iterations.callback[i]);
     }
 
-    for (const auto &duration : report.iterations.render_and_compare) {
-        rendering.AddSample(duration);
+    // Only the rendered samples are counted since the adaptive population may
+    // render fewer than the maximum number of samples.
+    const int stride = report.NumIterations() > 0 ? report.NumSamples() : 0;
+    for (int i = 0; i < report.NumIterations(); i++) {
+        for (int j = 0; j < report.iterations.num_samples[i]; j++) {
+            rendering.AddSample(report.iterations.render_and_compare[i * stride + j]);
+        }
     }
 
     console.Print();
@@ -92,6 +154,21 @@ void ShowTimingReport(const terminal::Console &console, const TimingReport &repo
             .Render(console);
         // clang-format on
     }
+
+    console.Print();
+    console.Print("Rendered {} samples.", report.TotalSamples());
+
+    render::CullStatistics culling;
+    for (const auto &iteration : report.iterations.culling) {
+        culling += iteration;
+    }
+
+    if (culling.submitted > 0) {
+        console.Print(
+            "Culled {} of {} shapes ({} transparent, {} degenerate, {} offscreen, {} occluded).",
+            culling.Culled(), culling.submitted, culling.transparent, culling.degenerate,
+            culling.offscreen, culling.occluded);
+    }
 }
 
 }  // namespace
@@ -103,6 +180,21 @@ constexpr const char *type_name<ImageComparison>() {
     return "METRIC";
 }
 
+template <>
+constexpr const char *type_name<OptimizerType>() {
+    return "OPTIMIZER";
+}
+
+template <>
+constexpr const char *type_name<BlockSelection>() {
+    return "SELECTION";
+}
+
+template <>
+constexpr const char *type_name<render::CoordinateMapping>() {
+    return "MAPPING";
+}
+
 template <>
 constexpr const char *type_name<render::AbstractionShape>() {
     return "SHAPE";
@@ -138,12 +230,40 @@ CLI::App *GenerateCommand::Init(CLI::App &parent) {
            "Optional location where the results at each optimization iteration are stored.")
         ->capture_default_str()
         ->group(kGeneralOptions);
+    _snapshot_interval = kDefaultSnapshotInterval;
+    app->add_option("--snapshot-interval", _snapshot_interval,
+                    "Number of iterations between the results saved with '--save-intermediate'.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber)
+        ->group(kGeneralOptions);
+    _progress_interval = kDefaultProgressInterval;
+    app->add_option("--progress-interval", _progress_interval,
+                    "Minimum time, in milliseconds, between progress updates.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber)
+        ->group(kGeneralOptions);
+    _config.callback_exact_cost = false;
+    app->add_flag("--exact-cost", _config.callback_exact_cost,
+                  "Render the solution to report its exact cost with each progress update.")
+        ->group(kGeneralOptions);
     app->add_option("--input-size", _image_size,
                     "Sets the maximum value of an image's largest side.  Images larger than this "
                     "will be scaled to fit.")
         ->capture_default_str()
         ->group(kGeneralOptions);
 
+    app->add_option("--checkpoint", _config.checkpoint_file,
+                    "Periodically save the optimizer state to this file so it can be resumed.")
+        ->group(kGeneralOptions);
+    app->add_option("--checkpoint-interval", _config.checkpoint_interval,
+                    "Number of iterations between checkpoints.")
+        ->capture_default_str()
+        ->group(kGeneralOptions);
+    app->add_option("--resume", _resume,
+                    "Resume an optimization from a checkpoint created with '--checkpoint'.")
+        ->check(CLI::ExistingFile)
+        ->group(kGeneralOptions);
+
 #ifdef ABSTRACTIONS_ENABLE_GPERFTOOLS
     _profile = {};
     app->add_option("--profile", _profile,
@@ -163,11 +283,43 @@ CLI::App *GenerateCommand::Init(CLI::App &parent) {
         ->capture_default_str()
         ->group(kEngineOptions);
 
+    app->add_option("--min-samples", _config.min_samples,
+                    "Adapt the number of samples, down to this minimum, to the gradient's noise.")
+        ->group(kEngineOptions);
+
     app->add_option("-s,--shapes", _config.num_drawn_shapes,
                     "Number of individual shapes that make up the abstract image.")
         ->capture_default_str()
         ->group(kEngineOptions);
 
+    app->add_option("--initial-shapes", _config.initial_drawn_shapes,
+                    "Start with this many shapes and gradually add more (shape curriculum).")
+        ->group(kEngineOptions);
+
+    app->add_option("--shape-growth-interval", _config.shape_growth_interval,
+                    "Number of iterations between adding shapes to the solution.")
+        ->capture_default_str()
+        ->group(kEngineOptions);
+
+    app->add_option("--shape-growth-count", _config.shape_growth_count,
+                    "Number of shapes, per shape type, added at each growth step.")
+        ->capture_default_str()
+        ->group(kEngineOptions);
+
+    app->add_option("--block-shapes", _config.block_shapes,
+                    "Only perturb this many shapes, per shape type, in each iteration.")
+        ->group(kEngineOptions);
+
+    app->add_option("--block-selection", _config.block_selection,
+                    "How the shapes perturbed in each iteration are picked.")
+        ->transform(BlockSelectionEnum)
+        ->default_str(fmt::format("{}", _config.block_selection))
+        ->group(kEngineOptions);
+
+    app->add_option("--colour-refinement", _config.colour_refinement_iterations,
+                    "Only refine the shape colours during this many final iterations.")
+        ->group(kEngineOptions);
+
     app->add_option("-t,--shape-type", shapes_cb,
                     "The type of shape to use.  May be repeated to use different shapes.")
         ->transform(AbstractionShapeEnum)
@@ -180,6 +332,35 @@ CLI::App *GenerateCommand::Init(CLI::App &parent) {
         ->capture_default_str()
         ->group(kEngineOptions);
 
+    app->add_option("--coordinates", _config.coordinate_mapping,
+                    "How the shape coordinates are mapped onto the image.")
+        ->transform(CoordinateMappingEnum)
+        ->default_str(fmt::format("{}", _config.coordinate_mapping))
+        ->group(kEngineOptions);
+
+    app->add_option("--time-limit", _time_limit,
+                    "Stop the optimization after this many seconds and keep the best result.")
+        ->check(CLI::PositiveNumber)
+        ->group(kEngineOptions);
+
+    app->add_option("--target-cost", _config.target_cost,
+                    "Stop the optimization once the solution cost falls below this value.")
+        ->check(CLI::NonNegativeNumber)
+        ->group(kEngineOptions);
+
+    app->add_option("--pyramid-levels", _config.pyramid_levels,
+                    "Number of levels in the coarse-to-fine resolution pyramid.")
+        ->capture_default_str()
+        ->group(kEngineOptions);
+
+    app->add_option("--pyramid-level-iterations", _config.pyramid_level_iterations,
+                    "Maximum iterations spent on each coarse pyramid level.")
+        ->group(kEngineOptions);
+
+    app->add_option("--pyramid-stall", _config.pyramid_stall_iterations,
+                    "Move to the next pyramid level after this many iterations without progress.")
+        ->group(kEngineOptions);
+
     app->add_option("--workers", _config.num_workers,
                     "Number of worker threads (default is based on the number of CPU cores).")
         ->capture_default_str()
@@ -191,6 +372,27 @@ CLI::App *GenerateCommand::Init(CLI::App &parent) {
         ->default_str(fmt::format("{}", _config.comparison_metric))
         ->group(kEngineOptions);
 
+    app->add_option("--optimizer", _config.optimizer,
+                    "The optimization algorithm.  The optimizer options only apply to PGPE.")
+        ->transform(OptimizerTypeEnum)
+        ->default_str(fmt::format("{}", _config.optimizer))
+        ->group(kEngineOptions);
+
+    app->add_flag("--single-precision", _config.single_precision,
+                  "Use single precision values for the optimizer to reduce memory use.")
+        ->group(kEngineOptions);
+
+    app->add_flag_callback(
+           "--aliased-samples",
+           [this]() { _config.sample_quality = render::RenderQuality::Aliased; },
+           "Render the samples without anti-aliasing; the final image is still anti-aliased.")
+        ->group(kEngineOptions);
+
+    app->add_option("--tile-size", _config.render_tile_size,
+                    "Render and compare the samples in square tiles of this size, in pixels.")
+        ->check(CLI::PositiveNumber)
+        ->group(kEngineOptions);
+
     // Optimizer configuration options
     _optim_settings.max_speed = kDefaultMaxSolutionVelocity;
 
@@ -213,6 +415,9 @@ CLI::App *GenerateCommand::Init(CLI::App &parent) {
                     "Maximum allowable change to the standard deviation estimate.")
         ->capture_default_str()
         ->group(kPgpeOptions);
+    app->add_option("--refresh-rate", _optim_settings.min_refresh_rate,
+                    "Reuse earlier samples but freshly sample this fraction of each population.")
+        ->group(kPgpeOptions);
 
     return app;
 }
@@ -229,8 +434,11 @@ void GenerateCommand::Run() const {
     // Show the processing configuration.
     terminal::Table table;
     table.AddRow("Shapes", fmt::format("{} [{}]", _config.shapes, _config.num_drawn_shapes))
-        .AddRow("Samples", _config.num_samples)
+        .AddRow("Samples", _config.min_samples ? fmt::format("{}-{}", *_config.min_samples,
+                                                             _config.num_samples)
+                                               : fmt::format("{}", _config.num_samples))
         .AddRow("Alpha Scale", _config.alpha_scale)
+        .AddRow("Coordinates", _config.coordinate_mapping)
         .AddRow("Image Size", fmt::format("{}x{}", image->Width(), image->Height()))
         .AddRow("Max Size", fmt::format("{}x{}", _image_size, _image_size));
 
@@ -239,6 +447,37 @@ void GenerateCommand::Run() const {
     }
 
     table.AddRow("Iterations", _config.iterations);
+
+    if (_config.initial_drawn_shapes) {
+        table.AddRow("Initial Shapes", *_config.initial_drawn_shapes);
+    }
+
+    if (_config.block_shapes) {
+        table.AddRow("Block Shapes",
+                     fmt::format("{} ({})", *_config.block_shapes, _config.block_selection));
+    }
+
+    if (_config.colour_refinement_iterations) {
+        table.AddRow("Colour Refinement", *_config.colour_refinement_iterations);
+    }
+
+    if (_config.pyramid_levels > 1) {
+        table.AddRow("Pyramid Levels", _config.pyramid_levels);
+    }
+
+    if (_config.checkpoint_file) {
+        table.AddRow("Checkpoint", fmt::format("{} [every {}]", *_config.checkpoint_file,
+                                               _config.checkpoint_interval));
+    }
+
+    if (_time_limit) {
+        table.AddRow("Time Limit", fmt::format("{}s", *_time_limit));
+    }
+
+    if (_config.target_cost) {
+        table.AddRow("Target Cost", *_config.target_cost);
+    }
+
     table.OuterBorders(false)
         .RowDividers(false)
         .VerticalSeparator("-")
@@ -259,9 +498,25 @@ void GenerateCommand::Run() const {
                                     indicators::option::ShowRemainingTime{true},
                                     indicators::option::MaxProgress{_config.iterations}};
 
+    // Load the checkpoint before anything else so the progress bar starts in
+    // the right place.
+    std::optional<EngineCheckpoint> checkpoint;
+    if (_resume) {
+        auto loaded = EngineCheckpoint::Load(*_resume);
+        abstractions_check(loaded);
+        checkpoint = std::move(*loaded);
+
+        console.Print("Resuming from '{}' at iteration {}", *_resume, checkpoint->iteration);
+        progbar.set_progress(checkpoint->iteration);
+    }
+
     if (!_per_stage_output.empty()) {
         console.Print("Storing optimizer steps to '{}'", _per_stage_output);
-        std::filesystem::remove_all(_per_stage_output);
+
+        // A resumed run adds to the intermediate results from the original run.
+        if (!checkpoint) {
+            std::filesystem::remove_all(_per_stage_output);
+        }
         std::filesystem::create_directories(_per_stage_output);
     }
 
@@ -273,33 +528,81 @@ void GenerateCommand::Run() const {
 #endif  // ABSTRACTIONS_ENABLE_GPERFTOOLS
 
     // Create the engine and generate an abstraction from the provided image.
-    auto engine = Engine::Create(_config, _optim_settings);
+    auto config = _config;
+    config.callback_period = std::chrono::milliseconds(_progress_interval);
+    if (_time_limit) {
+        config.time_limit = std::chrono::milliseconds(static_cast<int64_t>(*_time_limit * 1000));
+    }
+
+    auto engine = Engine::Create(config, _optim_settings);
     abstractions_check(engine);
 
+    // Intermediate results are rendered and saved on a separate worker so the
+    // optimizer never waits on them.  A snapshot is skipped, rather than
+    // queued, if the previous one is still being written.
+    threads::ThreadPool snapshot_stage(threads::ThreadPoolConfig{.num_workers = 1});
+    std::optional<threads::Job::Future> pending_snapshot;
+    int next_snapshot = checkpoint ? checkpoint->iteration : 0;
+
     engine->SetCallback([&, this](int i, double cost, ConstRowVectorRef params) {
         progbar.set_option(indicators::option::PrefixText{
             fmt::format("Running Optimizer (Iteration {:>5} [{:>5.3g}])", i + 1, cost)});
-        progbar.tick();
+        progbar.set_progress(i + 1);
 
         if (_per_stage_output.empty()) {
             return;
         }
 
-        if (i % 25 != 0) {
+        if (i < next_snapshot) {
             return;
         }
 
-        auto file_name = fmt::format("iter-{:0>5}.png", i);
-        auto out_path = _per_stage_output / file_name;
-        auto iteration_output = RenderImageAbstraction(image->Width(), image->Height(),
-                                                       _config.shapes, params, _config.alpha_scale);
-        abstractions_check(iteration_output);
-        abstractions_check(iteration_output->Save(out_path));
+        if (pending_snapshot) {
+            if (pending_snapshot->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return;
+            }
+
+            abstractions_check(pending_snapshot->get().error);
+            pending_snapshot.reset();
+        }
+
+        SnapshotPayload payload{
+            .width = image->Width(),
+            .height = image->Height(),
+            .shapes = _config.shapes,
+            .params = params,
+            .alpha_scale = _config.alpha_scale,
+            .mapping = _config.coordinate_mapping,
+            .path = _per_stage_output / fmt::format("iter-{:0>5}.png", i),
+        };
+        pending_snapshot = snapshot_stage.SubmitWithPayload<SaveSnapshot>(i, payload);
+        next_snapshot = (i / _snapshot_interval + 1) * _snapshot_interval;
     });
 
-    auto result = engine->GenerateAbstraction(*image);
+    auto result = checkpoint ? engine->ResumeAbstraction(*image, *checkpoint)
+                             : engine->GenerateAbstraction(*image);
     abstractions_check(result);
 
+    if (pending_snapshot) {
+        abstractions_check(pending_snapshot->get().error);
+    }
+
+    // The callbacks may skip a snapshot while another one is being written, so
+    // the final snapshot is always written from the returned solution.
+    if (!_per_stage_output.empty() && result->iterations > 0) {
+        const int i = result->iterations - 1;
+        SnapshotPayload payload{
+            .width = image->Width(),
+            .height = image->Height(),
+            .shapes = _config.shapes,
+            .params = result->solution,
+            .alpha_scale = _config.alpha_scale,
+            .mapping = _config.coordinate_mapping,
+            .path = _per_stage_output / fmt::format("iter-{:0>5}.png", i),
+        };
+        abstractions_check(snapshot_stage.SubmitWithPayload<SaveSnapshot>(i, payload).get().error);
+    }
+
     auto output_json = _output;
     output_json.replace_extension(".json");
     result->Save(output_json);
@@ -314,10 +617,13 @@ void GenerateCommand::Run() const {
     }
 #endif  // ABSTRACTIONS_ENABLE_GPERFTOOLS
 
-    // Generate the final output.
+    // Generate the final output.  The optimization is done so every core can
+    // help with the render.
+    const int num_threads = _config.num_workers.value_or(std::thread::hardware_concurrency());
     auto output =
         RenderImageAbstraction(image->Width(), image->Height(), _config.shapes, result->solution,
-                               _config.alpha_scale, Pixel(255, 255, 255));
+                               _config.alpha_scale, Pixel(255, 255, 255), num_threads,
+                               _config.coordinate_mapping);
     abstractions_check(output);
 
     auto output_image_file = _output;
@@ -326,5 +632,10 @@ void GenerateCommand::Run() const {
 
     console.Print("Finished in {}", terminal::FormatDuration(result->timing.total_time));
 
+    if (result->stop_reason != StopReason::Completed) {
+        console.Print("Stopped early after {} iterations ({}).", result->iterations,
+                      result->stop_reason);
+    }
+
     ShowTimingReport(console, result->timing);
 }
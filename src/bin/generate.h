@@ -17,7 +17,11 @@ private:
     std::filesystem::path _output;
     std::filesystem::path _per_stage_output;
     std::optional<std::filesystem::path> _profile;
+    std::optional<std::filesystem::path> _resume;
     int _image_size;
+    int _snapshot_interval;
+    int _progress_interval;
+    std::optional<double> _time_limit;
     abstractions::EngineConfig _config;
     abstractions::PgpeOptimizerSettings _optim_settings;
 };
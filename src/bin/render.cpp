@@ -5,6 +5,8 @@
 #include <fmt/color.h>
 #include <fmt/format.h>
 
+#include <thread>
+
 using namespace abstractions;
 
 CLI::App *RenderCommand::Init(CLI::App &parent) {
@@ -22,6 +24,11 @@ CLI::App *RenderCommand::Init(CLI::App &parent) {
     cmd->add_option("json", _json, "image abstraction JSON file")->transform(CLI::ExistingFile);
     cmd->add_option("output", _output, "output image file");
 
+    _num_threads = std::thread::hardware_concurrency();
+    cmd->add_option("-t,--threads", _num_threads, "number of rendering threads")
+        ->capture_default_str()
+        ->check(CLI::NonNegativeNumber);
+
     return cmd;
 }
 
@@ -58,6 +65,7 @@ void RenderCommand::Run() const {
     config.AddRow("Width", width)
         .AddRow("Height", height)
         .AddRow("Output", _output)
+        .AddRow("Threads", _num_threads)
         .VerticalSeparator("-")
         .OuterBorders(false)
         .RowDividers(false)
@@ -66,7 +74,8 @@ void RenderCommand::Run() const {
         .Render(console);
 
     auto image = RenderImageAbstraction(width, height, abstraction->shapes, abstraction->solution,
-                                        abstraction->alpha_scaling, Pixel(255, 255, 255));
+                                        abstraction->alpha_scaling, Pixel(255, 255, 255),
+                                        _num_threads, abstraction->coordinate_mapping);
     abstractions_check(image);
     abstractions_check(image->Save(_output));
 }
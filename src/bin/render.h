@@ -13,6 +13,7 @@ private:
     int _dim;
     bool _use_width;
     bool _use_height;
+    int _num_threads;
     std::filesystem::path _json;
     std::filesystem::path _output;
 };
@@ -26,7 +26,7 @@ void DrawCircles(render::ShapeGenerator &generator, const std::filesystem::path
         canvas.Clear();
 
         auto circles = generator.RandomCircles(num_circles);
-        abstractions_check(canvas.DrawFilledCircles(circles.Params));
+        abstractions_check(canvas.DrawFilledShapes(circles));
     }
     surface->Save(output);
 }
@@ -40,7 +40,7 @@ void DrawTriangles(render::ShapeGenerator &generator, const std::filesystem::pat
         canvas.Clear();
 
         auto triangles = generator.RandomTriangles(num_triangles);
-        abstractions_check(canvas.DrawFilledTriangles(triangles.Params));
+        abstractions_check(canvas.DrawFilledShapes(triangles));
     }
     surface->Save(output);
 }
@@ -54,7 +54,7 @@ void DrawRectangles(render::ShapeGenerator &generator, const std::filesystem::pa
         canvas.Clear();
 
         auto rects = generator.RandomRectangles(num_rects);
-        abstractions_check(canvas.DrawFilledRectangles(rects.Params));
+        abstractions_check(canvas.DrawFilledShapes(rects));
     }
     surface->Save(output);
 }
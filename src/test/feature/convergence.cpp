@@ -0,0 +1,41 @@
+#include <abstractions/engine.h>
+#include <abstractions/optimizer.h>
+
+#include <vector>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+constexpr tests::EngineWorkload kWorkload{};
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    const Image image = kWorkload.LoadImage(kSamplesPath / "triangles.png");
+    kWorkload.Print(console);
+
+    std::vector<tests::EngineRun> runs;
+    for (auto type : {OptimizerType::Pgpe, OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        console.Print("Running {}...", type);
+        EngineConfig config = kWorkload.Config(prng.seed());
+        config.optimizer = type;
+        runs.push_back(tests::RunEngine(image, config, fmt::format("{}", type)));
+    }
+
+    const double target = tests::CommonTarget(runs);
+
+    console.Separator();
+    console.Print("Target cost: {:.5f}", target);
+    console.Print("optimizer   final cost  iterations  time to target (ms)  total (ms)");
+    for (const auto &run : runs) {
+        const int index = run.IterationToTarget(target);
+        console.Print("{:<10}  {:>10.5f}  {:>10}  {:>19.1f}  {:>10.1f}", run.name, run.result.cost,
+                      index + 1, run.elapsed_ms[index], run.elapsed_ms.back());
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("convergence",
+                               "Compares the time each optimizer takes to reach the same cost.")
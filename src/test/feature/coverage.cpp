@@ -0,0 +1,91 @@
+#include <abstractions/errors.h>
+#include <abstractions/image.h>
+#include <abstractions/profile.h>
+#include <abstractions/render/coverage.h>
+#include <abstractions/render/renderer.h>
+#include <abstractions/render/shapes.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "support.h"
+
+using namespace abstractions;
+using namespace abstractions::render;
+
+namespace {
+
+constexpr int kImageSize = 128;
+constexpr int kNumShapes = 50;
+constexpr int kNumRenders = 2000;
+
+/// @brief A shape collection that's being benchmarked.
+struct Workload {
+    std::string name;
+    PackedShapeCollection shapes;
+};
+
+/// @brief Render the same collection repeatedly.
+/// @param renderer renderer being benchmarked
+/// @param shapes shapes to render
+/// @return the number of renders per second
+double MeasureRenderRate(Renderer &renderer, const PackedShapeCollection &shapes) {
+    Timer timer;
+    for (int i = 0; i < kNumRenders; i++) {
+        renderer.Render(shapes);
+    }
+    return kNumRenders / std::chrono::duration<double>(timer.GetElapsedTime()).count();
+}
+
+/// @brief Composite the same collection repeatedly into one reused target.
+/// @param masks coverage masks of the collection
+/// @param shapes shapes to composite
+/// @param composite target for the composites
+/// @return the number of composites per second
+double MeasureCompositeRate(const CoverageMasks &masks, const PackedShapeCollection &shapes,
+                            ColourPlanes &composite) {
+    Timer timer;
+    for (int i = 0; i < kNumRenders; i++) {
+        abstractions_check(masks.Composite(shapes, composite));
+    }
+    return kNumRenders / std::chrono::duration<double>(timer.GetElapsedTime()).count();
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    ShapeGenerator generator(kImageSize, kImageSize, prng);
+    std::vector<Workload> workloads{
+        {"circles", PackedShapeCollection(generator.RandomCircles(kNumShapes), {}, {})},
+        {"rectangles", PackedShapeCollection({}, generator.RandomRectangles(kNumShapes), {})},
+        {"triangles", PackedShapeCollection({}, {}, generator.RandomTriangles(kNumShapes))},
+    };
+
+    auto renderer = Renderer::Create(kImageSize, kImageSize, prng);
+    abstractions_check(renderer);
+
+    console.Print("Rendering and compositing {} shapes {} times on a {}x{} canvas.", kNumShapes,
+                  kNumRenders, kImageSize, kImageSize);
+    console.Separator();
+    console.Print("shapes      render (renders/s)  composite (renders/s)  speedup  mean diff");
+    for (const auto &workload : workloads) {
+        auto masks = renderer->CacheCoverage(workload.shapes);
+        abstractions_check(masks);
+
+        ColourPlanes composite;
+        const double render_rate = MeasureRenderRate(*renderer, workload.shapes);
+        const double composite_rate = MeasureCompositeRate(*masks, workload.shapes, composite);
+
+        const ColourPlanes rendered = ToColourPlanes(renderer->DrawingSurface());
+        const double diff = (rendered - composite).abs().mean();
+
+        console.Print("{:<10}  {:>18.0f}  {:>21.0f}  {:>6.2f}x  {:>9.5f}", workload.name,
+                      render_rate, composite_rate, composite_rate / render_rate, diff);
+
+        renderer->DrawingSurface().Save(output_folder.FilePath(workload.name + "-render.png"));
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("coverage",
+                               "Compares the render rate against compositing coverage masks.")
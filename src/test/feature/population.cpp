@@ -0,0 +1,57 @@
+#include <abstractions/engine.h>
+
+#include <vector>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+constexpr tests::EngineWorkload kWorkload{.iterations = 500};
+constexpr int kMinSamples = 8;
+
+/// @brief Count the renders done by the end of each iteration.
+/// @param run completed engine run
+/// @return the cumulative number of renders
+std::vector<int> CumulativeRenders(const tests::EngineRun &run) {
+    std::vector<int> renders;
+    int total = 0;
+    for (int samples : run.result.timing.iterations.num_samples) {
+        total += samples;
+        renders.push_back(total);
+    }
+    return renders;
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    const Image image = kWorkload.LoadImage(kSamplesPath / "triangles.png");
+    kWorkload.Print(console);
+
+    const auto seed = prng.seed();
+    EngineConfig adaptive = kWorkload.Config(seed);
+    adaptive.min_samples = kMinSamples;
+
+    std::vector<tests::EngineRun> runs{
+        tests::RunEngine(image, kWorkload.Config(seed), "fixed"),
+        tests::RunEngine(image, adaptive, fmt::format("{}-{}", kMinSamples, kWorkload.num_samples)),
+    };
+
+    // Compare the renders needed to reach the best cost that both runs
+    // managed to reach.
+    const double target = tests::CommonTarget(runs);
+
+    console.Print("Target cost: {:.5f}", target);
+    console.Print("population  final cost  iterations  renders to target  total renders");
+    for (const auto &run : runs) {
+        const int index = run.IterationToTarget(target);
+        const auto renders = CumulativeRenders(run);
+        console.Print("{:<10}  {:>10.5f}  {:>10}  {:>17}  {:>13}", run.name, run.result.cost,
+                      index + 1, renders[index], renders.back());
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("population",
+                               "Compares the renders needed by a fixed and an adaptive population.")
@@ -0,0 +1,85 @@
+#include <abstractions/errors.h>
+#include <abstractions/math/types.h>
+#include <abstractions/pgpe.h>
+#include <abstractions/profile.h>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+// Roughly what 1000 triangles would need.
+constexpr int kNumDim = 10000;
+constexpr int kNumSamples = 256;
+constexpr int kNumIter = 50;
+
+/// @brief The results of benchmarking one scalar type.
+struct BenchmarkResult {
+    double sample_ms;
+    double update_ms;
+    double final_cost;
+};
+
+/// @brief Time the optimizer's sample and update steps on a simple quadratic.
+/// @tparam T optimizer scalar type
+/// @param seed optimizer seed
+/// @return the per-iteration timings and the final cost
+template <typename T>
+BenchmarkResult RunBenchmark(uint32_t seed) {
+    auto optimizer = BasicPgpeOptimizer<T>::New({.max_speed = 0.5, .seed = seed});
+    abstractions_check(optimizer);
+
+    const BasicRowVector<T> target = BasicRowVector<T>::LinSpaced(kNumDim, -1, 1);
+    optimizer->Initialize(BasicRowVector<T>::Zero(kNumDim), 0.25);
+
+    BasicMatrix<T> samples = BasicMatrix<T>::Zero(kNumSamples, kNumDim);
+    BasicColumnVector<T> costs = BasicColumnVector<T>::Zero(kNumSamples);
+
+    detail::Duration sample_time{0};
+    detail::Duration update_time{0};
+    for (int i = 0; i < kNumIter; i++) {
+        Timer sample_timer;
+        abstractions_check(optimizer->Sample(samples));
+        sample_time += sample_timer.GetElapsedTime();
+
+        for (int j = 0; j < kNumSamples; j++) {
+            costs(j) = -(samples.row(j) - target).squaredNorm();
+        }
+        optimizer->RankLinearize(costs);
+
+        Timer update_timer;
+        abstractions_check(optimizer->Update(samples, costs));
+        update_time += update_timer.GetElapsedTime();
+    }
+
+    return BenchmarkResult{
+        .sample_ms = tests::ToMilliseconds(sample_time) / kNumIter,
+        .update_ms = tests::ToMilliseconds(update_time) / kNumIter,
+        .final_cost = (optimizer->GetEstimate()->template cast<double>() -
+                       target.template cast<double>())
+                          .squaredNorm(),
+    };
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    tests::PrintWorkload(console, kNumIter, kNumSamples, kNumDim, "parameters");
+
+    const auto fp64 = RunBenchmark<double>(prng.seed());
+    const auto fp32 = RunBenchmark<float>(prng.seed());
+
+    console.Print("            sample (ms)  update (ms)  final cost  samples (MiB)");
+    console.Print("double:     {:>11.3f}  {:>11.3f}  {:>10.4f}  {:>13.1f}", fp64.sample_ms,
+                  fp64.update_ms, fp64.final_cost,
+                  kNumSamples * kNumDim * sizeof(double) / 1048576.0);
+    console.Print("float:      {:>11.3f}  {:>11.3f}  {:>10.4f}  {:>13.1f}", fp32.sample_ms,
+                  fp32.update_ms, fp32.final_cost,
+                  kNumSamples * kNumDim * sizeof(float) / 1048576.0);
+    console.Separator();
+    console.Print("Update speedup: {:.2f}x", fp64.update_ms / fp32.update_ms);
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("precision",
+                               "Compares the single and double precision PGPE optimizers.")
@@ -0,0 +1,49 @@
+#include <abstractions/engine.h>
+#include <abstractions/render/canvas.h>
+
+#include <string>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+constexpr tests::EngineWorkload kWorkload{.num_shapes = 100};
+
+/// @brief Get the mean time per sample render.
+/// @param run completed engine run
+/// @return the render time, in microseconds
+double MeanRenderTime(const tests::EngineRun &run) {
+    const auto &timing = run.result.timing;
+    return 1000 * tests::ToMilliseconds(timing.stages.render_and_compare) / timing.TotalSamples();
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    kWorkload.Print(console);
+    console.Print("image             render AA (us)  aliased (us)  speedup  cost AA  aliased");
+
+    // The final cost always comes from an anti-aliased render, so both runs
+    // are measured against the same standard.
+    const auto seed = prng.seed();
+    for (const std::string name : {"2018.jpg", "monalisa.png", "yonge-dundas.jpg"}) {
+        const Image image = kWorkload.LoadImage(kExamplesPath / name);
+
+        EngineConfig config = kWorkload.Config(seed);
+        config.sample_quality = render::RenderQuality::Antialiased;
+        const auto antialiased = tests::RunEngine(image, config, "antialiased");
+
+        config.sample_quality = render::RenderQuality::Aliased;
+        const auto aliased = tests::RunEngine(image, config, "aliased");
+
+        console.Print("{:<16}  {:>14.1f}  {:>12.1f}  {:>6.2f}x  {:>7.4f}  {:>7.4f}", name,
+                      MeanRenderTime(antialiased), MeanRenderTime(aliased),
+                      MeanRenderTime(antialiased) / MeanRenderTime(aliased),
+                      antialiased.result.cost, aliased.result.cost);
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN(
+    "quality", "Compares the render time and final cost of aliased and anti-aliased samples.")
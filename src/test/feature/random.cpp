@@ -0,0 +1,75 @@
+#include <abstractions/math/matrices.h>
+#include <abstractions/math/random.h>
+#include <abstractions/profile.h>
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+constexpr int kNumSamples = 1 << 20;
+constexpr int kNumRepeats = 20;
+
+/// @brief Measure how many samples per second a particular method generates.
+double MeasureThroughput(const std::function<void(std::vector<double> &)> &generate) {
+    std::vector<double> values(kNumSamples);
+
+    Timer timer;
+    for (int i = 0; i < kNumRepeats; i++) {
+        generate(values);
+    }
+    auto elapsed = std::chrono::duration<double>(timer.GetElapsedTime());
+
+    return static_cast<double>(kNumSamples) * kNumRepeats / elapsed.count();
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    console.Print("Generating {} x {} normally distributed values with each method.", kNumRepeats,
+                  kNumSamples);
+    console.Separator();
+
+    // The original implementation, for reference.
+    auto std_minstd = MeasureThroughput([&](std::vector<double> &values) {
+        std::minstd_rand0 generator(prng.seed());
+        std::normal_distribution<double> dist(0, 1);
+        for (auto &value : values) {
+            value = dist(generator);
+        }
+    });
+
+    auto single = MeasureThroughput([&](std::vector<double> &values) {
+        NormalDistribution dist(Prng(prng.seed()), 0, 1);
+        for (auto &value : values) {
+            value = dist.Sample();
+        }
+    });
+
+    auto batch = MeasureThroughput([&](std::vector<double> &values) {
+        NormalDistribution dist(Prng(prng.seed()), 0, 1);
+        dist.Fill(values);
+    });
+
+    auto matrix = MeasureThroughput([&](std::vector<double> &values) {
+        NormalDistribution dist(Prng(prng.seed()), 0, 1);
+        Eigen::Map<Matrix> mapped(values.data(), 1024, kNumSamples / 1024);
+        RandomMatrix(mapped, dist);
+    });
+
+    console.Print("std::normal_distribution: {:>8.2f} M samples/sec", std_minstd / 1e6);
+    console.Print("Sample():                 {:>8.2f} M samples/sec", single / 1e6);
+    console.Print("Fill():                   {:>8.2f} M samples/sec", batch / 1e6);
+    console.Print("RandomMatrix():           {:>8.2f} M samples/sec", matrix / 1e6);
+    console.Separator();
+    console.Print("Batch speedup: {:.2f}x", batch / std_minstd);
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("random",
+                               "Measures the throughput of the normally distributed PRNGs.")
@@ -0,0 +1,77 @@
+#include <abstractions/errors.h>
+#include <abstractions/image.h>
+#include <abstractions/profile.h>
+#include <abstractions/render/canvas.h>
+#include <abstractions/render/renderer.h>
+#include <abstractions/render/shapes.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "support.h"
+
+using namespace abstractions;
+using namespace abstractions::render;
+
+namespace {
+
+constexpr int kImageSize = 128;
+constexpr int kNumShapes = 50;
+constexpr int kNumRenders = 2000;
+
+/// @brief A shape collection that's being benchmarked.
+struct Workload {
+    std::string name;
+    PackedShapeCollection shapes;
+};
+
+/// @brief Render the same collection repeatedly.
+/// @param renderer renderer being benchmarked
+/// @param shapes shapes to render
+/// @return the number of renders per second
+double MeasureRenderRate(Renderer &renderer, const PackedShapeCollection &shapes) {
+    Timer timer;
+    for (int i = 0; i < kNumRenders; i++) {
+        renderer.Render(shapes);
+    }
+    return kNumRenders / std::chrono::duration<double>(timer.GetElapsedTime()).count();
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    ShapeGenerator generator(kImageSize, kImageSize, prng);
+    std::vector<Workload> workloads{
+        {"circles", PackedShapeCollection(generator.RandomCircles(kNumShapes), {}, {})},
+        {"rectangles", PackedShapeCollection({}, generator.RandomRectangles(kNumShapes), {})},
+        {"triangles", PackedShapeCollection({}, {}, generator.RandomTriangles(kNumShapes))},
+    };
+
+    auto blend2d = Renderer::Create(kImageSize, kImageSize, prng);
+    auto scanline = Renderer::Create(kImageSize, kImageSize, prng);
+    abstractions_check(blend2d);
+    abstractions_check(scanline);
+    scanline->SetBackend(RenderBackend::Scanline);
+
+    console.Print("Rendering {} shapes {} times on a {}x{} canvas.", kNumShapes, kNumRenders,
+                  kImageSize, kImageSize);
+    console.Separator();
+    console.Print("shapes      blend2d (renders/s)  scanline (renders/s)  speedup  mean diff");
+    for (const auto &workload : workloads) {
+        const double blend2d_rate = MeasureRenderRate(*blend2d, workload.shapes);
+        const double scanline_rate = MeasureRenderRate(*scanline, workload.shapes);
+
+        auto diff = CompareImagesAbsDiff(blend2d->DrawingSurface(), scanline->DrawingSurface());
+        abstractions_check(diff);
+
+        console.Print("{:<10}  {:>19.0f}  {:>20.0f}  {:>6.2f}x  {:>9.5f}", workload.name,
+                      blend2d_rate, scanline_rate, scanline_rate / blend2d_rate, *diff);
+
+        blend2d->DrawingSurface().Save(output_folder.FilePath(workload.name + "-blend2d.png"));
+        scanline->DrawingSurface().Save(output_folder.FilePath(workload.name + "-scanline.png"));
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("rasterizer",
+                               "Compares the render rate of the Blend2D and scanline backends.")
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <abstractions/engine.h>
 #include <abstractions/errors.h>
+#include <abstractions/image.h>
 #include <abstractions/math/random.h>
 #include <abstractions/profile.h>
 #include <abstractions/terminal/console.h>
@@ -9,8 +11,16 @@
 #include <fmt/format.h>
 
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <limits>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "test-paths.h"
 
@@ -135,4 +145,141 @@ private:
     CLI::App _app;
 };
 
+/// @brief Convert a duration into fractional milliseconds.
+/// @param duration duration being converted
+/// @return the duration in milliseconds
+template <typename Rep, typename Period>
+double ToMilliseconds(std::chrono::duration<Rep, Period> duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// @brief Print the banner that describes what a benchmark runs.
+/// @param console console the banner is printed to
+/// @param iterations number of optimization iterations
+/// @param samples number of samples per iteration
+/// @param size number of things in each sample
+/// @param what what the samples are made of
+inline void PrintWorkload(const terminal::Console &console, int iterations, int samples, int size,
+                          std::string_view what) {
+    console.Print("Running {} iterations with {} samples of {} {}.", iterations, samples, size,
+                  what);
+    console.Separator();
+}
+
+/// @brief The common workload of the benchmarks that run the whole engine.
+///
+/// The benchmarks start from the config created by Config() and only change
+/// the setting they're comparing.
+struct EngineWorkload {
+    /// @brief Size of the longest side of the reference image.
+    int image_size = 128;
+
+    /// @brief Number of iterations in each run.
+    int iterations = 300;
+
+    /// @brief Number of samples in each iteration.
+    int num_samples = 64;
+
+    /// @brief Number of triangles in the solution.
+    int num_shapes = 50;
+
+    /// @brief Load a reference image and scale it to the workload's size.
+    /// @param path image path
+    /// @return the scaled image
+    Image LoadImage(const std::filesystem::path &path) const {
+        auto image = Image::Load(path);
+        abstractions_check(image);
+        abstractions_check(image->ScaleToFit(image_size));
+        return *image;
+    }
+
+    /// @brief Create the engine configuration for the workload.
+    /// @param seed engine seed
+    /// @return the engine configuration
+    EngineConfig Config(uint32_t seed) const {
+        return EngineConfig{
+            .iterations = iterations,
+            .num_samples = num_samples,
+            .num_drawn_shapes = num_shapes,
+            .seed = seed,
+        };
+    }
+
+    /// @brief Print the banner that describes the workload.
+    /// @param console console the banner is printed to
+    void Print(const terminal::Console &console) const {
+        PrintWorkload(console, iterations, num_samples, num_shapes, "triangles");
+    }
+};
+
+/// @brief A completed engine run and the cost after each of its iterations.
+struct EngineRun {
+    /// @brief Name of the setting that was used for the run.
+    std::string name;
+
+    /// @brief The engine's result.
+    OptimizationResult result;
+
+    /// @brief The estimate cost after each iteration.
+    std::vector<double> costs;
+
+    /// @brief The time, in milliseconds, since the start of the run after
+    ///     each iteration.
+    std::vector<double> elapsed_ms;
+
+    /// @brief Find the first iteration that reached a target cost.
+    /// @param target target cost
+    /// @return the iteration index, or the last iteration if the target was
+    ///     never reached
+    int IterationToTarget(double target) const {
+        auto reached = std::find_if(costs.begin(), costs.end(),
+                                    [target](double cost) { return cost <= target; });
+        return std::min<int>(std::distance(costs.begin(), reached), costs.size() - 1);
+    }
+};
+
+/// @brief Run the engine with the settings used by all of the benchmarks.
+/// @param image image being approximated
+/// @param config engine configuration
+/// @param name name of the setting being compared
+/// @return the engine's result along with its cost trace
+inline EngineRun RunEngine(const Image &image, const EngineConfig &config, std::string name) {
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    abstractions_check(engine);
+
+    std::vector<double> costs;
+    std::vector<double> elapsed_ms;
+    // The callback is given the negated cost, so flip it back to make the
+    // lower costs the better ones.
+    Timer timer;
+    engine->SetCallback([&](int, double cost, ConstRowVectorRef) {
+        costs.push_back(-cost);
+        elapsed_ms.push_back(ToMilliseconds(timer.GetElapsedTime()));
+    });
+
+    auto result = engine->GenerateAbstraction(image);
+    abstractions_check(result);
+
+    return EngineRun{
+        .name = std::move(name),
+        .result = std::move(*result),
+        .costs = std::move(costs),
+        .elapsed_ms = std::move(elapsed_ms),
+    };
+}
+
+/// @brief Find the best cost that every run managed to reach.
+/// @param runs completed engine runs
+/// @return the common target cost
+///
+/// This lets the benchmarks compare how much work each run needed to reach
+/// the same cost.
+inline double CommonTarget(const std::vector<EngineRun> &runs) {
+    double target = std::numeric_limits<double>::lowest();
+    for (const auto &run : runs) {
+        target = std::max(target, *std::min_element(run.costs.begin(), run.costs.end()));
+    }
+    return target;
+}
+
 }  // namespace abstractions::tests
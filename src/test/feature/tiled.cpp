@@ -0,0 +1,53 @@
+#include <abstractions/engine.h>
+
+#include <optional>
+
+#include "support.h"
+
+using namespace abstractions;
+
+namespace {
+
+constexpr tests::EngineWorkload kWorkload{
+    .image_size = 256,
+    .iterations = 20,
+    .num_samples = 16,
+    .num_shapes = 2000,
+};
+
+/// @brief Get the mean render and compare time per iteration.
+/// @param run completed engine run
+/// @return the iteration time, in milliseconds
+///
+/// The stage timing is the wall-clock time, so it includes how well the
+/// renders are spread across the workers.
+double MeanIterationTime(const tests::EngineRun &run) {
+    return tests::ToMilliseconds(run.result.timing.stages.render_and_compare) /
+           run.result.iterations;
+}
+
+}  // namespace
+
+ABSTRACTIONS_FEATURE_TEST() {
+    const Image image = kWorkload.LoadImage(kExamplesPath / "monalisa.png");
+    kWorkload.Print(console);
+    console.Print("tiles      render (ms/iter)  speedup  final cost");
+
+    const auto seed = prng.seed();
+    const auto full = tests::RunEngine(image, kWorkload.Config(seed), "none");
+    console.Print("{:<9}  {:>16.2f}  {:>6.2f}x  {:>10.5f}", full.name, MeanIterationTime(full),
+                  1.0, full.result.cost);
+
+    for (int tile_size : {32, 64, 128}) {
+        EngineConfig config = kWorkload.Config(seed);
+        config.render_tile_size = tile_size;
+        const auto tiled =
+            tests::RunEngine(image, config, fmt::format("{}x{}", tile_size, tile_size));
+        console.Print("{:<9}  {:>16.2f}  {:>6.2f}x  {:>10.5f}", tiled.name,
+                      MeanIterationTime(tiled), MeanIterationTime(full) / MeanIterationTime(tiled),
+                      tiled.result.cost);
+    }
+}
+
+ABSTRACTIONS_FEATURE_TEST_MAIN("tiled",
+                               "Compares the render time of tiled and full sample renders.")
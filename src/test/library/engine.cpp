@@ -1,7 +1,17 @@
 #include <abstractions/engine.h>
+#include <abstractions/image.h>
 #include <abstractions/math/types.h>
 #include <abstractions/render/shapes.h>
 #include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stop_token>
+#include <thread>
+#include <vector>
 
 #include "support.h"
 
@@ -17,6 +27,7 @@ TEST_CASE("Can serialize/deserialize OptimizationResult.") {
         .cost = 123,
         .iterations = 456,
         .aspect_ratio = 2.5,
+        .coordinate_mapping = render::CoordinateMapping::Sigmoid,
         .shapes = render::AbstractionShape::Triangles | render::AbstractionShape::Circles,
         .seed = 789,
         .timing = TimingReport(0, 0),
@@ -30,6 +41,1093 @@ TEST_CASE("Can serialize/deserialize OptimizationResult.") {
     CHECK(result.cost == restored->cost);
     CHECK(result.iterations == restored->iterations);
     CHECK(result.aspect_ratio == restored->aspect_ratio);
+    CHECK(result.coordinate_mapping == restored->coordinate_mapping);
     CHECK(result.shapes == restored->shapes);
     CHECK(result.seed == restored->seed);
 }
+
+TEST_CASE("Engine configuration validates the optimization limits.") {
+    EngineConfig config;
+    REQUIRE_FALSE(config.Validate().has_value());
+
+    SUBCASE("Time limit must be positive.") {
+        config.time_limit = std::chrono::milliseconds(0);
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Target cost cannot be negative.") {
+        config.target_cost = -1.0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Pyramid needs at least one level.") {
+        config.pyramid_levels = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Initial shapes must not exceed the number of drawn shapes.") {
+        config.initial_drawn_shapes = config.num_drawn_shapes + 1;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Callback interval must be positive.") {
+        config.callback_interval = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Callback period must be positive.") {
+        config.callback_period = std::chrono::milliseconds(0);
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Checkpoint interval must be positive.") {
+        config.checkpoint_interval = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Pyramid schedule must be positive.") {
+        config.pyramid_levels = 3;
+        config.pyramid_level_iterations = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Adaptive population must fit within the number of samples.") {
+        config.min_samples = config.num_samples + 2;
+        REQUIRE(config.Validate().has_value());
+
+        config.min_samples = 2;
+        REQUIRE(config.Validate().has_value());
+
+        config.min_samples = 5;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Shape blocks must have at least one shape.") {
+        config.block_shapes = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Render tiles must have at least one pixel.") {
+        config.render_tile_size = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+
+    SUBCASE("Colour refinement must run for at least one iteration.") {
+        config.colour_refinement_iterations = 0;
+        REQUIRE(config.Validate().has_value());
+    }
+}
+
+TEST_CASE("TimingReport can be truncated to the completed iterations.") {
+    TimingReport report(10, 4);
+    REQUIRE(report.NumIterations() == 10);
+    REQUIRE(report.NumSamples() == 4);
+
+    report.Truncate(3);
+    CHECK(report.NumIterations() == 3);
+    CHECK(report.NumSamples() == 4);
+    CHECK(report.iterations.sample.size() == 3);
+    CHECK(report.iterations.callback.size() == 3);
+    CHECK(report.iterations.render_and_compare.size() == 12);
+    CHECK(report.iterations.num_samples.size() == 3);
+    CHECK(report.iterations.culling.size() == 3);
+
+    SUBCASE("The report can be emptied.") {
+        report.Truncate(0);
+        CHECK(report.NumIterations() == 0);
+        CHECK(report.NumSamples() == 0);
+        CHECK(report.iterations.render_and_compare.empty());
+        CHECK(report.TotalSamples() == 0);
+    }
+
+    SUBCASE("The report is never grown.") {
+        report.Truncate(5);
+        CHECK(report.NumIterations() == 3);
+        CHECK(report.NumSamples() == 4);
+    }
+}
+
+TEST_CASE("TimingReport counts the rendered samples.") {
+    TimingReport report(3, 8);
+    CHECK(report.TotalSamples() == 0);
+
+    report.iterations.num_samples = {4, 8, 6};
+    CHECK(report.TotalSamples() == 18);
+    CHECK(report.NumSamples() == 8);
+}
+
+TEST_CASE("Engine stops early when a stop is requested.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    std::stop_source stop_source;
+    EngineConfig config{
+        .iterations = 100,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+        .stop_token = stop_source.get_token(),
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    std::vector<double> costs;
+    std::vector<RowVector> estimates;
+    engine->SetCallback([&](int i, double cost, ConstRowVectorRef solution) {
+        costs.push_back(cost);
+        estimates.push_back(solution);
+        if (i == 2) {
+            stop_source.request_stop();
+        }
+    });
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(result->stop_reason == StopReason::Cancelled);
+    CHECK(result->iterations == 3);
+    CHECK(result->timing.NumIterations() == 3);
+    REQUIRE(costs.size() >= 3);
+
+    // A cancelled run returns the best estimate too, and its cost is the one
+    // that was given to the callback.
+    const auto best = std::max_element(costs.begin(), costs.begin() + 3) - costs.begin();
+    CHECK(result->solution == estimates[best]);
+    CHECK(result->cost == doctest::Approx(-costs[best]));
+    CHECK(estimates.back() == result->solution);
+}
+
+TEST_CASE("Engine measures the target cost like the returned cost.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 20,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+        .pyramid_levels = 2,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    std::vector<double> costs;
+    engine->SetCallback([&](int, double cost, ConstRowVectorRef) { costs.push_back(cost); });
+
+    auto reference = engine->GenerateAbstraction(*image);
+    REQUIRE(reference.has_value());
+    REQUIRE(costs.size() >= 10);
+
+    // Target the cost reached part way through the run.  The engine must stop
+    // with a result that actually meets the target.
+    const double target = -*std::max_element(costs.begin(), costs.begin() + 10);
+    config.target_cost = target;
+    engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(result->stop_reason == StopReason::TargetCost);
+    CHECK(result->iterations <= 10);
+    CHECK(result->cost <= target);
+}
+
+TEST_CASE("Engine returns the best estimate when the time limit is reached.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 100,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+        .time_limit = std::chrono::milliseconds(500),
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    // The estimate is rendered every iteration, so the callback is given the
+    // exact (negated) cost of every estimate.  The run is stalled until it
+    // runs out of time.
+    std::vector<double> costs;
+    std::vector<RowVector> estimates;
+    engine->SetCallback([&](int i, double cost, ConstRowVectorRef solution) {
+        costs.push_back(cost);
+        estimates.push_back(solution);
+        if (i == 5) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        }
+    });
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(result->stop_reason == StopReason::TimeLimit);
+    REQUIRE(result->iterations == 6);
+    REQUIRE(costs.size() >= 6);
+
+    const auto best = std::max_element(costs.begin(), costs.begin() + 6) - costs.begin();
+    CHECK(result->solution == estimates[best]);
+    CHECK(result->cost == doctest::Approx(-costs[best]));
+    CHECK(estimates.back() == result->solution);
+}
+
+TEST_CASE("Engine results don't depend on the number of workers.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 4,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 1,
+        .seed = 1,
+    };
+
+    auto single = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(single.has_value());
+
+    config.num_workers = 3;
+    auto multiple = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(multiple.has_value());
+
+    auto expected = single->GenerateAbstraction(*image);
+    auto actual = multiple->GenerateAbstraction(*image);
+    REQUIRE(expected.has_value());
+    REQUIRE(actual.has_value());
+
+    CHECK(actual->solution == expected->solution);
+    CHECK(actual->cost == expected->cost);
+}
+
+TEST_CASE("Engine single-precision mode matches double-precision.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 10,
+        .num_samples = 8,
+        .num_drawn_shapes = 5,
+        .seed = 1,
+    };
+
+    auto fp64 = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(fp64.has_value());
+
+    config.single_precision = true;
+    auto fp32 = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(fp32.has_value());
+
+    auto expected = fp64->GenerateAbstraction(*image);
+    auto actual = fp32->GenerateAbstraction(*image);
+    REQUIRE(expected.has_value());
+    REQUIRE(actual.has_value());
+
+    CHECK(actual->solution.size() == expected->solution.size());
+    CHECK(actual->cost == doctest::Approx(expected->cost).epsilon(0.05));
+}
+
+TEST_CASE("Engine callback can be throttled.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 8,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+        .callback_interval = 3,
+    };
+
+    std::vector<int> callback_iterations;
+    std::vector<double> callback_costs;
+    auto callback = [&](int i, double cost, ConstRowVectorRef) {
+        callback_iterations.push_back(i);
+        callback_costs.push_back(cost);
+    };
+
+    SUBCASE("Callback runs every N iterations and on the last one.") {
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+        engine->SetCallback(callback);
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        CHECK(callback_iterations == std::vector<int>{0, 3, 6, 7});
+    }
+
+    SUBCASE("Callback can skip rendering the exact cost.") {
+        config.callback_interval = 1;
+        config.callback_exact_cost = false;
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+        engine->SetCallback(callback);
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        REQUIRE(callback_iterations.size() == 8);
+
+        // The reported cost is the best sample cost, which is negated.
+        for (auto cost : callback_costs) {
+            CHECK(cost < 0);
+        }
+    }
+
+    SUBCASE("The final iteration gets a callback when the engine stops early.") {
+        config.iterations = 100000;
+        config.time_limit = std::chrono::milliseconds(200);
+        config.callback_period = std::chrono::hours(1);
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        RowVector callback_solution;
+        engine->SetCallback([&](int i, double cost, ConstRowVectorRef solution) {
+            callback(i, cost, solution);
+            callback_solution = solution;
+        });
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        REQUIRE(result->stop_reason == StopReason::TimeLimit);
+        CHECK(callback_iterations == std::vector<int>{result->iterations - 1});
+        CHECK(callback_costs.front() == doctest::Approx(-result->cost));
+        CHECK(callback_solution == result->solution);
+    }
+}
+
+TEST_CASE("Engine can run a coarse-to-fine optimization schedule.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(128).has_value());
+
+    EngineConfig config{
+        .iterations = 6,
+        .num_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+        .pyramid_levels = 3,
+        .pyramid_level_iterations = 2,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(result->iterations == 6);
+    CHECK(result->stop_reason == StopReason::Completed);
+    CHECK(result->solution.size() == 5 * render::TriangleCollection::TotalDimensions);
+
+    // The run starts on the coarsest level and moves up a level every two
+    // iterations, halving the reference size each time.
+    const auto &timing = result->timing.iterations;
+    CHECK(timing.pyramid_level == std::vector<int>{2, 2, 1, 1, 0, 0});
+    for (int i = 0; i < result->iterations; i++) {
+        const int scale = 1 << timing.pyramid_level[i];
+        CHECK(timing.reference_width[i] == image->Width() / scale);
+        CHECK(timing.reference_height[i] == image->Height() / scale);
+    }
+}
+
+TEST_CASE("Engine can grow the solution with a shape curriculum.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 7,
+        .num_samples = 4,
+        .shapes = render::AbstractionShape::Circles | render::AbstractionShape::Triangles,
+        .num_drawn_shapes = 8,
+        .num_workers = 2,
+        .seed = 1,
+        .initial_drawn_shapes = 2,
+        .shape_growth_interval = 2,
+        .shape_growth_count = 3,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    std::vector<int> solution_sizes;
+    engine->SetCallback([&](int, double, ConstRowVectorRef solution) {
+        solution_sizes.push_back(solution.size());
+    });
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+
+    // Shapes are added at iterations 2 and 4 and then capped at 8 on iteration
+    // 6.
+    constexpr int kShapeSize =
+        render::CircleCollection::TotalDimensions + render::TriangleCollection::TotalDimensions;
+    const std::vector<int> expected{
+        2 * kShapeSize, 2 * kShapeSize, 5 * kShapeSize, 5 * kShapeSize,
+        8 * kShapeSize, 8 * kShapeSize, 8 * kShapeSize,
+    };
+
+    CHECK(solution_sizes == expected);
+    CHECK(result->solution.size() == 8 * kShapeSize);
+
+    render::PackedShapeCollection collection(config.shapes, result->solution);
+    CHECK(collection.CollectionSize() == 8);
+}
+
+TEST_CASE("Engine returns a grown solution when it stops early.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    std::stop_source stop_source;
+    EngineConfig config{
+        .iterations = 10,
+        .num_samples = 4,
+        .num_drawn_shapes = 6,
+        .num_workers = 2,
+        .seed = 1,
+        .stop_token = stop_source.get_token(),
+        .initial_drawn_shapes = 2,
+        .shape_growth_interval = 2,
+        .shape_growth_count = 4,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    engine->SetCallback([&](int i, double, ConstRowVectorRef) {
+        if (i == 3) {
+            stop_source.request_stop();
+        }
+    });
+
+    // The estimates from before the growth have fewer shapes, so they can't
+    // be returned even if they had a lower cost.
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(result->stop_reason == StopReason::Cancelled);
+    CHECK(result->iterations == 4);
+    CHECK(result->solution.size() == 6 * render::TriangleCollection::TotalDimensions);
+}
+
+TEST_CASE("Can serialize/deserialize EngineCheckpoint.") {
+    tests::TempFolder temp_folder;
+
+    EngineCheckpoint checkpoint{
+        .iteration = 12,
+        .seed = 34,
+        .shapes = render::AbstractionShape::Rectangles,
+        .coordinate_mapping = render::CoordinateMapping::Sigmoid,
+        .num_samples = 2,
+        .num_active_shapes = 1,
+        .num_active_samples = 2,
+        .population_snr = 1.5,
+        .optimizer =
+            OptimizerState{
+                .type = OptimizerType::Pgpe,
+                .state = RowVector::LinSpaced(8, 1, 8),
+                .standard_deviation = RowVector::Constant(8, 0.25),
+                .vectors = {{"velocity", RowVector::LinSpaced(8, -1, 1)}},
+                .seed = 34,
+                .population = 11,
+            },
+        .pyramid_level = 1,
+        .level_start = 10,
+        .level_stall_count = 2,
+        .level_best_cost = std::numeric_limits<double>::infinity(),
+        .refining_colours = true,
+    };
+
+    REQUIRE_FALSE(checkpoint.Save(temp_folder.Path() / "checkpoint.json").has_value());
+    auto restored = EngineCheckpoint::Load(temp_folder.Path() / "checkpoint.json");
+
+    REQUIRE(restored.has_value());
+    CHECK(restored->iteration == checkpoint.iteration);
+    CHECK(restored->seed == checkpoint.seed);
+    CHECK(restored->shapes == checkpoint.shapes);
+    CHECK(restored->coordinate_mapping == checkpoint.coordinate_mapping);
+    CHECK(restored->num_samples == checkpoint.num_samples);
+    CHECK(restored->num_active_shapes == checkpoint.num_active_shapes);
+    CHECK(restored->num_active_samples == checkpoint.num_active_samples);
+    CHECK(restored->population_snr == checkpoint.population_snr);
+    CHECK(restored->optimizer.state == checkpoint.optimizer.state);
+    CHECK(restored->optimizer.standard_deviation == checkpoint.optimizer.standard_deviation);
+    CHECK(restored->optimizer.type == checkpoint.optimizer.type);
+    CHECK(restored->optimizer.vectors == checkpoint.optimizer.vectors);
+    CHECK(restored->optimizer.seed == checkpoint.optimizer.seed);
+    CHECK(restored->optimizer.population == checkpoint.optimizer.population);
+    CHECK(restored->pyramid_level == checkpoint.pyramid_level);
+    CHECK(restored->level_start == checkpoint.level_start);
+    CHECK(restored->level_stall_count == checkpoint.level_stall_count);
+    CHECK(std::isinf(restored->level_best_cost));
+    CHECK(restored->refining_colours == checkpoint.refining_colours);
+}
+
+TEST_CASE("Engine can resume an interrupted optimization from a checkpoint.") {
+    tests::TempFolder temp_folder;
+
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 8,
+        .num_samples = 4,
+        .num_drawn_shapes = 6,
+        .num_workers = 2,
+        .seed = 1,
+        .pyramid_levels = 2,
+        .pyramid_level_iterations = 3,
+        .initial_drawn_shapes = 2,
+        .shape_growth_interval = 2,
+        .shape_growth_count = 2,
+    };
+
+    // The reference is a single, uninterrupted run.
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    auto expected = engine->GenerateAbstraction(*image);
+    REQUIRE(expected.has_value());
+
+    // Stop the same optimization part way through and then resume it.
+    std::stop_source stop_source;
+    auto interrupted_config = config;
+    interrupted_config.stop_token = stop_source.get_token();
+    interrupted_config.checkpoint_file = temp_folder.Path() / "checkpoint.json";
+    interrupted_config.checkpoint_interval = 2;
+
+    auto interrupted = Engine::Create(interrupted_config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(interrupted.has_value());
+    interrupted->SetCallback([&](int i, double, ConstRowVectorRef) {
+        if (i == 4) {
+            stop_source.request_stop();
+        }
+    });
+
+    auto partial = interrupted->GenerateAbstraction(*image);
+    REQUIRE(partial.has_value());
+    REQUIRE(partial->stop_reason == StopReason::Cancelled);
+
+    auto checkpoint = EngineCheckpoint::Load(*interrupted_config.checkpoint_file);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->iteration == 5);
+
+    auto resumed = engine->ResumeAbstraction(*image, *checkpoint);
+    REQUIRE(resumed.has_value());
+    CHECK(resumed->iterations == expected->iterations);
+    CHECK(resumed->stop_reason == StopReason::Completed);
+    CHECK(resumed->seed == expected->seed);
+    CHECK(resumed->solution == expected->solution);
+    CHECK(resumed->cost == expected->cost);
+
+    SUBCASE("Checkpoint must match the engine configuration.") {
+        auto other_config = config;
+        other_config.num_samples = 8;
+
+        auto other = Engine::Create(other_config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(other.has_value());
+        CHECK_FALSE(other->ResumeAbstraction(*image, *checkpoint).has_value());
+    }
+
+    SUBCASE("Checkpoint must match the engine's coordinate mapping.") {
+        auto other_config = config;
+        other_config.coordinate_mapping = render::CoordinateMapping::Clamped;
+
+        auto other = Engine::Create(other_config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(other.has_value());
+        CHECK(checkpoint->coordinate_mapping == config.coordinate_mapping);
+        CHECK_FALSE(other->ResumeAbstraction(*image, *checkpoint).has_value());
+    }
+
+    SUBCASE("Checkpoint must match the engine's optimizer.") {
+        auto other_config = config;
+        other_config.optimizer = OptimizerType::Snes;
+
+        auto other = Engine::Create(other_config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(other.has_value());
+        CHECK_FALSE(other->ResumeAbstraction(*image, *checkpoint).has_value());
+    }
+
+    SUBCASE("Checkpoint can't be resumed when samples are reused.") {
+        auto other = Engine::Create(
+            config, PgpeOptimizerSettings{.max_speed = 0.15, .min_refresh_rate = 0.5});
+        REQUIRE(other.has_value());
+        CHECK_FALSE(other->ResumeAbstraction(*image, *checkpoint).has_value());
+    }
+}
+
+TEST_CASE("Engine can use any of the optimizers.") {
+    tests::TempFolder temp_folder;
+
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        EngineConfig config{
+            .iterations = 6,
+            .num_samples = 8,
+            .num_drawn_shapes = 5,
+            .optimizer = type,
+            .num_workers = 2,
+            .seed = 1,
+        };
+
+        // The PGPE settings are ignored, so they don't need to be valid.
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0});
+        REQUIRE(engine.has_value());
+
+        auto expected = engine->GenerateAbstraction(*image);
+        REQUIRE(expected.has_value());
+        CHECK(expected->iterations == 6);
+        CHECK(std::isfinite(expected->cost));
+
+        // The optimizer's state is checkpointed and restored like PGPE's.
+        std::stop_source stop_source;
+        auto interrupted_config = config;
+        interrupted_config.stop_token = stop_source.get_token();
+        interrupted_config.checkpoint_file = temp_folder.Path() / "checkpoint.json";
+        interrupted_config.checkpoint_interval = 1;
+
+        auto interrupted =
+            Engine::Create(interrupted_config, PgpeOptimizerSettings{.max_speed = 0});
+        REQUIRE(interrupted.has_value());
+        interrupted->SetCallback([&](int i, double, ConstRowVectorRef) {
+            if (i == 2) {
+                stop_source.request_stop();
+            }
+        });
+
+        REQUIRE(interrupted->GenerateAbstraction(*image).has_value());
+
+        auto checkpoint = EngineCheckpoint::Load(*interrupted_config.checkpoint_file);
+        REQUIRE(checkpoint.has_value());
+        CHECK(checkpoint->optimizer.type == type);
+
+        auto resumed = engine->ResumeAbstraction(*image, *checkpoint);
+        REQUIRE(resumed.has_value());
+        CHECK(resumed->solution == expected->solution);
+        CHECK(resumed->cost == expected->cost);
+    }
+}
+
+TEST_CASE("Engine can adapt the population size.") {
+    tests::TempFolder temp_folder;
+
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 12,
+        .num_samples = 16,
+        .min_samples = 4,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    auto expected = engine->GenerateAbstraction(*image);
+    REQUIRE(expected.has_value());
+
+    // The population always starts at the minimum and stays within the limits.
+    const auto &num_samples = expected->timing.iterations.num_samples;
+    REQUIRE(num_samples.size() == 12);
+    CHECK(num_samples[0] == 4);
+    for (int samples : num_samples) {
+        CHECK(samples >= 4);
+        CHECK(samples <= 16);
+        CHECK(samples % 2 == 0);
+    }
+
+    // Four samples give a very noisy gradient for the 50 parameters, so the
+    // population has to grow away from the minimum.
+    const auto first_change =
+        std::find_if(num_samples.begin(), num_samples.end(), [](int n) { return n != 4; });
+    REQUIRE(first_change != num_samples.end());
+    CHECK(*first_change == 8);
+    CHECK(expected->timing.TotalSamples() > 12 * 4);
+
+    SUBCASE("Adaptive population is restored from a checkpoint.") {
+        std::stop_source stop_source;
+        auto interrupted_config = config;
+        interrupted_config.stop_token = stop_source.get_token();
+        interrupted_config.checkpoint_file = temp_folder.Path() / "checkpoint.json";
+        interrupted_config.checkpoint_interval = 1;
+
+        auto interrupted =
+            Engine::Create(interrupted_config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(interrupted.has_value());
+        interrupted->SetCallback([&](int i, double, ConstRowVectorRef) {
+            if (i == 6) {
+                stop_source.request_stop();
+            }
+        });
+        REQUIRE(interrupted->GenerateAbstraction(*image).has_value());
+
+        auto checkpoint = EngineCheckpoint::Load(*interrupted_config.checkpoint_file);
+        REQUIRE(checkpoint.has_value());
+        CHECK(checkpoint->num_active_samples == num_samples[checkpoint->iteration]);
+
+        auto resumed = engine->ResumeAbstraction(*image, *checkpoint);
+        REQUIRE(resumed.has_value());
+        CHECK(resumed->solution == expected->solution);
+        CHECK(resumed->cost == expected->cost);
+    }
+}
+
+TEST_CASE("Engine can reuse samples from the previous population.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 12,
+        .num_samples = 16,
+        .num_drawn_shapes = 5,
+        .num_workers = 2,
+        .seed = 1,
+    };
+
+    // A slow moving distribution leaves most of the previous samples likely
+    // under the new one.
+    PgpeOptimizerSettings settings{
+        .max_speed = 0.01,
+        .stddev_learning_rate = 0,
+        .min_refresh_rate = 0.25,
+    };
+
+    auto engine = Engine::Create(config, settings);
+    REQUIRE(engine.has_value());
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+
+    const auto &num_samples = result->timing.iterations.num_samples;
+    REQUIRE(num_samples.size() == 12);
+    CHECK(num_samples[0] == 16);
+    for (int samples : num_samples) {
+        CHECK(samples <= 16);
+        CHECK(samples % 2 == 0);
+    }
+    CHECK(result->timing.TotalSamples() < 12 * 16);
+
+    SUBCASE("Nothing is reused when every sample must be fresh.") {
+        settings.min_refresh_rate = 1;
+        auto fresh = Engine::Create(config, settings);
+        REQUIRE(fresh.has_value());
+
+        settings.min_refresh_rate = {};
+        auto baseline = Engine::Create(config, settings);
+        REQUIRE(baseline.has_value());
+
+        auto fresh_result = fresh->GenerateAbstraction(*image);
+        auto baseline_result = baseline->GenerateAbstraction(*image);
+        REQUIRE(fresh_result.has_value());
+        REQUIRE(baseline_result.has_value());
+
+        CHECK(fresh_result->timing.TotalSamples() == 12 * 16);
+        CHECK(fresh_result->solution == baseline_result->solution);
+    }
+}
+
+TEST_CASE("Engine can perturb a block of shapes in each iteration.") {
+    constexpr int kNumShapes = 6;
+    constexpr int kBlockShapes = 2;
+    constexpr int kShapeDims = render::TriangleCollection::TotalDimensions;
+
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    for (auto selection :
+         {BlockSelection::RoundRobin, BlockSelection::Random, BlockSelection::ErrorGuided}) {
+        INFO(fmt::format("Selection: {}", selection));
+
+        EngineConfig config{
+            .iterations = 6,
+            .num_samples = 8,
+            .num_drawn_shapes = kNumShapes,
+            .num_workers = 1,
+            .seed = 1,
+            .block_shapes = kBlockShapes,
+            .block_selection = selection,
+        };
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        // Only the shapes in the block can change between iterations.
+        std::vector<RowVector> estimates;
+        engine->SetCallback([&](int, double, ConstRowVectorRef solution) {
+            estimates.push_back(solution);
+        });
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        REQUIRE(estimates.size() == 6);
+
+        for (int i = 1; i < static_cast<int>(estimates.size()); i++) {
+            int num_changed = 0;
+            for (int k = 0; k < kNumShapes; k++) {
+                const auto before = estimates[i - 1].segment(k * kShapeDims, kShapeDims);
+                const auto after = estimates[i].segment(k * kShapeDims, kShapeDims);
+                num_changed += before != after ? 1 : 0;
+            }
+            CHECK(num_changed <= kBlockShapes);
+        }
+
+        // The blocks are split between the workers without changing the result.
+        config.num_workers = 3;
+        auto parallel = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(parallel.has_value());
+
+        auto parallel_result = parallel->GenerateAbstraction(*image);
+        REQUIRE(parallel_result.has_value());
+        CHECK(parallel_result->solution == result->solution);
+    }
+
+    SUBCASE("Blocks are only supported by PGPE without sample reuse.") {
+        EngineConfig config{.optimizer = OptimizerType::Snes, .block_shapes = 2};
+        CHECK_FALSE(Engine::Create(config).has_value());
+
+        config.optimizer = OptimizerType::Pgpe;
+        const PgpeOptimizerSettings reuse{.max_speed = 0.15, .min_refresh_rate = 0.5};
+        CHECK_FALSE(Engine::Create(config, reuse).has_value());
+    }
+}
+
+TEST_CASE("Engine can render the samples in tiles.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    EngineConfig config{
+        .iterations = 5,
+        .num_samples = 8,
+        .num_drawn_shapes = 20,
+        .render_tile_size = 24,
+        .num_workers = 1,
+        .seed = 1,
+    };
+
+    auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(engine.has_value());
+
+    auto result = engine->GenerateAbstraction(*image);
+    REQUIRE(result.has_value());
+    CHECK(std::isfinite(result->cost));
+    CHECK(result->timing.iterations.culling.front().submitted > 0);
+
+    // The tile costs are always added up in the same order, so the result
+    // doesn't depend on which worker rendered each tile.
+    config.num_workers = 3;
+    auto parallel = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+    REQUIRE(parallel.has_value());
+
+    auto parallel_result = parallel->GenerateAbstraction(*image);
+    REQUIRE(parallel_result.has_value());
+    CHECK(parallel_result->solution == result->solution);
+}
+
+TEST_CASE("Engine can map every shape independently.") {
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    for (auto mapping : {render::CoordinateMapping::Clamped, render::CoordinateMapping::Sigmoid}) {
+        INFO(fmt::format("Mapping: {}", mapping));
+
+        EngineConfig config{
+            .iterations = 5,
+            .num_samples = 8,
+            .coordinate_mapping = mapping,
+            .num_drawn_shapes = 10,
+            .num_workers = 1,
+            .seed = 1,
+        };
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        CHECK(result->coordinate_mapping == mapping);
+
+        // The result can be rendered again with the same mapping.
+        auto rendered = RenderImageAbstraction(image->Width(), image->Height(), result->shapes,
+                                               result->solution, result->alpha_scaling,
+                                               Pixel(0, 0, 0, 255), 0, result->coordinate_mapping);
+        REQUIRE(rendered.has_value());
+        CHECK(*CompareImagesSquaredDiff(*image, *rendered) == doctest::Approx(result->cost));
+    }
+}
+
+TEST_CASE("Engine can refine the colours with cached coverage masks.") {
+    constexpr int kNumShapes = 6;
+    constexpr int kShapeDims = render::TriangleCollection::TotalDimensions;
+    constexpr int kGeometryDims = kShapeDims - 4;
+
+    auto image = Image::Load(kSamplesPath / "triangles.png");
+    REQUIRE(image.has_value());
+    REQUIRE_FALSE(image->ScaleToFit(64).has_value());
+
+    // Only the colours can change once the refinement has started.
+    auto check_refinement = [&](const std::vector<RowVector> &estimates, int first) {
+        bool colours_changed = false;
+        for (int i = first + 1; i < static_cast<int>(estimates.size()); i++) {
+            for (int k = 0; k < kNumShapes; k++) {
+                const int offset = k * kShapeDims;
+                CHECK(estimates[i].segment(offset, kGeometryDims) ==
+                      estimates[first].segment(offset, kGeometryDims));
+                colours_changed |= estimates[i].segment(offset + kGeometryDims, 4) !=
+                                   estimates[first].segment(offset + kGeometryDims, 4);
+            }
+        }
+        CHECK(colours_changed);
+    };
+
+    SUBCASE("The refinement runs at the end of the schedule.") {
+        EngineConfig config{
+            .iterations = 6,
+            .num_samples = 8,
+            .num_drawn_shapes = kNumShapes,
+            .num_workers = 2,
+            .seed = 1,
+            .colour_refinement_iterations = 3,
+        };
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        std::vector<RowVector> estimates;
+        engine->SetCallback([&](int, double, ConstRowVectorRef solution) {
+            estimates.push_back(solution);
+        });
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        REQUIRE(estimates.size() == 6);
+        CHECK(std::isfinite(result->cost));
+        check_refinement(estimates, 2);
+
+        // The composited samples aren't rasterized.
+        CHECK(result->timing.iterations.culling[2].submitted > 0);
+        CHECK(result->timing.iterations.culling[3].submitted == 0);
+    }
+
+    SUBCASE("The refinement can be requested by the caller.") {
+        ColourRefinementRequest refinement;
+        EngineConfig config{
+            .iterations = 6,
+            .num_samples = 8,
+            .num_drawn_shapes = kNumShapes,
+            .num_workers = 1,
+            .seed = 1,
+            .colour_refinement_request = refinement,
+        };
+
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        std::vector<RowVector> estimates;
+        engine->SetCallback([&](int i, double, ConstRowVectorRef solution) {
+            estimates.push_back(solution);
+            if (i == 1) {
+                refinement.Request();
+            }
+        });
+
+        auto result = engine->GenerateAbstraction(*image);
+        REQUIRE(result.has_value());
+        REQUIRE(estimates.size() == 6);
+        check_refinement(estimates, 1);
+    }
+
+    SUBCASE("The refinement resumes from a checkpoint.") {
+        tests::TempFolder temp_folder;
+        std::stop_source stop_source;
+        EngineConfig config{
+            .iterations = 6,
+            .num_samples = 8,
+            .num_drawn_shapes = kNumShapes,
+            .num_workers = 1,
+            .seed = 1,
+            .stop_token = stop_source.get_token(),
+            .colour_refinement_iterations = 4,
+            .checkpoint_file = temp_folder.Path() / "checkpoint.json",
+        };
+
+        auto interrupted = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(interrupted.has_value());
+        interrupted->SetCallback([&](int i, double, ConstRowVectorRef) {
+            if (i == 3) {
+                stop_source.request_stop();
+            }
+        });
+
+        auto partial = interrupted->GenerateAbstraction(*image);
+        REQUIRE(partial.has_value());
+        REQUIRE(partial->stop_reason == StopReason::Cancelled);
+
+        auto checkpoint = EngineCheckpoint::Load(*config.checkpoint_file);
+        REQUIRE(checkpoint.has_value());
+        CHECK(checkpoint->refining_colours);
+
+        // The phase carries over even though the resumed engine doesn't
+        // schedule it.
+        config.stop_token = {};
+        config.colour_refinement_iterations.reset();
+        config.checkpoint_file.reset();
+        auto engine = Engine::Create(config, PgpeOptimizerSettings{.max_speed = 0.15});
+        REQUIRE(engine.has_value());
+
+        std::vector<RowVector> estimates;
+        engine->SetCallback([&](int, double, ConstRowVectorRef solution) {
+            estimates.push_back(solution);
+        });
+
+        auto resumed = engine->ResumeAbstraction(*image, *checkpoint);
+        REQUIRE(resumed.has_value());
+        REQUIRE(estimates.size() == 2);
+        check_refinement(estimates, 0);
+    }
+
+    SUBCASE("The refinement is only supported by PGPE without sample reuse.") {
+        const PgpeOptimizerSettings reuse{.max_speed = 0.15, .min_refresh_rate = 0.5};
+
+        EngineConfig config{.optimizer = OptimizerType::Snes, .colour_refinement_iterations = 2};
+        CHECK_FALSE(Engine::Create(config).has_value());
+
+        config.optimizer = OptimizerType::Pgpe;
+        CHECK_FALSE(Engine::Create(config, reuse).has_value());
+
+        EngineConfig requested{
+            .optimizer = OptimizerType::Snes,
+            .colour_refinement_request = ColourRefinementRequest(),
+        };
+        CHECK_FALSE(Engine::Create(requested).has_value());
+
+        requested.optimizer = OptimizerType::Pgpe;
+        CHECK_FALSE(Engine::Create(requested, reuse).has_value());
+    }
+}
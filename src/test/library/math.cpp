@@ -4,6 +4,8 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 
+#include <cmath>
+#include <sstream>
 #include <vector>
 
 TEST_SUITE_BEGIN("math");
@@ -111,12 +113,12 @@ TEST_CASE("A configured PRNG can be used with a Distribution<> object.") {
     abstractions::Prng prng(1);
     abstractions::Distribution abs_dist(prng, normal_dist);
 
-    // Distribution mean is 1.0, so sampling 100x should be ~1.0
+    // Distribution mean is 1.0, so sampling 10000x should be ~1.0
     double sum = 0.0;
-    for (int i = 0; i < 100; i++) {
+    for (int i = 0; i < 10000; i++) {
         sum += abs_dist.Sample();
     }
-    sum /= 100;
+    sum /= 10000;
 
     CHECK(sum == doctest::Approx(1.0).epsilon(0.01));
 }
@@ -129,6 +131,22 @@ TEST_CASE("Distribution object can return the Prng<> seed.") {
     REQUIRE(abs_dist.Seed() == 123);
 }
 
+TEST_CASE("Distribution state can be saved and restored.") {
+    abstractions::NormalDistribution first(abstractions::Prng(1), 0.0, 1.0);
+    for (int i = 0; i < 5; i++) {
+        first.Sample();
+    }
+
+    abstractions::NormalDistribution second(abstractions::Prng(2), 0.0, 1.0);
+    REQUIRE(second.SetState(first.GetState()));
+
+    for (int i = 0; i < 10; i++) {
+        REQUIRE(first.Sample() == second.Sample());
+    }
+
+    REQUIRE_FALSE(second.SetState("invalid"));
+}
+
 TEST_CASE("Can create a matrix of normally distributed random values.") {
     abstractions::Prng prng(1);
     abstractions::NormalDistribution normal_dist(prng, 2.5, 1.0);
@@ -155,6 +173,123 @@ TEST_CASE("Can create a matrix of normally distributed random values.") {
     }
 }
 
+TEST_CASE("xoshiro256++ matches the reference implementation.") {
+    // The reference output for a state of {1, 2, 3, 4}.
+    abstractions::Xoshiro256pp generator;
+    std::istringstream("1 2 3 4") >> generator;
+    REQUIRE(generator() == 41943041);
+
+    // Saving and restoring the state continues the same sequence.
+    std::stringstream state;
+    state << generator;
+
+    abstractions::Xoshiro256pp restored(123);
+    state >> restored;
+    REQUIRE(restored == generator);
+    REQUIRE(restored() == generator());
+}
+
+TEST_CASE("Philox4x32 matches the reference implementation.") {
+    using abstractions::Philox4x32;
+
+    // Known-answer vectors from the Random123 library.
+    CHECK(Philox4x32::Generate({0, 0, 0, 0}, {0, 0}) ==
+          Philox4x32::Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    CHECK(Philox4x32::Generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                               {0xffffffff, 0xffffffff}) ==
+          Philox4x32::Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+    CHECK(Philox4x32::Generate({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                               {0xa4093822, 0x299f31d0}) ==
+          Philox4x32::Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+}
+
+TEST_CASE("Philox4x32 can skip ahead in constant time.") {
+    using abstractions::Philox4x32;
+
+    Philox4x32 stepped(42, 3, 7, 1);
+    for (int i = 0; i < 1001; i++) {
+        stepped();
+    }
+
+    Philox4x32 skipped(42, 3, 7, 1);
+    skipped.discard(1001);
+    REQUIRE(skipped == stepped);
+    REQUIRE(skipped() == stepped());
+
+    // Seeking backwards regenerates the same values.
+    Philox4x32 generator(42, 3, 7, 1);
+    std::vector<uint64_t> expected;
+    for (int i = 0; i < 5; i++) {
+        expected.push_back(generator());
+    }
+
+    generator.Seek(1);
+    for (int i = 1; i < 5; i++) {
+        CHECK(generator() == expected[i]);
+    }
+
+    // Every part of the key selects a different stream.
+    const uint64_t first = Philox4x32(42, 3, 7, 1)();
+    CHECK(Philox4x32(43, 3, 7, 1)() != first);
+    CHECK(Philox4x32(42, 4, 7, 1)() != first);
+    CHECK(Philox4x32(42, 3, 8, 1)() != first);
+    CHECK(Philox4x32(42, 3, 7, 2)() != first);
+
+    // Saving and restoring the state continues the same sequence.
+    std::stringstream state;
+    state << generator;
+
+    Philox4x32 restored;
+    state >> restored;
+    REQUIRE(restored == generator);
+    REQUIRE(restored() == generator());
+}
+
+TEST_CASE("Batch normal samples have the expected statistics.") {
+    constexpr int kNumSamples = 100001;
+
+    abstractions::NormalDistribution normal_dist(abstractions::Prng(1), 2.5, 2.0);
+    std::vector<double> values(kNumSamples);
+    normal_dist.Fill(values);
+
+    Eigen::Map<Eigen::ArrayXd> samples(values.data(), kNumSamples);
+    const double mean = samples.mean();
+    const double variance = (samples - mean).square().mean();
+    const double skew = ((samples - mean) / std::sqrt(variance)).cube().mean();
+    const double kurtosis = ((samples - mean) / std::sqrt(variance)).pow(4).mean();
+
+    CHECK(mean == doctest::Approx(2.5).epsilon(0.01));
+    CHECK(variance == doctest::Approx(4.0).epsilon(0.01));
+    CHECK(std::abs(skew) < 0.05);
+    CHECK(kurtosis == doctest::Approx(3.0).epsilon(0.02));
+
+    // Roughly 68% of the samples should be within one standard deviation.
+    const double within_one = ((samples - 2.5).abs() < 2.0).cast<double>().mean();
+    CHECK(within_one == doctest::Approx(0.6827).epsilon(0.01));
+
+    SUBCASE("Batch and single samples come from the same distribution.") {
+        double sum = 0;
+        for (int i = 0; i < kNumSamples; i++) {
+            sum += normal_dist.Sample();
+        }
+        CHECK(sum / kNumSamples == doctest::Approx(2.5).epsilon(0.01));
+    }
+}
+
+TEST_CASE("Batch uniform samples are on [0, 1).") {
+    constexpr int kNumSamples = 100000;
+
+    abstractions::UniformDistribution uniform_dist(abstractions::Prng(1));
+    std::vector<double> values(kNumSamples);
+    uniform_dist.Fill(values);
+
+    Eigen::Map<Eigen::ArrayXd> samples(values.data(), kNumSamples);
+    CHECK(samples.minCoeff() >= 0.0);
+    CHECK(samples.maxCoeff() < 1.0);
+    CHECK(samples.mean() == doctest::Approx(0.5).epsilon(0.01));
+    CHECK((samples - 0.5).square().mean() == doctest::Approx(1.0 / 12.0).epsilon(0.01));
+}
+
 TEST_CASE("Can create a matrix of uniformally distributed random values.") {
     abstractions::Prng prng(1);
     abstractions::UniformDistribution uniform_dist(prng);
@@ -0,0 +1,230 @@
+#include <abstractions/cmaes.h>
+#include <abstractions/errors.h>
+#include <abstractions/math/matrices.h>
+#include <abstractions/optimizer.h>
+#include <abstractions/snes.h>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <Eigen/Core>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using namespace abstractions;
+
+namespace {
+
+/// @brief Create one of the derivative-free optimizers.
+std::unique_ptr<IOptimizer<double>> MakeOptimizer(OptimizerType type, uint32_t seed) {
+    switch (type) {
+        case OptimizerType::Snes:
+            return std::make_unique<SnesOptimizer>(
+                *SnesOptimizer::New(SnesOptimizerSettings{.seed = seed}));
+        case OptimizerType::SepCmaEs:
+            return std::make_unique<SepCmaEsOptimizer>(
+                *SepCmaEsOptimizer::New(SepCmaEsOptimizerSettings{.seed = seed}));
+        default:
+            return nullptr;
+    }
+}
+
+/// @brief Evaluate the (negated) sphere function, centred on `target`, for
+///     every sample.
+void SphereFitness(ConstMatrixRef samples, ConstRowVectorRef target, ColumnVectorRef fitness) {
+    fitness = -(samples.rowwise() - target).rowwise().squaredNorm();
+}
+
+}  // namespace
+
+TEST_SUITE_BEGIN("optimizer");
+
+TEST_CASE("Can validate SNES and sep-CMA-ES optimizer settings.") {
+    CHECK_FALSE(SnesOptimizerSettings{}.Validate().has_value());
+    CHECK_FALSE(SepCmaEsOptimizerSettings{}.Validate().has_value());
+
+    CHECK(SnesOptimizerSettings{.init_stddev = 0}.Validate().has_value());
+    CHECK(SnesOptimizerSettings{.mean_learning_rate = -1}.Validate().has_value());
+    CHECK(SnesOptimizerSettings{.stddev_learning_rate = 0}.Validate().has_value());
+    CHECK(SepCmaEsOptimizerSettings{.init_stddev = -1}.Validate().has_value());
+
+    CHECK_FALSE(SnesOptimizer::New(SnesOptimizerSettings{.init_stddev = 0}).has_value());
+    CHECK_FALSE(SepCmaEsOptimizer::New(SepCmaEsOptimizerSettings{.init_stddev = 0}).has_value());
+}
+
+TEST_CASE("Only PGPE supports block-coordinate updates.") {
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        auto optimizer = MakeOptimizer(type, 1);
+        optimizer->Initialize(RowVector::Zero(4), 0.5);
+        CHECK(optimizer->SetActiveParameters({0, 2}).has_value());
+        CHECK_FALSE(optimizer->SetActiveParameters({}).has_value());
+    }
+}
+
+TEST_CASE("Optimizers can minimize a quadratic.") {
+    constexpr int kNumParams = 10;
+    constexpr int kNumSamples = 16;
+    constexpr int kIterations = 400;
+
+    const RowVector target = RowVector::LinSpaced(kNumParams, -1, 1);
+
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        auto optimizer = MakeOptimizer(type, 1);
+        REQUIRE(optimizer);
+        CHECK(optimizer->Type() == type);
+        optimizer->Initialize(RowVector::Zero(kNumParams), 0.5);
+
+        Matrix samples = Matrix::Zero(kNumSamples, kNumParams);
+        ColumnVector fitness = ColumnVector::Zero(kNumSamples);
+        for (int i = 0; i < kIterations; i++) {
+            abstractions_check(optimizer->Sample(samples));
+            SphereFitness(samples, target, fitness);
+            abstractions_check(optimizer->Update(samples, fitness));
+        }
+
+        const RowVector estimate = *optimizer->GetEstimate();
+        INFO(fmt::format("Distance to the target: {}", (estimate - target).norm()));
+        CHECK((estimate - target).norm() < 1e-3);
+        CHECK(optimizer->GetSolutionStdDev()->maxCoeff() < 1e-3);
+    }
+}
+
+TEST_CASE("Optimizer updates can be computed in independent blocks.") {
+    constexpr int kNumParams = 9;
+    constexpr int kNumSamples = 8;
+
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        auto full = MakeOptimizer(type, 2);
+        auto blocked = MakeOptimizer(type, 2);
+        full->Initialize(RowVector::LinSpaced(kNumParams, 0, 1), 0.25);
+        blocked->Initialize(RowVector::LinSpaced(kNumParams, 0, 1), 0.25);
+
+        Matrix samples = Matrix::Zero(kNumSamples, kNumParams);
+        ColumnVector fitness = ColumnVector::Zero(kNumSamples);
+        for (int i = 0; i < 3; i++) {
+            abstractions_check(full->Sample(samples));
+            blocked->NewPopulation();
+            SphereFitness(samples, RowVector::Constant(kNumParams, 0.5), fitness);
+
+            abstractions_check(full->Update(samples, fitness));
+            abstractions_check(blocked->BeginUpdate(samples, fitness));
+            abstractions_check(blocked->AccumulateGradients(samples, 4, 5));
+            abstractions_check(blocked->AccumulateGradients(samples, 0, 4));
+            abstractions_check(blocked->FinishUpdate());
+
+            CHECK(*blocked->GetEstimate() == *full->GetEstimate());
+            CHECK(*blocked->GetSolutionStdDev() == *full->GetSolutionStdDev());
+        }
+
+        SUBCASE("Error when accumulating without an update.") {
+            CHECK(blocked->AccumulateGradients(samples, 0, 1).has_value());
+            CHECK(blocked->FinishUpdate().has_value());
+        }
+    }
+}
+
+TEST_CASE("Optimizer state can be saved and restored.") {
+    constexpr int kNumParams = 5;
+    constexpr int kNumSamples = 6;
+
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        auto optimizer = MakeOptimizer(type, 1);
+        optimizer->Initialize(RowVector::Zero(kNumParams), 1.0);
+
+        // Run an update so that the state isn't just the initial values.
+        Matrix samples = Matrix::Zero(kNumSamples, kNumParams);
+        ColumnVector fitness = ColumnVector::Zero(kNumSamples);
+        abstractions_check(optimizer->Sample(samples));
+        SphereFitness(samples, RowVector::Ones(kNumParams), fitness);
+        abstractions_check(optimizer->Update(samples, fitness));
+
+        auto state = optimizer->GetState();
+        REQUIRE(state.has_value());
+        CHECK(state->type == type);
+
+        auto restored = MakeOptimizer(type, 2);
+        REQUIRE_FALSE(restored->SetState(*state).has_value());
+
+        Matrix expected = Matrix::Zero(kNumSamples, kNumParams);
+        Matrix actual = Matrix::Zero(kNumSamples, kNumParams);
+        abstractions_check(optimizer->Sample(expected));
+        abstractions_check(restored->Sample(actual));
+        CHECK(expected == actual);
+
+        // The evolution paths also have to be restored for the updates to match.
+        SphereFitness(expected, RowVector::Ones(kNumParams), fitness);
+        abstractions_check(optimizer->Update(expected, fitness));
+        abstractions_check(restored->Update(actual, fitness));
+        CHECK(*restored->GetEstimate() == *optimizer->GetEstimate());
+        CHECK(*restored->GetSolutionStdDev() == *optimizer->GetSolutionStdDev());
+
+        auto other_state = *state;
+        other_state.type = OptimizerType::Pgpe;
+        CHECK(restored->SetState(other_state).has_value());
+
+        other_state = *state;
+        other_state.standard_deviation = RowVector::Ones(kNumParams + 1);
+        CHECK(restored->SetState(other_state).has_value());
+    }
+}
+
+TEST_CASE("Parameters can be inserted into any optimizer.") {
+    for (auto type : {OptimizerType::Snes, OptimizerType::SepCmaEs}) {
+        INFO(fmt::format("Optimizer: {}", type));
+
+        auto optimizer = MakeOptimizer(type, 1);
+
+        RowVector inserted(2);
+        inserted << 10, 20;
+        CHECK(optimizer->InsertParameters(0, inserted).has_value());
+
+        RowVector initial(3);
+        initial << 1, 2, 3;
+        optimizer->Initialize(initial, 0.5);
+        REQUIRE_FALSE(optimizer->InsertParameters(1, inserted, 0.25).has_value());
+
+        RowVector expected(5);
+        expected << 1, 10, 20, 2, 3;
+        RowVector expected_stddev(5);
+        expected_stddev << 0.5, 0.25, 0.25, 0.5, 0.5;
+
+        CHECK(*optimizer->GetEstimate() == expected);
+        CHECK(*optimizer->GetSolutionStdDev() == expected_stddev);
+
+        // The optimizer still works with the larger solution.
+        Matrix samples = Matrix::Zero(4, 5);
+        ColumnVector fitness = ColumnVector::Zero(4);
+        abstractions_check(optimizer->Sample(samples));
+        SphereFitness(samples, RowVector::Zero(5), fitness);
+        abstractions_check(optimizer->Update(samples, fitness));
+
+        CHECK(optimizer->InsertParameters(6, inserted).has_value());
+        CHECK(optimizer->InsertParameters(-1, inserted).has_value());
+    }
+}
+
+TEST_CASE("sep-CMA-ES samples are independent.") {
+    auto optimizer = SepCmaEsOptimizer::New(SepCmaEsOptimizerSettings{.seed = 1});
+    REQUIRE(optimizer.has_value());
+    optimizer->Initialize(RowVector::Zero(4), 1.0);
+
+    // Any number of samples, greater than one, can be drawn.
+    Matrix samples = Matrix::Zero(5, 4);
+    abstractions_check(optimizer->Sample(samples));
+
+    Matrix mirrored = samples.topRows(2) + samples.bottomRows(2);
+    CHECK(mirrored.norm() > 0);
+
+    Matrix single = Matrix::Zero(1, 4);
+    CHECK(optimizer->Sample(single).has_value());
+}
+
+TEST_SUITE_END();
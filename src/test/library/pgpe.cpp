@@ -3,9 +3,13 @@
 #include <abstractions/math/random.h>
 #include <abstractions/pgpe.h>
 #include <doctest/doctest.h>
+#include <fmt/format.h>
 
 #include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
 #include <numbers>
+#include <vector>
 
 using namespace abstractions;
 
@@ -46,6 +50,15 @@ TEST_CASE("Can validate PGPE optimizer settings.") {
         auto err = settings.Validate();
         REQUIRE(err.value() != kMaxSpeedNotSet);
     }
+
+    SUBCASE("Error when the minimum refresh rate isn't on (0, 1].") {
+        CHECK_FALSE(PgpeOptimizerSettings{.max_speed = 1, .min_refresh_rate = 1}
+                        .Validate()
+                        .has_value());
+        CHECK(PgpeOptimizerSettings{.max_speed = 1, .min_refresh_rate = 0}.Validate().has_value());
+        CHECK(
+            PgpeOptimizerSettings{.max_speed = 1, .min_refresh_rate = 1.5}.Validate().has_value());
+    }
 }
 
 TEST_CASE("Can create an optimizer using PgpeOptimizer::Create()") {
@@ -100,6 +113,490 @@ TEST_CASE("Two calls to Sample() should not return the same result.") {
     REQUIRE((first - second).norm() != 0);
 }
 
+TEST_CASE("Samples can be generated in independent blocks.") {
+    auto first = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    auto second = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(first.has_value());
+    REQUIRE(second.has_value());
+
+    first->Initialize(RowVector::LinSpaced(7, 1, 7), 0.5);
+    second->Initialize(RowVector::LinSpaced(7, 1, 7), 0.5);
+
+    Matrix expected = Matrix::Zero(6, 7);
+    abstractions_check(first->Sample(expected));
+
+    // The block order and sizes shouldn't matter.
+    Matrix blocked = Matrix::Zero(6, 7);
+    auto population = second->NewPopulation();
+    REQUIRE_FALSE(second->SampleBlock(blocked, 5, 2, population).has_value());
+    REQUIRE_FALSE(second->SampleBlock(blocked, 0, 1, population).has_value());
+    REQUIRE_FALSE(second->SampleBlock(blocked, 1, 4, population).has_value());
+
+    CHECK(blocked == expected);
+    Matrix mirrored = blocked.topRows(3) + blocked.bottomRows(3);
+    CHECK(mirrored.isApprox(2 * RowVector::LinSpaced(7, 1, 7).replicate(3, 1)));
+
+    SUBCASE("Error when the block is outside of the samples.") {
+        CHECK(second->SampleBlock(blocked, 5, 3, population).has_value());
+        CHECK(second->SampleBlock(blocked, -1, 2, population).has_value());
+    }
+}
+
+TEST_CASE("Any population can be regenerated without replaying earlier ones.") {
+    auto first = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    auto second = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(first.has_value());
+    REQUIRE(second.has_value());
+
+    first->Initialize(RowVector::LinSpaced(5, 1, 5), 0.5);
+    second->Initialize(RowVector::LinSpaced(5, 1, 5), 0.5);
+
+    Matrix expected = Matrix::Zero(6, 5);
+    for (int i = 0; i < 4; i++) {
+        abstractions_check(first->Sample(expected));
+    }
+
+    Matrix replayed = Matrix::Zero(6, 5);
+    REQUIRE_FALSE(second->SampleBlock(replayed, 0, 5, 3).has_value());
+    CHECK(replayed == expected);
+
+    REQUIRE_FALSE(second->SampleBlock(replayed, 0, 5, 2).has_value());
+    CHECK(replayed != expected);
+}
+
+TEST_CASE("Parameters can be inserted into an initialized optimizer.") {
+    auto optimizer = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(optimizer.has_value());
+
+    RowVector x_init(4);
+    x_init << 1, 2, 3, 4;
+    optimizer->Initialize(x_init, 0.5);
+
+    RowVector inserted(2);
+    inserted << 10, 20;
+
+    SUBCASE("Insert into the middle of the solution.") {
+        REQUIRE_FALSE(optimizer->InsertParameters(2, inserted, 0.25).has_value());
+
+        RowVector expected(6);
+        expected << 1, 2, 10, 20, 3, 4;
+
+        RowVector expected_stddev(6);
+        expected_stddev << 0.5, 0.5, 0.25, 0.25, 0.5, 0.5;
+
+        CHECK(*optimizer->GetEstimate() == expected);
+        CHECK(*optimizer->GetSolutionStdDev() == expected_stddev);
+        CHECK(*optimizer->GetSolutionVelocity() == RowVector::Zero(6));
+    }
+
+    SUBCASE("Insert at the end and use the mean standard deviation.") {
+        REQUIRE_FALSE(optimizer->InsertParameters(4, inserted).has_value());
+
+        RowVector expected(6);
+        expected << 1, 2, 3, 4, 10, 20;
+
+        CHECK(*optimizer->GetEstimate() == expected);
+        CHECK(*optimizer->GetSolutionStdDev() == RowVector::Constant(6, 0.5));
+    }
+
+    SUBCASE("Samples need to match the new size.") {
+        REQUIRE_FALSE(optimizer->InsertParameters(0, inserted).has_value());
+
+        Matrix samples = Matrix::Zero(4, 4);
+        CHECK(optimizer->Sample(samples).has_value());
+
+        samples = Matrix::Zero(4, 6);
+        CHECK_FALSE(optimizer->Sample(samples).has_value());
+    }
+
+    SUBCASE("Error when inserting outside of the solution.") {
+        CHECK(optimizer->InsertParameters(5, inserted).has_value());
+        CHECK(optimizer->InsertParameters(-1, inserted).has_value());
+    }
+}
+
+TEST_CASE("Optimizer state can be saved and restored.") {
+    auto optimizer = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(optimizer.has_value());
+    REQUIRE_FALSE(optimizer->GetState().has_value());
+
+    optimizer->Initialize(5, 1.0);
+
+    Matrix samples = Matrix::Zero(4, 5);
+    abstractions_check(optimizer->Sample(samples));
+
+    auto state = optimizer->GetState();
+    REQUIRE(state.has_value());
+
+    SUBCASE("Restored optimizer generates the same samples.") {
+        auto restored = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 2});
+        REQUIRE(restored.has_value());
+        REQUIRE_FALSE(restored->SetState(*state).has_value());
+
+        Matrix expected = Matrix::Zero(4, 5);
+        Matrix actual = Matrix::Zero(4, 5);
+        abstractions_check(optimizer->Sample(expected));
+        abstractions_check(restored->Sample(actual));
+
+        CHECK(expected == actual);
+        CHECK(*restored->GetEstimate() == *optimizer->GetEstimate());
+    }
+
+    SUBCASE("Error when the state vectors have different lengths.") {
+        state->vectors["velocity"] = RowVector::Zero(3);
+        CHECK(optimizer->SetState(*state).has_value());
+    }
+
+    SUBCASE("Error when the velocity is missing.") {
+        state->vectors.clear();
+        CHECK(optimizer->SetState(*state).has_value());
+    }
+
+    SUBCASE("Error when the state is from another optimizer.") {
+        state->type = OptimizerType::Snes;
+        CHECK(optimizer->SetState(*state).has_value());
+    }
+}
+
+TEST_CASE("Update matches the reference PGPE/ClipUp equations.") {
+    constexpr int kNumParams = 37;
+    constexpr int kNumSamples = 24;
+
+    PgpeOptimizerSettings settings{.max_speed = 0.5, .seed = 3};
+    auto optimizer = PgpeOptimizer::New(settings);
+    REQUIRE(optimizer.has_value());
+    optimizer->Initialize(RowVector::LinSpaced(kNumParams, -1, 1), 0.25);
+
+    NormalDistribution cost_dist(Prng(4), 0, 1);
+    Matrix samples = Matrix::Zero(kNumSamples, kNumParams);
+
+    // Run a few updates so that the velocity and standard deviations are no
+    // longer uniform.
+    for (int iteration = 0; iteration < 5; iteration++) {
+        abstractions_check(optimizer->Sample(samples));
+        ColumnVector costs = RandomMatrix(kNumSamples, 1, cost_dist);
+
+        const RowVector state = *optimizer->GetEstimate();
+        const RowVector stddev = *optimizer->GetSolutionStdDev();
+        const RowVector velocity = *optimizer->GetSolutionVelocity();
+
+        // This is a direct, matrix-based implementation of the update.
+        const int n = kNumSamples / 2;
+        const Matrix perturbations = samples.topRows(n).rowwise() - state;
+        const ColumnVector delta_cost = (costs.topRows(n) - costs.bottomRows(n)) / 2.0;
+        const ColumnVector stddev_weights =
+            ((costs.topRows(n) + costs.bottomRows(n)) / 2.0).array() - costs.mean();
+        const Matrix stddev_directions =
+            (perturbations.array().pow(2).rowwise() - stddev.array().pow(2)).rowwise() /
+            stddev.array();
+
+        const RowVector grad_solution =
+            (delta_cost.asDiagonal() * perturbations).colwise().sum() / n;
+        const RowVector grad_stddev =
+            (stddev_weights.asDiagonal() * stddev_directions).colwise().sum() / n;
+
+        RowVector expected_velocity = settings.momentum * velocity +
+                                      settings.max_speed / 2.0 * grad_solution.normalized();
+        if (expected_velocity.norm() > settings.max_speed) {
+            expected_velocity = settings.max_speed * expected_velocity.normalized();
+        }
+
+        const RowVector expected_stddev =
+            (stddev + settings.stddev_learning_rate * grad_stddev)
+                .cwiseMin((1 + settings.stddev_max_change) * stddev)
+                .cwiseMax(((1 - settings.stddev_max_change) * stddev).cwiseMax(1e-9));
+
+        abstractions_check(optimizer->Update(samples, costs));
+
+        CHECK(optimizer->GetSolutionVelocity()->isApprox(expected_velocity, 1e-12));
+        CHECK(optimizer->GetEstimate()->isApprox(state + expected_velocity, 1e-12));
+        CHECK(optimizer->GetSolutionStdDev()->isApprox(expected_stddev, 1e-12));
+    }
+}
+
+TEST_CASE("Updates can be computed in independent blocks.") {
+    auto first = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(first.has_value());
+    first->Initialize(RowVector::LinSpaced(7, 1, 7), 0.5);
+    PgpeOptimizer second(*first);
+
+    Matrix samples = Matrix::Zero(6, 7);
+    abstractions_check(first->Sample(samples));
+    const ColumnVector costs = ColumnVector::LinSpaced(6, -0.5, 0.5);
+
+    abstractions_check(first->Update(samples, costs));
+
+    // The block order and sizes shouldn't matter.
+    REQUIRE_FALSE(second.BeginUpdate(samples, costs).has_value());
+    REQUIRE_FALSE(second.AccumulateGradients(samples, 5, 2).has_value());
+    REQUIRE_FALSE(second.AccumulateGradients(samples, 0, 1).has_value());
+    REQUIRE_FALSE(second.AccumulateGradients(samples, 1, 4).has_value());
+    REQUIRE_FALSE(second.FinishUpdate().has_value());
+
+    CHECK(*second.GetEstimate() == *first->GetEstimate());
+    CHECK(*second.GetSolutionStdDev() == *first->GetSolutionStdDev());
+    CHECK(*second.GetSolutionVelocity() == *first->GetSolutionVelocity());
+
+    SUBCASE("Error when no update is in progress.") {
+        CHECK(second.AccumulateGradients(samples, 0, 7).has_value());
+        CHECK(second.FinishUpdate().has_value());
+    }
+
+    SUBCASE("Error when the block is outside of the parameters.") {
+        REQUIRE_FALSE(second.BeginUpdate(samples, costs).has_value());
+        CHECK(second.AccumulateGradients(samples, 5, 3).has_value());
+        CHECK(second.AccumulateGradients(samples, -1, 2).has_value());
+    }
+}
+
+TEST_CASE("Populations can reuse samples with importance mixing.") {
+    constexpr int kNumParams = 6;
+    constexpr int kNumSamples = 16;
+
+    // A tiny speed and no standard deviation updates keep the distribution
+    // almost unchanged, so most of the previous pairs should be reused.
+    PgpeOptimizerSettings settings{
+        .max_speed = 1e-6,
+        .stddev_learning_rate = 0,
+        .seed = 2,
+        .min_refresh_rate = 0.25,
+    };
+    auto optimizer = PgpeOptimizer::New(settings);
+    REQUIRE(optimizer.has_value());
+    optimizer->Initialize(RowVector::LinSpaced(kNumParams, -1, 1), 0.5);
+
+    Matrix previous = Matrix::Zero(kNumSamples, kNumParams);
+    const ColumnVector previous_costs = ColumnVector::LinSpaced(kNumSamples, -1, 1);
+    Matrix samples = Matrix::Zero(kNumSamples, kNumParams);
+    ColumnVector costs = ColumnVector::Zero(kNumSamples);
+    std::vector<int> fresh;
+
+    SUBCASE("Nothing is reused before the first update.") {
+        abstractions_check(optimizer->Sample(samples));
+        abstractions_check(
+            optimizer->MixPopulation(samples, costs, previous, previous_costs, 0, fresh));
+        CHECK(fresh.size() == kNumSamples);
+    }
+
+    abstractions_check(optimizer->Sample(previous));
+    abstractions_check(optimizer->Update(previous, previous_costs));
+
+    const uint32_t population = optimizer->NewPopulation();
+    abstractions_check(optimizer->SampleBlock(samples, 0, kNumParams, population));
+    const Matrix sampled = samples;
+
+    abstractions_check(
+        optimizer->MixPopulation(samples, costs, previous, previous_costs, population, fresh));
+
+    // Pairs are either fresh or reused as a whole.
+    REQUIRE(fresh.size() % 2 == 0);
+    REQUIRE(fresh.size() < kNumSamples);
+    const int num_pairs = kNumSamples / 2;
+    const int num_fresh = fresh.size() / 2;
+    for (int k = 0; k < num_fresh; k++) {
+        CHECK(fresh[k + num_fresh] == fresh[k] + num_pairs);
+    }
+
+    for (int i = 0; i < kNumSamples; i++) {
+        INFO(fmt::format("Row {}", i));
+        if (std::find(fresh.begin(), fresh.end(), i) != fresh.end()) {
+            CHECK(samples.row(i) == sampled.row(i));
+            continue;
+        }
+
+        int match = -1;
+        for (int j = 0; j < kNumSamples; j++) {
+            if (previous.row(j) == samples.row(i)) {
+                match = j;
+            }
+        }
+        REQUIRE(match >= 0);
+        CHECK(costs(i) == previous_costs(match));
+    }
+
+    SUBCASE("The mixed update uses the per-sample gradients.") {
+        for (int i : fresh) {
+            costs(i) = i % 3 - 1.0;
+        }
+
+        const RowVector state = *optimizer->GetEstimate();
+        const RowVector stddev = *optimizer->GetSolutionStdDev();
+        const RowVector velocity = *optimizer->GetSolutionVelocity();
+
+        const Matrix perturbations = samples.rowwise() - state;
+        const ColumnVector weights = costs.array() - costs.mean();
+        const RowVector grad_solution =
+            (weights.asDiagonal() * perturbations).colwise().sum() / kNumSamples;
+
+        RowVector expected_velocity = settings.momentum * velocity +
+                                      settings.max_speed / 2.0 * grad_solution.normalized();
+        if (expected_velocity.norm() > settings.max_speed) {
+            expected_velocity = settings.max_speed * expected_velocity.normalized();
+        }
+
+        abstractions_check(optimizer->Update(samples, costs));
+        CHECK(optimizer->GetSolutionVelocity()->isApprox(expected_velocity, 1e-12));
+        CHECK(optimizer->GetEstimate()->isApprox(state + expected_velocity, 1e-12));
+        CHECK(*optimizer->GetSolutionStdDev() == stddev);
+    }
+
+    SUBCASE("Nothing is reused without a minimum refresh rate.") {
+        settings.min_refresh_rate = {};
+        auto other = PgpeOptimizer::New(settings);
+        other->Initialize(RowVector::LinSpaced(kNumParams, -1, 1), 0.5);
+        abstractions_check(other->Update(previous, previous_costs));
+
+        abstractions_check(other->Sample(samples));
+        abstractions_check(
+            other->MixPopulation(samples, costs, previous, previous_costs, 1, fresh));
+        CHECK(fresh.size() == kNumSamples);
+    }
+
+    SUBCASE("Error when the previous population doesn't match.") {
+        const Matrix wrong = Matrix::Zero(kNumSamples, kNumParams + 1);
+        CHECK(optimizer->MixPopulation(samples, costs, wrong, previous_costs, population, fresh)
+                  .has_value());
+    }
+}
+
+TEST_CASE("Block-coordinate updates only change the active parameters.") {
+    constexpr int kNumParams = 8;
+    constexpr int kNumSamples = 6;
+
+    PgpeOptimizerSettings settings{.max_speed = 0.5, .seed = 1};
+    auto optimizer = PgpeOptimizer::New(settings);
+    REQUIRE(optimizer.has_value());
+    optimizer->Initialize(RowVector::LinSpaced(kNumParams, -1, 1), 0.25);
+
+    const std::vector<int> active{1, 4, 5};
+    REQUIRE_FALSE(optimizer->SetActiveParameters(active).has_value());
+    CHECK(optimizer->GetActiveParameters() == active);
+
+    const RowVector state = *optimizer->GetEstimate();
+    const RowVector stddev = *optimizer->GetSolutionStdDev();
+
+    // The inactive columns are left as they were.
+    Matrix samples = state.replicate(kNumSamples, 1);
+    abstractions_check(optimizer->Sample(samples));
+    for (int i = 0; i < kNumParams; i++) {
+        INFO(fmt::format("Parameter {}", i));
+        const bool is_active = std::find(active.begin(), active.end(), i) != active.end();
+        CHECK((samples.col(i).array() == state(i)).all() == !is_active);
+    }
+
+    // The block is updated exactly like an optimizer that only has the active
+    // parameters.
+    auto reduced = PgpeOptimizer::New(settings);
+    abstractions_check(reduced->SetState(OptimizerState{
+        .type = OptimizerType::Pgpe,
+        .state = state(active),
+        .standard_deviation = stddev(active),
+        .vectors = {{"velocity", RowVector::Zero(active.size())}},
+        .seed = 1,
+    }));
+
+    const ColumnVector costs = ColumnVector::LinSpaced(kNumSamples, -0.5, 0.5);
+    const Matrix reduced_samples = samples(Eigen::all, active);
+    abstractions_check(optimizer->Update(samples, costs));
+    abstractions_check(reduced->Update(reduced_samples, costs));
+
+    const RowVector updated = *optimizer->GetEstimate();
+    const RowVector updated_stddev = *optimizer->GetSolutionStdDev();
+    CHECK(RowVector(updated(active)).isApprox(*reduced->GetEstimate(), 1e-12));
+    CHECK(RowVector(updated_stddev(active)).isApprox(*reduced->GetSolutionStdDev(), 1e-12));
+    for (int i = 0; i < kNumParams; i++) {
+        if (std::find(active.begin(), active.end(), i) == active.end()) {
+            CHECK(updated(i) == state(i));
+            CHECK(updated_stddev(i) == stddev(i));
+            CHECK((*optimizer->GetSolutionVelocity())(i) == 0);
+        }
+    }
+
+    SUBCASE("Clearing the block makes every parameter active.") {
+        REQUIRE_FALSE(optimizer->SetActiveParameters({}).has_value());
+        abstractions_check(optimizer->Sample(samples));
+        CHECK((samples.row(0).array() != updated.array()).all());
+    }
+
+    SUBCASE("Error when the block is invalid.") {
+        CHECK(optimizer->SetActiveParameters({4, 1}).has_value());
+        CHECK(optimizer->SetActiveParameters({1, 1}).has_value());
+        CHECK(optimizer->SetActiveParameters({kNumParams}).has_value());
+        CHECK(optimizer->SetActiveParameters({-1}).has_value());
+    }
+
+    SUBCASE("Inserting parameters resets the block.") {
+        REQUIRE_FALSE(optimizer->InsertParameters(0, RowVector::Zero(2)).has_value());
+        CHECK(optimizer->GetActiveParameters().empty());
+    }
+}
+
+TEST_CASE("Single-precision samples match the double-precision ones.") {
+    auto fp64 = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    auto fp32 = BasicPgpeOptimizer<float>::New(PgpeOptimizerSettings{.max_speed = 1.0, .seed = 1});
+    REQUIRE(fp64.has_value());
+    REQUIRE(fp32.has_value());
+
+    fp64->Initialize(RowVector::LinSpaced(7, 1, 7), 0.5);
+    fp32->Initialize(BasicRowVector<float>::LinSpaced(7, 1, 7), 0.5f);
+
+    Matrix expected = Matrix::Zero(6, 7);
+    BasicMatrix<float> actual = BasicMatrix<float>::Zero(6, 7);
+    abstractions_check(fp64->Sample(expected));
+    abstractions_check(fp32->Sample(actual));
+
+    CHECK(actual.cast<double>().isApprox(expected, 1e-6));
+
+    SUBCASE("State is shared between both precisions.") {
+        auto restored = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 1.0});
+        REQUIRE(restored.has_value());
+
+        auto state = fp32->GetState();
+        REQUIRE(state.has_value());
+        REQUIRE_FALSE(restored->SetState(*state).has_value());
+        CHECK(restored->GetEstimate()->isApprox(fp32->GetEstimate()->cast<double>()));
+    }
+}
+
+TEST_CASE("Single and double precision optimizers converge to the same cost.") {
+    constexpr int kNumDim = 50;
+    constexpr int kNumSamples = 64;
+    constexpr int kIterations = 500;
+
+    const RowVector target = RowVector::LinSpaced(kNumDim, -1, 1);
+
+    auto optimize = [&]<typename T>(BasicPgpeOptimizer<T> &optimizer) -> double {
+        const BasicRowVector<T> target_t = target.cast<T>();
+        optimizer.Initialize(BasicRowVector<T>::Zero(kNumDim), T(0.5));
+
+        BasicMatrix<T> samples = BasicMatrix<T>::Zero(kNumSamples, kNumDim);
+        BasicColumnVector<T> costs = BasicColumnVector<T>::Zero(kNumSamples);
+        for (int i = 0; i < kIterations; i++) {
+            abstractions_check(optimizer.Sample(samples));
+            for (int j = 0; j < kNumSamples; j++) {
+                costs(j) = -(samples.row(j) - target_t).squaredNorm();
+            }
+            optimizer.RankLinearize(costs);
+            abstractions_check(optimizer.Update(samples, costs));
+        }
+
+        return (optimizer.GetEstimate()->template cast<double>() - target).squaredNorm();
+    };
+
+    auto fp64 = PgpeOptimizer::New(PgpeOptimizerSettings{.max_speed = 0.1, .seed = 1});
+    auto fp32 = BasicPgpeOptimizer<float>::New(PgpeOptimizerSettings{.max_speed = 0.1, .seed = 1});
+    REQUIRE(fp64.has_value());
+    REQUIRE(fp32.has_value());
+
+    const double fp64_cost = optimize(*fp64);
+    const double fp32_cost = optimize(*fp32);
+    INFO(fmt::format("double: {}, float: {}", fp64_cost, fp32_cost));
+
+    CHECK(fp64_cost < 0.1);
+    CHECK(fp32_cost < 0.1);
+    CHECK(std::abs(fp64_cost - fp32_cost) < 0.01);
+}
+
 TEST_CASE("PgpeOptimizer can find the equation of a line from noisy data.") {
     // Constants
     constexpr int kIterations = 2500;
@@ -1,8 +1,17 @@
 #include <abstractions/errors.h>
 #include <abstractions/image.h>
+#include <abstractions/math/matrices.h>
 #include <abstractions/math/random.h>
 #include <abstractions/render/canvas.h>
+#include <abstractions/render/coverage.h>
+#include <abstractions/render/renderer.h>
+#include <abstractions/render/shapes.h>
+#include <abstractions/render/tiles.h>
 #include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
 
 using namespace abstractions;
 
@@ -18,4 +27,494 @@ TEST_CASE("Assertion occurs when expected to Canvas constructor is empty.") {
 
 #endif
 
+TEST_CASE("Renderer can start from the cached layers of a base collection.") {
+    constexpr int kWidth = 64;
+    constexpr int kHeight = 48;
+    constexpr int kNumShapes = 40;
+    constexpr int kFirstChanged = 35;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(1));
+    render::PackedShapeCollection base(generator.RandomCircles(kNumShapes), {},
+                                       generator.RandomTriangles(kNumShapes));
+
+    // Only the colours change so the coordinates span the same range.
+    auto shapes = base;
+    shapes.Triangles().Params.bottomRows(kNumShapes - kFirstChanged).rightCols(4).array() *= 0.5;
+
+    auto expected = render::Renderer::Create(kWidth, kHeight);
+    auto cached = render::Renderer::Create(kWidth, kHeight);
+    auto shared = render::Renderer::Create(kWidth, kHeight);
+    REQUIRE(expected.has_value());
+    REQUIRE(cached.has_value());
+    REQUIRE(shared.has_value());
+
+    expected->Render(shapes);
+    REQUIRE_FALSE(cached->CacheLayers(base).has_value());
+    shared->ShareLayers(*cached);
+
+    SUBCASE("Rendering from a cached layer matches a full render.") {
+        cached->Render(shapes, kNumShapes + kFirstChanged);
+        shared->Render(shapes, kNumShapes + kFirstChanged);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), cached->DrawingSurface()) == 0);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), shared->DrawingSurface()) == 0);
+    }
+
+    SUBCASE("The layers aren't used when the coordinates are rescaled differently.") {
+        shapes.Triangles().Params(kNumShapes - 1, 0) += 10;
+        expected->Render(shapes);
+        cached->Render(shapes, kNumShapes + kFirstChanged);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), cached->DrawingSurface()) == 0);
+    }
+
+    SUBCASE("Rendering without any layers is a full render.") {
+        cached->ClearLayers();
+        cached->Render(shapes, kNumShapes + kFirstChanged);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), cached->DrawingSurface()) == 0);
+    }
+
+    SUBCASE("The layer interval must be positive.") {
+        CHECK(cached->CacheLayers(base, 0).has_value());
+    }
+}
+
+TEST_CASE("Independent coordinate mappings place every shape on its own.") {
+    Matrix coords(3, 2);
+    coords << 0.2, 0.3, 0.5, 0.5, 0.8, 0.9;
+
+    Matrix moved = coords;
+    moved(2, 0) = 5;
+
+    for (auto mapping : {render::CoordinateMapping::Clamped, render::CoordinateMapping::Sigmoid}) {
+        INFO(fmt::format("Mapping: {}", mapping));
+
+        const Matrix mapped = render::MapCoordinates(coords, mapping);
+        const Matrix mapped_moved = render::MapCoordinates(moved, mapping);
+        CHECK(mapped.topRows(2) == mapped_moved.topRows(2));
+        CHECK(mapped.minCoeff() >= -0.1);
+        CHECK(mapped.maxCoeff() <= 1.1);
+
+        for (double value : {0.0, 0.25, 0.5, 1.0}) {
+            Matrix unmapped(1, 1);
+            unmapped << render::UnmapCoordinate(value, mapping);
+            CHECK(render::MapCoordinates(unmapped, mapping)(0, 0) == doctest::Approx(value));
+        }
+    }
+
+    // Moving one shape moves every other shape when the coordinates are
+    // rescaled.
+    constexpr auto kRescaled = render::CoordinateMapping::Rescaled;
+    const Matrix rescaled = render::MapCoordinates(coords, kRescaled);
+    const Matrix rescaled_moved = render::MapCoordinates(moved, kRescaled);
+    CHECK(rescaled.col(0).topRows(2) != rescaled_moved.col(0).topRows(2));
+}
+
+TEST_CASE("Independent coordinate mappings can always use the cached layers.") {
+    constexpr int kWidth = 64;
+    constexpr int kHeight = 48;
+    constexpr int kNumShapes = 40;
+    constexpr int kFirstChanged = 35;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(1));
+    render::PackedShapeCollection base({}, {}, generator.RandomTriangles(kNumShapes));
+
+    // Moving a shape past the others would change how everything is rescaled.
+    auto shapes = base;
+    shapes.Triangles().Params(kNumShapes - 1, 0) += 10;
+
+    for (auto mapping : {render::CoordinateMapping::Clamped, render::CoordinateMapping::Sigmoid}) {
+        INFO(fmt::format("Mapping: {}", mapping));
+
+        auto expected = render::Renderer::Create(kWidth, kHeight);
+        auto cached = render::Renderer::Create(kWidth, kHeight);
+        REQUIRE(expected.has_value());
+        REQUIRE(cached.has_value());
+        expected->SetCoordinateMapping(mapping);
+        cached->SetCoordinateMapping(mapping);
+
+        expected->Render(shapes);
+        REQUIRE_FALSE(cached->CacheLayers(base).has_value());
+        cached->Render(shapes, kFirstChanged);
+
+        CHECK(cached->Statistics().submitted < expected->Statistics().submitted);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), cached->DrawingSurface()) == 0);
+
+        // The layers can't be reused with a different mapping.
+        cached->SetCoordinateMapping(render::CoordinateMapping::Rescaled);
+        cached->Render(shapes, kFirstChanged);
+        CHECK(cached->Statistics().submitted == kNumShapes);
+    }
+}
+
+TEST_CASE("Multi-threaded renders match single-threaded renders.") {
+    constexpr int kWidth = 160;
+    constexpr int kHeight = 120;
+    constexpr int kNumShapes = 30;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(3));
+    render::PackedShapeCollection shapes(generator.RandomCircles(kNumShapes),
+                                         generator.RandomRectangles(kNumShapes),
+                                         generator.RandomTriangles(kNumShapes));
+
+    auto single = render::Renderer::Create(kWidth, kHeight, Prng<>(4));
+    auto multi = render::Renderer::Create(kWidth, kHeight, Prng<>(4));
+    REQUIRE(single.has_value());
+    REQUIRE(multi.has_value());
+
+    single->UseRandomBackgroundFill(true);
+    multi->UseRandomBackgroundFill(true);
+    multi->SetThreadCount(4);
+
+    single->Render(shapes);
+    multi->Render(shapes);
+    CHECK(*CompareImagesAbsDiff(single->DrawingSurface(), multi->DrawingSurface()) == 0);
+}
+
+TEST_CASE("The scanline rasterizer is close to Blend2D.") {
+    constexpr int kWidth = 96;
+    constexpr int kHeight = 64;
+    constexpr int kNumShapes = 20;
+
+    // The mean, per-pixel, absolute difference of the colour channels.  This
+    // allows for about two levels of difference in each channel.
+    constexpr double kTolerance = 0.02;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(2));
+    auto circles = generator.RandomCircles(kNumShapes);
+    auto rectangles = generator.RandomRectangles(kNumShapes);
+    auto triangles = generator.RandomTriangles(kNumShapes);
+
+    auto blend2d = render::Renderer::Create(kWidth, kHeight);
+    auto scanline = render::Renderer::Create(kWidth, kHeight);
+    REQUIRE(blend2d.has_value());
+    REQUIRE(scanline.has_value());
+    scanline->SetBackend(render::RenderBackend::Scanline);
+
+    auto check_shapes = [&](const render::PackedShapeCollection &shapes) {
+        blend2d->Render(shapes);
+        scanline->Render(shapes);
+
+        auto diff = CompareImagesAbsDiff(blend2d->DrawingSurface(), scanline->DrawingSurface());
+        REQUIRE(diff.has_value());
+        CHECK(*diff < kTolerance);
+    };
+
+    SUBCASE("Circles") {
+        check_shapes(render::PackedShapeCollection(circles, {}, {}));
+    }
+
+    SUBCASE("Rectangles") {
+        check_shapes(render::PackedShapeCollection({}, rectangles, {}));
+    }
+
+    SUBCASE("Triangles") {
+        check_shapes(render::PackedShapeCollection({}, {}, triangles));
+    }
+
+    SUBCASE("All shapes") {
+        check_shapes(render::PackedShapeCollection(circles, rectangles, triangles));
+    }
+}
+
+TEST_CASE("Aliased renders approximate anti-aliased renders.") {
+    constexpr int kWidth = 96;
+    constexpr int kHeight = 64;
+    constexpr int kNumShapes = 20;
+
+    // Only the shape edges differ, so the mean difference stays small.
+    constexpr double kTolerance = 0.05;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(5));
+    render::PackedShapeCollection shapes(generator.RandomCircles(kNumShapes),
+                                         generator.RandomRectangles(kNumShapes),
+                                         generator.RandomTriangles(kNumShapes));
+
+    auto antialiased = render::Renderer::Create(kWidth, kHeight);
+    auto aliased = render::Renderer::Create(kWidth, kHeight);
+    auto scanline = render::Renderer::Create(kWidth, kHeight);
+    REQUIRE(antialiased.has_value());
+    REQUIRE(aliased.has_value());
+    REQUIRE(scanline.has_value());
+
+    aliased->SetQuality(render::RenderQuality::Aliased);
+    scanline->SetQuality(render::RenderQuality::Aliased);
+    scanline->SetBackend(render::RenderBackend::Scanline);
+
+    antialiased->Render(shapes);
+    aliased->Render(shapes);
+    scanline->Render(shapes);
+
+    auto diff = CompareImagesAbsDiff(antialiased->DrawingSurface(), aliased->DrawingSurface());
+    REQUIRE(diff.has_value());
+    CHECK(*diff > 0);
+    CHECK(*diff < kTolerance);
+
+    // Aliased renders always go through the scanline rasterizer.
+    CHECK(*CompareImagesAbsDiff(aliased->DrawingSurface(), scanline->DrawingSurface()) == 0);
+}
+
+TEST_CASE("Shapes that can't change any pixels are culled.") {
+    constexpr int kSize = 32;
+
+    // Circles are stored as (x, y, s, r, g, b, a) tuples.  Only the centres
+    // are rescaled, so the first two circles span the frame.
+    Matrix circles(6, 7);
+    // clang-format off
+    circles <<
+        0.0, 0.0, 0.2,  1, 1, 1, 1,      // visible
+        1.0, 1.0, 0.2,  1, 1, 1, 1,      // visible
+        0.5, 0.5, 0.0,  1, 1, 1, 1,      // no area
+        0.5, 0.5, 0.2,  1, 1, 1, -1,     // transparent after clamping
+        0.0, 0.5, 0.05, 1, 1, 1, 1,      // left of the frame
+        0.5, 0.5, 0.2,  1, 1, 1, 0.001;  // too transparent to change a pixel
+    // clang-format on
+
+    render::CircleCollection collection;
+    collection.Params = circles;
+
+    auto image = Image::New(kSize, kSize, true);
+    REQUIRE(image.has_value());
+
+    SUBCASE("Source-over compositing culls the transparent shapes.") {
+        render::Canvas canvas(*image, Prng<>(1));
+        REQUIRE_FALSE(canvas.DrawFilledShapes(collection).has_value());
+
+        const auto &statistics = canvas.Statistics();
+        CHECK(statistics.submitted == 6);
+        CHECK(statistics.degenerate == 1);
+        CHECK(statistics.offscreen == 1);
+        CHECK(statistics.transparent == 2);
+        CHECK(statistics.Culled() == 4);
+    }
+
+    SUBCASE("Source-copy compositing draws the transparent shapes.") {
+        render::Canvas canvas(*image, Prng<>(1));
+        REQUIRE_FALSE(canvas.SetCompositeMode(render::CompositeMode::SrcCopy).has_value());
+        REQUIRE_FALSE(canvas.DrawFilledShapes(collection, 2, 6).has_value());
+
+        const auto &statistics = canvas.Statistics();
+        CHECK(statistics.submitted == 4);
+        CHECK(statistics.transparent == 0);
+        CHECK(statistics.Culled() == 2);
+    }
+
+    SUBCASE("The renderer reports the statistics of its last render.") {
+        auto renderer = render::Renderer::Create(kSize, kSize);
+        REQUIRE(renderer.has_value());
+
+        renderer->Render(render::PackedShapeCollection(collection, {}, {}));
+        CHECK(renderer->Statistics().submitted == 6);
+        CHECK(renderer->Statistics().Culled() == 4);
+
+        collection.Params = circles.topRows(2);
+        renderer->Render(render::PackedShapeCollection(collection, {}, {}));
+        CHECK(renderer->Statistics().submitted == 2);
+        CHECK(renderer->Statistics().Culled() == 0);
+    }
+}
+
+TEST_CASE("Occlusion culling doesn't change the render.") {
+    constexpr int kWidth = 96;
+    constexpr int kHeight = 64;
+    constexpr int kNumShapes = 40;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(6));
+    auto circles = generator.RandomCircles(kNumShapes);
+    auto rectangles = generator.RandomRectangles(kNumShapes);
+    auto triangles = generator.RandomTriangles(kNumShapes);
+
+    // Make half of the shapes opaque so that they hide the ones under them.
+    for (int i = 0; i < kNumShapes; i += 2) {
+        circles.Params(i, 6) = 1;
+        rectangles.Params(i, 7) = 1;
+        triangles.Params(i, 9) = 1;
+    }
+    render::PackedShapeCollection shapes(circles, rectangles, triangles);
+
+    for (auto quality : {render::RenderQuality::Antialiased, render::RenderQuality::Aliased}) {
+        INFO(fmt::format("Aliased: {}", quality == render::RenderQuality::Aliased));
+
+        auto expected = render::Renderer::Create(kWidth, kHeight, Prng<>(7));
+        auto culled = render::Renderer::Create(kWidth, kHeight, Prng<>(7));
+        REQUIRE(expected.has_value());
+        REQUIRE(culled.has_value());
+
+        expected->SetQuality(quality);
+        culled->SetQuality(quality);
+        culled->SetOcclusionCulling(true);
+
+        expected->Render(shapes);
+        culled->Render(shapes);
+        CHECK(expected->Statistics().occluded == 0);
+        CHECK(culled->Statistics().occluded > 0);
+        CHECK(*CompareImagesAbsDiff(expected->DrawingSurface(), culled->DrawingSurface()) == 0);
+    }
+}
+
+TEST_CASE("Tiled renders match the full render.") {
+    constexpr int kWidth = 96;
+    constexpr int kHeight = 64;
+    constexpr int kNumShapes = 30;
+
+    // The tiles along the right and bottom edges are clipped.
+    constexpr int kTileSize = 40;
+
+    // Only the rounding of the shape edges along the tile boundaries differs.
+    constexpr double kTolerance = 0.01;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(8));
+    render::PackedShapeCollection shapes(generator.RandomCircles(kNumShapes),
+                                         generator.RandomRectangles(kNumShapes),
+                                         generator.RandomTriangles(kNumShapes));
+
+    auto renderer = render::Renderer::Create(kWidth, kHeight, Prng<>(9));
+    REQUIRE(renderer.has_value());
+    renderer->SetAlphaScale(0.8);
+
+    auto check_tiles = [&]() {
+        renderer->Render(shapes);
+
+        auto tiles = renderer->BinShapes(shapes, kTileSize);
+        REQUIRE(tiles.has_value());
+        REQUIRE(tiles->NumTiles() == 6);
+        CHECK(tiles->Statistics().submitted == renderer->Statistics().submitted);
+
+        double total_diff = 0;
+        for (int i = 0; i < tiles->NumTiles(); i++) {
+            const BLRectI rect = tiles->Tile(i);
+            auto tile = Image::New(rect.w, rect.h, true);
+            REQUIRE(tile.has_value());
+            REQUIRE_FALSE(renderer->RenderTile(*tiles, i, *tile).has_value());
+
+            auto diff =
+                CompareImageRegionAbsDiff(renderer->DrawingSurface(), *tile, rect.x, rect.y);
+            REQUIRE(diff.has_value());
+            total_diff += *diff * rect.w * rect.h;
+        }
+        CHECK(total_diff / (kWidth * kHeight) < kTolerance);
+
+        // The target has to match the tile.
+        auto wrong_size = Image::New(kTileSize + 1, kTileSize, true);
+        CHECK(renderer->RenderTile(*tiles, 0, *wrong_size).has_value());
+        CHECK(renderer->RenderTile(*tiles, tiles->NumTiles(), *wrong_size).has_value());
+    };
+
+    SUBCASE("Constant background") {
+        renderer->SetBackground(20, 40, 60);
+        check_tiles();
+    }
+
+    SUBCASE("Random background") {
+        renderer->UseRandomBackgroundFill(true);
+        check_tiles();
+    }
+
+    SUBCASE("Scanline rasterizer") {
+        renderer->SetBackend(render::RenderBackend::Scanline);
+        check_tiles();
+    }
+}
+
+TEST_CASE("Tile bins include the anti-aliased edges of the shapes.") {
+    constexpr int kWidth = 64;
+    constexpr int kHeight = 48;
+    constexpr int kNumShapes = 20;
+    constexpr int kTileSize = 8;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(10));
+    render::PackedShapeCollection shapes(generator.RandomCircles(kNumShapes),
+                                         generator.RandomRectangles(kNumShapes),
+                                         generator.RandomTriangles(kNumShapes));
+
+    auto tiles = render::TiledShapes::Create(shapes, kWidth, kHeight, 1.0,
+                                             render::CoordinateMapping::Clamped, kTileSize);
+    REQUIRE(tiles.has_value());
+
+    // The pixels just outside of a shape's bounding box may be partially
+    // covered, so every tile that holds one of them must draw the shape.
+    for (int i = 0; i < static_cast<int>(tiles->Shapes().size()); i++) {
+        const BLBox &bounds = tiles->Shapes()[i].bounds;
+        const double x0 = std::floor(bounds.x0) - 1;
+        const double y0 = std::floor(bounds.y0) - 1;
+        const double x1 = std::ceil(bounds.x1) + 1;
+        const double y1 = std::ceil(bounds.y1) + 1;
+
+        for (int t = 0; t < tiles->NumTiles(); t++) {
+            const BLRectI rect = tiles->Tile(t);
+            const bool touched = x0 < rect.x + rect.w && x1 > rect.x && y0 < rect.y + rect.h &&
+                                 y1 > rect.y;
+            const auto &bin = tiles->Bin(t);
+            INFO("shape ", i, ", tile ", t);
+            CHECK((std::find(bin.begin(), bin.end(), i) != bin.end()) == touched);
+        }
+    }
+}
+
+TEST_CASE("Compositing the coverage masks matches the render.") {
+    constexpr int kWidth = 64;
+    constexpr int kHeight = 48;
+    constexpr int kNumShapes = 20;
+
+    // Only the rounding of the 8-bit channels in the render differs.
+    constexpr double kTolerance = 0.01;
+
+    render::ShapeGenerator generator(kWidth, kHeight, Prng<>(10));
+    render::PackedShapeCollection shapes(generator.RandomCircles(kNumShapes),
+                                         generator.RandomRectangles(kNumShapes),
+                                         generator.RandomTriangles(kNumShapes));
+
+    auto renderer = render::Renderer::Create(kWidth, kHeight, Prng<>(11));
+    REQUIRE(renderer.has_value());
+    renderer->SetAlphaScale(0.8);
+
+    auto check_composite = [&]() {
+        auto masks = renderer->CacheCoverage(shapes);
+        REQUIRE(masks.has_value());
+        CHECK(masks->NumShapes() == 3 * kNumShapes);
+        CHECK(masks->NumMasks() <= masks->NumShapes());
+
+        // The masks don't depend on the colours they were created with.
+        UniformDistribution colours(Prng<>(12));
+        shapes.Circles().ColourValues() = RandomMatrix(kNumShapes, 4, colours);
+        shapes.Rectangles().ColourValues() = RandomMatrix(kNumShapes, 4, colours);
+        shapes.Triangles().ColourValues() = RandomMatrix(kNumShapes, 4, colours);
+
+        renderer->Render(shapes);
+        const render::ColourPlanes expected = render::ToColourPlanes(renderer->DrawingSurface());
+
+        render::ColourPlanes composite;
+        REQUIRE_FALSE(masks->Composite(shapes, composite).has_value());
+        REQUIRE(composite.rows() == kWidth * kHeight);
+
+        const double diff = (expected - composite).abs().sum() / (kWidth * kHeight);
+        CHECK(diff < kTolerance);
+
+        // Reusing the target only resets the pixels under the masks, which
+        // gives the same result as starting from the background.
+        shapes.Triangles().ColourValues() = RandomMatrix(kNumShapes, 4, colours);
+        render::ColourPlanes fresh;
+        REQUIRE_FALSE(masks->Composite(shapes, fresh).has_value());
+        REQUIRE_FALSE(masks->Composite(shapes, composite).has_value());
+        CHECK((fresh == composite).all());
+
+        // The shapes have to match the masks.
+        render::PackedShapeCollection fewer(render::AbstractionShape::Circles, kNumShapes);
+        CHECK(masks->Composite(fewer, composite).has_value());
+    };
+
+    SUBCASE("Constant background") {
+        renderer->SetBackground(20, 40, 60);
+        check_composite();
+    }
+
+    SUBCASE("Random background") {
+        renderer->UseRandomBackgroundFill(true);
+        check_composite();
+    }
+
+    SUBCASE("Scanline rasterizer") {
+        renderer->SetBackend(render::RenderBackend::Scanline);
+        check_composite();
+    }
+}
+
 TEST_SUITE_END();
@@ -1,7 +1,10 @@
 #include <abstractions/render/shapes.h>
 #include <doctest/doctest.h>
 
+#include <cmath>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "support.h"
 
@@ -255,4 +258,68 @@ TEST_CASE("Assert when shapes have different sizes in a packed shape collection.
                       errors::AbstractionsError);
 }
 
+TEST_CASE("Shape traits describe every shape in packing order.") {
+    std::vector<AbstractionShape> visited;
+    int total_dims = 0;
+    ForEachShapeType([&]<typename Traits>(Traits) {
+        visited.push_back(Traits::Shape);
+        total_dims += Traits::Collection::TotalDimensions;
+        CHECK(Traits::CoordinateDimensions <= Traits::Collection::ShapeDimensions);
+        CHECK(fmt::format("{}", Traits::Shape) == Traits::Label);
+    });
+
+    std::vector<AbstractionShape> expected{AbstractionShape::Circles, AbstractionShape::Rectangles,
+                                           AbstractionShape::Triangles};
+    CHECK(visited == expected);
+    CHECK(kNumShapeTypes == static_cast<int>(expected.size()));
+
+    std::vector<AbstractionShape> reversed;
+    ForEachShapeTypeReversed([&]<typename Traits>(Traits) { reversed.push_back(Traits::Shape); });
+    CHECK(reversed == std::vector<AbstractionShape>(expected.rbegin(), expected.rend()));
+
+    const auto all = AbstractionShape::Circles | AbstractionShape::Rectangles |
+                     AbstractionShape::Triangles;
+    PackedShapeCollection packed(all, 3);
+    CHECK(packed.TotalDimensions() == total_dims);
+    CHECK(&packed.Collection<AbstractionShape::Rectangles>() == &packed.Rectangles());
+
+    packed.ForEachCollection([&]<typename Traits>(Traits, auto &collection) {
+        CHECK(collection.NumShapes() == 3);
+        static_assert(std::is_same_v<std::remove_cvref_t<decltype(collection)>,
+                                     typename Traits::Collection>);
+    });
+}
+
+TEST_CASE("Every shape can be placed inside of a square.") {
+    ForEachShapeType([&]<typename Traits>(Traits) {
+        CAPTURE(Traits::Label);
+        const auto shape = Traits::InscribedInSquare(0.5, 0.25, 0.1);
+        static_assert(std::tuple_size_v<decltype(shape)> == Traits::Collection::ShapeDimensions);
+
+        // Coordinates alternate between 'x' and 'y'.
+        for (int i = 0; i < Traits::CoordinateDimensions; i++) {
+            const double centre = i % 2 == 0 ? 0.5 : 0.25;
+            CHECK(std::abs(shape[i] - centre) <= 0.1 + 1e-12);
+        }
+    });
+}
+
+TEST_CASE("Each shape parameter is stored contiguously.") {
+    TriangleCollection triangles(4);
+    InitShapeCollection(triangles, 0);
+    static_assert(decltype(triangles.Params)::ColsAtCompileTime ==
+                  TriangleCollection::TotalDimensions);
+
+    // Every parameter, e.g., the first 'x' coordinate, is its own array.
+    const double *x0 = triangles.Params.col(0).data();
+    for (int i = 0; i < triangles.NumShapes(); i++) {
+        CHECK(x0[i] == triangles.Params(i, 0));
+    }
+
+    // The storage layout doesn't change how the shapes are packed.
+    PackedShapeCollection packed(CircleCollection(), RectangleCollection(), triangles);
+    PackedShapeCollection unpacked(AbstractionShape::Triangles, packed.AsPackedVector());
+    CHECK(unpacked.Triangles().Params == triangles.Params);
+}
+
 TEST_SUITE_END();